@@ -27,6 +27,7 @@ testScripts=(
     'mempool_spendcoinbase.py'
     'mempool_coinbase_spends.py'
     'httpbasics.py'
+    'rpcbatch.py'
     'zapwallettxes.py'
     'proxy_test.py'
     'merkle_blocks.py'
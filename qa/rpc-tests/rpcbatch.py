@@ -0,0 +1,81 @@
+#!/usr/bin/env python2
+
+#
+# Test JSON-RPC batches: concurrent calls run on several threads but the
+# replies keep the order of the requests, and a call that is not concurrent
+# sees the effects of the calls before it
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+import base64
+import json
+
+try:
+    import http.client as httplib
+except ImportError:
+    import httplib
+try:
+    import urllib.parse as urlparse
+except ImportError:
+    import urlparse
+
+class RPCBatchTest (BitcoinTestFramework):
+    def setup_nodes(self):
+        return start_nodes(4, self.options.tmpdir, [["-rpcbatchthreads=4"]] * 4)
+
+    def batch(self, node, requests):
+        url = urlparse.urlparse(node.url)
+        authpair = url.username + ':' + url.password
+        headers = {"Authorization": "Basic " + base64.b64encode(authpair)}
+
+        conn = httplib.HTTPConnection(url.hostname, url.port)
+        conn.connect()
+        conn.request('POST', '/', json.dumps(requests), headers)
+        replies = json.loads(conn.getresponse().read())
+        conn.close()
+        assert_equal(len(replies), len(requests))
+        return replies
+
+    def run_test(self):
+        node = self.nodes[0]
+        height = node.getblockcount()
+
+        # a run of concurrent calls comes back in the order of the requests
+        requests = [{"method": "getblockhash", "params": [h], "id": h} for h in range(height + 1)]
+        replies = self.batch(node, requests)
+        for h in range(height + 1):
+            assert_equal(replies[h]['id'], h)
+            assert_equal(replies[h]['error'], None)
+            assert_equal(replies[h]['result'], node.getblockhash(h))
+
+        # an error stays in its place within the run
+        requests = [{"method": "getblockhash", "params": [0], "id": 0},
+                    {"method": "getblockhash", "params": [height + 100], "id": 1},
+                    {"method": "nosuchmethod", "id": 2},
+                    {"method": "getblockhash", "params": [height], "id": 3}]
+        replies = self.batch(node, requests)
+        assert_equal([r['id'] for r in replies], [0, 1, 2, 3])
+        assert_equal(replies[0]['result'], node.getblockhash(0))
+        assert(replies[1]['error'] is not None)
+        assert_equal(replies[2]['error']['code'], -32601)
+        assert_equal(replies[3]['result'], node.getbestblockhash())
+
+        # generate is not concurrent: it waits for the run before it and the run after it sees its block
+        requests = [{"method": "getblockcount", "id": 0},
+                    {"method": "getbestblockhash", "id": 1},
+                    {"method": "generate", "params": [1], "id": 2},
+                    {"method": "getblockcount", "id": 3},
+                    {"method": "getbestblockhash", "id": 4},
+                    {"method": "getblockhash", "params": [height + 1], "id": 5}]
+        replies = self.batch(node, requests)
+        for r in replies:
+            assert_equal(r['error'], None)
+        assert_equal(replies[0]['result'], height)
+        assert_equal(replies[1]['result'], node.getblockhash(height))
+        assert_equal(replies[3]['result'], height + 1)
+        assert_equal(replies[4]['result'], replies[2]['result'][0])
+        assert_equal(replies[5]['result'], replies[2]['result'][0])
+
+if __name__ == '__main__':
+    RPCBatchTest ().main ()
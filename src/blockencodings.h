@@ -7,24 +7,16 @@
 
 #include "primitives/block.h"
 
-#include <memory>
+#include <limits>
 
 class CTxMemPool;
 
-// Dumb helper to handle CTransaction compression at serialize-time
-struct TransactionCompressor {
-private:
-    CTransactionRef& tx;
-public:
-    explicit TransactionCompressor(CTransactionRef& txIn) : tx(txIn) {}
-
-    ADD_SERIALIZE_METHODS;
-
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
-        READWRITE(tx); //TODO: Compress tx encoding
-    }
-};
+/** Version of the compact block encoding negotiated with "sendcmpct" */
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
+/** Blocks deeper than this below the tip are sent in full instead of as compact blocks */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** "getblocktxn" is only answered for blocks up to this deep below the tip */
+static const int MAX_BLOCKTXN_DEPTH = 10;
 
 class BlockTransactionsRequest {
 public:
@@ -35,7 +27,7 @@ public:
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+    inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(blockhash);
         uint64_t indexes_size = (uint64_t)indexes.size();
         READWRITE(COMPACTSIZE(indexes_size));
@@ -72,7 +64,7 @@ class BlockTransactions {
 public:
     // A BlockTransactions message
     uint256 blockhash;
-    std::vector<CTransactionRef> txn;
+    std::vector<CTransaction> txn;
 
     BlockTransactions() {}
     explicit BlockTransactions(const BlockTransactionsRequest& req) :
@@ -81,7 +73,7 @@ public:
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+    inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(blockhash);
         uint64_t txn_size = (uint64_t)txn.size();
         READWRITE(COMPACTSIZE(txn_size));
@@ -90,11 +82,11 @@ public:
             while (txn.size() < txn_size) {
                 txn.resize(std::min((uint64_t)(1000 + txn.size()), txn_size));
                 for (; i < txn.size(); i++)
-                    READWRITE(REF(TransactionCompressor(txn[i])));
+                    READWRITE(txn[i]);
             }
         } else {
             for (size_t i = 0; i < txn.size(); i++)
-                READWRITE(REF(TransactionCompressor(txn[i])));
+                READWRITE(txn[i]);
         }
     }
 };
@@ -104,18 +96,18 @@ struct PrefilledTransaction {
     // Used as an offset since last prefilled tx in CBlockHeaderAndShortTxIDs,
     // as a proper transaction-in-block-index in PartiallyDownloadedBlock
     uint16_t index;
-    CTransactionRef tx;
+    CTransaction tx;
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+    inline void SerializationOp(Stream& s, Operation ser_action) {
         uint64_t idx = index;
         READWRITE(COMPACTSIZE(idx));
         if (idx > std::numeric_limits<uint16_t>::max())
             throw std::ios_base::failure("index overflowed 16-bits");
         index = idx;
-        READWRITE(REF(TransactionCompressor(tx)));
+        READWRITE(tx);
     }
 };
 
@@ -124,8 +116,6 @@ typedef enum ReadStatus_t
     READ_STATUS_OK,
     READ_STATUS_INVALID, // Invalid object, peer is sending bogus crap
     READ_STATUS_FAILED, // Failed to process object
-    READ_STATUS_CHECKBLOCK_FAILED, // Used only by FillBlock to indicate a
-                                   // failure in CheckBlock.
 } ReadStatus;
 
 class CBlockHeaderAndShortTxIDs {
@@ -148,7 +138,11 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    /**
+     * The coinbase is always sent in full, and so is the last transaction when fPrefillLast is set:
+     * the staking transaction of a PoS block is made by the staker and is in nobody's mempool.
+     */
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fPrefillLast);
 
     uint64_t GetShortID(const uint256& txhash) const;
 
@@ -157,7 +151,7 @@ public:
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+    inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(header);
         READWRITE(nonce);
 
@@ -193,17 +187,20 @@ public:
 
 class PartiallyDownloadedBlock {
 protected:
-    std::vector<CTransactionRef> txn_available;
-    size_t prefilled_count = 0, mempool_count = 0, extra_count = 0;
+    std::vector<CTransaction> txn_available;
+    std::vector<bool> have_txn;
     CTxMemPool* pool;
 public:
+    size_t prefilled_count = 0, mempool_count = 0;
     CBlockHeader header;
     explicit PartiallyDownloadedBlock(CTxMemPool* poolIn) : pool(poolIn) {}
 
-    // extra_txn is a list of extra transactions to look at, in <witness hash, reference> form
-    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn);
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock);
     bool IsTxAvailable(size_t index) const;
-    ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
+    /** The indexes of the transactions to ask the peer for with "getblocktxn" */
+    std::vector<uint16_t> GetMissing() const;
+    /** READ_STATUS_FAILED means the merkle root does not match, most likely a short id collision */
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing);
 };
 
 #endif
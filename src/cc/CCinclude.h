@@ -265,6 +265,16 @@ static int32_t ignorevin;
  */
 bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock);
 
+/*****
+ * @brief get several transactions by their hashes (without locks)
+ * @note disk reads are sorted by position, use it to resolve all the vins of a tx at once
+ * @param[in] hashes what to look for
+ * @param[out] txOut the found transactions, in the order of hashes
+ * @param[out] hashBlocks the hashes of the blocks (all zeros if still in mempool)
+ * @returns for each hash, true if found
+ */
+std::vector<bool> myGetTransactions(const std::vector<uint256> &hashes, std::vector<CTransaction> &txOut, std::vector<uint256> &hashBlocks);
+
 /// NSPV_myGetTransaction is called in NSPV mode
 /// @param hash hash of transaction to get (txid)
 /// @param[out] txOut returned transaction object
@@ -830,6 +840,18 @@ UniValue FinalizeCCTxExt(bool remote, uint64_t skipmask, struct CCcontract_info
 /// @param CCflag if true the function searches for cc outputs, otherwise for normal outputs
 void SetCCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,bool CCflag = true);
 
+/// overloaded SetCCunspents returns the unspent cc outputs on an address whose opreturn has the evalcode, funcid and reference txid.
+/// Uses the CC index when it is enabled, otherwise returns all unspent outputs like SetCCunspents above and the caller must filter them.
+/// Only the oracles CC calls it so far, the other modules scan every unspent output of their address
+/// Token-wrapped opreturns are indexed under EVAL_TOKENS, not the evalcode of the module inside
+/// @param[out] unspentOutputs vector of pairs of address key and amount
+/// @param coinaddr address where unspent outputs are searched
+/// @param CCflag if true the function searches for cc outputs, otherwise for normal outputs (which are not filtered)
+/// @param evalcode evalcode in the opreturn
+/// @param funcid funcid in the opreturn, 0 for any
+/// @param reftxid txid after the funcid in the opreturn, zeroid for any
+void SetCCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,bool CCflag, uint8_t evalcode, uint8_t funcid, uint256 reftxid);
+
 /// SetCCtxids returns a vector of all outputs on an address
 /// @param[out] addressIndex vector of pairs of address index key and amount
 /// @param coinaddr address where the unspent outputs are searched
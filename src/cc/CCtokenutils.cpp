@@ -18,6 +18,7 @@
 // This code was moved to a separate source file to enable linking libcommon.so (with importcoin.cpp which depends on some token functions)
 
 #include "CCtokens.h"
+#include "opretschema.h"
 
 #ifndef IS_CHARINSTR
 #define IS_CHARINSTR(c, str) (std::string(str).find((char)(c)) != std::string::npos)
@@ -151,25 +152,25 @@ uint8_t DecodeTokenCreateOpRet(const CScript &scriptPubKey, std::vector<uint8_t>
 
 uint8_t DecodeTokenCreateOpRet(const CScript &scriptPubKey, std::vector<uint8_t> &origpubkey, std::string &name, std::string &description, std::vector<std::pair<uint8_t, vscript_t>> &oprets)
 {
-    vscript_t vopret, vblob;
+    CCOpRetStream ss;
+    vscript_t vblob;
     uint8_t dummyEvalcode, funcid, opretId = 0;
 
-    GetOpReturnData(scriptPubKey, vopret);
     oprets.clear();
 
-    if (vopret.size() > 2 && vopret.begin()[0] == EVAL_TOKENS && vopret.begin()[1] == 'c')
+    if (ss.Open(scriptPubKey) && ss.size() > 2 && ss.data()[0] == EVAL_TOKENS && ss.data()[1] == 'c')
     {
-        if (E_UNMARSHAL(vopret, ss >> dummyEvalcode; ss >> funcid; ss >> origpubkey; ss >> name; ss >> description;
-        while (!ss.eof()) {
-            ss >> opretId;
-            if (!ss.eof()) {
-                ss >> vblob;
-                oprets.push_back(std::make_pair(opretId, vblob));
+        try {
+            ss >> dummyEvalcode; ss >> funcid; ss >> origpubkey; ss >> name; ss >> description;
+            while (!ss.eof()) {
+                ss >> opretId;
+                if (!ss.eof()) {
+                    ss >> vblob;
+                    oprets.push_back(std::make_pair(opretId, vblob));
+                }
             }
-        }))
-        {
             return(funcid);
-        }
+        } catch (...) {}
     }
     LOGSTREAM((char *)"cctokens", CCLOG_INFO, stream << "DecodeTokenCreateOpRet() incorrect token create opret" << std::endl);
     return (uint8_t)0;
@@ -180,29 +181,28 @@ uint8_t DecodeTokenCreateOpRet(const CScript &scriptPubKey, std::vector<uint8_t>
 // for 'c' returns only funcid. NOTE: nonfungible data is not returned
 uint8_t DecodeTokenOpRet(const CScript scriptPubKey, uint8_t &evalCodeTokens, uint256 &tokenid, std::vector<CPubKey> &voutPubkeys, std::vector<std::pair<uint8_t, vscript_t>>  &oprets)
 {
-    vscript_t vopret, vblob, dummyPubkey, vnonfungibleDummy;
-    uint8_t funcId = 0, *script, dummyEvalCode, dummyFuncId, ccType, opretId = 0;
+    CCOpRetStream ss, ssOldstyle;
+    CCOpRetBlob oldstyledata;
+    vscript_t vblob, dummyPubkey;
+    uint8_t funcId = 0, dummyEvalCode, dummyFuncId, ccType, opretId = 0;
     std::string dummyName; std::string dummyDescription;
-    uint256 dummySrcTokenId;
     CPubKey voutPubkey1, voutPubkey2;
 
     vscript_t voldstyledata;
-    bool foundOldstyle = false;
+    bool foundOldstyle = false, decoded = false;
 
-    GetOpReturnData(scriptPubKey, vopret);
-    script = (uint8_t *)vopret.data();
     tokenid = zeroid;
     oprets.clear();
 
-    if (script != NULL && vopret.size() > 2)
+    if (ss.Open(scriptPubKey) && ss.size() > 2)
     {
-        evalCodeTokens = script[0];
+        evalCodeTokens = ss.data()[0];
         if (evalCodeTokens != EVAL_TOKENS) {
             LOGSTREAM((char *)"cctokens", CCLOG_INFO, stream << "DecodeTokenOpRet() incorrect evalcode in tokens opret" << std::endl);
             return (uint8_t)0;
         }
 
-        funcId = script[1];
+        funcId = ss.data()[1];
         LOGSTREAM((char *)"cctokens", CCLOG_DEBUG2, stream << "DecodeTokenOpRet() decoded funcId=" << (char)(funcId ? funcId : ' ') << std::endl);
 
         switch (funcId)
@@ -211,29 +211,37 @@ uint8_t DecodeTokenOpRet(const CScript scriptPubKey, uint8_t &evalCodeTokens, ui
             return DecodeTokenCreateOpRet(scriptPubKey, dummyPubkey, dummyName, dummyDescription, oprets);
 
         case 't':
-           
-            // compatibility with old-style rogue or assets data (with no opretid):
-            // try to unmarshal old-style rogue or assets data:
-            foundOldstyle = E_UNMARSHAL(vopret, ss >> dummyEvalCode; ss >> dummyFuncId; ss >> tokenid; ss >> ccType;
-                                        if (ccType >= 1) ss >> voutPubkey1;
-                                        if (ccType == 2) ss >> voutPubkey2;
-                                        if (!ss.eof()) {
-                                            ss >> voldstyledata;
-                                        }) && voldstyledata.size() >= 2 && 
-                                            (voldstyledata.begin()[0] == 0x11 /*EVAL_ROGUE*/ && IS_CHARINSTR(voldstyledata.begin()[1], "RHQKG")  ||
-                                             voldstyledata.begin()[0] == EVAL_ASSETS && IS_CHARINSTR(voldstyledata.begin()[1], "sbSBxo")) ;
-                
-            if (foundOldstyle ||  // fix for compatibility with old style data (no opretid)
-                E_UNMARSHAL(vopret, ss >> dummyEvalCode; ss >> dummyFuncId; ss >> tokenid; ss >> ccType;
-                    if (ccType >= 1) ss >> voutPubkey1;
-                    if (ccType == 2) ss >> voutPubkey2;
+            try {
+                ss >> dummyEvalCode; ss >> dummyFuncId; ss >> tokenid; ss >> ccType;
+                if (ccType >= 1) ss >> voutPubkey1;
+                if (ccType == 2) ss >> voutPubkey2;
+
+                // compatibility with old-style rogue or assets data (with no opretid):
+                // try to unmarshal the rest as a single old-style rogue or assets blob first:
+                ssOldstyle = ss;
+                try {
+                    if (!ssOldstyle.eof())
+                        ssOldstyle >> oldstyledata;
+                    foundOldstyle = ssOldstyle.eof() && oldstyledata.size >= 2 &&
+                                    (oldstyledata.data[0] == 0x11 /*EVAL_ROGUE*/ && IS_CHARINSTR(oldstyledata.data[1], "RHQKG")  ||
+                                     oldstyledata.data[0] == EVAL_ASSETS && IS_CHARINSTR(oldstyledata.data[1], "sbSBxo"));
+                } catch (...) {}
+
+                if (foundOldstyle)  // fix for compatibility with old style data (no opretid)
+                    voldstyledata = oldstyledata.ToVector();
+                else {
                     while (!ss.eof()) {
                         ss >> opretId;
                         if (!ss.eof()) {
                             ss >> vblob;
                             oprets.push_back(std::make_pair(opretId, vblob));
                         }
-                    }))
+                    }
+                }
+                decoded = true;
+            } catch (...) {}
+
+            if (decoded)
             {
                 if (!(ccType >= 0 && ccType <= 2)) { //incorrect ccType
                     LOGSTREAM((char *)"cctokens", CCLOG_INFO, stream << "DecodeTokenOpRet() incorrect ccType=" << (int)ccType << " tokenid=" << revuint256(tokenid).GetHex() << std::endl);
@@ -113,13 +113,35 @@ UniValue FinalizeCCTxExt(bool remote, uint64_t CCmask, struct CCcontract_info *c
 	GetTokensCCaddress(cp, unspendabletokensaddr, unspendablepk);  // it may be a three-eval cc, if cp->additionalEvalcode2 is set
 	othertokenscond = MakeTokensCCcond1(cp->evalcode, cp->additionalTokensEvalcode2, unspendablepk);
 
+    // resolve the vin txs with one batched lookup, the loops below need each of them several times
+    std::map<uint256, std::pair<CTransaction,uint256> > vintxs;
+    {
+        std::vector<uint256> txids,blockhashes; std::vector<CTransaction> txs;
+        for (i=0; i<n; i++)
+            if ( i != 0 || mtx.vin[i].prevout.n != 10e8 )
+                txids.push_back(mtx.vin[i].prevout.hash);
+        std::vector<bool> found = myGetTransactions(txids,txs,blockhashes);
+        for (size_t j=0; j<txids.size(); j++)
+            if ( found[j] )
+                vintxs[txids[j]] = std::make_pair(txs[j],blockhashes[j]);
+    }
+    auto getvintx = [&vintxs](const uint256 &txid,CTransaction &tx,uint256 &blockhash) -> bool
+    {
+        auto it = vintxs.find(txid);
+        if ( it == vintxs.end() )
+            return false;
+        tx = it->second.first;
+        blockhash = it->second.second;
+        return true;
+    };
+
     //Reorder vins so that for multiple normal vins all other except vin0 goes to the end
     //This is a must to avoid hardfork change of validation in every CC, because there could be maximum one normal vin at the begining with current validation.
     for (i=0; i<n; i++)
     {
         if (i==0 && mtx.vin[i].prevout.n==10e8)
             continue;
-        if ( myGetTransaction(mtx.vin[i].prevout.hash,vintx,hashBlock) != 0 && mtx.vin[i].prevout.n < vintx.vout.size() )
+        if ( getvintx(mtx.vin[i].prevout.hash,vintx,hashBlock) != 0 && mtx.vin[i].prevout.n < vintx.vout.size() )
         {
             if ( vintx.vout[mtx.vin[i].prevout.n].scriptPubKey.IsPayToCryptoCondition() == 0 && ccvins==0)
                 normalvins++;            
@@ -144,7 +166,7 @@ UniValue FinalizeCCTxExt(bool remote, uint64_t CCmask, struct CCcontract_info *c
     for (i=0; i<n; i++)
     {
         if (i==0 && mtx.vin[i].prevout.n==10e8) continue;
-        if ( (mgret= myGetTransaction(mtx.vin[i].prevout.hash,vintx,hashBlock)) != 0 )
+        if ( (mgret= getvintx(mtx.vin[i].prevout.hash,vintx,hashBlock)) != 0 )
         {
             utxovout = mtx.vin[i].prevout.n;
             utxovalues[i] = vintx.vout[utxovout].nValue;
@@ -177,7 +199,7 @@ UniValue FinalizeCCTxExt(bool remote, uint64_t CCmask, struct CCcontract_info *c
     {
         if (i==0 && mtx.vin[i].prevout.n==10e8)
             continue;
-        if ( (mgret= myGetTransaction(mtx.vin[i].prevout.hash,vintx,hashBlock)) != 0 )
+        if ( (mgret= getvintx(mtx.vin[i].prevout.hash,vintx,hashBlock)) != 0 )
         {
             utxovout = mtx.vin[i].prevout.n;
             if ( vintx.vout[utxovout].scriptPubKey.IsPayToCryptoCondition() == 0 )
@@ -419,6 +441,30 @@ void SetCCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValu
     }
 }
 
+void SetCCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,bool ccflag, uint8_t evalcode, uint8_t funcid, uint256 reftxid)
+{
+    int32_t type=0,i,n; char *ptr; std::string addrstr; uint160 hashBytes;
+    std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > outputs;
+    if ( KOMODO_NSPV_SUPERLITE || !fCCIndex || !ccflag )
+    {
+        // without the CC index the caller filters the opreturns itself
+        SetCCunspents(unspentOutputs,coinaddr,ccflag);
+        return;
+    }
+    n = (int32_t)strlen(coinaddr);
+    addrstr.resize(n+1);
+    ptr = (char *)addrstr.data();
+    for (i=0; i<=n; i++)
+        ptr[i] = coinaddr[i];
+    CBitcoinAddress address(addrstr);
+    if ( address.GetIndexKey(hashBytes, type, ccflag) == 0 )
+        return;
+    if ( GetCCIndex(hashBytes, type, evalcode, funcid, reftxid, outputs) == 0 )
+        return;
+    for (std::vector<std::pair<CCIndexKey, CAddressUnspentValue> >::const_iterator it=outputs.begin(); it!=outputs.end(); it++)
+        unspentOutputs.push_back(std::make_pair(CAddressUnspentKey(it->first.type, it->first.hashBytes, it->first.txhash, it->first.index), it->second));
+}
+
 void SetCCtxids(std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,char *coinaddr,bool ccflag)
 {
     int32_t type=0,i,n; char *ptr; std::string addrstr; uint160 hashBytes; std::vector<std::pair<uint160, int> > addresses;
@@ -0,0 +1,186 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef CC_OPRETSCHEMA_H
+#define CC_OPRETSCHEMA_H
+
+#include "script/script.h"
+#include "serialize.h"
+#include "version.h"
+
+#include <algorithm>
+#include <ios>
+#include <string.h>
+
+
+/*
+ * Opreturn decoding in place
+ *
+ * E_UNMARSHAL copies the opreturn out of the script into a vector and then once more
+ * into a CDataStream before the first field is read. CCOpRetStream reads the same
+ * serialization straight from the script's OP_RETURN push, so only the decoded fields
+ * themselves allocate.
+ */
+
+class CCOpRetStream
+{
+    const uint8_t *pcur, *pend;
+
+public:
+    CCOpRetStream() : pcur(NULL), pend(NULL) {}
+
+    /* points the stream at the OP_RETURN push of script, same rules as GetOpReturnData */
+    bool Open(const CScript &script)
+    {
+        CScript::const_iterator pc = script.begin();
+        opcodetype opcode;
+        pcur = pend = NULL;
+        if (!script.GetOp(pc, opcode) || opcode != OP_RETURN)
+            return false;
+        CScript::const_iterator pdata = pc;
+        if (!script.GetOp(pc, opcode) || opcode <= OP_0 || opcode > OP_PUSHDATA4)
+            return false;
+        pdata += opcode < OP_PUSHDATA1 ? 1 : opcode == OP_PUSHDATA1 ? 2 : opcode == OP_PUSHDATA2 ? 3 : 5;
+        pcur = &script[0] + (pdata - script.begin());
+        pend = &script[0] + (pc - script.begin());
+        return true;
+    }
+
+    const uint8_t *data() const { return pcur; }
+    size_t size() const { return pend - pcur; }
+    bool eof() const { return pcur == pend; }
+
+    int GetType() const { return SER_NETWORK; }
+    int GetVersion() const { return PROTOCOL_VERSION; }
+
+    /* returns the next nSize bytes in place and steps over them */
+    const uint8_t *Consume(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CCOpRetStream::read(): end of data");
+        const uint8_t *p = pcur;
+        pcur += nSize;
+        return p;
+    }
+
+    void read(char *pch, size_t nSize)
+    {
+        if (nSize != 0)
+            memcpy(pch, Consume(nSize), nSize);
+    }
+
+    void ignore(size_t nSize) { Consume(nSize); }
+
+    template<typename T>
+    CCOpRetStream& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+};
+
+/*
+ * A length prefixed byte string left inside the script, for fields that are only inspected
+ */
+struct CCOpRetBlob
+{
+    const uint8_t *data;
+    size_t size;
+
+    CCOpRetBlob() : data(NULL), size(0) {}
+
+    void Unserialize(CCOpRetStream &s)
+    {
+        size = ReadCompactSize(s);
+        data = s.Consume(size);
+    }
+
+    std::vector<uint8_t> ToVector() const { return std::vector<uint8_t>(data, data + size); }
+};
+
+/*
+ * The evalcode byte is checked and the funcid byte returned, without touching the fields.
+ * Like the hand written decoders, a push of two bytes or less is not an opreturn of a module.
+ */
+inline uint8_t CCOpRetFuncId(const CScript &script, uint8_t evalcode)
+{
+    CCOpRetStream s;
+    if (s.Open(script) && s.size() > 2 && s.data()[0] == evalcode)
+        return s.data()[1];
+    return 0;
+}
+
+template <uint8_t... FUNCIDS>
+struct CCFuncIds
+{
+    static bool Contains(uint8_t funcid)
+    {
+        static const uint8_t funcids[] = { FUNCIDS... };
+        return std::find(funcids, funcids + sizeof(funcids), funcid) != funcids + sizeof(funcids);
+    }
+};
+
+inline void CCReadFields(CCOpRetStream &s) {}
+
+template <typename T, typename... Rest>
+void CCReadFields(CCOpRetStream &s, T &field, Rest&... rest)
+{
+    s >> field;
+    CCReadFields(s, rest...);
+}
+
+/*
+ * Opreturn layout of a module: evalcode, one of FuncIds, then Fields in order, with nothing
+ * after them. Modules typedef one per layout, eg
+ *
+ *   typedef CCOpRetSchema<EVAL_ORACLES, CCFuncIds<'D'>, uint256, uint256, CPubKey, std::vector<uint8_t>> OraclesDataSchema;
+ *
+ * and decode with OraclesDataSchema::Decode(scriptPubKey, oracletxid, batontxid, pk, data).
+ */
+template <uint8_t EVALCODE, typename FuncIds, typename... Fields>
+struct CCOpRetSchema
+{
+    /* opens s on the script and returns the funcid if it has this layout's evalcode and one of its funcids */
+    static uint8_t Open(CCOpRetStream &s, const CScript &script)
+    {
+        if (s.Open(script) && s.size() > 2 && s.data()[0] == EVALCODE && FuncIds::Contains(s.data()[1]))
+            return s.data()[1];
+        return 0;
+    }
+
+    static uint8_t Match(const CScript &script)
+    {
+        CCOpRetStream s;
+        return Open(s, script);
+    }
+
+    /* returns the funcid, or 0 if the script does not match or the fields do not decode exactly */
+    static uint8_t Decode(const CScript &script, Fields&... fields)
+    {
+        CCOpRetStream s;
+        uint8_t funcid;
+        if ((funcid = Open(s, script)) == 0)
+            return 0;
+        try {
+            s.ignore(2);
+            CCReadFields(s, fields...);
+            if (s.eof())
+                return funcid;
+        } catch (...) {}
+        return 0;
+    }
+};
+
+#endif /* CC_OPRETSCHEMA_H */
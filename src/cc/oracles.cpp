@@ -14,6 +14,7 @@
  ******************************************************************************/
 
 #include "CCOracles.h"
+#include "opretschema.h"
 #include "komodo.h"
 #include "komodo_bitcoind.h"
 
@@ -109,20 +110,17 @@ CScript EncodeOraclesCreateOpRet(uint8_t funcid,std::string name,std::string des
     return(opret);
 }
 
+typedef CCOpRetSchema<EVAL_ORACLES, CCFuncIds<'C'>, std::string, std::string, std::string> OraclesCreateSchema;
+typedef CCOpRetSchema<EVAL_ORACLES, CCFuncIds<'R', 'S', 'F'>, uint256, CPubKey, int64_t> OraclesOpRetSchema;
+typedef CCOpRetSchema<EVAL_ORACLES, CCFuncIds<'D'>, uint256, uint256, CPubKey, std::vector<uint8_t>> OraclesDataSchema;
+
 uint8_t DecodeOraclesCreateOpRet(const CScript &scriptPubKey,std::string &name,std::string &description,std::string &format)
 {
-    std::vector<uint8_t> vopret; uint8_t *script,e,f,funcid;
-    GetOpReturnData(scriptPubKey,vopret);
-    script = (uint8_t *)vopret.data();
-    if ( vopret.size() > 2 && script[0] == EVAL_ORACLES )
+    if ( OraclesCreateSchema::Match(scriptPubKey) != 0 )
     {
-        if ( script[1] == 'C' )
-        {
-            if ( E_UNMARSHAL(vopret,ss >> e; ss >> f; ss >> name; ss >> format; ss >> description) != 0 )
-            {
-                return(script[1]);
-            } else LogPrintf("DecodeOraclesCreateOpRet unmarshal error for C\n");
-        }
+        if ( OraclesCreateSchema::Decode(scriptPubKey,name,format,description) != 0 )
+            return('C');
+        else LogPrintf("DecodeOraclesCreateOpRet unmarshal error for C\n");
     }
     return(0);
 }
@@ -136,16 +134,10 @@ CScript EncodeOraclesOpRet(uint8_t funcid,uint256 oracletxid,CPubKey pk,int64_t
 
 uint8_t DecodeOraclesOpRet(const CScript &scriptPubKey,uint256 &oracletxid,CPubKey &pk,int64_t &num)
 {
-    std::vector<uint8_t> vopret; uint8_t *script,e,f;
-    GetOpReturnData(scriptPubKey,vopret);
-    script = (uint8_t *)vopret.data();
-    if ( vopret.size() > 2 && script[0] == EVAL_ORACLES )
-    {
-        if (script[0] == EVAL_ORACLES && (script[1]== 'R' || script[1] == 'S' || script[1] == 'F') && E_UNMARSHAL(vopret,ss >> e; ss >> f; ss >> oracletxid; ss >> pk; ss >> num)!=0)
-            return(f);
-        else return(script[1]);
-    }
-    return(0);
+    uint8_t f;
+    if ( (f= OraclesOpRetSchema::Decode(scriptPubKey,oracletxid,pk,num)) != 0 )
+        return(f);
+    return(CCOpRetFuncId(scriptPubKey,EVAL_ORACLES));
 }
 
 CScript EncodeOraclesData(uint8_t funcid,uint256 oracletxid,uint256 batontxid,CPubKey pk,std::vector <uint8_t>data)
@@ -157,16 +149,7 @@ CScript EncodeOraclesData(uint8_t funcid,uint256 oracletxid,uint256 batontxid,CP
 
 uint8_t DecodeOraclesData(const CScript &scriptPubKey,uint256 &oracletxid,uint256 &batontxid,CPubKey &pk,std::vector <uint8_t>&data)
 {
-    std::vector<uint8_t> vopret; uint8_t *script,e,f;
-    GetOpReturnData(scriptPubKey,vopret);
-    script = (uint8_t *)vopret.data();
-    if ( vopret.size() > 2 && E_UNMARSHAL(vopret,ss >> e; ss >> f; ss >> oracletxid; ss >> batontxid; ss >> pk; ss >> data) != 0 )
-    {
-        if ( e == EVAL_ORACLES && f == 'D' )
-            return(f);
-        //else LogPrintf("DecodeOraclesData evalcode.%d f.%c\n",e,f);
-    } //else LogPrintf("DecodeOraclesData not enough opereturn data\n");
-    return(0);
+    return(OraclesDataSchema::Decode(scriptPubKey,oracletxid,batontxid,pk,data));
 }
 
 CPubKey OracleBatonPk(char *batonaddr,struct CCcontract_info *cp)
@@ -269,7 +252,7 @@ uint256 OracleBatonUtxo(uint64_t txfee,struct CCcontract_info *cp,uint256 refora
 {
     uint256 txid,oracletxid,hashBlock,btxid,batontxid = zeroid; int64_t dfee; int32_t dheight=0,vout,height,numvouts; CTransaction tx; CPubKey pk; uint8_t *ptr; std::vector<uint8_t> vopret,data;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    SetCCunspents(unspentOutputs,batonaddr,true);
+    SetCCunspents(unspentOutputs,batonaddr,true,EVAL_ORACLES,0,reforacletxid);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
         txid = it->first.txhash;
@@ -759,7 +742,7 @@ int64_t AddOracleInputs(struct CCcontract_info *cp,CMutableTransaction &mtx,uint
     char coinaddr[64],funcid; int64_t nValue,price,totalinputs = 0; uint256 tmporacletxid,tmpbatontxid,txid,hashBlock; std::vector<uint8_t> origpubkey,data; CTransaction vintx; int32_t numvouts,vout,n = 0;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; CPubKey tmppk; int64_t tmpnum;
     GetCCaddress(cp,coinaddr,pk);
-    SetCCunspents(unspentOutputs,coinaddr,true);
+    SetCCunspents(unspentOutputs,coinaddr,true,cp->evalcode,0,oracletxid);
     //LogPrintf("addoracleinputs from (%s)\n",coinaddr);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
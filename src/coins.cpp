@@ -31,6 +31,8 @@
 
 #include <assert.h>
 
+#include <boost/thread.hpp>
+
 /**
  * calculate number of bytes for the bitmask, and its number of non-zero bytes
  * each bit in the bitmask represents the availability of one output, but the
@@ -102,7 +104,7 @@ bool CCoinsViewBacked::GetStats(CCoinsStats &stats) const { return base->GetStat
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0), nFlushes(0) { }
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -547,6 +549,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
 }
 
 bool CCoinsViewCache::Flush() {
+    nFlushes++;
     bool fOk = base->BatchWrite(cacheCoins, hashBlock, hashSproutAnchor, hashSaplingAnchor, cacheSproutAnchors, cacheSaplingAnchors, cacheSproutNullifiers, cacheSaplingNullifiers);
     cacheCoins.clear();
     cacheSproutAnchors.clear();
@@ -557,6 +560,73 @@ bool CCoinsViewCache::Flush() {
     return fOk;
 }
 
+//! below this many reads a thread costs more than it saves
+static const size_t PREFETCH_PER_THREAD = 32;
+
+static void ReadCoinsRange(const CCoinsView *base, const uint256 *txids, size_t count, std::vector<std::pair<uint256, CCoins> > *coins)
+{
+    CCoins tmp;
+    for (size_t i = 0; i < count; i++) {
+        if (base->GetCoins(txids[i], tmp)) {
+            coins->push_back(std::make_pair(txids[i], CCoins()));
+            tmp.swap(coins->back().second);
+        }
+    }
+}
+
+void CCoinsViewCache::ReadBaseCoins(const std::vector<uint256> &txids, int nThreads, std::vector<std::pair<uint256, CCoins> > &coins) const
+{
+    size_t nWorkers = std::min((size_t)std::max(nThreads, 1), txids.size() / PREFETCH_PER_THREAD + 1);
+    if (nWorkers == 1) {
+        ReadCoinsRange(base, txids.data(), txids.size(), &coins);
+        return;
+    }
+    std::vector<std::vector<std::pair<uint256, CCoins> > > vResults(nWorkers);
+    size_t nPerWorker = (txids.size() + nWorkers - 1) / nWorkers;
+    boost::thread_group workers;
+    for (size_t i = 0; i < nWorkers; i++) {
+        size_t nBegin = std::min(i * nPerWorker, txids.size());
+        size_t nCount = std::min(nPerWorker, txids.size() - nBegin);
+        workers.create_thread(boost::bind(&ReadCoinsRange, base, txids.data() + nBegin, nCount, &vResults[i]));
+    }
+    workers.join_all();
+    for (size_t i = 0; i < nWorkers; i++) {
+        for (size_t j = 0; j < vResults[i].size(); j++) {
+            coins.push_back(std::make_pair(vResults[i][j].first, CCoins()));
+            coins.back().second.swap(vResults[i][j].second);
+        }
+    }
+}
+
+size_t CCoinsViewCache::AddPrefetched(std::vector<std::pair<uint256, CCoins> > &coins)
+{
+    size_t nAdded = 0;
+    for (size_t i = 0; i < coins.size(); i++) {
+        std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(coins[i].first, CCoinsCacheEntry()));
+        if (!ret.second)
+            continue;
+        coins[i].second.swap(ret.first->second.coins);
+        if (ret.first->second.coins.IsPruned())
+            ret.first->second.flags = CCoinsCacheEntry::FRESH;
+        cachedCoinsUsage += ret.first->second.coins.DynamicMemoryUsage();
+        nAdded++;
+    }
+    return nAdded;
+}
+
+size_t CCoinsViewCache::Prefetch(const std::vector<uint256> &txids, int nThreads)
+{
+    std::vector<uint256> missing;
+    for (size_t i = 0; i < txids.size(); i++)
+        if (cacheCoins.find(txids[i]) == cacheCoins.end())
+            missing.push_back(txids[i]);
+    if (missing.empty())
+        return 0;
+    std::vector<std::pair<uint256, CCoins> > coins;
+    ReadBaseCoins(missing, nThreads, coins);
+    return AddPrefetched(coins);
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
@@ -605,18 +675,16 @@ CAmount CCoinsViewCache::GetTransparentValueIn(int32_t nHeight,int64_t &interest
         return 0;
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        value = GetOutputFor(tx.vin[i]).nValue;
+        const CCoins* coins = AccessCoins(tx.vin[i].prevout.hash);
+        assert(coins && coins->IsAvailable(tx.vin[i].prevout.n));
+        value = coins->vout[tx.vin[i].prevout.n].nValue;
         nResult += value;
 #ifdef KOMODO_ENABLE_INTEREST
         if ( chainName.isKMD() && nHeight >= 60000 )
         {
             if ( value >= 10*COIN )
             {
-                int64_t interest; 
-                int32_t txheight; 
-                uint32_t locktime;
-                interest = komodo_accrued_interest(&txheight,&locktime,tx.vin[i].prevout.hash,
-                        tx.vin[i].prevout.n,0,value,nHeight);
+                int64_t interest = komodo_coins_interest(tx.vin[i].prevout.hash,*coins,tx.vin[i].prevout.n,nHeight);
                 nResult += interest;
                 interestp += interest;
             }
@@ -49,6 +49,7 @@
  * - unspentness bitvector, for vout[2] and further; least significant byte first
  * - the non-spent CTxOuts (via CTxOutCompressor)
  * - VARINT(nHeight)
+ * - VARINT(nLockTime), absent in records written before it was stored
  *
  * The nCode value consists of:
  * - bit 1: IsCoinBase()
@@ -107,14 +108,19 @@ public:
     //! version of the CTransaction; accesses to this value should probably check for nHeight as well,
     //! as new tx version will probably only be introduced at certain heights
     int nVersion;
-    //uint32_t nLockTime;
+
+    //! nLockTime of the CTransaction, for KMD interest; only meaningful if fHaveLockTime,
+    //! records written before it was stored have to look the transaction up instead
+    uint32_t nLockTime;
+    bool fHaveLockTime;
 
     void FromTx(const CTransaction &tx, int nHeightIn) {
         fCoinBase = tx.IsCoinBase();
         vout = tx.vout;
         nHeight = nHeightIn;
         nVersion = tx.nVersion;
-        //nLockTime = tx.nLockTime;
+        nLockTime = tx.nLockTime;
+        fHaveLockTime = true;
         ClearUnspendable();
     }
 
@@ -128,10 +134,12 @@ public:
         std::vector<CTxOut>().swap(vout);
         nHeight = 0;
         nVersion = 0;
+        nLockTime = 0;
+        fHaveLockTime = false;
     }
 
     //! empty constructor
-    CCoins() : fCoinBase(false), vout(0), nHeight(0), nVersion(0) { }
+    CCoins() : fCoinBase(false), vout(0), nHeight(0), nVersion(0), nLockTime(0), fHaveLockTime(false) { }
 
     //!remove spent outputs at the end of vout
     void Cleanup() {
@@ -154,6 +162,8 @@ public:
         to.vout.swap(vout);
         std::swap(to.nHeight, nHeight);
         std::swap(to.nVersion, nVersion);
+        std::swap(to.nLockTime, nLockTime);
+        std::swap(to.fHaveLockTime, fHaveLockTime);
     }
 
     //! equality test
@@ -164,6 +174,8 @@ public:
          return a.fCoinBase == b.fCoinBase &&
                 a.nHeight == b.nHeight &&
                 a.nVersion == b.nVersion &&
+                a.fHaveLockTime == b.fHaveLockTime &&
+                a.nLockTime == b.nLockTime &&
                 a.vout == b.vout;
     }
     friend bool operator!=(const CCoins &a, const CCoins &b) {
@@ -203,6 +215,9 @@ public:
         }
         // coinbase height
         ::Serialize(s, VARINT(nHeight));
+        // locktime
+        if (fHaveLockTime)
+            ::Serialize(s, VARINT(nLockTime));
     }
 
     template<typename Stream>
@@ -236,6 +251,11 @@ public:
         }
         // coinbase height
         ::Unserialize(s, VARINT(nHeight));
+        // locktime
+        nLockTime = 0;
+        fHaveLockTime = !s.eof();
+        if (fHaveLockTime)
+            ::Unserialize(s, VARINT(nLockTime));
         Cleanup();
     }
 
@@ -495,6 +515,9 @@ protected:
     /* Cached dynamic memory usage for the inner CCoins objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Number of times this cache was flushed to its base. */
+    uint64_t nFlushes;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
     ~CCoinsViewCache();
@@ -556,6 +579,31 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Number of flushes so far: coins read from the base before a flush may be outdated after it
+    uint64_t GetFlushCount() const { return nFlushes; }
+
+    /**
+     * Read coins from the base view on several threads, without touching this cache, so it
+     * may run while the cache is in use. The base view must allow concurrent reads (CCoinsViewDB does)
+     * @param txids the transactions to read, those the base does not have are left out
+     * @param nThreads max. number of threads
+     * @param[out] coins the coins found
+     */
+    void ReadBaseCoins(const std::vector<uint256> &txids, int nThreads, std::vector<std::pair<uint256, CCoins> > &coins) const;
+
+    /**
+     * Cache coins read from the base view, as FetchCoins would. Cached entries are newer and kept
+     * @note the base must not have been flushed to since the coins were read
+     * @returns the number of entries added
+     */
+    size_t AddPrefetched(std::vector<std::pair<uint256, CCoins> > &coins);
+
+    /**
+     * Cache the coins of txids that are not cached yet, reading them from the base on several threads
+     * @returns the number of entries added
+     */
+    size_t Prefetch(const std::vector<uint256> &txids, int nThreads);
+
     /** 
      * @brief get amount of bitcoins coming in to a transaction
      * @note lightweight clients may not know anything besides the hash of previous transactions,
@@ -25,6 +25,8 @@
 #include "notarisationdb.h"
 #include "cc/import.h"
 
+#include <tuple>
+
 /*
  * The crosschain workflow.
  *
@@ -47,6 +49,14 @@
 
 int NOTARISATION_SCAN_LIMIT_BLOCKS = 1440;
 
+/** Entries kept in mapProofRootMoms before it starts over */
+static const size_t MAX_PROOFROOT_CACHE = 1000;
+
+// The MoMs of a proof root by (hash of the block of the latest own notarisation, symbol, ccid).
+// Everything below that block is fixed by its hash, so entries never go stale.
+static CCriticalSection cs_proofroots;
+static std::map<std::tuple<uint256, std::string, uint32_t>, std::vector<uint256> > mapProofRootMoms;
+
 /****
  * Determine the type of crosschain
  * @param symbol the asset chain to check
@@ -139,50 +149,48 @@ uint256 CrossChain::CalculateProofRoot(const char* symbol, uint32_t targetCCid,
     if (kmdHeight < 0 || kmdHeight > chainActive.Height())
         return uint256();
 
-    int seenOwnNotarisations = 0;
-    CrosschainType authority = GetSymbolAuthority(symbol);
-    std::set<uint256> tmp_moms;
-
-    for (int i=0; i<NOTARISATION_SCAN_LIMIT_BLOCKS; i++) {
-        if (i > kmdHeight) break;
-        NotarisationsInBlock notarisations;
-        uint256 blockHash = *chainActive[kmdHeight-i]->phashBlock;
-        if (!GetBlockNotarisations(blockHash, notarisations))
-            continue;
-
-        // See if we have an own notarisation in this block
-        for(Notarisation& nota : notarisations) {
-            if (strcmp(nota.second.symbol, symbol) == 0)
-            {
-                seenOwnNotarisations++;
-                if (seenOwnNotarisations == 1)
-                    destNotarisationTxid = nota.first;
-                else if (seenOwnNotarisations == 7)
-                    goto end;
-                //break;
-            }
-        }
+    // The 7th latest own notarisation within the scan limit ends the range, which runs from
+    // the block of the latest one down to the block after that.
+    std::vector<IndexedNotarisation> ownNotarisations;
+    GetLastNotarisationsBySymbol(symbol, kmdHeight, std::max(kmdHeight - NOTARISATION_SCAN_LIMIT_BLOCKS + 1, 0), 7, ownNotarisations);
+    if (ownNotarisations.size() < 7) {
+        // Not enough own notarisations found to return determinate MoMoM
+        destNotarisationTxid = uint256();
+        moms.clear();
+        return uint256();
+    }
+    destNotarisationTxid = ownNotarisations[0].second.first;
+    int topHeight = ownNotarisations[0].first;
+    int endHeight = ownNotarisations[6].first;
 
-        if (seenOwnNotarisations >= 1) {
-            for(Notarisation& nota : notarisations) {
-                if (GetSymbolAuthority(nota.second.symbol) == authority)
-                    if (nota.second.ccId == targetCCid) {
-                      tmp_moms.insert(nota.second.MoM);
-                      //LogPrintf( "added mom: %s\n",nota.second.MoM.GetHex().data());
-                    }
-            }
+    std::tuple<uint256, std::string, uint32_t> key(chainActive[topHeight]->GetBlockHash(), symbol, targetCCid);
+    {
+        LOCK(cs_proofroots);
+        std::map<std::tuple<uint256, std::string, uint32_t>, std::vector<uint256> >::iterator it = mapProofRootMoms.find(key);
+        if (it != mapProofRootMoms.end()) {
+            moms = it->second;
+            return GetMerkleRoot(moms);
         }
     }
 
-    // Not enough own notarisations found to return determinate MoMoM
-    destNotarisationTxid = uint256();
-    moms.clear();
-    return uint256();
+    CrosschainType authority = GetSymbolAuthority(symbol);
+    std::set<uint256> tmp_moms;
+    std::vector<IndexedNotarisation> notarisations;
+    GetNotarisationsByCcid(targetCCid, endHeight + 1, topHeight, notarisations);
+    for (IndexedNotarisation& nota : notarisations) {
+        if (GetSymbolAuthority(nota.second.second.symbol) == authority && nota.second.second.ccId == targetCCid)
+            tmp_moms.insert(nota.second.second.MoM);
+    }
 
-end:
     // add set to vector. Set makes sure there are no dupes included. 
     moms.clear();
     std::copy(tmp_moms.begin(), tmp_moms.end(), std::back_inserter(moms));
+    {
+        LOCK(cs_proofroots);
+        if (mapProofRootMoms.size() >= MAX_PROOFROOT_CACHE)
+            mapProofRootMoms.clear();
+        mapProofRootMoms[key] = moms;
+    }
     return GetMerkleRoot(moms);
 }
 
@@ -217,6 +225,32 @@ int ScanNotarisationsFromHeight(int nHeight, const IsTarget f, Notarisation &fou
     return 0;
 }
 
+/*****
+ * @brief Get a notarisation for symbol from a given height
+ * @note Reads the by symbol index instead of every block up to the limit
+ * @param[in] nHeight the height
+ * @param[in] symbol the symbol of the notarisations f is asked about
+ * @param[in] f
+ * @param[out] found
+ * @returns the height of the notarisation
+ */
+template <typename IsTarget>
+int ScanNotarisationsFromHeight(int nHeight, const std::string &symbol, const IsTarget f, Notarisation &found)
+{
+    int limit = std::min(nHeight + NOTARISATION_SCAN_LIMIT_BLOCKS, chainActive.Height());
+    int start = std::max(nHeight, 1);
+
+    std::vector<IndexedNotarisation> notarisations;
+    GetNotarisationsBySymbol(symbol, start, limit - 1, notarisations);
+    for (IndexedNotarisation& entry : notarisations) {
+        if (f(entry.second)) {
+            found = entry.second;
+            return entry.first;
+        }
+    }
+    return 0;
+}
+
 /******
  * @brief
  * @note this happens on the KMD chain
@@ -260,7 +294,7 @@ TxProof CrossChain::GetCrossChainProof(const uint256 txid, const char* targetSym
     auto isTarget = [&](Notarisation &nota) {
         return strcmp(nota.second.symbol, targetSymbol) == 0;
     };
-    kmdHeight = ScanNotarisationsFromHeight(kmdHeight, isTarget, nota);
+    kmdHeight = ScanNotarisationsFromHeight(kmdHeight, targetSymbol, isTarget, nota);
     if (!kmdHeight)
         throw std::runtime_error("Cannot find notarisation for target inclusive of source");
         
@@ -523,7 +557,7 @@ TxProof CrossChain::GetAssetchainProof(uint256 hash,CTransaction burnTx)
             if (!IsSameAssetChain(nota)) return false;
             return nota.second.height >= blockIndex->nHeight;
         };
-        if (!ScanNotarisationsFromHeight(blockIndex->nHeight, isTarget, nota))
+        if (!ScanNotarisationsFromHeight(blockIndex->nHeight, chainName.symbol(), isTarget, nota))
             throw std::runtime_error("backnotarisation not yet confirmed");
 
         // index of block in MoM leaves
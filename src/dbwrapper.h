@@ -52,6 +52,11 @@ public:
      */
     CDBBatch(const CDBWrapper &_parent) : parent(_parent) { };
 
+    void Clear()
+    {
+        batch.Clear();
+    }
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -78,6 +83,18 @@ public:
 
         batch.Delete(slKey);
     }
+
+    //! Write an already serialized key and value
+    void WriteRaw(const std::string &key, const std::string &value)
+    {
+        batch.Put(key, value);
+    }
+
+    //! Erase an already serialized key
+    void EraseRaw(const std::string &key)
+    {
+        batch.Delete(key);
+    }
 };
 
 class CDBIterator
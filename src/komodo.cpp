@@ -651,11 +651,18 @@ int32_t gettxout_scriptPubKey(uint8_t *scriptPubKey,int32_t maxsize,uint256 txid
     return(-1);
 }
 
-int32_t komodo_notarycmp(uint8_t *scriptPubKey,int32_t scriptlen,uint8_t pubkeys[64][33],int32_t numnotaries,uint8_t rmd160[20])
+/****
+ * @brief check if a scriptPubKey pays to a notary
+ * @param table the season's notaries, when set pubkeys is not used
+ * @returns the notaryid (0 for a match of the first notary's p2pkh) or -1
+ */
+int32_t komodo_notarycmp(uint8_t *scriptPubKey,int32_t scriptlen,const komodo::notary_table *table,uint8_t pubkeys[64][33],int32_t numnotaries,uint8_t rmd160[20])
 {
     int32_t i;
     if ( scriptlen == 25 && memcmp(&scriptPubKey[3],rmd160,20) == 0 )
         return(0);
+    else if ( scriptlen == 35 && table != nullptr )
+        return table->find(&scriptPubKey[1]);
     else if ( scriptlen == 35 )
     {
         for (i=0; i<numnotaries; i++)
@@ -712,8 +719,17 @@ int32_t komodo_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block)
             lastStakedEra = staked_era;
         }
     }
-    numnotaries = komodo_notaries(pubkeys,pindex->nHeight,pindex->GetBlockTime());
-    calc_rmd160_sha256(rmd160,pubkeys[0],33);
+    const komodo::notary_table *notaries = komodo_notarytable(pindex->nHeight,chainName.isKMD() ? 0 : pindex->GetBlockTime());
+    if ( notaries != nullptr )
+    {
+        numnotaries = notaries->num;
+        memcpy(rmd160,notaries->rmd160[0],20);
+    }
+    else
+    {
+        numnotaries = komodo_notaries(pubkeys,pindex->nHeight,pindex->GetBlockTime());
+        calc_rmd160_sha256(rmd160,pubkeys[0],33);
+    }
     if ( pindex->nHeight > hwmheight )
         hwmheight = pindex->nHeight;
     else
@@ -757,7 +773,7 @@ int32_t komodo_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block)
                     continue;
                 if ( (scriptlen= gettxout_scriptPubKey(scriptPubKey,sizeof(scriptPubKey),block.vtx[i].vin[j].prevout.hash,block.vtx[i].vin[j].prevout.n)) > 0 )
                 {
-                    if ( (k= komodo_notarycmp(scriptPubKey,scriptlen,pubkeys,numnotaries,rmd160)) >= 0 )
+                    if ( (k= komodo_notarycmp(scriptPubKey,scriptlen,notaries,pubkeys,numnotaries,rmd160)) >= 0 )
                         signedmask |= (1LL << k);
                     else if ( 0 && numvins >= 17 )
                     {
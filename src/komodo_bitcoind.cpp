@@ -21,6 +21,10 @@
 #include "rpc/net.h"
 #include "init.h"
 
+#include <atomic>
+#include <limits>
+#include <thread>
+
 
 /************************************************************************
  *
@@ -729,19 +733,14 @@ int32_t komodo_isPoS(CBlock *pblock, int32_t height,CTxDestination *addressout)
 
 int32_t komodo_is_notarytx(const CTransaction& tx)
 {
-    uint8_t *ptr; static uint8_t crypto777[33];
-    if ( tx.vout.size() > 0 )
+    static const std::vector<uint8_t> crypto777 = ParseHex(CRYPTO777_PUBSECPSTR); // initialized once, thread safe
+    if ( tx.vout.size() > 0 && tx.vout[0].scriptPubKey.size() >= 34 )
     {
-        ptr = (uint8_t *)&tx.vout[0].scriptPubKey[0];
-        if ( ptr != 0 )
+        const uint8_t *ptr = (const uint8_t *)&tx.vout[0].scriptPubKey[0];
+        if ( memcmp(ptr+1,crypto777.data(),33) == 0 )
         {
-            if ( crypto777[0] == 0 )
-                decode_hex(crypto777,33,CRYPTO777_PUBSECPSTR);
-            if ( memcmp(ptr+1,crypto777,33) == 0 )
-            {
-                //LogPrintf("found notarytx\n");
-                return(1);
-            }
+            //LogPrintf("found notarytx\n");
+            return(1);
         }
     }
     return(0);
@@ -1209,35 +1208,40 @@ uint32_t komodo_segid32(char *coinaddr)
     return(addrhash.uints[0]);
 }
 
+int8_t komodo_blocksegid(const CBlock &block,CBlockIndex *pindex)
+{
+    CTxDestination voutaddress; uint64_t value; uint32_t txtime; char voutaddr[64],destaddr[64]; int32_t txn_count,vout,newStakerActive,height = pindex->nHeight; uint256 txid,merkleroot; CScript opret; int8_t segid = -1;
+    newStakerActive = komodo_newStakerActive(height, block.nTime);
+    txn_count = block.vtx.size();
+    if ( txn_count > 1 && block.vtx[txn_count-1].vin.size() == 1 && block.vtx[txn_count-1].vout.size() == 1+komodo_hasOpRet(height,pindex->nTime) )
+    {
+        txid = block.vtx[txn_count-1].vin[0].prevout.hash;
+        vout = block.vtx[txn_count-1].vin[0].prevout.n;
+        txtime = komodo_txtime(opret,&value,txid,vout,destaddr);
+        if ( ExtractDestination(block.vtx[txn_count-1].vout[0].scriptPubKey,voutaddress) )
+        {
+            strcpy(voutaddr,CBitcoinAddress(voutaddress).ToString().c_str());
+            if ( newStakerActive == 1 && block.vtx[txn_count-1].vout.size() == 2 && DecodeStakingOpRet(block.vtx[txn_count-1].vout[1].scriptPubKey, merkleroot) != 0 )
+                newStakerActive++;
+            if ( newStakerActive == 2 || (newStakerActive == 0 && strcmp(destaddr,voutaddr) == 0 && block.vtx[txn_count-1].vout[0].nValue == value) )
+            {
+                segid = komodo_segid32(voutaddr) & 0x3f;
+                //LogPrintf( "komodo_segid: ht.%i --> %i\n",height,pindex->segid);
+            }
+        } //else LogPrintf("komodo_segid ht.%d couldnt extract voutaddress\n",height);
+    }
+    return(segid);
+}
+
 int8_t komodo_segid(int32_t nocache,int32_t height)
 {
-    CTxDestination voutaddress; CBlock block; CBlockIndex *pindex; uint64_t value; uint32_t txtime; char voutaddr[64],destaddr[64]; int32_t txn_count,vout,newStakerActive; uint256 txid,merkleroot; CScript opret; int8_t segid = -1;
+    CBlock block; CBlockIndex *pindex; int8_t segid = -1;
     if ( height > 0 && (pindex= komodo_chainactive(height)) != 0 )
     {
         if ( nocache == 0 && pindex->segid >= -1 )
             return(pindex->segid);
         if ( komodo_blockload(block,pindex) == 0 )
-        {
-            newStakerActive = komodo_newStakerActive(height, block.nTime);
-            txn_count = block.vtx.size();
-            if ( txn_count > 1 && block.vtx[txn_count-1].vin.size() == 1 && block.vtx[txn_count-1].vout.size() == 1+komodo_hasOpRet(height,pindex->nTime) )
-            {
-                txid = block.vtx[txn_count-1].vin[0].prevout.hash;
-                vout = block.vtx[txn_count-1].vin[0].prevout.n;
-                txtime = komodo_txtime(opret,&value,txid,vout,destaddr);
-                if ( ExtractDestination(block.vtx[txn_count-1].vout[0].scriptPubKey,voutaddress) )
-                {
-                    strcpy(voutaddr,CBitcoinAddress(voutaddress).ToString().c_str());
-                    if ( newStakerActive == 1 && block.vtx[txn_count-1].vout.size() == 2 && DecodeStakingOpRet(block.vtx[txn_count-1].vout[1].scriptPubKey, merkleroot) != 0 )
-                        newStakerActive++;
-                    if ( newStakerActive == 2 || (newStakerActive == 0 && strcmp(destaddr,voutaddr) == 0 && block.vtx[txn_count-1].vout[0].nValue == value) )
-                    {
-                        segid = komodo_segid32(voutaddr) & 0x3f;
-                        //LogPrintf( "komodo_segid: ht.%i --> %i\n",height,pindex->segid);
-                    }
-                } //else LogPrintf("komodo_segid ht.%d couldnt extract voutaddress\n",height);
-            }
-        }
+            segid = komodo_blocksegid(block,pindex);
         // The new staker sets segid in komodo_checkPOW, this persists after restart by being saved in the blockindex for blocks past the HF timestamp, to keep backwards compatibility.
         // PoW blocks cannot contain a staking tx. If segid has not yet been set, we can set it here accurately.
         if ( pindex->segid == -2 ) 
@@ -1246,33 +1250,84 @@ int8_t komodo_segid(int32_t nocache,int32_t height)
     return(segid);
 }
 
+// the segids of the last blocks of the active chain by height modulo the ring size, height 0 marks a free slot
+static const int32_t KOMODO_SEGIDRING_SIZE = 128;
+static CCriticalSection cs_segidring;
+static int32_t segidringheights[KOMODO_SEGIDRING_SIZE];
+static int8_t segidring[KOMODO_SEGIDRING_SIZE];
+
+static void komodo_segidring_set(int32_t height,int8_t segid)
+{
+    LOCK(cs_segidring);
+    segidringheights[height % KOMODO_SEGIDRING_SIZE] = height;
+    segidring[height % KOMODO_SEGIDRING_SIZE] = segid;
+}
+
+bool komodo_segidring_connect(CBlockIndex *pindex,const CBlock &block)
+{
+    bool fChanged = false;
+    AssertLockHeld(cs_main);
+    if ( ASSETCHAINS_STAKED == 0 || pindex->nHeight <= 0 )
+        return(false);
+    if ( pindex->segid < -1 )
+    {
+        pindex->segid = komodo_blocksegid(block,pindex);
+        fChanged = true;
+    }
+    komodo_segidring_set(pindex->nHeight,pindex->segid);
+    return(fChanged);
+}
+
+void komodo_segidring_disconnect(const CBlockIndex *pindex)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_segidring);
+    if ( pindex->nHeight > 0 && segidringheights[pindex->nHeight % KOMODO_SEGIDRING_SIZE] == pindex->nHeight )
+        segidringheights[pindex->nHeight % KOMODO_SEGIDRING_SIZE] = 0;
+}
+
 void komodo_segids(uint8_t *hashbuf,int32_t height,int32_t n)
 {
-    static uint8_t prevhashbuf[100]; static int32_t prevheight;
-    int32_t i;
-    if ( height == prevheight && n == 100 )
-        memcpy(hashbuf,prevhashbuf,100);
-    else
+    int32_t i,ht; std::vector<int32_t> missing;
+    memset(hashbuf,0xff,n);
     {
-        memset(hashbuf,0xff,n);
+        LOCK(cs_segidring);
         for (i=0; i<n; i++)
         {
-            hashbuf[i] = (uint8_t)komodo_segid(0,height+i);
-            //LogPrintf("%02x ",hashbuf[i]);
-        }
-        if ( n == 100 )
-        {
-            memcpy(prevhashbuf,hashbuf,100);
-            prevheight = height;
-            //LogPrintf("prevsegids.%d\n",height+n);
+            if ( (ht= height+i) <= 0 )
+                continue;
+            if ( segidringheights[ht % KOMODO_SEGIDRING_SIZE] == ht )
+                hashbuf[i] = (uint8_t)segidring[ht % KOMODO_SEGIDRING_SIZE];
+            else missing.push_back(i);
         }
     }
+    if ( missing.empty() )
+        return;
+    // after a restart the window is filled from the block index, cs_main keeps it in step with the tip
+    LOCK(cs_main);
+    for (i=0; i<missing.size(); i++)
+    {
+        ht = height + missing[i];
+        hashbuf[missing[i]] = (uint8_t)komodo_segid(0,ht);
+        if ( komodo_chainactive(ht) != 0 && ht > chainActive.Height() - KOMODO_SEGIDRING_SIZE )
+            komodo_segidring_set(ht,(int8_t)hashbuf[missing[i]]);
+    }
 }
 
-uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256 txid,int32_t vout)
+bits256 komodo_stakeaddrhash(const char *address)
 {
     bits256 addrhash;
     vcalc_sha256(0,(uint8_t *)&addrhash,(uint8_t *)address,(int32_t)strlen(address));
+    return(addrhash);
+}
+
+uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256 txid,int32_t vout)
+{
+    return(komodo_stakehash2(hashp,komodo_stakeaddrhash(address),hashbuf,txid,vout));
+}
+
+uint32_t komodo_stakehash2(uint256 *hashp,const bits256 &addrhash,uint8_t *hashbuf,uint256 txid,int32_t vout)
+{
     memcpy(&hashbuf[100],&addrhash,sizeof(addrhash));
     memcpy(&hashbuf[100+sizeof(addrhash)],&txid,sizeof(txid));
     memcpy(&hashbuf[100+sizeof(addrhash)+sizeof(txid)],&vout,sizeof(vout));
@@ -1280,10 +1335,125 @@ uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256
     return(addrhash.uints[0]);
 }
 
+// the blocks komodo_PoWtarget() averages: the 100 below height, by height modulo 100
+struct komodo_powwindow
+{
+    int32_t height;       // 0 when not built
+    uint256 tiphash;      // the block at height-1 the window was built on
+    int32_t n,m;          // PoS and PoW blocks
+    arith_uint256 sum;    // sum of the PoW block hashes, modulo 2^256 like the original walk
+    int8_t flags[100];    // 1 PoS, 0 PoW, -1 not counted
+};
+static komodo_powwindow powwindow; // for the next block of the active chain, cs_main
+
+static int32_t komodo_powwindow_slot(int32_t ht)
+{
+    return(((ht % 100) + 100) % 100);
+}
+
+static int8_t komodo_powwindow_flag(const CBlockIndex *pindex)
+{
+    int8_t segid;
+    if ( pindex == 0 || pindex->nHeight <= 1 )
+        return(-1);
+    if ( (segid= pindex->segid) < -1 )
+        segid = komodo_segid(0,pindex->nHeight);
+    return(segid >= 0);
+}
+
+static void komodo_powwindow_apply(komodo_powwindow *w,const CBlockIndex *pindex,int8_t flag,bool fAdd)
+{
+    if ( flag < 0 || pindex == 0 )
+        return;
+    if ( flag != 0 )
+        w->n += fAdd ? 1 : -1;
+    else
+    {
+        w->m += fAdd ? 1 : -1;
+        if ( fAdd )
+            w->sum += UintToArith256(pindex->GetBlockHash());
+        else w->sum -= UintToArith256(pindex->GetBlockHash());
+    }
+}
+
+static void komodo_powwindow_build(komodo_powwindow *w,int32_t height)
+{
+    CBlockIndex *pindex; int32_t ht;
+    w->n = w->m = 0;
+    w->sum = arith_uint256(0);
+    for (ht=height-100; ht<height; ht++)
+    {
+        pindex = ht > 1 ? komodo_chainactive(ht) : 0;
+        w->flags[komodo_powwindow_slot(ht)] = komodo_powwindow_flag(pindex);
+        komodo_powwindow_apply(w,pindex,w->flags[komodo_powwindow_slot(ht)],true);
+    }
+    w->height = height;
+    pindex = komodo_chainactive(height-1);
+    w->tiphash = pindex != 0 ? pindex->GetBlockHash() : uint256();
+}
+
+void komodo_powwindow_connect(const CBlockIndex *pindex)
+{
+    int32_t slot;
+    AssertLockHeld(cs_main);
+    if ( ASSETCHAINS_STAKED == 0 || powwindow.height == 0 )
+        return;
+    if ( powwindow.height != pindex->nHeight || pindex->pprev == 0 || powwindow.tiphash != pindex->pprev->GetBlockHash() )
+    {
+        powwindow.height = 0;
+        return;
+    }
+    // the block 100 below the new tip leaves the window, the new tip takes its slot
+    slot = komodo_powwindow_slot(pindex->nHeight);
+    komodo_powwindow_apply(&powwindow,pindex->nHeight >= 100 ? chainActive[pindex->nHeight-100] : 0,powwindow.flags[slot],false);
+    powwindow.flags[slot] = komodo_powwindow_flag(pindex);
+    komodo_powwindow_apply(&powwindow,pindex,powwindow.flags[slot],true);
+    powwindow.height = pindex->nHeight + 1;
+    powwindow.tiphash = pindex->GetBlockHash();
+}
+
+void komodo_powwindow_disconnect(const CBlockIndex *pindex)
+{
+    int32_t slot; const CBlockIndex *pback;
+    AssertLockHeld(cs_main);
+    if ( ASSETCHAINS_STAKED == 0 || powwindow.height == 0 )
+        return;
+    if ( powwindow.height != pindex->nHeight+1 || pindex->pprev == 0 || powwindow.tiphash != pindex->GetBlockHash() )
+    {
+        powwindow.height = 0;
+        return;
+    }
+    // the disconnected tip leaves the window, the block 100 below it comes back in its slot
+    slot = komodo_powwindow_slot(pindex->nHeight);
+    komodo_powwindow_apply(&powwindow,pindex,powwindow.flags[slot],false);
+    pback = pindex->nHeight >= 100 ? chainActive[pindex->nHeight-100] : 0;
+    powwindow.flags[slot] = komodo_powwindow_flag(pback);
+    komodo_powwindow_apply(&powwindow,pback,powwindow.flags[slot],true);
+    powwindow.height = pindex->nHeight;
+    powwindow.tiphash = pindex->pprev->GetBlockHash();
+}
+
+// the miner calls komodo_PoWtarget() without cs_main, the window and chainActive are read under it here
+static void komodo_powwindow_get(int32_t height,int32_t *np,int32_t *mp,arith_uint256 *sump)
+{
+    komodo_powwindow w; const komodo_powwindow *pw = &w;
+    LOCK(cs_main);
+    if ( height == chainActive.Height()+1 && chainActive.Tip() != 0 )
+    {
+        if ( powwindow.height != height || powwindow.tiphash != chainActive.Tip()->GetBlockHash() )
+            komodo_powwindow_build(&powwindow,height);
+        pw = &powwindow;
+    }
+    else komodo_powwindow_build(&w,height);
+    *np = pw->n;
+    *mp = pw->m;
+    *sump = pw->sum;
+}
+
 arith_uint256 komodo_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t height,int32_t goalperc,int32_t newStakerActive)
 {
     int32_t oldflag = 0,dispflag = 0;
-    CBlockIndex *pindex; arith_uint256 easydiff,bnTarget,hashval,sum,ave; bool fNegative,fOverflow; int32_t i,n,m,ht,percPoS,diff,val;
+    arith_uint256 easydiff,bnTarget,hashval,sum,ave; bool fNegative,fOverflow; int32_t i,n,m,percPoS,diff,val;
     *percPoSp = percPoS = 0;
     
     if ( newStakerActive == 0 && height <= 10 || (ASSETCHAINS_STAKED == 100 && height <= 100) ) 
@@ -1299,31 +1469,8 @@ arith_uint256 komodo_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t he
     }    
     else 
         easydiff.SetCompact(STAKING_MIN_DIFF,&fNegative,&fOverflow);
-    for (i=n=m=0; i<100; i++)
-    {
-        ht = height - 100 + i;
-        if ( ht <= 1 )
-            continue;
-        if ( (pindex= komodo_chainactive(ht)) != 0 )
-        {
-            if ( komodo_segid(0,ht) >= 0 )
-            {
-                n++;
-                percPoS++;
-                if ( dispflag != 0 && ASSETCHAINS_STAKED < 100 )
-                    LogPrintf("0");
-            }
-            else
-            {
-                if ( dispflag != 0 && ASSETCHAINS_STAKED < 100 )
-                    LogPrintf("1");
-                sum += UintToArith256(pindex->GetBlockHash());
-                m++;
-            }
-        } //else LogPrintf( "pindex returned null ht.%i\n",ht);
-        if ( dispflag != 0 && ASSETCHAINS_STAKED < 100 && (i % 10) == 9 )
-            LogPrintf(" %d, ",percPoS);
-    }
+    komodo_powwindow_get(height,&n,&m,&sum);
+    percPoS = n;
     if ( m+n < 100 )
     {
         // We do actual PoS % at the start. Requires coin distribution in first 10 blocks! 
@@ -1396,8 +1543,16 @@ arith_uint256 komodo_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t he
 
 uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,char *destaddr,int32_t PoSperc)
 {
-    bool fNegative,fOverflow; uint8_t hashbuf[256]; char address[64]; bits256 addrhash; arith_uint256 hashval,mindiff,ratio,coinage256; uint256 hash,pasthash; int32_t segid,minage,i,iter=0; int64_t diff=0; uint32_t txtime,segid32,winner = 0 ; uint64_t value,coinage;
+    uint8_t hashbuf[256]; char address[64]; uint32_t txtime; uint64_t value;
+    address[0] = 0;
     txtime = komodo_txtime2(&value,txid,vout,address);
+    komodo_segids(hashbuf,nHeight-101,100);
+    return(komodo_stake2(validateflag,bnTarget,nHeight,txid,vout,blocktime,prevtime,value,txtime,komodo_stakeaddrhash(address),hashbuf));
+}
+
+uint32_t komodo_stake2(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,uint64_t value,uint32_t txtime,const bits256 &addrhash,uint8_t *hashbuf)
+{
+    bool fNegative,fOverflow; arith_uint256 hashval,mindiff,ratio,coinage256; uint256 hash; int32_t segid,minage,i,iter=0; int64_t diff=0; uint32_t segid32,winner = 0 ; uint64_t coinage;
     if ( validateflag == 0 )
     {
         //LogPrintf("blocktime.%u -> ",blocktime);
@@ -1419,8 +1574,7 @@ uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeigh
     ratio = (mindiff / bnTarget);
     if ( (minage= nHeight*3) > 6000 ) // about 100 blocks
         minage = 6000;
-    komodo_segids(hashbuf,nHeight-101,100);
-    segid32 = komodo_stakehash(&hash,address,hashbuf,txid,vout);
+    segid32 = komodo_stakehash2(&hash,addrhash,hashbuf,txid,vout);
     segid = ((nHeight + segid32) & 0x3f);
     for (iter=0; iter<600; iter++)
     {
@@ -1480,6 +1634,107 @@ uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeigh
     return(blocktime * winner);
 }
 
+void komodo_stakelimits_init(komodo_stakelimits *limits,arith_uint256 bnTarget)
+{
+    bool fNegative,fOverflow; arith_uint256 mindiff,maxval = ~arith_uint256(0);
+    limits->bnTarget = bnTarget;
+    limits->ratio = limits->winlimit = limits->wraplimit = arith_uint256(0);
+    limits->fMayWrap = false;
+    limits->fExact = false;
+    if ( bnTarget == 0 )
+    {
+        limits->fExact = true;
+        return;
+    }
+    mindiff.SetCompact(STAKING_MIN_DIFF,&fNegative,&fOverflow);
+    limits->ratio = (mindiff / bnTarget);
+    if ( limits->ratio == 0 ) // every hashval is 0, winlimit 0 lets any coinage win
+        return;
+    if ( (limits->winlimit= (bnTarget / limits->ratio)) == maxval )
+    {
+        limits->fExact = true;
+        return;
+    }
+    limits->winlimit += 1;
+    if ( limits->ratio > 1 )
+    {
+        limits->fMayWrap = true;
+        limits->wraplimit = (maxval / limits->ratio) + 1;
+    }
+}
+
+static uint64_t komodo_stakelimit64(const arith_uint256 &x)
+{
+    return(x.bits() > 64 ? std::numeric_limits<uint64_t>::max() : x.GetLow64());
+}
+
+uint32_t komodo_stake_earliest(const komodo_stakelimits &limits,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,uint64_t value,uint32_t txtime,const bits256 &addrhash,const uint8_t *segids)
+{
+    arith_uint256 hashval; uint256 hash; uint8_t hashbuf[256]; int32_t segid,minage,iter=0; int64_t diff=0; uint32_t segid32,winner = 0; uint64_t coinage,c1,winabove,wrapupto;
+    memcpy(hashbuf,segids,100);
+    if ( limits.fExact )
+        return(komodo_stake2(0,limits.bnTarget,nHeight,txid,vout,blocktime,prevtime,value,txtime,addrhash,hashbuf));
+    // same checks and coinage as komodo_stake2(), only the comparison with the target differs
+    if ( blocktime < prevtime+3 )
+        blocktime = prevtime+3;
+    if ( blocktime < GetTime()-60 )
+        blocktime = GetTime()+30;
+    if ( value == 0 || txtime == 0 || blocktime == 0 || prevtime == 0 )
+        return(0);
+    if ( value < SATOSHIDEN )
+        return(0);
+    value /= SATOSHIDEN;
+    if ( (minage= nHeight*3) > 6000 )
+        minage = 6000;
+    segid32 = komodo_stakehash2(&hash,addrhash,hashbuf,txid,vout);
+    segid = ((nHeight + segid32) & 0x3f);
+    hashval = UintToArith256(hash);
+    // ratio * (hashval / c1) <= bnTarget  <=>  c1 > hashval / winlimit, unless the product overflows
+    winabove = limits.winlimit == 0 ? 0 : komodo_stakelimit64(hashval / limits.winlimit);
+    wrapupto = limits.fMayWrap != 0 ? komodo_stakelimit64(hashval / limits.wraplimit) : 0;
+    for (iter=0; iter<600; iter++)
+    {
+        if ( blocktime+iter+segid*2 < txtime+minage )
+            continue;
+        diff = (iter + blocktime - txtime - minage);
+        if ( diff < 0 )
+            diff = 60;
+        else if ( diff > 3600*24*30 )
+            diff = 3600*24*30;
+        if ( iter > 0 )
+            diff += segid*2;
+        coinage = (value * diff);
+        if ( blocktime+iter+segid*2 > prevtime+480 )
+            coinage *= ((blocktime+iter+segid*2) - (prevtime+400));
+        c1 = coinage + 1;
+        if ( c1 > winabove )
+            winner = 1;
+        else if ( c1 == 0 || (limits.fMayWrap != 0 && c1 <= wrapupto) )
+            winner = (limits.ratio * (hashval / arith_uint256(c1)) <= limits.bnTarget);
+        if ( winner != 0 )
+        {
+            blocktime += iter;
+            blocktime += segid * 2;
+            break;
+        }
+    }
+    if ( nHeight < 10 )
+        return(blocktime);
+    return(blocktime * winner);
+}
+
+static const size_t KOMODO_STAKESEARCH_CHUNK = 256;
+static std::atomic<uint64_t> nStakingCandidates(0);
+static std::atomic<int64_t> nStakingMicros(0);
+
+double komodo_stakingrate(uint64_t *candidatesp)
+{
+    uint64_t n = nStakingCandidates; int64_t micros = nStakingMicros;
+    if ( candidatesp != 0 )
+        *candidatesp = n;
+    return(micros > 0 ? 1000000. * n / micros : 0.);
+}
+
 int32_t komodo_is_PoSblock(int32_t slowflag,int32_t height,CBlock *pblock,arith_uint256 bnTarget,arith_uint256 bhash)
 {
     CBlockIndex *previndex,*pindex; char voutaddr[64],destaddr[64]; uint256 txid, merkleroot; uint32_t txtime,prevtime=0; int32_t ret,vout,PoSperc,txn_count,eligible=0,isPoS = 0,segid; uint64_t value; arith_uint256 POWTarget;
@@ -2200,40 +2455,224 @@ int64_t komodo_coinsupply(int64_t *zfundsp,int64_t *sproutfundsp,int32_t height)
     return(supply);
 }
 
-void komodo_addutxo(std::vector<komodo_staking> &array,uint32_t txtime,uint64_t nValue,uint256 txid,int32_t vout,char *address,uint8_t *hashbuf,CScript pk)
+CStakingSet stakingSet;
+
+CStakingSet::CStakingSet() : fValid(false) {}
+
+void CStakingSet::Invalidate()
 {
-    uint256 hash; uint32_t segid32; komodo_staking kp;
-    segid32 = komodo_stakehash(&hash,address,hashbuf,txid,vout);
-    if ( array.size() >= array.capacity() )
-    {
-        array.reserve(array.capacity() + 1000);
-        //LogPrintf("%s realloc array.size().%d array.capacity().%d\n", __func__, array.size(), array.capacity());
-    }
-    //memset(&kp,0,sizeof(kp));
-    strcpy(kp.address, address);
-    kp.txid = txid;
+    LOCK(cs);
+    fValid = false;
+}
+
+void CStakingSet::Add(const CTransaction &tx, int32_t vout, int32_t nHeight, uint32_t txtime)
+{
+    CTxDestination address; komodo_staking kp;
+    const CTxOut &out = tx.vout[vout];
+    if ( out.nValue < COIN || ExtractDestination(out.scriptPubKey,address) == 0 )
+        return;
+    if ( (IsMine(*pwalletMain,out.scriptPubKey) & ISMINE_SPENDABLE) == 0 )
+        return;
+    std::string strAddress = CBitcoinAddress(address).ToString();
+    if ( strAddress.size() >= sizeof(kp.address) )
+        return;
+    strcpy(kp.address,strAddress.c_str());
+    kp.addrhash = komodo_stakeaddrhash(kp.address);
+    kp.txid = tx.GetHash();
     kp.vout = vout;
-    kp.hashval = UintToArith256(hash);
+    kp.nValue = out.nValue;
     kp.txtime = txtime;
-    kp.segid32 = segid32;
-    kp.nValue = nValue;
-    kp.scriptPubKey = pk;
-    array.push_back(kp);
-    //LogPrintf("kp.%p array.size().%d\n",kp,array.size());
+    kp.matureheight = 0;
+    if ( tx.IsCoinBase() )
+        kp.matureheight = std::max((int32_t)tx.UnlockTime(0),(int32_t)(nHeight + Params().CoinbaseMaturity() - 1));
+    kp.scriptPubKey = out.scriptPubKey;
+    candidates[COutPoint(kp.txid,vout)] = kp;
 }
 
-int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blocktimep,uint32_t *txtimep,uint256 *utxotxidp,int32_t *utxovoutp,uint64_t *utxovaluep,uint8_t *utxosig, uint256 merkleroot)
+bool CStakingSet::Rebuild()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pwalletMain->cs_wallet);
+    AssertLockHeld(cs);
+    int64_t nStart = GetTimeMicros();
+    candidates.clear();
+    pending.clear();
+    for (std::map<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
+    {
+        const CWalletTx &wtx = it->second;
+        if ( wtx.GetDepthInMainChain() < 1 )
+            continue;
+        BlockMap::const_iterator mi = mapBlockIndex.find(wtx.hashBlock);
+        if ( mi == mapBlockIndex.end() || mi->second == 0 )
+            continue;
+        for (int32_t i=0; i<wtx.vout.size(); i++)
+            if ( !pwalletMain->IsSpent(it->first,i) )
+                Add(wtx,i,mi->second->nHeight,mi->second->nTime);
+    }
+    LogPrint("pos","%s: %u staking utxos from %u wallet transactions in %.2fms\n",__func__,candidates.size(),pwalletMain->mapWallet.size(),0.001 * (GetTimeMicros() - nStart));
+    fValid = true;
+    snapshot.reset();
+    return(true);
+}
+
+std::shared_ptr<const std::vector<komodo_staking> > CStakingSet::GetCandidates(std::set<COutPoint> &locked)
+{
+    {
+        // the locked coins are refreshed whenever the wallet is free, they rarely change
+        TRY_LOCK(pwalletMain->cs_wallet,lockWallet);
+        if ( lockWallet )
+        {
+            std::vector<COutPoint> vLocked;
+            pwalletMain->ListLockedCoins(vLocked);
+            LOCK(cs);
+            setLocked = std::set<COutPoint>(vLocked.begin(),vLocked.end());
+        }
+    }
+    bool fRebuild;
+    {
+        LOCK(cs);
+        fRebuild = !fValid;
+    }
+    if ( fRebuild )
+    {
+        LOCK2(cs_main,pwalletMain->cs_wallet);
+        LOCK(cs);
+        Rebuild();
+    }
+    LOCK(cs);
+    locked = setLocked;
+    if ( !snapshot )
+    {
+        std::shared_ptr<std::vector<komodo_staking> > vec(new std::vector<komodo_staking>());
+        vec->reserve(candidates.size());
+        for (std::map<COutPoint, komodo_staking>::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
+            vec->push_back(it->second);
+        snapshot = vec;
+    }
+    return(snapshot);
+}
+
+void CStakingSet::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+{
+    LOCK(cs);
+    if ( !fValid )
+        return;
+    for (int32_t i=0; i<tx.vin.size(); i++)
+    {
+        std::map<COutPoint, komodo_staking>::iterator it = candidates.find(tx.vin[i].prevout);
+        if ( it != candidates.end() )
+        {
+            if ( pblock == 0 )
+                pending.insert(*it);
+            candidates.erase(it);
+            snapshot.reset();
+        }
+        else if ( pblock != 0 )
+            pending.erase(tx.vin[i].prevout);
+    }
+    if ( pblock != 0 )
+    {
+        // called by ConnectTip, which holds cs_main
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(pblock->GetHash());
+        if ( mi == mapBlockIndex.end() || mi->second == 0 )
+            return;
+        for (int32_t i=0; i<tx.vout.size(); i++)
+            Add(tx,i,mi->second->nHeight,pblock->nTime);
+        snapshot.reset();
+    }
+}
+
+void CStakingSet::ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added)
+{
+    LOCK(cs);
+    if ( !added )
+    {
+        // the outputs spent by a disconnected block are not known here
+        fValid = false;
+        return;
+    }
+    if ( pending.empty() )
+        return;
+    // bring back the outputs whose spends left the mempool without being mined
+    {
+        LOCK(mempool.cs);
+        for (std::map<COutPoint, komodo_staking>::iterator it = pending.begin(); it != pending.end(); )
+        {
+            if ( mempool.mapNextTx.count(it->first) == 0 )
+            {
+                candidates.insert(*it);
+                snapshot.reset();
+                pending.erase(it++);
+            }
+            else ++it;
+        }
+    }
+}
+
+void CStakingSet::RescanWallet()
+{
+    Invalidate();
+}
+
+/****
+ * Fills eligibles with komodo_stake_earliest() of each mature, unlocked candidate, split over
+ * -stakingthreads workers that take KOMODO_STAKESEARCH_CHUNK candidates at a time
+ * @returns false if the search was stopped by a new tip, a shutdown or -gen being turned off
+ */
+static bool komodo_stakesearch(std::vector<uint32_t> &eligibles,const std::vector<komodo_staking> &array,const std::set<COutPoint> &locked,const komodo_stakelimits &limits,int32_t nHeight,uint32_t prevtime,const uint8_t *segids)
 {
-    // use thread_local to prevent crash in case of accidental thread overlapping
-    thread_local std::vector<komodo_staking> array; 
-    thread_local uint32_t lasttime;
+    std::atomic<size_t> next(0); std::atomic<bool> fAbort(false),fNewTip(false); int32_t nThreads;
+    auto worker = [&]()
+    {
+        size_t begin,end,i;
+        while ( !fAbort && (begin= next.fetch_add(KOMODO_STAKESEARCH_CHUNK)) < array.size() )
+        {
+            if ( ShutdownRequested() || !GetBoolArg("-gen",false) )
+            {
+                fAbort = true;
+                break;
+            }
+            {
+                LOCK(cs_main);
+                if ( chainActive.Tip() == nullptr || chainActive.Tip()->nHeight+1 > nHeight )
+                {
+                    fAbort = fNewTip = true;
+                    break;
+                }
+            }
+            end = std::min(begin + KOMODO_STAKESEARCH_CHUNK,array.size());
+            for (i=begin; i<end; i++)
+            {
+                const komodo_staking &kp = array[i];
+                if ( kp.matureheight > nHeight-1 || (!locked.empty() && locked.count(COutPoint(kp.txid,kp.vout)) != 0) )
+                    continue;
+                eligibles[i] = komodo_stake_earliest(limits,nHeight,kp.txid,kp.vout,0,prevtime,kp.nValue,kp.txtime,kp.addrhash,segids);
+            }
+        }
+    };
+    if ( (nThreads= GetArg("-stakingthreads",0)) <= 0 )
+        nThreads = GetNumCores();
+    nThreads = std::max(1,std::min(nThreads,(int32_t)((array.size() + KOMODO_STAKESEARCH_CHUNK - 1) / KOMODO_STAKESEARCH_CHUNK)));
+    std::vector<std::thread> workers;
+    for (int32_t i=1; i<nThreads; i++)
+        workers.emplace_back(worker);
+    worker();
+    for (std::thread &t : workers)
+        t.join();
+    if ( fNewTip )
+        LogPrintf("[%s:%d] chain tip changed during staking loop t.%u\n",chainName.symbol().c_str(),nHeight,(uint32_t)time(NULL));
+    return(!fAbort);
+}
 
-    int32_t PoSperc = 0, newStakerActive; 
-    std::set<CBitcoinAddress> setAddress; int32_t winners,segid,minage,nHeight,counter=0,i,m,siglen=0,nMinDepth = 1,nMaxDepth = 99999999; std::vector<COutput> vecOutputs; uint32_t block_from_future_rejecttime,besttime,eligible,earliest = 0; CScript best_scriptPubKey; arith_uint256 mindiff,ratio,bnTarget,tmpTarget; CBlockIndex *pindex; CTxDestination address; bool fNegative,fOverflow; uint8_t hashbuf[256]; CTransaction tx; uint256 hashBlock;
+int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blocktimep,uint32_t *txtimep,uint256 *utxotxidp,int32_t *utxovoutp,uint64_t *utxovaluep,uint8_t *utxosig, uint256 merkleroot)
+{
+    int32_t PoSperc = 0, newStakerActive;
+    int32_t winners,nHeight,i,siglen=0; uint32_t block_from_future_rejecttime,besttime,eligible,prevtime,earliest = 0; CScript best_scriptPubKey; arith_uint256 bnTarget; komodo_stakelimits limits; bool fNegative,fOverflow; uint8_t hashbuf[256];
     uint64_t cbPerc = *utxovaluep, tocoinbase = 0;
     if (!EnsureWalletIsAvailable(0))
         return 0;
-    
+
     bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
     assert(pwalletMain != NULL);
     *utxovaluep = 0;
@@ -2248,86 +2687,32 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
     if ( tipindex == nullptr )
         return(0);
     nHeight = tipindex->nHeight + 1;
-    if ( (minage= nHeight*3) > 6000 ) // about 100 blocks
-        minage = 6000;
     if ( *blocktimep < tipindex->nTime+60 )
         *blocktimep = tipindex->nTime+60;
     komodo_segids(hashbuf,nHeight-101,100);
     // this was for VerusHash PoS64
     //tmpTarget = komodo_PoWtarget(&PoSperc,bnTarget,nHeight,ASSETCHAINS_STAKED);
-    bool resetstaker = false;
-    if ( array.size() != 0 )
-    {
-        LOCK(cs_main);
-        CBlockIndex* pblockindex = chainActive[tipindex->nHeight];
-        CBlock block; CTxDestination addressout;
-        if ( ReadBlockFromDisk(block, pblockindex, 1) && komodo_isPoS(&block, nHeight, &addressout) != 0 && IsMine(*pwalletMain,addressout) != 0 )
-        {
-              resetstaker = true;
-              LogPrintf( "[%s:%d] Reset ram staker after mining a block!\n",chainName.symbol().c_str(),nHeight);
-        }
-    }
 
-    if ( resetstaker || array.size() == 0 || time(NULL) > lasttime+600 )
-    {
-        LOCK2(cs_main, pwalletMain->cs_wallet);
-        pwalletMain->AvailableCoins(vecOutputs, false, NULL, true);
-        if ( array.size() != 0 )
-        {
-            array.clear();
-            lasttime = 0;
-        }
-        BOOST_FOREACH(const COutput& out, vecOutputs)
-        {
-            if ( (tipindex= chainActive.Tip()) == 0 || tipindex->nHeight+1 > nHeight )
-            {
-                LogPrintf("[%s:%d] chain tip changed during staking loop t.%u counter.%d\n",chainName.symbol().c_str(),nHeight,(uint32_t)time(NULL),counter);
-                return(0);
-            }
-            counter++;
-            if ( out.nDepth < nMinDepth || out.nDepth > nMaxDepth )
-            {
-                //LogPrintf("komodo_staked invalid depth %d\n",(int32_t)out.nDepth);
-                continue;
-            }
-            CAmount nValue = out.tx->vout[out.i].nValue;
-            if ( nValue < COIN  || !out.fSpendable )
-                continue;
-            const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-            if ( ExtractDestination(pk,address) != 0 )
-            {
-                if ( IsMine(*pwalletMain,address) == 0 )
-                    continue;
-                if ( myGetTransaction(out.tx->GetHash(),tx,hashBlock) != 0 && (pindex= komodo_getblockindex(hashBlock)) != 0 )
-                {
-                    komodo_addutxo(array,(uint32_t)pindex->nTime,(uint64_t)nValue,out.tx->GetHash(),out.i,(char *)CBitcoinAddress(address).ToString().c_str(),hashbuf,(CScript)pk);
-                    //LogPrintf("%s array.size().%d vs array.capacity().%d\n", __func__,array.size(),array.capacity());
-                }
-            }
-        }
-        lasttime = (uint32_t)time(NULL);
-        //LogPrintf("%s finished kp data of utxo for staking %u ht.%d array.size().%d array.capacity().%d\n", __func__,(uint32_t)time(NULL),nHeight,array.size(),array.capacity());
-    }
+    std::set<COutPoint> locked;
+    std::shared_ptr<const std::vector<komodo_staking> > candidates = stakingSet.GetCandidates(locked);
+    const std::vector<komodo_staking> &array = *candidates;
     block_from_future_rejecttime = (uint32_t)GetTime() + ASSETCHAINS_STAKED_BLOCK_FUTURE_MAX;    
+    komodo_stakelimits_init(&limits,bnTarget);
+    prevtime = (uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF;
+    std::vector<uint32_t> eligibles(array.size(),0);
+    int64_t nStart = GetTimeMicros();
+    if ( komodo_stakesearch(eligibles,array,locked,limits,nHeight,prevtime,hashbuf) == 0 )
+        return(0);
+    nStakingMicros = GetTimeMicros() - nStart;
+    nStakingCandidates = array.size();
     for (i=winners=0; i<array.size(); i++)
     {
-        if ( ShutdownRequested() || !GetBoolArg("-gen",false) )
-            return(0);
-        {
-            LOCK(cs_main);
-            tipindex = chainActive.Tip();
-        }
-        if ( tipindex == nullptr || tipindex->nHeight+1 > nHeight )
-        {
-            LogPrintf("[%s:%d] chain tip changed during staking loop t.%u counter.%d\n",chainName.symbol().c_str(),nHeight,(uint32_t)time(NULL),i);
-            return 0;
-        }
-        komodo_staking &kp = array[i];
-        eligible = komodo_stake(0,bnTarget,nHeight,kp.txid,kp.vout,0,(uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF,kp.address,PoSperc);
+        const komodo_staking &kp = array[i];
+        eligible = eligibles[i];
         if ( eligible > 0 )
         {
             besttime = 0;
-            if ( eligible == komodo_stake(1,bnTarget,nHeight,kp.txid,kp.vout,eligible,(uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF,kp.address,PoSperc) )
+            if ( eligible == komodo_stake2(1,bnTarget,nHeight,kp.txid,kp.vout,eligible,prevtime,kp.nValue,kp.txtime,kp.addrhash,hashbuf) )
             {
                 // have elegible utxo to stake with. 
                 if ( earliest == 0 || eligible < earliest || (eligible == earliest && (*utxovaluep == 0 || kp.nValue < *utxovaluep)) )
@@ -2349,11 +2734,6 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
             }
         }
     }
-    if ( array.size() < 500 && array.size() != 0 )
-    {
-        array.clear();
-        lasttime = 0;
-    }
     if ( earliest != 0 )
     {
         bool signSuccess; SignatureData sigdata; uint64_t txfee; uint8_t *ptr; uint256 revtxid,utxotxid;
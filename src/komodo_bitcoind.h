@@ -22,6 +22,13 @@
 #include "script/standard.h"
 #include "cc/CCinclude.h"
 #include "komodo_globals.h"
+#include "bits256.h"
+#include "sync.h"
+#include "validationinterface.h"
+
+#include <map>
+#include <memory>
+#include <set>
 
 bool EnsureWalletIsAvailable(bool avoidException);
 
@@ -184,16 +191,89 @@ uint64_t komodo_commission(const CBlock *pblock,int32_t height);
 
 uint32_t komodo_segid32(char *coinaddr);
 
+/****
+ * @param block the block of pindex, already read
+ * @returns the segid of the block staker, -1 for a PoW block
+ */
+int8_t komodo_blocksegid(const CBlock &block,CBlockIndex *pindex);
+
 int8_t komodo_segid(int32_t nocache,int32_t height);
 
+/****
+ * Put the segid of a newly connected tip in the window komodo_segids() reads, cs_main must be held
+ * @returns true if pindex->segid was not known yet and has been set
+ */
+bool komodo_segidring_connect(CBlockIndex *pindex,const CBlock &block);
+
+/****
+ * Drop the segid of a disconnected tip from the window, cs_main must be held
+ */
+void komodo_segidring_disconnect(const CBlockIndex *pindex);
+
+/****
+ * @param hashbuf receives the segids of the n active chain blocks from height, 0xff for PoW blocks
+ */
 void komodo_segids(uint8_t *hashbuf,int32_t height,int32_t n);
 
 uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256 txid,int32_t vout);
 
+/****
+ * @param address the address of a staking utxo
+ * @returns the sha256 of the address, the part of the stake hash that only depends on the address
+ */
+bits256 komodo_stakeaddrhash(const char *address);
+
+/****
+ * komodo_stakehash() with the address hash already computed
+ */
+uint32_t komodo_stakehash2(uint256 *hashp,const bits256 &addrhash,uint8_t *hashbuf,uint256 txid,int32_t vout);
+
+/****
+ * Slide the window komodo_PoWtarget() keeps for the next block over a connected or disconnected tip,
+ * a window that does not match is rebuilt on its next use. cs_main must be held
+ */
+void komodo_powwindow_connect(const CBlockIndex *pindex);
+void komodo_powwindow_disconnect(const CBlockIndex *pindex);
+
 arith_uint256 komodo_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t height,int32_t goalperc,int32_t newStakerActive);
 
 uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,char *destaddr,int32_t PoSperc);
 
+/****
+ * komodo_stake() for a utxo whose value, txtime and address hash are known, reads nothing from disk
+ * @param hashbuf the segids of komodo_segids(hashbuf,nHeight-101,100), bytes 100 and up are overwritten
+ */
+uint32_t komodo_stake2(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,uint64_t value,uint32_t txtime,const bits256 &addrhash,uint8_t *hashbuf);
+
+/****
+ * The coinage bounds of a staking target. A utxo wins at the first iteration whose coinage+1
+ * exceeds UintToArith256(hash) / winlimit, so the search compares 64 bit coinages instead of
+ * doing a 256 bit division per iteration
+ */
+struct komodo_stakelimits
+{
+    arith_uint256 bnTarget;
+    arith_uint256 ratio;
+    arith_uint256 winlimit;  // (bnTarget / ratio) + 1
+    arith_uint256 wraplimit; // (~0 / ratio) + 1, below it ratio * quotient can overflow
+    bool fMayWrap;
+    bool fExact;             // the bounds do not apply, fall back to komodo_stake2()
+};
+
+void komodo_stakelimits_init(komodo_stakelimits *limits,arith_uint256 bnTarget);
+
+/****
+ * komodo_stake2() with validateflag 0, returns the same blocktime
+ * @param segids the first 100 bytes of hashbuf as filled by komodo_segids(), not modified
+ */
+uint32_t komodo_stake_earliest(const komodo_stakelimits &limits,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,uint64_t value,uint32_t txtime,const bits256 &addrhash,const uint8_t *segids);
+
+/****
+ * @param candidatesp the candidates checked by the last staking round
+ * @returns the candidates checked per second in the last staking round
+ */
+double komodo_stakingrate(uint64_t *candidatesp);
+
 int32_t komodo_is_PoSblock(int32_t slowflag,int32_t height,CBlock *pblock,arith_uint256 bnTarget,arith_uint256 bhash);
 
 // for now, we will ignore slowFlag in the interest of keeping success/fail simpler for security purposes
@@ -225,14 +305,52 @@ int64_t komodo_coinsupply(int64_t *zfundsp,int64_t *sproutfundsp,int32_t height)
 struct komodo_staking
 {
     char address[64];
+    bits256 addrhash;
     uint256 txid;
-    arith_uint256 hashval;
     uint64_t nValue;
-    uint32_t segid32,txtime;
+    uint32_t txtime;
     int32_t vout;
+    int32_t matureheight; // tip height from which a coinbase output can be spent, 0 otherwise
     CScript scriptPubKey;
 };
 
-void komodo_addutxo(std::vector<komodo_staking> &array,uint32_t txtime,uint64_t nValue,uint256 txid,int32_t vout,char *address,uint8_t *hashbuf,CScript pk);
+/****
+ * The wallet utxos that can stake, kept up to date from the validation signals so that
+ * a staking round neither waits for the wallet lock nor reads transactions from disk.
+ * The set is only rebuilt from the wallet at the first round and after a reorg or rescan
+ */
+class CStakingSet : public CValidationInterface
+{
+public:
+    CStakingSet();
+
+    /****
+     * @param locked receives the coins locked with lockunspent, as last seen
+     * @returns the staking candidates, rebuilt from the wallet first if needed
+     */
+    std::shared_ptr<const std::vector<komodo_staking> > GetCandidates(std::set<COutPoint> &locked);
+    //! have the next round rebuild the set from the wallet
+    void Invalidate();
+
+protected:
+    void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added);
+    void RescanWallet();
+
+private:
+    CCriticalSection cs;
+    bool fValid;
+    std::map<COutPoint, komodo_staking> candidates;
+    //! candidates spent by mempool transactions, restored if the spend leaves the mempool unconfirmed
+    std::map<COutPoint, komodo_staking> pending;
+    //! the candidates as last handed out, replaced when they change
+    std::shared_ptr<const std::vector<komodo_staking> > snapshot;
+    std::set<COutPoint> setLocked;
+
+    void Add(const CTransaction &tx, int32_t vout, int32_t nHeight, uint32_t txtime);
+    bool Rebuild();
+};
+
+extern CStakingSet stakingSet;
 
 int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blocktimep,uint32_t *txtimep,uint256 *utxotxidp,int32_t *utxovoutp,uint64_t *utxovaluep,uint8_t *utxosig, uint256 merkleroot);
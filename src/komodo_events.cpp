@@ -144,14 +144,9 @@ void komodo_event_rewind(komodo_state *sp, const char *symbol, int32_t height)
             KOMODO_LASTMINED = prevKOMODO_LASTMINED;
             prevKOMODO_LASTMINED = 0;
         }
-        while ( sp->events.size() > 0)
-        {
-            auto ev = sp->events.back();
-            if (ev-> height < height)
-                    break;
-            komodo_event_undo(sp, *ev);
-            sp->events.pop_back();
-        }
+        // events are only undone through the base class, which is a no-op,
+        // so dropping everything at or above height is enough
+        sp->events.rewind(height);
     }
 }
 
@@ -451,9 +451,19 @@ bool komodo_faststateinit(komodo_state *sp,const char *fname,char *symbol, const
 {
     uint32_t starttime = (uint32_t)time(NULL);
 
-    uint8_t *filedata = nullptr;
-    long datalen;
-    if ( (filedata= OS_fileptr(&datalen,fname)) != 0 )
+    std::shared_ptr<komodo::mapped_file> file;
+    try
+    {
+        file = std::make_shared<komodo::mapped_file>(fname);
+    }
+    catch(const std::runtime_error& ex)
+    {
+        LogPrintf("%s\n", ex.what());
+        return false;
+    }
+    uint8_t *filedata = file->data();
+    long datalen = file->size();
+    if ( filedata != nullptr && datalen > 0 )
     {
         long fpos = 0;
         long lastfpos = 0;
@@ -467,12 +477,18 @@ bool komodo_faststateinit(komodo_state *sp,const char *fname,char *symbol, const
             fwrite(&prevpos100,1,sizeof(prevpos100),indfp), indcounter++;
 
         LogPrintf("processing %s %ldKB, validated.%d\n",fname,datalen/1024,-1);
+        // the events keep a position into the mapped file instead of a decoded copy
+        sp->events.set_source(file, dest);
         int32_t func;
-        while (!ShutdownRequested() && (func= komodo_parsestatefiledata(sp,filedata,&fpos,datalen,symbol,dest)) >= 0)
+        while (!ShutdownRequested() && fpos < datalen)
         {
+            sp->events.set_replay(filedata[fpos], fpos);
+            if ( (func= komodo_parsestatefiledata(sp,filedata,&fpos,datalen,symbol,dest)) < 0 )
+                break;
             lastfpos = komodo_indfile_update(indfp,&prevpos100,lastfpos,fpos,func,&indcounter);
         }
-        if (ShutdownRequested()) { fclose(indfp); return false; }
+        sp->events.set_replay(0, 0);
+        if (ShutdownRequested()) { if ( indfp != nullptr ) fclose(indfp); return false; }
         if ( indfp != nullptr )
         {
             fclose(indfp);
@@ -482,7 +498,6 @@ bool komodo_faststateinit(komodo_state *sp,const char *fname,char *symbol, const
                 LogPrintf("%s validated fpos.%ld\n",indfname.c_str(),fpos);
         }
         LogPrintf("took %d seconds to process %s %ldKB\n",(int32_t)(time(NULL)-starttime),fname,datalen/1024);
-        free(filedata);
         return true;
     }
     return false;
@@ -13,6 +13,7 @@
  *                                                                            *
  ******************************************************************************/
 #include "komodo_interest.h"
+#include "coins.h"
 #include "komodo_bitcoind.h"
 #include "komodo_utils.h" // dstr()
 #include "komodo_hardfork.h"
@@ -236,3 +237,33 @@ uint64_t komodo_accrued_interest(int32_t *txheightp,uint32_t *locktimep,uint256
     return 0;
 }
 
+/****
+ * @brief get accrued interest from the coins of the transaction, without looking the transaction up
+ * @note coins stored before they carried nLockTime fall back to komodo_accrued_interest
+ * @note like komodo_accrued_interest the interest runs to the time of the tip, whatever tipheight
+ * @param hash the transaction hash
+ * @param coins the unspent outputs of the transaction
+ * @param n the vout
+ * @param tipheight
+ * @return the interest calculated
+ */
+uint64_t komodo_coins_interest(const uint256 &hash,const CCoins &coins,int32_t n,int32_t tipheight)
+{
+    if ( !coins.fHaveLockTime )
+    {
+        int32_t txheight; uint32_t locktime;
+        return komodo_accrued_interest(&txheight,&locktime,hash,n,0,coins.vout[n].nValue,tipheight);
+    }
+    // coins of the block being connected or of the mempool have no block to look up yet,
+    // komodo_interest_args finds no block index for them and so no interest
+    if ( coins.nHeight > tipheight || coins.nLockTime == 0 )
+        return 0;
+    uint32_t tiptime = 0;
+    {
+        LOCK(cs_main);
+        CBlockIndex *tipindex;
+        if ( (tipindex= chainActive.Tip()) != 0 )
+            tiptime = (uint32_t)tipindex->nTime;
+    }
+    return komodo_interest(coins.nHeight,coins.vout[n].nValue,coins.nLockTime,tiptime);
+}
@@ -15,6 +15,8 @@
 #include "uint256.h"
 #include <cstdint>
 
+class CCoins;
+
 // each era of this many blocks reduces block reward from 3 to 2 to 1
 #define KOMODO_ENDOFERA 7777777
 
@@ -51,3 +53,14 @@ uint64_t komodo_interest(int32_t txheight,uint64_t nValue,uint32_t nLockTime,uin
  */
 uint64_t komodo_accrued_interest(int32_t *txheightp,uint32_t *locktimep,uint256 hash,int32_t n,
         int32_t checkheight,uint64_t checkvalue,int32_t tipheight);
+
+/****
+ * @brief get accrued interest from the coins of the transaction, without looking the transaction up
+ * @note coins stored before they carried nLockTime fall back to komodo_accrued_interest
+ * @param hash the transaction hash
+ * @param coins the unspent outputs of the transaction
+ * @param n the vout
+ * @param tipheight
+ * @return the interest calculated
+ */
+uint64_t komodo_coins_interest(const uint256 &hash,const CCoins &coins,int32_t n,int32_t tipheight);
@@ -35,6 +35,19 @@ struct NSPV_ntzargs
     int32_t txidht,ntzheight;
 };
 
+// responses are built without cs_main, it is only taken around the chainActive and mapBlockIndex lookups
+int32_t NSPV_tipheight()
+{
+    LOCK(cs_main);
+    return(chainActive.Tip() != 0 ? chainActive.Tip()->nHeight : 0);
+}
+
+int32_t NSPV_blockheight(uint256 hash)
+{
+    LOCK(cs_main);
+    return(komodo_blockheight(hash));
+}
+
 int32_t NSPV_notarization_find(struct NSPV_ntzargs *args,int32_t height,int32_t dir)
 {
     int32_t ntzheight = 0; uint256 hashBlock; CTransaction tx; Notarisation nota; 
@@ -78,6 +91,7 @@ int32_t NSPV_notarized_bracket(struct NSPV_ntzargs *prev,struct NSPV_ntzargs *ne
 int32_t NSPV_ntzextract(struct NSPV_ntz *ptr,uint256 ntztxid,int32_t txidht,uint256 desttxid,int32_t ntzheight)
 {
     CBlockIndex *pindex;
+    LOCK(cs_main);
     ptr->blockhash = *chainActive[ntzheight]->phashBlock;
     ptr->height = ntzheight;
     ptr->txidheight = txidht;
@@ -91,7 +105,7 @@ int32_t NSPV_ntzextract(struct NSPV_ntz *ptr,uint256 ntztxid,int32_t txidht,uint
 int32_t NSPV_getntzsresp(struct NSPV_ntzsresp *ptr,int32_t origreqheight)
 {
     struct NSPV_ntzargs prev,next; int32_t reqheight = origreqheight;
-    if ( reqheight < chainActive.Tip()->nHeight )
+    if ( reqheight < NSPV_tipheight() )
         reqheight++;
     if ( NSPV_notarized_bracket(&prev,&next,reqheight) == 0 )
     {
@@ -113,6 +127,7 @@ int32_t NSPV_getntzsresp(struct NSPV_ntzsresp *ptr,int32_t origreqheight)
 int32_t NSPV_setequihdr(struct NSPV_equihdr *hdr,int32_t height)
 {
     CBlockIndex *pindex;
+    LOCK(cs_main);
     if ( (pindex= komodo_chainactive(height)) != 0 )
     {
         hdr->nVersion = pindex->nVersion;
@@ -133,25 +148,30 @@ int32_t NSPV_setequihdr(struct NSPV_equihdr *hdr,int32_t height)
 int32_t NSPV_getinfo(struct NSPV_inforesp *ptr,int32_t reqheight)
 {
     int32_t prevMoMheight,len = 0; CBlockIndex *pindex, *pindex2; struct NSPV_ntzsresp pair;
-    if ( (pindex= chainActive.Tip()) != 0 )
     {
+        LOCK(cs_main);
+        if ( (pindex= chainActive.Tip()) == 0 )
+            return(-1);
         ptr->height = pindex->nHeight;
         ptr->blockhash = pindex->GetBlockHash();
-        memset(&pair,0,sizeof(pair));
-        if ( NSPV_getntzsresp(&pair,ptr->height-1) < 0 )
-            return(-1);
-        ptr->notarization = pair.prevntz;
+    }
+    memset(&pair,0,sizeof(pair));
+    if ( NSPV_getntzsresp(&pair,ptr->height-1) < 0 )
+        return(-1);
+    ptr->notarization = pair.prevntz;
+    {
+        LOCK(cs_main);
         if ( (pindex2= komodo_chainactive(ptr->notarization.txidheight)) != 0 )
             ptr->notarization.timestamp = pindex->nTime;
-        //LogPrintf( "timestamp.%i\n", ptr->notarization.timestamp );
-        if ( reqheight == 0 )
-            reqheight = ptr->height;
-        ptr->hdrheight = reqheight;
-        ptr->version = NSPV_PROTOCOL_VERSION;
-        if ( NSPV_setequihdr(&ptr->H,reqheight) < 0 )
-            return(-1);
-        return(sizeof(*ptr));
-    } else return(-1);
+    }
+    //LogPrintf( "timestamp.%i\n", ptr->notarization.timestamp );
+    if ( reqheight == 0 )
+        reqheight = ptr->height;
+    ptr->hdrheight = reqheight;
+    ptr->version = NSPV_PROTOCOL_VERSION;
+    if ( NSPV_setequihdr(&ptr->H,reqheight) < 0 )
+        return(-1);
+    return(sizeof(*ptr));
 }
 
 int32_t NSPV_getaddressutxos(struct NSPV_utxosresp *ptr,char *coinaddr,bool isCC,int32_t skipcount,uint32_t filter)
@@ -168,7 +188,7 @@ int32_t NSPV_getaddressutxos(struct NSPV_utxosresp *ptr,char *coinaddr,bool isCC
         skipcount = 0;
     if ( (ptr->numutxos= (int32_t)unspentOutputs.size()) >= 0 && ptr->numutxos < maxlen )
     {
-        tipheight = chainActive.Tip()->nHeight;
+        tipheight = NSPV_tipheight();
         ptr->nodeheight = tipheight;
         if ( skipcount >= ptr->numutxos )
             skipcount = ptr->numutxos-1;
@@ -334,7 +354,7 @@ int32_t NSPV_getccmoduleutxos(struct NSPV_utxosresp *ptr, char *coinaddr, int64_
     ptr->numutxos = 0;
     strncpy(ptr->coinaddr, coinaddr, sizeof(ptr->coinaddr) - 1);
     ptr->CCflag = 1;
-    tipheight = chainActive.Tip()->nHeight;  
+    tipheight = NSPV_tipheight();
     ptr->nodeheight = tipheight; // will be checked in libnspv
     //}
    
@@ -442,7 +462,7 @@ int32_t NSPV_getaddresstxids(struct NSPV_txidsresp *ptr,char *coinaddr,bool isCC
     int32_t maxlen,txheight,ind=0,n = 0,len = 0; CTransaction tx; uint256 hashBlock;
     std::vector<std::pair<CAddressIndexKey, CAmount> > txids;
     SetCCtxids(txids,coinaddr,isCC);
-    ptr->nodeheight = chainActive.Tip()->nHeight;
+    ptr->nodeheight = NSPV_tipheight();
     maxlen = MAX_BLOCK_SIZE(ptr->nodeheight) - 512;
     maxlen /= sizeof(*ptr->txids);
     strncpy(ptr->coinaddr,coinaddr,sizeof(ptr->coinaddr)-1);
@@ -623,7 +643,7 @@ int32_t NSPV_mempoolfuncs(bits256 *satoshisp,int32_t *vindexp,std::vector<uint25
 int32_t NSPV_mempooltxids(struct NSPV_mempoolresp *ptr,char *coinaddr,uint8_t isCC,uint8_t funcid,uint256 txid,int32_t vout)
 {
     std::vector<uint256> txids; bits256 satoshis; uint256 tmp,tmpdest; int32_t i,len = 0;
-    ptr->nodeheight = chainActive.Tip()->nHeight;
+    ptr->nodeheight = NSPV_tipheight();
     strncpy(ptr->coinaddr,coinaddr,sizeof(ptr->coinaddr)-1);
     ptr->CCflag = isCC;
     ptr->txid = txid;
@@ -772,11 +792,15 @@ int32_t NSPV_gettxproof(struct NSPV_txproof *ptr,int32_t vout,uint256 txid,int32
         ptr->vout = vout;
         ptr->hashblock = hashBlock;
         if ( height == 0 )
-            ptr->height = komodo_blockheight(hashBlock);
+            ptr->height = NSPV_blockheight(hashBlock);
         else
         {
             ptr->height = height;
-            if ( (pindex= komodo_chainactive(height)) != 0 && komodo_blockload(block,pindex) == 0 )
+            {
+                LOCK(cs_main);
+                pindex = komodo_chainactive(height);
+            }
+            if ( pindex != 0 && komodo_blockload(block,pindex) == 0 )
             {
                 BOOST_FOREACH(const CTransaction&tx, block.vtx)
                 {
@@ -805,6 +829,7 @@ int32_t NSPV_gettxproof(struct NSPV_txproof *ptr,int32_t vout,uint256 txid,int32
                 }
             }
         }
+        LOCK(cs_main);
         ptr->unspentvalue = CCgettxout(txid,vout,1,1);
     }
     return(sizeof(*ptr) - sizeof(ptr->tx) - sizeof(ptr->txproof) + ptr->txlen + ptr->txprooflen);
@@ -815,18 +840,18 @@ int32_t NSPV_getntzsproofresp(struct NSPV_ntzsproofresp *ptr,uint256 prevntztxid
     int32_t i; uint256 hashBlock,bhash0,bhash1,desttxid0,desttxid1; CTransaction tx;
     ptr->prevtxid = prevntztxid;
     ptr->prevntz = NSPV_getrawtx(tx,hashBlock,&ptr->prevtxlen,ptr->prevtxid);
-    ptr->prevtxidht = komodo_blockheight(hashBlock);
+    ptr->prevtxidht = NSPV_blockheight(hashBlock);
     if ( NSPV_notarizationextract(0,&ptr->common.prevht,&bhash0,&desttxid0,tx) < 0 )
         return(-2);
-    else if ( komodo_blockheight(bhash0) != ptr->common.prevht )
+    else if ( NSPV_blockheight(bhash0) != ptr->common.prevht )
         return(-3);
     
     ptr->nexttxid = nextntztxid;
     ptr->nextntz = NSPV_getrawtx(tx,hashBlock,&ptr->nexttxlen,ptr->nexttxid);
-    ptr->nexttxidht = komodo_blockheight(hashBlock);
+    ptr->nexttxidht = NSPV_blockheight(hashBlock);
     if ( NSPV_notarizationextract(0,&ptr->common.nextht,&bhash1,&desttxid1,tx) < 0 )
         return(-5);
-    else if ( komodo_blockheight(bhash1) != ptr->common.nextht )
+    else if ( NSPV_blockheight(bhash1) != ptr->common.nextht )
         return(-6);
 
     else if ( ptr->common.prevht > ptr->common.nextht || (ptr->common.nextht - ptr->common.prevht) > 1440 )
@@ -874,364 +899,434 @@ int32_t NSPV_getspentinfo(struct NSPV_spentinfo *ptr,uint256 txid,int32_t vout)
     return(len);
 }
 
-void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a request
+int32_t NSPV_response(std::vector<uint8_t> &response,std::vector<uint8_t> request) // builds the serialized response to a request
 {
-    int32_t len,slen,ind,reqheight,n; std::vector<uint8_t> response; uint32_t timestamp = (uint32_t)time(NULL);
+    int32_t len,slen,reqheight,n;
+    response.clear();
     if ( (len= request.size()) > 0 )
     {
-        if ( (ind= request[0]>>1) >= sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes) )
-            ind = (int32_t)(sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes)) - 1;
-        if ( pfrom->prevtimes[ind] > timestamp )
-            pfrom->prevtimes[ind] = 0;
         if ( request[0] == NSPV_INFO ) // info
         {
-            //LogPrintf("check info %u vs %u, ind.%d\n",timestamp,pfrom->prevtimes[ind],ind);
-            if ( timestamp > pfrom->prevtimes[ind] )
+            struct NSPV_inforesp I;
+            if ( len == 1+sizeof(reqheight) )
+                iguana_rwnum(0,&request[1],sizeof(reqheight),&reqheight);
+            else reqheight = 0;
+            //LogPrintf("request height.%d\n",reqheight);
+            memset(&I,0,sizeof(I));
+            if ( (slen= NSPV_getinfo(&I,reqheight)) > 0 )
             {
-                struct NSPV_inforesp I;
-                if ( len == 1+sizeof(reqheight) )
-                    iguana_rwnum(0,&request[1],sizeof(reqheight),&reqheight);
-                else reqheight = 0;
-                //LogPrintf("request height.%d\n",reqheight);
-                memset(&I,0,sizeof(I));
-                if ( (slen= NSPV_getinfo(&I,reqheight)) > 0 )
-                {
-                    response.resize(1 + slen);
-                    response[0] = NSPV_INFORESP;
-                    //LogPrintf("slen.%d version.%d\n",slen,I.version);
-                    if ( NSPV_rwinforesp(1,&response[1],&I) == slen )
-                    {
-                        //LogPrintf("send info resp to id %d\n",(int32_t)pfrom->id);
-                        pfrom->PushMessage("nSPV",response);
-                        pfrom->prevtimes[ind] = timestamp;
-                    }
-                    NSPV_inforesp_purge(&I);
-                }
+                response.resize(1 + slen);
+                response[0] = NSPV_INFORESP;
+                //LogPrintf("slen.%d version.%d\n",slen,I.version);
+                if ( NSPV_rwinforesp(1,&response[1],&I) != slen )
+                    response.clear();
+                NSPV_inforesp_purge(&I);
             }
         }
         else if ( request[0] == NSPV_UTXOS )
         {
             //LogPrintf("utxos: %u > %u, ind.%d, len.%d\n",timestamp,pfrom->prevtimes[ind],ind,len);
-            if ( timestamp > pfrom->prevtimes[ind] )
+            struct NSPV_utxosresp U;
+            if ( len < 64+5 && (request[1] == len-3 || request[1] == len-7 || request[1] == len-11) )
             {
-                struct NSPV_utxosresp U;
-                if ( len < 64+5 && (request[1] == len-3 || request[1] == len-7 || request[1] == len-11) )
+                int32_t skipcount = 0; char coinaddr[64]; uint8_t filter; uint8_t isCC = 0;
+                memcpy(coinaddr,&request[2],request[1]);
+                coinaddr[request[1]] = 0;
+                if ( request[1] == len-3 )
+                    isCC = (request[len-1] != 0);
+                else if ( request[1] == len-7 )
                 {
-                    int32_t skipcount = 0; char coinaddr[64]; uint8_t filter; uint8_t isCC = 0;
-                    memcpy(coinaddr,&request[2],request[1]);
-                    coinaddr[request[1]] = 0;
-                    if ( request[1] == len-3 )
-                        isCC = (request[len-1] != 0);
-                    else if ( request[1] == len-7 )
-                    {
-                        isCC = (request[len-5] != 0);
-                        iguana_rwnum(0,&request[len-4],sizeof(skipcount),&skipcount);
-                    }
-                    else
-                    {
-                        isCC = (request[len-9] != 0);
-                        iguana_rwnum(0,&request[len-8],sizeof(skipcount),&skipcount);
-                        iguana_rwnum(0,&request[len-4],sizeof(filter),&filter);
-                    }
-                    if ( 0 && isCC != 0 )
-                        LogPrintf("utxos %s isCC.%d skipcount.%d filter.%x\n",coinaddr,isCC,skipcount,filter);
-                    memset(&U,0,sizeof(U));
-                    if ( (slen= NSPV_getaddressutxos(&U,coinaddr,isCC,skipcount,filter)) > 0 )
-                    {
-                        response.resize(1 + slen);
-                        response[0] = NSPV_UTXOSRESP;
-                        if ( NSPV_rwutxosresp(1,&response[1],&U) == slen )
-                        {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
-                        }
-                        NSPV_utxosresp_purge(&U);
-                    }
+                    isCC = (request[len-5] != 0);
+                    iguana_rwnum(0,&request[len-4],sizeof(skipcount),&skipcount);
+                }
+                else
+                {
+                    isCC = (request[len-9] != 0);
+                    iguana_rwnum(0,&request[len-8],sizeof(skipcount),&skipcount);
+                    iguana_rwnum(0,&request[len-4],sizeof(filter),&filter);
+                }
+                if ( 0 && isCC != 0 )
+                    LogPrintf("utxos %s isCC.%d skipcount.%d filter.%x\n",coinaddr,isCC,skipcount,filter);
+                memset(&U,0,sizeof(U));
+                if ( (slen= NSPV_getaddressutxos(&U,coinaddr,isCC,skipcount,filter)) > 0 )
+                {
+                    response.resize(1 + slen);
+                    response[0] = NSPV_UTXOSRESP;
+                    if ( NSPV_rwutxosresp(1,&response[1],&U) != slen )
+                        response.clear();
+                    NSPV_utxosresp_purge(&U);
                 }
             }
         }
         else if ( request[0] == NSPV_TXIDS )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            struct NSPV_txidsresp T;
+            if ( len < 64+5 && (request[1] == len-3 || request[1] == len-7 || request[1] == len-11) )
             {
-                struct NSPV_txidsresp T;
-                if ( len < 64+5 && (request[1] == len-3 || request[1] == len-7 || request[1] == len-11) )
+                int32_t skipcount = 0; char coinaddr[64]; uint32_t filter; uint8_t isCC = 0;
+                memcpy(coinaddr,&request[2],request[1]);
+                coinaddr[request[1]] = 0;
+                if ( request[1] == len-3 )
+                    isCC = (request[len-1] != 0);
+                else if ( request[1] == len-7 )
+                {
+                    isCC = (request[len-5] != 0);
+                    iguana_rwnum(0,&request[len-4],sizeof(skipcount),&skipcount);
+                }
+                else
+                {
+                    isCC = (request[len-9] != 0);
+                    iguana_rwnum(0,&request[len-8],sizeof(skipcount),&skipcount);
+                    iguana_rwnum(0,&request[len-4],sizeof(filter),&filter);
+                }
+                if ( 0 && isCC != 0 )
+                    LogPrintf("txids %s isCC.%d skipcount.%d filter.%d\n",coinaddr,isCC,skipcount,filter);
+                memset(&T,0,sizeof(T));
+                if ( (slen= NSPV_getaddresstxids(&T,coinaddr,isCC,skipcount,filter)) > 0 )
                 {
-                    int32_t skipcount = 0; char coinaddr[64]; uint32_t filter; uint8_t isCC = 0;
-                    memcpy(coinaddr,&request[2],request[1]);
-                    coinaddr[request[1]] = 0;
-                    if ( request[1] == len-3 )
-                        isCC = (request[len-1] != 0);
-                    else if ( request[1] == len-7 )
-                    {
-                        isCC = (request[len-5] != 0);
-                        iguana_rwnum(0,&request[len-4],sizeof(skipcount),&skipcount);
-                    }
-                    else
-                    {
-                        isCC = (request[len-9] != 0);
-                        iguana_rwnum(0,&request[len-8],sizeof(skipcount),&skipcount);
-                        iguana_rwnum(0,&request[len-4],sizeof(filter),&filter);
-                    }
-                    if ( 0 && isCC != 0 )
-                        LogPrintf("txids %s isCC.%d skipcount.%d filter.%d\n",coinaddr,isCC,skipcount,filter);
-                    memset(&T,0,sizeof(T));
-                    if ( (slen= NSPV_getaddresstxids(&T,coinaddr,isCC,skipcount,filter)) > 0 )
-                    {
 //LogPrintf("slen.%d\n",slen);
-                        response.resize(1 + slen);
-                        response[0] = NSPV_TXIDSRESP;
-                        if ( NSPV_rwtxidsresp(1,&response[1],&T) == slen )
-                        {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
-                        }
-                        NSPV_txidsresp_purge(&T);
-                    }
-                } else LogPrintf("len.%d req1.%d\n",len,request[1]);
-            }
+                    response.resize(1 + slen);
+                    response[0] = NSPV_TXIDSRESP;
+                    if ( NSPV_rwtxidsresp(1,&response[1],&T) != slen )
+                        response.clear();
+                    NSPV_txidsresp_purge(&T);
+                }
+            } else LogPrintf("len.%d req1.%d\n",len,request[1]);
         }
         else if ( request[0] == NSPV_MEMPOOL )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            struct NSPV_mempoolresp M; char coinaddr[64];
+            if ( len < sizeof(M)+64 )
             {
-                struct NSPV_mempoolresp M; char coinaddr[64];
-                if ( len < sizeof(M)+64 )
+                int32_t vout; uint256 txid; uint8_t funcid,isCC = 0;
+                n = 1;
+                n += iguana_rwnum(0,&request[n],sizeof(isCC),&isCC);
+                n += iguana_rwnum(0,&request[n],sizeof(funcid),&funcid);
+                n += iguana_rwnum(0,&request[n],sizeof(vout),&vout);
+                n += iguana_rwbignum(0,&request[n],sizeof(txid),(uint8_t *)&txid);
+                slen = request[n++];
+                if ( slen < 63 )
                 {
-                    int32_t vout; uint256 txid; uint8_t funcid,isCC = 0;
-                    n = 1;
-                    n += iguana_rwnum(0,&request[n],sizeof(isCC),&isCC);
-                    n += iguana_rwnum(0,&request[n],sizeof(funcid),&funcid);
-                    n += iguana_rwnum(0,&request[n],sizeof(vout),&vout);
-                    n += iguana_rwbignum(0,&request[n],sizeof(txid),(uint8_t *)&txid);
-                    slen = request[n++];
-                    if ( slen < 63 )
+                    memcpy(coinaddr,&request[n],slen), n += slen;
+                    coinaddr[slen] = 0;
+                    if ( isCC != 0 )
+                        LogPrintf("(%s) isCC.%d funcid.%d %s/v%d len.%d slen.%d\n",coinaddr,isCC,funcid,txid.GetHex().c_str(),vout,len,slen);
+                    memset(&M,0,sizeof(M));
+                    if ( (slen= NSPV_mempooltxids(&M,coinaddr,isCC,funcid,txid,vout)) > 0 )
                     {
-                        memcpy(coinaddr,&request[n],slen), n += slen;
-                        coinaddr[slen] = 0;
-                        if ( isCC != 0 )
-                            LogPrintf("(%s) isCC.%d funcid.%d %s/v%d len.%d slen.%d\n",coinaddr,isCC,funcid,txid.GetHex().c_str(),vout,len,slen);
-                        memset(&M,0,sizeof(M));
-                        if ( (slen= NSPV_mempooltxids(&M,coinaddr,isCC,funcid,txid,vout)) > 0 )
-                        {
-                            //LogPrintf("NSPV_mempooltxids slen.%d\n",slen);
-                            response.resize(1 + slen);
-                            response[0] = NSPV_MEMPOOLRESP;
-                            if ( NSPV_rwmempoolresp(1,&response[1],&M) == slen )
-                            {
-                                pfrom->PushMessage("nSPV",response);
-                                pfrom->prevtimes[ind] = timestamp;
-                            }
-                            NSPV_mempoolresp_purge(&M);
-                        }
+                        //LogPrintf("NSPV_mempooltxids slen.%d\n",slen);
+                        response.resize(1 + slen);
+                        response[0] = NSPV_MEMPOOLRESP;
+                        if ( NSPV_rwmempoolresp(1,&response[1],&M) != slen )
+                            response.clear();
+                        NSPV_mempoolresp_purge(&M);
                     }
-                } else LogPrintf("len.%d req1.%d\n",len,request[1]);
-            }
+                }
+            } else LogPrintf("len.%d req1.%d\n",len,request[1]);
         }
         else if ( request[0] == NSPV_NTZS )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            struct NSPV_ntzsresp N; int32_t height;
+            if ( len == 1+sizeof(height) )
             {
-                struct NSPV_ntzsresp N; int32_t height;
-                if ( len == 1+sizeof(height) )
+                iguana_rwnum(0,&request[1],sizeof(height),&height);
+                memset(&N,0,sizeof(N));
+                if ( (slen= NSPV_getntzsresp(&N,height)) > 0 )
                 {
-                    iguana_rwnum(0,&request[1],sizeof(height),&height);
-                    memset(&N,0,sizeof(N));
-                    if ( (slen= NSPV_getntzsresp(&N,height)) > 0 )
-                    {
-                        response.resize(1 + slen);
-                        response[0] = NSPV_NTZSRESP;
-                        if ( NSPV_rwntzsresp(1,&response[1],&N) == slen )
-                        {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
-                        }
-                        NSPV_ntzsresp_purge(&N);
-                    }
+                    response.resize(1 + slen);
+                    response[0] = NSPV_NTZSRESP;
+                    if ( NSPV_rwntzsresp(1,&response[1],&N) != slen )
+                        response.clear();
+                    NSPV_ntzsresp_purge(&N);
                 }
             }
         }
         else if ( request[0] == NSPV_NTZSPROOF )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            struct NSPV_ntzsproofresp P; uint256 prevntz,nextntz;
+            if ( len == 1+sizeof(prevntz)+sizeof(nextntz) )
             {
-                struct NSPV_ntzsproofresp P; uint256 prevntz,nextntz;
-                if ( len == 1+sizeof(prevntz)+sizeof(nextntz) )
+                iguana_rwbignum(0,&request[1],sizeof(prevntz),(uint8_t *)&prevntz);
+                iguana_rwbignum(0,&request[1+sizeof(prevntz)],sizeof(nextntz),(uint8_t *)&nextntz);
+                memset(&P,0,sizeof(P));
+                if ( (slen= NSPV_getntzsproofresp(&P,prevntz,nextntz)) > 0 )
                 {
-                    iguana_rwbignum(0,&request[1],sizeof(prevntz),(uint8_t *)&prevntz);
-                    iguana_rwbignum(0,&request[1+sizeof(prevntz)],sizeof(nextntz),(uint8_t *)&nextntz);
-                    memset(&P,0,sizeof(P));
-                    if ( (slen= NSPV_getntzsproofresp(&P,prevntz,nextntz)) > 0 )
-                    {
-                        // LogPrintf("slen.%d msg prev.%s next.%s\n",slen,prevntz.GetHex().c_str(),nextntz.GetHex().c_str());
-                        response.resize(1 + slen);
-                        response[0] = NSPV_NTZSPROOFRESP;
-                        if ( NSPV_rwntzsproofresp(1,&response[1],&P) == slen )
-                        {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
-                        }
-                        NSPV_ntzsproofresp_purge(&P);
-                    } else LogPrintf("err.%d\n",slen);
-                }
+                    // LogPrintf("slen.%d msg prev.%s next.%s\n",slen,prevntz.GetHex().c_str(),nextntz.GetHex().c_str());
+                    response.resize(1 + slen);
+                    response[0] = NSPV_NTZSPROOFRESP;
+                    if ( NSPV_rwntzsproofresp(1,&response[1],&P) != slen )
+                        response.clear();
+                    NSPV_ntzsproofresp_purge(&P);
+                } else LogPrintf("err.%d\n",slen);
             }
         }
         else if ( request[0] == NSPV_TXPROOF )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            struct NSPV_txproof P; uint256 txid; int32_t height,vout;
+            if ( len == 1+sizeof(txid)+sizeof(height)+sizeof(vout) )
             {
-                struct NSPV_txproof P; uint256 txid; int32_t height,vout;
-                if ( len == 1+sizeof(txid)+sizeof(height)+sizeof(vout) )
+                iguana_rwnum(0,&request[1],sizeof(height),&height);
+                iguana_rwnum(0,&request[1+sizeof(height)],sizeof(vout),&vout);
+                iguana_rwbignum(0,&request[1+sizeof(height)+sizeof(vout)],sizeof(txid),(uint8_t *)&txid);
+                //LogPrintf("got txid %s/v%d ht.%d\n",txid.GetHex().c_str(),vout,height);
+                memset(&P,0,sizeof(P));
+                if ( (slen= NSPV_gettxproof(&P,vout,txid,height)) > 0 )
                 {
-                    iguana_rwnum(0,&request[1],sizeof(height),&height);
-                    iguana_rwnum(0,&request[1+sizeof(height)],sizeof(vout),&vout);
-                    iguana_rwbignum(0,&request[1+sizeof(height)+sizeof(vout)],sizeof(txid),(uint8_t *)&txid);
-                    //LogPrintf("got txid %s/v%d ht.%d\n",txid.GetHex().c_str(),vout,height);
-                    memset(&P,0,sizeof(P));
-                    if ( (slen= NSPV_gettxproof(&P,vout,txid,height)) > 0 )
-                    {
-                        //LogPrintf("slen.%d\n",slen);
-                        response.resize(1 + slen);
-                        response[0] = NSPV_TXPROOFRESP;
-                        if ( NSPV_rwtxproof(1,&response[1],&P) == slen )
-                        {
-                            //LogPrintf("send response\n");
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
-                        }
-                        NSPV_txproof_purge(&P);
-                    } else LogPrintf("gettxproof error.%d\n",slen);
-                } else LogPrintf("txproof reqlen.%d\n",len);
-            }
+                    //LogPrintf("slen.%d\n",slen);
+                    response.resize(1 + slen);
+                    response[0] = NSPV_TXPROOFRESP;
+                    if ( NSPV_rwtxproof(1,&response[1],&P) != slen )
+                        response.clear();
+                    NSPV_txproof_purge(&P);
+                } else LogPrintf("gettxproof error.%d\n",slen);
+            } else LogPrintf("txproof reqlen.%d\n",len);
         }
         else if ( request[0] == NSPV_SPENTINFO )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            struct NSPV_spentinfo S; int32_t vout; uint256 txid;
+            if ( len == 1+sizeof(txid)+sizeof(vout) )
             {
-                struct NSPV_spentinfo S; int32_t vout; uint256 txid;
-                if ( len == 1+sizeof(txid)+sizeof(vout) )
+                iguana_rwnum(0,&request[1],sizeof(vout),&vout);
+                iguana_rwbignum(0,&request[1+sizeof(vout)],sizeof(txid),(uint8_t *)&txid);
+                memset(&S,0,sizeof(S));
+                if ( (slen= NSPV_getspentinfo(&S,txid,vout)) > 0 )
                 {
-                    iguana_rwnum(0,&request[1],sizeof(vout),&vout);
-                    iguana_rwbignum(0,&request[1+sizeof(vout)],sizeof(txid),(uint8_t *)&txid);
-                    memset(&S,0,sizeof(S));
-                    if ( (slen= NSPV_getspentinfo(&S,txid,vout)) > 0 )
-                    {
-                        response.resize(1 + slen);
-                        response[0] = NSPV_SPENTINFORESP;
-                        if ( NSPV_rwspentinfo(1,&response[1],&S) == slen )
-                        {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
-                        }
-                        NSPV_spentinfo_purge(&S);
-                    }
+                    response.resize(1 + slen);
+                    response[0] = NSPV_SPENTINFORESP;
+                    if ( NSPV_rwspentinfo(1,&response[1],&S) != slen )
+                        response.clear();
+                    NSPV_spentinfo_purge(&S);
                 }
             }
         }
         else if ( request[0] == NSPV_BROADCAST )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            struct NSPV_broadcastresp B; uint32_t n,offset; uint256 txid;
+            if ( len > 1+sizeof(txid)+sizeof(n) )
             {
-                struct NSPV_broadcastresp B; uint32_t n,offset; uint256 txid;
-                if ( len > 1+sizeof(txid)+sizeof(n) )
+                iguana_rwbignum(0,&request[1],sizeof(txid),(uint8_t *)&txid);
+                iguana_rwnum(0,&request[1+sizeof(txid)],sizeof(n),&n);
+                memset(&B,0,sizeof(B));
+                offset = 1 + sizeof(txid) + sizeof(n);
+                if ( n < MAX_TX_SIZE_AFTER_SAPLING && request.size() == offset+n && (slen= NSPV_sendrawtransaction(&B,&request[offset],n)) > 0 )
                 {
-                    iguana_rwbignum(0,&request[1],sizeof(txid),(uint8_t *)&txid);
-                    iguana_rwnum(0,&request[1+sizeof(txid)],sizeof(n),&n);
-                    memset(&B,0,sizeof(B));
-                    offset = 1 + sizeof(txid) + sizeof(n);
-                    if ( n < MAX_TX_SIZE_AFTER_SAPLING && request.size() == offset+n && (slen= NSPV_sendrawtransaction(&B,&request[offset],n)) > 0 )
-                    {
-                        response.resize(1 + slen);
-                        response[0] = NSPV_BROADCASTRESP;
-                        if ( NSPV_rwbroadcastresp(1,&response[1],&B) == slen )
-                        {
-                            pfrom->PushMessage("nSPV",response);
-                            pfrom->prevtimes[ind] = timestamp;
-                        }
-                        NSPV_broadcast_purge(&B);
-                    }
+                    response.resize(1 + slen);
+                    response[0] = NSPV_BROADCASTRESP;
+                    if ( NSPV_rwbroadcastresp(1,&response[1],&B) != slen )
+                        response.clear();
+                    NSPV_broadcast_purge(&B);
                 }
             }
         }
         else if ( request[0] == NSPV_REMOTERPC )
         {
-            if ( timestamp > pfrom->prevtimes[ind] )
+            struct NSPV_remoterpcresp R; int32_t p;
+            p = 1;
+            p+=iguana_rwnum(0,&request[p],sizeof(slen),&slen);
+            memset(&R,0,sizeof(R));
+            if (request.size() == p+slen && (slen=NSPV_remoterpc(&R,(char *)&request[p],slen))>0 )
             {
-                struct NSPV_remoterpcresp R; int32_t p;
-                p = 1;
-                p+=iguana_rwnum(0,&request[p],sizeof(slen),&slen);
-                memset(&R,0,sizeof(R));
-                if (request.size() == p+slen && (slen=NSPV_remoterpc(&R,(char *)&request[p],slen))>0 )
-                {
-                    response.resize(1 + slen);
-                    response[0] = NSPV_REMOTERPCRESP;
-                    NSPV_rwremoterpcresp(1,&response[1],&R,slen);
-                    pfrom->PushMessage("nSPV",response);
-                    pfrom->prevtimes[ind] = timestamp;
-                    NSPV_remoterpc_purge(&R);
-                }                
-            }
+                response.resize(1 + slen);
+                response[0] = NSPV_REMOTERPCRESP;
+                NSPV_rwremoterpcresp(1,&response[1],&R,slen);
+                NSPV_remoterpc_purge(&R);
+            }                
         }
         else if (request[0] == NSPV_CCMODULEUTXOS)  // get cc module utxos from coinaddr for the requested amount, evalcode, funcid list and txid
         {
-            //LogPrintf("utxos: %u > %u, ind.%d, len.%d\n",timestamp,pfrom->prevtimes[ind],ind,len);
-            if (timestamp > pfrom->prevtimes[ind])
+            struct NSPV_utxosresp U;
+            char coinaddr[64];
+            int64_t amount;
+            uint8_t evalcode;
+            char funcids[27];
+            uint256 filtertxid;
+            bool errorFormat = false;
+            const int32_t BITCOINADDRESSMINLEN = 20;
+
+            int32_t minreqlen = sizeof(uint8_t) + sizeof(uint8_t) + BITCOINADDRESSMINLEN + sizeof(amount) + sizeof(evalcode) + sizeof(uint8_t) + sizeof(filtertxid);
+            int32_t maxreqlen = sizeof(uint8_t) + sizeof(uint8_t) + sizeof(coinaddr)-1 + sizeof(amount) + sizeof(evalcode) + sizeof(uint8_t) + sizeof(funcids)-1 + sizeof(filtertxid);
+
+            if (len >= minreqlen && len <= maxreqlen)
             {
-                struct NSPV_utxosresp U;
-                char coinaddr[64];
-                int64_t amount;
-                uint8_t evalcode;
-                char funcids[27];
-                uint256 filtertxid;
-                bool errorFormat = false;
-                const int32_t BITCOINADDRESSMINLEN = 20;
-
-                int32_t minreqlen = sizeof(uint8_t) + sizeof(uint8_t) + BITCOINADDRESSMINLEN + sizeof(amount) + sizeof(evalcode) + sizeof(uint8_t) + sizeof(filtertxid);
-                int32_t maxreqlen = sizeof(uint8_t) + sizeof(uint8_t) + sizeof(coinaddr)-1 + sizeof(amount) + sizeof(evalcode) + sizeof(uint8_t) + sizeof(funcids)-1 + sizeof(filtertxid);
-
-                if (len >= minreqlen && len <= maxreqlen)
+                n = 1;
+                int32_t addrlen = request[n++];
+                if (addrlen < sizeof(coinaddr))
                 {
-                    n = 1;
-                    int32_t addrlen = request[n++];
-                    if (addrlen < sizeof(coinaddr))
+                    memcpy(coinaddr, &request[n], addrlen);
+                    coinaddr[addrlen] = 0;
+                    n += addrlen;
+                    iguana_rwnum(0, &request[n], sizeof(amount), &amount);
+                    n += sizeof(amount);
+                    iguana_rwnum(0, &request[n], sizeof(evalcode), &evalcode);
+                    n += sizeof(evalcode);
+
+                    int32_t funcidslen = request[n++];
+                    if (funcidslen < sizeof(funcids))
                     {
-                        memcpy(coinaddr, &request[n], addrlen);
-                        coinaddr[addrlen] = 0;
-                        n += addrlen;
-                        iguana_rwnum(0, &request[n], sizeof(amount), &amount);
-                        n += sizeof(amount);
-                        iguana_rwnum(0, &request[n], sizeof(evalcode), &evalcode);
-                        n += sizeof(evalcode);
-
-                        int32_t funcidslen = request[n++];
-                        if (funcidslen < sizeof(funcids))
+                        memcpy(funcids, &request[n], funcidslen);
+                        funcids[funcidslen] = 0;
+                        n += funcidslen;
+                        iguana_rwbignum(0, &request[n], sizeof(filtertxid), (uint8_t *)&filtertxid);
+                        std::cerr << __func__ << " " << "request addr=" << coinaddr << " amount=" << amount << " evalcode=" << (int)evalcode << " funcids=" << funcids << " filtertxid=" << filtertxid.GetHex() << std::endl;
+
+                        memset(&U, 0, sizeof(U));
+                        if ((slen = NSPV_getccmoduleutxos(&U, coinaddr, amount, evalcode, funcids, filtertxid)) > 0)
                         {
-                            memcpy(funcids, &request[n], funcidslen);
-                            funcids[funcidslen] = 0;
-                            n += funcidslen;
-                            iguana_rwbignum(0, &request[n], sizeof(filtertxid), (uint8_t *)&filtertxid);
-                            std::cerr << __func__ << " " << "request addr=" << coinaddr << " amount=" << amount << " evalcode=" << (int)evalcode << " funcids=" << funcids << " filtertxid=" << filtertxid.GetHex() << std::endl;
-
-                            memset(&U, 0, sizeof(U));
-                            if ((slen = NSPV_getccmoduleutxos(&U, coinaddr, amount, evalcode, funcids, filtertxid)) > 0)
-                            {
-                                std::cerr << __func__ << " " << "created utxos, slen=" << slen << std::endl;
-                                response.resize(1 + slen);
-                                response[0] = NSPV_CCMODULEUTXOSRESP;
-                                if (NSPV_rwutxosresp(1, &response[1], &U) == slen)
-                                {
-                                    pfrom->PushMessage("nSPV", response);
-                                    pfrom->prevtimes[ind] = timestamp;
-                                    std::cerr << __func__ << " " << "returned nSPV response" << std::endl;
-                                }
-                                NSPV_utxosresp_purge(&U);
-                            }
+                            std::cerr << __func__ << " " << "created utxos, slen=" << slen << std::endl;
+                            response.resize(1 + slen);
+                            response[0] = NSPV_CCMODULEUTXOSRESP;
+                            if ( NSPV_rwutxosresp(1, &response[1], &U) != slen )
+                                response.clear();
+                            NSPV_utxosresp_purge(&U);
                         }
                     }
                 }
             }
         }
     }
+    return((int32_t)response.size());
+}
+
+/**
+ * Requests are answered by the ThreadNSPVRequests() workers instead of the message handler thread.
+ * Every peer has its own bounded queue and the workers take one request per peer in turn, so a
+ * single busy wallet cannot starve the others. Responses that only depend on the chain are cached
+ * for the current tip: a popular address or proof is built once per block.
+ */
+#define NSPV_MAXPEERQUEUE 8
+#define NSPV_MAXQUEUE 512
+#define NSPV_MAXCACHEBYTES (64 << 20)
+
+struct NSPV_peerqueue { CNode *pfrom; std::deque<std::vector<uint8_t> > requests; };
+
+static boost::mutex NSPV_queuemutex;
+static boost::condition_variable NSPV_queuecond;
+static std::map<NodeId,NSPV_peerqueue> NSPV_queues;
+static std::deque<NodeId> NSPV_readypeers; // peers with queued requests, in turn
+static int32_t NSPV_numqueued;
+
+static CCriticalSection cs_NSPV_cache;
+static uint256 NSPV_cachetip;
+static std::map<std::vector<uint8_t>,std::vector<uint8_t> > NSPV_cache;
+static size_t NSPV_cachebytes;
+
+int32_t NSPV_cacheable(uint8_t reqtype) // what depends on the mempool or has side effects changes without a new block
+{
+    switch ( reqtype )
+    {
+        case NSPV_UTXOS:            // skips outputs spent in the mempool
+        case NSPV_CCMODULEUTXOS:
+        case NSPV_TXPROOF:          // unspent value includes the mempool
+        case NSPV_SPENTINFO:
+        case NSPV_MEMPOOL:
+        case NSPV_BROADCAST:
+        case NSPV_REMOTERPC:
+            return(0);
+        default:
+            return(1);
+    }
+}
+
+int32_t NSPV_cachedresponse(std::vector<uint8_t> &response,const std::vector<uint8_t> &request)
+{
+    uint256 tiphash;
+    if ( request[0] == NSPV_BROADCAST || request[0] == NSPV_REMOTERPC ) // these take their own locks
+        return(NSPV_response(response,request));
+    {
+        LOCK(cs_main);
+        if ( chainActive.Tip() == 0 )
+            return(0);
+        tiphash = chainActive.Tip()->GetBlockHash();
+    }
+    if ( NSPV_cacheable(request[0]) != 0 )
+    {
+        LOCK(cs_NSPV_cache);
+        if ( NSPV_cachetip != tiphash )
+        {
+            NSPV_cache.clear();
+            NSPV_cachebytes = 0;
+            NSPV_cachetip = tiphash;
+        }
+        std::map<std::vector<uint8_t>,std::vector<uint8_t> >::const_iterator it = NSPV_cache.find(request);
+        if ( it != NSPV_cache.end() )
+        {
+            response = it->second;
+            return((int32_t)response.size());
+        }
+    }
+    if ( NSPV_response(response,request) > 0 && NSPV_cacheable(request[0]) != 0 )
+    {
+        LOCK(cs_NSPV_cache);
+        // a new tip may have reset the cache while the response was built
+        if ( NSPV_cachetip == tiphash && NSPV_cachebytes + request.size() + response.size() <= NSPV_MAXCACHEBYTES )
+        {
+            NSPV_cache[request] = response;
+            NSPV_cachebytes += request.size() + response.size();
+        }
+    }
+    return((int32_t)response.size());
+}
+
+void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a request
+{
+    int32_t ind; uint32_t timestamp = (uint32_t)time(NULL);
+    if ( request.size() == 0 )
+        return;
+    if ( (ind= request[0]>>1) >= sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes) )
+        ind = (int32_t)(sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes)) - 1;
+    {
+        boost::unique_lock<boost::mutex> lock(NSPV_queuemutex);
+        if ( pfrom->prevtimes[ind] > timestamp )
+            pfrom->prevtimes[ind] = 0;
+        if ( timestamp <= pfrom->prevtimes[ind] )
+            return;
+        NSPV_peerqueue &queue = NSPV_queues[pfrom->GetId()];
+        if ( NSPV_numqueued >= NSPV_MAXQUEUE || queue.requests.size() >= NSPV_MAXPEERQUEUE )
+        {
+            LogPrint("nspv","nSPV request type.%d from peer=%d dropped, %d queued\n",request[0],pfrom->GetId(),NSPV_numqueued);
+            if ( queue.requests.empty() )
+                NSPV_queues.erase(pfrom->GetId());
+            return;
+        }
+        if ( queue.requests.empty() )
+        {
+            queue.pfrom = pfrom;
+            NSPV_readypeers.push_back(pfrom->GetId());
+        }
+        pfrom->AddRef();
+        queue.requests.push_back(request);
+        NSPV_numqueued++;
+        pfrom->prevtimes[ind] = timestamp; // only accepted requests count against the peer
+    }
+    NSPV_queuecond.notify_one();
+}
+
+void ThreadNSPVRequests()
+{
+    RenameThread("komodo-nspv");
+    while ( true )
+    {
+        boost::this_thread::interruption_point();
+        CNode *pfrom; std::vector<uint8_t> request,response;
+        {
+            boost::unique_lock<boost::mutex> lock(NSPV_queuemutex);
+            while ( NSPV_readypeers.empty() )
+                NSPV_queuecond.wait(lock);
+            NodeId id = NSPV_readypeers.front();
+            NSPV_readypeers.pop_front();
+            NSPV_peerqueue &queue = NSPV_queues[id];
+            pfrom = queue.pfrom;
+            request.swap(queue.requests.front());
+            queue.requests.pop_front();
+            NSPV_numqueued--;
+            if ( queue.requests.empty() )
+                NSPV_queues.erase(id);
+            else NSPV_readypeers.push_back(id);
+        }
+        if ( !pfrom->fDisconnect && NSPV_cachedresponse(response,request) > 0 )
+            pfrom->PushMessage("nSPV",response);
+        pfrom->Release();
+    }
 }
 
 #endif // KOMODO_NSPVFULLNODE_H
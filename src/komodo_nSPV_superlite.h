@@ -17,8 +17,12 @@
 #ifndef KOMODO_NSPVSUPERLITE_H
 #define KOMODO_NSPVSUPERLITE_H
 
-// nSPV client. VERY simplistic "single threaded" networking model. for production GUI best to multithread, etc.
-// no caching, no optimizations, no reducing the number of ntzsproofs needed by detecting overlaps, etc.
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+// nSPV client. simplistic networking model: a request blocks its caller until komodo_nSPVresp() signals the answer.
+// responses are cached, but no reducing the number of ntzsproofs needed by detecting overlaps, etc.
 // advantage is that it is simpler to implement and understand to create a design for a more performant version
 
 
@@ -39,93 +43,123 @@ struct NSPV_ntzsproofresp NSPV_ntzsproofresult;
 struct NSPV_txproof NSPV_txproofresult;
 struct NSPV_broadcastresp NSPV_broadcastresult;
 
-struct NSPV_ntzsresp NSPV_ntzsresp_cache[NSPV_MAXVINS];
-struct NSPV_ntzsproofresp NSPV_ntzsproofresp_cache[NSPV_MAXVINS * 2];
-struct NSPV_txproof NSPV_txproof_cache[NSPV_MAXVINS * 4];
+/**
+ * Responses are stored by komodo_nSPVresp() under cs_NSPVresp, which then wakes up the
+ * NSPV_request() callers waiting for them on NSPV_respcond. A caller knows its response by
+ * the request fields echoed in it (txid, height, address...), the wire format has no ids.
+ */
+static CWaitableCriticalSection cs_NSPVresp;
+static CConditionVariable NSPV_respcond;
+static std::map<uint256,uint32_t> NSPV_txproofs_pending; // txproof requests sent ahead by NSPV_txproof_prefetch
+
+struct NSPV_uint256hasher
+{
+    size_t operator()(const uint256 &hash) const { return(hash.GetCheapHash()); }
+};
+
+struct NSPV_uint256pairhasher
+{
+    size_t operator()(const std::pair<uint256,uint256> &hashes) const { return(hashes.first.GetCheapHash() ^ (hashes.second.GetCheapHash() * 31)); }
+};
+
+// fixed size cache of responses, the least recently used one is purged to make room
+template <typename K,typename V,typename H = std::hash<K> >
+class NSPV_lrucache
+{
+    typedef std::list<std::pair<K,V> > itemlist;
+    itemlist items;
+    std::unordered_map<K,typename itemlist::iterator,H> index;
+    size_t maxitems;
+    void (*purge)(V *);
+public:
+    NSPV_lrucache(size_t maxitemsIn,void (*purgeIn)(V *)) : maxitems(maxitemsIn), purge(purgeIn) {}
+    ~NSPV_lrucache() { clear(); }
+
+    V *find(const K &key)
+    {
+        typename std::unordered_map<K,typename itemlist::iterator,H>::iterator it = index.find(key);
+        if ( it == index.end() )
+            return(0);
+        items.splice(items.begin(),items,it->second);
+        return(&it->second->second);
+    }
+
+    V *insert(const K &key) // returns the emptied entry for key
+    {
+        V *ptr;
+        if ( (ptr= find(key)) != 0 )
+        {
+            (*purge)(ptr);
+            return(ptr);
+        }
+        if ( items.size() >= maxitems )
+        {
+            (*purge)(&items.back().second);
+            index.erase(items.back().first);
+            items.pop_back();
+        }
+        items.push_front(std::make_pair(key,V()));
+        memset(&items.front().second,0,sizeof(V));
+        index[key] = items.begin();
+        return(&items.front().second);
+    }
+
+    void clear()
+    {
+        for (typename itemlist::iterator it = items.begin(); it != items.end(); ++it)
+            (*purge)(&it->second);
+        items.clear();
+        index.clear();
+    }
+};
+
+static NSPV_lrucache<int32_t,struct NSPV_ntzsresp> NSPV_ntzsresp_cache(NSPV_MAXVINS,NSPV_ntzsresp_purge);
+static NSPV_lrucache<std::pair<uint256,uint256>,struct NSPV_ntzsproofresp,NSPV_uint256pairhasher> NSPV_ntzsproofresp_cache(NSPV_MAXVINS * 2,NSPV_ntzsproofresp_purge);
+static NSPV_lrucache<uint256,struct NSPV_txproof,NSPV_uint256hasher> NSPV_txproof_cache(NSPV_MAXVINS * 4,NSPV_txproof_purge);
+
+// the cache functions are called with cs_NSPVresp held
 
 struct NSPV_ntzsresp *NSPV_ntzsresp_find(int32_t reqheight)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache); i++)
-        if ( NSPV_ntzsresp_cache[i].reqheight == reqheight )
-            return(&NSPV_ntzsresp_cache[i]);
-    return(0);
+    return(NSPV_ntzsresp_cache.find(reqheight));
 }
 
 struct NSPV_ntzsresp *NSPV_ntzsresp_add(struct NSPV_ntzsresp *ptr)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache); i++)
-        if ( NSPV_ntzsresp_cache[i].reqheight == 0 )
-            break;
-    if ( i == sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache) )
-        i = (rand() % (sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache)));
-    NSPV_ntzsresp_purge(&NSPV_ntzsresp_cache[i]);
-    NSPV_ntzsresp_copy(&NSPV_ntzsresp_cache[i],ptr);
+    struct NSPV_ntzsresp *entry = NSPV_ntzsresp_cache.insert(ptr->reqheight);
+    NSPV_ntzsresp_copy(entry,ptr);
     LogPrintf("ADD CACHE ntzsresp req.%d\n",ptr->reqheight);
-    return(&NSPV_ntzsresp_cache[i]);
+    return(entry);
 }
 
 struct NSPV_txproof *NSPV_txproof_find(uint256 txid)
 {
-    int32_t i; struct NSPV_txproof *backup = 0;
-    for (i=0; i<sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache); i++)
-        if ( NSPV_txproof_cache[i].txid == txid )
-        {
-            if ( NSPV_txproof_cache[i].txprooflen != 0 )
-                return(&NSPV_txproof_cache[i]);
-            else backup = &NSPV_txproof_cache[i];
-        }
-    return(backup);
+    return(NSPV_txproof_cache.find(txid));
 }
 
 struct NSPV_txproof *NSPV_txproof_add(struct NSPV_txproof *ptr)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache); i++)
-        if ( NSPV_txproof_cache[i].txid == ptr->txid )
-        {
-            if ( NSPV_txproof_cache[i].txprooflen == 0 && ptr->txprooflen != 0 )
-            {
-                NSPV_txproof_purge(&NSPV_txproof_cache[i]);
-                NSPV_txproof_copy(&NSPV_txproof_cache[i],ptr);
-                return(&NSPV_txproof_cache[i]);
-            }
-            else if ( NSPV_txproof_cache[i].txprooflen != 0 || ptr->txprooflen == 0 )
-                return(&NSPV_txproof_cache[i]);
-        }
-    for (i=0; i<sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache); i++)
-        if ( NSPV_txproof_cache[i].txlen == 0 )
-            break;
-    if ( i == sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache) )
-        i = (rand() % (sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache)));
-    NSPV_txproof_purge(&NSPV_txproof_cache[i]);
-    NSPV_txproof_copy(&NSPV_txproof_cache[i],ptr);
+    struct NSPV_txproof *entry;
+    // a proof without the merkle branch never replaces one with it
+    if ( (entry= NSPV_txproof_cache.find(ptr->txid)) != 0 && (entry->txprooflen != 0 || ptr->txprooflen == 0) )
+        return(entry);
+    entry = NSPV_txproof_cache.insert(ptr->txid);
+    NSPV_txproof_copy(entry,ptr);
     LogPrintf("ADD CACHE txproof %s\n",ptr->txid.GetHex().c_str());
-    return(&NSPV_txproof_cache[i]);
+    return(entry);
 }
 
 struct NSPV_ntzsproofresp *NSPV_ntzsproof_find(uint256 prevtxid,uint256 nexttxid)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache); i++)
-        if ( NSPV_ntzsproofresp_cache[i].prevtxid == prevtxid && NSPV_ntzsproofresp_cache[i].nexttxid == nexttxid )
-            return(&NSPV_ntzsproofresp_cache[i]);
-    return(0);
+    return(NSPV_ntzsproofresp_cache.find(std::make_pair(prevtxid,nexttxid)));
 }
 
 struct NSPV_ntzsproofresp *NSPV_ntzsproof_add(struct NSPV_ntzsproofresp *ptr)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache); i++)
-        if ( NSPV_ntzsproofresp_cache[i].common.hdrs == 0 )
-            break;
-    if ( i == sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache) )
-        i = (rand() % (sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache)));
-    NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresp_cache[i]);
-    NSPV_ntzsproofresp_copy(&NSPV_ntzsproofresp_cache[i],ptr);
+    struct NSPV_ntzsproofresp *entry = NSPV_ntzsproofresp_cache.insert(std::make_pair(ptr->prevtxid,ptr->nexttxid));
+    NSPV_ntzsproofresp_copy(entry,ptr);
     LogPrintf("ADD CACHE ntzsproof %s %s\n",ptr->prevtxid.GetHex().c_str(),ptr->nexttxid.GetHex().c_str());
-    return(&NSPV_ntzsproofresp_cache[i]);
+    return(entry);
 }
 
 // komodo_nSPVresp is called from async message processing
@@ -133,6 +167,7 @@ struct NSPV_ntzsproofresp *NSPV_ntzsproof_add(struct NSPV_ntzsproofresp *ptr)
 void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a response
 {
     struct NSPV_inforesp I; int32_t len; uint32_t timestamp = (uint32_t)time(NULL);
+    boost::unique_lock<boost::mutex> lock(cs_NSPVresp);
     strncpy(NSPV_lastpeer,pfrom->addr.ToString().c_str(),sizeof(NSPV_lastpeer)-1);
     if ( (len= response.size()) > 0 )
     {
@@ -187,11 +222,21 @@ void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a r
                 LogPrintf("got ntzproof response %u size.%d prev.%d next.%d\n",timestamp,(int32_t)response.size(),NSPV_ntzsproofresult.common.prevht,NSPV_ntzsproofresult.common.nextht);
                 break;
             case NSPV_TXPROOFRESP:
-                NSPV_txproof_purge(&NSPV_txproofresult);
-                NSPV_rwtxproof(0,&response[1],&NSPV_txproofresult);
-                if ( NSPV_txproof_find(NSPV_txproofresult.txid) == 0 )
-                    NSPV_txproof_add(&NSPV_txproofresult);
-                LogPrintf("got txproof response %u size.%d %s ht.%d\n",timestamp,(int32_t)response.size(),NSPV_txproofresult.txid.GetHex().c_str(),NSPV_txproofresult.height);
+                {
+                    struct NSPV_txproof P;
+                    memset(&P,0,sizeof(P));
+                    NSPV_rwtxproof(0,&response[1],&P);
+                    NSPV_txproof_add(&P);
+                    LogPrintf("got txproof response %u size.%d %s ht.%d\n",timestamp,(int32_t)response.size(),P.txid.GetHex().c_str(),P.height);
+                    // prefetched proofs only go to the cache, NSPV_txproofresult is for the request waiting on it
+                    if ( NSPV_txproofs_pending.erase(P.txid) != 0 )
+                        NSPV_txproof_purge(&P);
+                    else
+                    {
+                        NSPV_txproof_purge(&NSPV_txproofresult);
+                        NSPV_txproofresult = P;
+                    }
+                }
                 break;
             case NSPV_SPENTINFORESP:
                 NSPV_spentinfo_purge(&NSPV_spentresult);
@@ -212,6 +257,7 @@ void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a r
             default: LogPrintf("unexpected response %02x size.%d at %u\n",response[0],(int32_t)response.size(),timestamp);
                 break;
         }
+        NSPV_respcond.notify_all();
     }
 }
 
@@ -258,6 +304,30 @@ CNode *NSPV_req(CNode *pnode,uint8_t *msg,int32_t len,uint64_t mask,int32_t ind)
     return(0);
 }
 
+// waits until ready() holds, it is checked again whenever a response arrives
+int32_t NSPV_wait(int64_t micros,const std::function<bool()> &ready)
+{
+    boost::unique_lock<boost::mutex> lock(cs_NSPVresp);
+    return(NSPV_respcond.wait_for(lock,boost::chrono::microseconds(micros),ready));
+}
+
+// sends the request to a peer and waits for the response satisfying ready(), at most three times
+int32_t NSPV_request(uint8_t *msg,int32_t len,uint64_t mask,const std::function<bool()> &ready)
+{
+    int32_t iter;
+    for (iter=0; iter<3; iter++)
+    {
+        if ( NSPV_req(0,msg,len,mask,msg[0]>>1) != 0 )
+        {
+            if ( NSPV_wait((int64_t)NSPV_POLLITERS * NSPV_POLLMICROS,ready) != 0 )
+                return(1);
+        }
+        else if ( NSPV_wait(1000000,ready) != 0 ) // every peer was asked this second
+            return(1);
+    }
+    return(0);
+}
+
 UniValue NSPV_logout()
 {
     UniValue result(UniValue::VOBJ);
@@ -265,9 +335,13 @@ UniValue NSPV_logout()
     if ( NSPV_logintime != 0 )
         LogPrintf("scrub wif and privkey from NSPV memory\n");
     else result.push_back(Pair("status","wasnt logged in"));
-    memset(NSPV_ntzsproofresp_cache,0,sizeof(NSPV_ntzsproofresp_cache));
-    memset(NSPV_txproof_cache,0,sizeof(NSPV_txproof_cache));
-    memset(NSPV_ntzsresp_cache,0,sizeof(NSPV_ntzsresp_cache));
+    {
+        boost::unique_lock<boost::mutex> lock(cs_NSPVresp);
+        NSPV_ntzsproofresp_cache.clear();
+        NSPV_txproof_cache.clear();
+        NSPV_ntzsresp_cache.clear();
+        NSPV_txproofs_pending.clear();
+    }
     memset(NSPV_wifstr,0,sizeof(NSPV_wifstr));
     memset(&NSPV_key,0,sizeof(NSPV_key));
     NSPV_logintime = 0;
@@ -553,20 +627,12 @@ UniValue NSPV_login(char *wifstr)
 
 UniValue NSPV_getinfo_req(int32_t reqht)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_inforesp I;
+    uint8_t msg[512]; int32_t len = 0; struct NSPV_inforesp I;
     NSPV_inforesp_purge(&NSPV_inforesult);
     msg[len++] = NSPV_INFO;
     len += iguana_rwnum(1,&msg[len],sizeof(reqht),&reqht);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
-    {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_inforesult.height != 0 )
-                return(NSPV_getinfo_json(&NSPV_inforesult));
-        }
-    } else sleep(1);
+    if ( NSPV_request(msg,len,NODE_NSPV,[&]() { return(NSPV_inforesult.height != 0); }) != 0 )
+        return(NSPV_getinfo_json(&NSPV_inforesult));
     memset(&I,0,sizeof(I));
     return(NSPV_getinfo_json(&NSPV_inforesult));
 }
@@ -591,7 +657,7 @@ uint32_t NSPV_blocktime(int32_t hdrheight)
 
 UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter)
 {
-    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t i,iter,slen,len = 0;
+    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t slen,len = 0;
     //LogPrintf("utxos %s NSPV addr %s\n",coinaddr,NSPV_address.c_str());
     //if ( NSPV_utxosresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_utxosresult.coinaddr) == 0 && CCflag == NSPV_utxosresult.CCflag  && skipcount == NSPV_utxosresult.skipcount && filter == NSPV_utxosresult.filter )
     //    return(NSPV_utxosresp_json(&NSPV_utxosresult));
@@ -611,16 +677,8 @@ UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
     msg[len++] = (CCflag != 0);
     len += iguana_rwnum(1,&msg[len],sizeof(skipcount),&skipcount);
     len += iguana_rwnum(1,&msg[len],sizeof(filter),&filter);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_ADDRINDEX,msg[0]>>1) != 0 )
-    {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( (NSPV_inforesult.height == 0 || NSPV_utxosresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr,NSPV_utxosresult.coinaddr) == 0 && CCflag == NSPV_utxosresult.CCflag )
-                return(NSPV_utxosresp_json(&NSPV_utxosresult));
-        }
-    } else sleep(1);
+    if ( NSPV_request(msg,len,NODE_ADDRINDEX,[&]() { return((NSPV_inforesult.height == 0 || NSPV_utxosresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr,NSPV_utxosresult.coinaddr) == 0 && CCflag == NSPV_utxosresult.CCflag); }) != 0 )
+        return(NSPV_utxosresp_json(&NSPV_utxosresult));
     result.push_back(Pair("result","error"));
     result.push_back(Pair("error","no utxos result"));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
@@ -629,7 +687,7 @@ UniValue NSPV_addressutxos(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
 
 UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter)
 {
-    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t i,iter,slen,len = 0;
+    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t slen,len = 0;
     if ( NSPV_txidsresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_txidsresult.coinaddr) == 0 && CCflag == NSPV_txidsresult.CCflag && skipcount == NSPV_txidsresult.skipcount )
         return(NSPV_txidsresp_json(&NSPV_txidsresult));
     if ( skipcount < 0 )
@@ -649,16 +707,8 @@ UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
     len += iguana_rwnum(1,&msg[len],sizeof(skipcount),&skipcount);
     len += iguana_rwnum(1,&msg[len],sizeof(filter),&filter);
     //LogPrintf("skipcount.%d\n",skipcount);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_ADDRINDEX,msg[0]>>1) != 0 )
-    {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( (NSPV_inforesult.height == 0 || NSPV_txidsresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr,NSPV_txidsresult.coinaddr) == 0 && CCflag == NSPV_txidsresult.CCflag )
-                return(NSPV_txidsresp_json(&NSPV_txidsresult));
-        }
-    } else sleep(1);
+    if ( NSPV_request(msg,len,NODE_ADDRINDEX,[&]() { return((NSPV_inforesult.height == 0 || NSPV_txidsresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr,NSPV_txidsresult.coinaddr) == 0 && CCflag == NSPV_txidsresult.CCflag); }) != 0 )
+        return(NSPV_txidsresp_json(&NSPV_txidsresult));
     result.push_back(Pair("result","error"));
     result.push_back(Pair("error","no txid result"));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
@@ -667,7 +717,7 @@ UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32
 
 UniValue NSPV_ccaddresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,uint256 filtertxid,uint8_t evalcode, uint8_t func)
 {
-    UniValue result(UniValue::VOBJ); uint8_t msg[512],funcid=NSPV_CC_TXIDS; char zeroes[64]; int32_t i,iter,slen,len = 0,vout;
+    UniValue result(UniValue::VOBJ); uint8_t msg[512],funcid=NSPV_CC_TXIDS; char zeroes[64]; int32_t slen,len = 0,vout;
     NSPV_mempoolresp_purge(&NSPV_mempoolresult);
     memset(zeroes,0,sizeof(zeroes));
     if ( coinaddr == 0 )
@@ -688,16 +738,8 @@ UniValue NSPV_ccaddresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,uin
     msg[len++] = slen;
     memcpy(&msg[len],coinaddr,slen), len += slen;
     LogPrintf("(%s) func.%d CC.%d %s skipcount.%d len.%d\n",coinaddr,NSPV_CC_TXIDS,CCflag,filtertxid.GetHex().c_str(),skipcount,len);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
-    {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_mempoolresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_mempoolresult.coinaddr) == 0 && CCflag == NSPV_mempoolresult.CCflag && filtertxid == NSPV_mempoolresult.txid && vout == NSPV_mempoolresult.vout && funcid == NSPV_mempoolresult.funcid )
-                return(NSPV_mempoolresp_json(&NSPV_mempoolresult));
-        }
-    } else sleep(1);
+    if ( NSPV_request(msg,len,NODE_NSPV,[&]() { return(NSPV_mempoolresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_mempoolresult.coinaddr) == 0 && CCflag == NSPV_mempoolresult.CCflag && filtertxid == NSPV_mempoolresult.txid && vout == NSPV_mempoolresult.vout && funcid == NSPV_mempoolresult.funcid); }) != 0 )
+        return(NSPV_mempoolresp_json(&NSPV_mempoolresult));
     result.push_back(Pair("result","error"));
     result.push_back(Pair("error","no txid result"));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
@@ -706,7 +748,7 @@ UniValue NSPV_ccaddresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,uin
 
 UniValue NSPV_mempooltxids(char *coinaddr,int32_t CCflag,uint8_t funcid,uint256 txid,int32_t vout)
 {
-    UniValue result(UniValue::VOBJ); uint8_t msg[512]; char zeroes[64]; int32_t i,iter,slen,len = 0;
+    UniValue result(UniValue::VOBJ); uint8_t msg[512]; char zeroes[64]; int32_t slen,len = 0;
     NSPV_mempoolresp_purge(&NSPV_mempoolresult);
     memset(zeroes,0,sizeof(zeroes));
     if ( coinaddr == 0 )
@@ -726,16 +768,8 @@ UniValue NSPV_mempooltxids(char *coinaddr,int32_t CCflag,uint8_t funcid,uint256
     msg[len++] = slen;
     memcpy(&msg[len],coinaddr,slen), len += slen;
     LogPrintf("(%s) func.%d CC.%d %s/v%d len.%d\n",coinaddr,funcid,CCflag,txid.GetHex().c_str(),vout,len);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
-    {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_mempoolresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_mempoolresult.coinaddr) == 0 && CCflag == NSPV_mempoolresult.CCflag && txid == NSPV_mempoolresult.txid && vout == NSPV_mempoolresult.vout && funcid == NSPV_mempoolresult.funcid )
-                return(NSPV_mempoolresp_json(&NSPV_mempoolresult));
-        }
-    } else sleep(1);
+    if ( NSPV_request(msg,len,NODE_NSPV,[&]() { return(NSPV_mempoolresult.nodeheight >= NSPV_inforesult.height && strcmp(coinaddr,NSPV_mempoolresult.coinaddr) == 0 && CCflag == NSPV_mempoolresult.CCflag && txid == NSPV_mempoolresult.txid && vout == NSPV_mempoolresult.vout && funcid == NSPV_mempoolresult.funcid); }) != 0 )
+        return(NSPV_mempoolresp_json(&NSPV_mempoolresult));
     result.push_back(Pair("result","error"));
     result.push_back(Pair("error","no txid result"));
     result.push_back(Pair("lastpeer",NSPV_lastpeer));
@@ -783,54 +817,44 @@ bool NSPV_evalcode_inmempool(uint8_t evalcode,uint8_t funcid)
 
 UniValue NSPV_notarizations(int32_t reqheight)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_ntzsresp N,*ptr;
-    if ( (ptr= NSPV_ntzsresp_find(reqheight)) != 0 )
+    uint8_t msg[512]; int32_t len = 0; struct NSPV_ntzsresp N,*ptr;
     {
-        LogPrintf("FROM CACHE NSPV_notarizations.%d\n",reqheight);
-        NSPV_ntzsresp_purge(&NSPV_ntzsresult);
-        NSPV_ntzsresp_copy(&NSPV_ntzsresult,ptr);
-        return(NSPV_ntzsresp_json(ptr));
+        boost::unique_lock<boost::mutex> lock(cs_NSPVresp);
+        if ( (ptr= NSPV_ntzsresp_find(reqheight)) != 0 )
+        {
+            LogPrintf("FROM CACHE NSPV_notarizations.%d\n",reqheight);
+            NSPV_ntzsresp_purge(&NSPV_ntzsresult);
+            NSPV_ntzsresp_copy(&NSPV_ntzsresult,ptr);
+            return(NSPV_ntzsresp_json(ptr));
+        }
     }
     msg[len++] = NSPV_NTZS;
     len += iguana_rwnum(1,&msg[len],sizeof(reqheight),&reqheight);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
-    {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_ntzsresult.reqheight == reqheight )
-                return(NSPV_ntzsresp_json(&NSPV_ntzsresult));
-        }
-    } else sleep(1);
+    if ( NSPV_request(msg,len,NODE_NSPV,[&]() { return(NSPV_ntzsresult.reqheight == reqheight); }) != 0 )
+        return(NSPV_ntzsresp_json(&NSPV_ntzsresult));
     memset(&N,0,sizeof(N));
     return(NSPV_ntzsresp_json(&N));
 }
 
 UniValue NSPV_txidhdrsproof(uint256 prevtxid,uint256 nexttxid)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_ntzsproofresp P,*ptr;
-    if ( (ptr= NSPV_ntzsproof_find(prevtxid,nexttxid)) != 0 )
+    uint8_t msg[512]; int32_t len = 0; struct NSPV_ntzsproofresp P,*ptr;
     {
-        LogPrintf("FROM CACHE NSPV_txidhdrsproof %s %s\n",ptr->prevtxid.GetHex().c_str(),ptr->nexttxid.GetHex().c_str());
+        boost::unique_lock<boost::mutex> lock(cs_NSPVresp);
+        if ( (ptr= NSPV_ntzsproof_find(prevtxid,nexttxid)) != 0 )
+        {
+            LogPrintf("FROM CACHE NSPV_txidhdrsproof %s %s\n",ptr->prevtxid.GetHex().c_str(),ptr->nexttxid.GetHex().c_str());
+            NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
+            NSPV_ntzsproofresp_copy(&NSPV_ntzsproofresult,ptr);
+            return(NSPV_ntzsproof_json(ptr));
+        }
         NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
-        NSPV_ntzsproofresp_copy(&NSPV_ntzsproofresult,ptr);
-        return(NSPV_ntzsproof_json(ptr));
     }
-    NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
     msg[len++] = NSPV_NTZSPROOF;
     len += iguana_rwbignum(1,&msg[len],sizeof(prevtxid),(uint8_t *)&prevtxid);
     len += iguana_rwbignum(1,&msg[len],sizeof(nexttxid),(uint8_t *)&nexttxid);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
-    {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_ntzsproofresult.prevtxid == prevtxid && NSPV_ntzsproofresult.nexttxid == nexttxid )
-                return(NSPV_ntzsproof_json(&NSPV_ntzsproofresult));
-        }
-    } else sleep(1);
+    if ( NSPV_request(msg,len,NODE_NSPV,[&]() { return(NSPV_ntzsproofresult.prevtxid == prevtxid && NSPV_ntzsproofresult.nexttxid == nexttxid); }) != 0 )
+        return(NSPV_ntzsproof_json(&NSPV_ntzsproofresult));
     memset(&P,0,sizeof(P));
     return(NSPV_ntzsproof_json(&P));
 }
@@ -845,61 +869,96 @@ UniValue NSPV_hdrsproof(int32_t prevht,int32_t nextht)
     return(NSPV_txidhdrsproof(prevtxid,nexttxid));
 }
 
-UniValue NSPV_txproof(int32_t vout,uint256 txid,int32_t height)
+int32_t NSPV_txproof_msg(uint8_t *msg,int32_t vout,uint256 txid,int32_t height)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_txproof P,*ptr;
-    if ( (ptr= NSPV_txproof_find(txid)) != 0 )
-    {
-        LogPrintf("FROM CACHE NSPV_txproof %s\n",txid.GetHex().c_str());
-        NSPV_txproof_purge(&NSPV_txproofresult);
-        NSPV_txproof_copy(&NSPV_txproofresult,ptr);
-        return(NSPV_txproof_json(ptr));
-    }
-    NSPV_txproof_purge(&NSPV_txproofresult);
+    int32_t len = 0;
     msg[len++] = NSPV_TXPROOF;
     len += iguana_rwnum(1,&msg[len],sizeof(height),&height);
     len += iguana_rwnum(1,&msg[len],sizeof(vout),&vout);
     len += iguana_rwbignum(1,&msg[len],sizeof(txid),(uint8_t *)&txid);
-    LogPrintf("req txproof %s/v%d at height.%d\n",txid.GetHex().c_str(),vout,height);
-    for (iter=0; iter<3; iter++)
+    return(len);
+}
+
+// sends the txproof request without waiting, NSPV_txproof() then finds the response in the cache
+void NSPV_txproof_prefetch(int32_t vout,uint256 txid,int32_t height)
+{
+    uint8_t msg[512]; int32_t len; uint32_t timestamp = (uint32_t)time(NULL);
+    {
+        boost::unique_lock<boost::mutex> lock(cs_NSPVresp);
+        if ( NSPV_txproof_find(txid) != 0 || (NSPV_txproofs_pending.count(txid) != 0 && timestamp < NSPV_txproofs_pending[txid]+3) )
+            return;
+    }
+    len = NSPV_txproof_msg(msg,vout,txid,height);
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        boost::unique_lock<boost::mutex> lock(cs_NSPVresp);
+        NSPV_txproofs_pending[txid] = timestamp;
+    }
+}
+
+// copies the proof of txid into *dest, which the caller purges, from the cache or else from a peer
+int32_t NSPV_txproof_get(struct NSPV_txproof *dest,int32_t vout,uint256 txid,int32_t height)
+{
+    uint8_t msg[512]; int32_t len; struct NSPV_txproof *ptr;
+    memset(dest,0,sizeof(*dest));
+    {
+        boost::unique_lock<boost::mutex> lock(cs_NSPVresp);
+        // a prefetched request gets its time to be answered before it is sent again
+        if ( NSPV_txproofs_pending.count(txid) != 0 )
+            NSPV_respcond.wait_for(lock,boost::chrono::microseconds((int64_t)NSPV_POLLITERS * NSPV_POLLMICROS),[&]() { return(NSPV_txproofs_pending.count(txid) == 0); });
+        if ( (ptr= NSPV_txproof_find(txid)) != 0 )
+        {
+            LogPrintf("FROM CACHE NSPV_txproof %s\n",txid.GetHex().c_str());
+            NSPV_txproof_copy(dest,ptr);
+            return(1);
+        }
+        NSPV_txproofs_pending.erase(txid);
+        NSPV_txproof_purge(&NSPV_txproofresult);
+    }
+    len = NSPV_txproof_msg(msg,vout,txid,height);
+    LogPrintf("req txproof %s/v%d at height.%d\n",txid.GetHex().c_str(),vout,height);
+    if ( NSPV_request(msg,len,NODE_NSPV,[&]() { return(NSPV_txproofresult.txid == txid); }) != 0 )
+    {
+        boost::unique_lock<boost::mutex> lock(cs_NSPVresp);
+        // another response may have replaced NSPV_txproofresult since, the cache still has this one
+        if ( NSPV_txproofresult.txid == txid )
+            ptr = &NSPV_txproofresult;
+        else ptr = NSPV_txproof_find(txid);
+        if ( ptr != 0 )
         {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_txproofresult.txid == txid )
-                return(NSPV_txproof_json(&NSPV_txproofresult));
+            NSPV_txproof_copy(dest,ptr);
+            return(1);
         }
-    } else sleep(1);
+    }
     LogPrintf("txproof timeout\n");
-    memset(&P,0,sizeof(P));
-    return(NSPV_txproof_json(&P));
+    return(0);
+}
+
+UniValue NSPV_txproof(int32_t vout,uint256 txid,int32_t height)
+{
+    struct NSPV_txproof P; UniValue result;
+    NSPV_txproof_get(&P,vout,txid,height);
+    result = NSPV_txproof_json(&P);
+    NSPV_txproof_purge(&P);
+    return(result);
 }
 
 UniValue NSPV_spentinfo(uint256 txid,int32_t vout)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_spentinfo I;
+    uint8_t msg[512]; int32_t len = 0; struct NSPV_spentinfo I;
     NSPV_spentinfo_purge(&NSPV_spentresult);
     msg[len++] = NSPV_SPENTINFO;
     len += iguana_rwnum(1,&msg[len],sizeof(vout),&vout);
     len += iguana_rwbignum(1,&msg[len],sizeof(txid),(uint8_t *)&txid);
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_SPENTINDEX,msg[0]>>1) != 0 )
-    {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_spentresult.txid == txid && NSPV_spentresult.vout == vout )
-                return(NSPV_spentinfo_json(&NSPV_spentresult));
-        }
-    } else sleep(1);
+    if ( NSPV_request(msg,len,NODE_SPENTINDEX,[&]() { return(NSPV_spentresult.txid == txid && NSPV_spentresult.vout == vout); }) != 0 )
+        return(NSPV_spentinfo_json(&NSPV_spentresult));
     memset(&I,0,sizeof(I));
     return(NSPV_spentinfo_json(&I));
 }
 
 UniValue NSPV_broadcast(char *hex)
 {
-    uint8_t *msg,*data; uint256 txid; int32_t i,n,iter,len = 0; struct NSPV_broadcastresp B;
+    uint8_t *msg,*data; uint256 txid; int32_t n,len = 0; struct NSPV_broadcastresp B;
     NSPV_broadcast_purge(&NSPV_broadcastresult);
     n = (int32_t)strlen(hex) >> 1;
     data = (uint8_t *)malloc(n);
@@ -912,19 +971,11 @@ UniValue NSPV_broadcast(char *hex)
     memcpy(&msg[len],data,n), len += n;
     free(data);
     //LogPrintf("send txid.%s\n",txid.GetHex().c_str());
-    for (iter=0; iter<3; iter++)
-    if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
+    if ( NSPV_request(msg,len,NODE_NSPV,[&]() { return(NSPV_broadcastresult.txid == txid); }) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
-        {
-            usleep(NSPV_POLLMICROS);
-            if ( NSPV_broadcastresult.txid == txid )
-            {
-                free(msg);
-                return(NSPV_broadcast_json(&NSPV_broadcastresult,txid));
-            }
-        }
-    } else sleep(1);
+        free(msg);
+        return(NSPV_broadcast_json(&NSPV_broadcastresult,txid));
+    }
     free(msg);
     memset(&B,0,sizeof(B));
     B.retcode = -2;
@@ -937,7 +988,7 @@ UniValue NSPV_broadcast(char *hex)
 // For second+ funcids the filtertxid will be compared to txid in opret
 UniValue NSPV_ccmoduleutxos(char *coinaddr, int64_t amount, uint8_t evalcode, std::string funcids, uint256 filtertxid)
 {
-    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t i, iter, slen, len = 0;
+    UniValue result(UniValue::VOBJ); uint8_t msg[512]; int32_t slen, len = 0;
     uint8_t CCflag = 1;
 
     NSPV_utxosresp_purge(&NSPV_utxosresult);
@@ -961,21 +1012,12 @@ UniValue NSPV_ccmoduleutxos(char *coinaddr, int64_t amount, uint8_t evalcode, st
     memcpy(&msg[len], funcids.data(), slen), len += slen;
 
     len += iguana_rwbignum(1, &msg[len], sizeof(filtertxid), (uint8_t *)&filtertxid);
-    for (iter = 0; iter<3; iter++)
-        if (NSPV_req(0, msg, len, NODE_ADDRINDEX, msg[0] >> 1) != 0)
-        {
-            for (i = 0; i<NSPV_POLLITERS; i++)
-            {
-                usleep(NSPV_POLLMICROS);
-                if ((NSPV_inforesult.height == 0 || NSPV_utxosresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr, NSPV_utxosresult.coinaddr) == 0 && CCflag == NSPV_utxosresult.CCflag)
-                    return(NSPV_utxosresp_json(&NSPV_utxosresult));
-            }
-        }
-        else sleep(1);
-        result.push_back(Pair("result", "error"));
-        result.push_back(Pair("error", "no utxos result"));
-        result.push_back(Pair("lastpeer", NSPV_lastpeer));
-        return(result);
+    if (NSPV_request(msg, len, NODE_ADDRINDEX, [&]() { return((NSPV_inforesult.height == 0 || NSPV_utxosresult.nodeheight >= NSPV_inforesult.height) && strcmp(coinaddr, NSPV_utxosresult.coinaddr) == 0 && CCflag == NSPV_utxosresult.CCflag); }) != 0)
+        return(NSPV_utxosresp_json(&NSPV_utxosresult));
+    result.push_back(Pair("result", "error"));
+    result.push_back(Pair("error", "no utxos result"));
+    result.push_back(Pair("lastpeer", NSPV_lastpeer));
+    return(result);
 }
 
 #endif // KOMODO_NSPVSUPERLITE_H
@@ -47,7 +47,6 @@ int32_t NSPV_validatehdrs(struct NSPV_ntzsproofresp *ptr)
         if ( blockhash != ptr->common.hdrs[i].hashPrevBlock )
             return(-i-13);
     }
-    sleep(1); // need this to get past the once per second rate limiter per message
     if ( NSPV_txextract(tx,ptr->prevntz,ptr->prevtxlen) < 0 )
         return(-8);
     else if ( tx.GetHash() != ptr->prevtxid )
@@ -63,21 +62,18 @@ int32_t NSPV_validatehdrs(struct NSPV_ntzsproofresp *ptr)
 
 int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int32_t height,CTransaction &tx,uint256 &hashblock,int32_t &txheight,int32_t &currentheight,int64_t extradata,uint32_t tiptime,int64_t &rewardsum)
 {
-    struct NSPV_txproof *ptr; int32_t i,offset,retval; int64_t rewards = 0; uint32_t nLockTime; std::vector<uint8_t> proof;
+    struct NSPV_txproof P,*ptr = &P; int32_t i,offset,retval; int64_t rewards = 0; uint32_t nLockTime; std::vector<uint8_t> proof;
     retval = skipvalidation != 0 ? 0 : -1;
 
     //LogPrintf("NSPV_gettx %s/v%d ht.%d\n",txid.GetHex().c_str(),vout,height);
-    if ( (ptr= NSPV_txproof_find(txid)) == 0 )
-    {
-        NSPV_txproof(vout,txid,height);
-        ptr = &NSPV_txproofresult;
-    }
+    NSPV_txproof_get(ptr,vout,txid,height); // a copy, prefetched proofs keep arriving while it is checked
     hashblock=ptr->hashblock;
     txheight=ptr->height;
     currentheight=NSPV_inforesult.height;
     if ( ptr->txid != txid )
     {
         LogPrintf("txproof error %s != %s\n",ptr->txid.GetHex().c_str(),txid.GetHex().c_str());
+        NSPV_txproof_purge(ptr);
         return(-1);
     }
     else if ( NSPV_txextract(tx,ptr->tx,ptr->txlen) < 0 || ptr->txlen <= 0 )
@@ -120,7 +116,6 @@ int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int
             {
                 //LogPrintf("call NSPV_txidhdrsproof %s %s\n",NSPV_ntzsresult.prevntz.txid.GetHex().c_str(),NSPV_ntzsresult.nextntz.txid.GetHex().c_str());
                 NSPV_txidhdrsproof(NSPV_ntzsresult.prevntz.txid,NSPV_ntzsresult.nextntz.txid);
-                usleep(10000);
                 if ( (retval= NSPV_validatehdrs(&NSPV_ntzsproofresult)) == 0 )
                 {
                     std::vector<uint256> txids; uint256 proofroot;
@@ -135,6 +130,7 @@ int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int
             } else retval = -2005;
         } else retval = -2004;
     }
+    NSPV_txproof_purge(ptr);
     return(retval);
 }
 
@@ -284,11 +280,11 @@ std::string NSPV_signtx(int64_t &rewardsum,int64_t &interestsum,UniValue &retcod
     }
     if ( opret.size() > 0 )
         mtx.vout.push_back(CTxOut(0,opret));
+    for (i=0; i<n; i++) // the proofs are requested together and arrive while the vins are checked
+        NSPV_txproof_prefetch(mtx.vin[i].prevout.n,mtx.vin[i].prevout.hash,used[i].height);
     for (i=0; i<n; i++)
     {
         utxovout = mtx.vin[i].prevout.n;
-        if ( i > 0 )
-            sleep(1);
         validation = NSPV_gettransaction(0,utxovout,mtx.vin[i].prevout.hash,used[i].height,vintx,hashBlock,txheight,currentheight,used[i].extradata,NSPV_tiptime,rewardsum);
         retcodes.push_back(validation);
         if ( validation != -1 ) // most others are degraded security
@@ -24,10 +24,54 @@
 
 // statics used within this .cpp for caching purposes
 static int didinit; // see komodo_init
-static uint8_t kmd_pubkeys[NUM_KMD_SEASONS][64][33]; // see komodo_notaries
 static int32_t hwmheight; // highest height ever passed to komodo_notariesinit
 static int32_t hadnotarization; // used in komodo_dpowconfs
-static bool didinit_NOTARIES[NUM_KMD_SEASONS]; // komodo_notaries()
+static bool didinit_NOTARIES[NUM_KMD_SEASONS]; // NOTARY_ADDRESSES filled, see komodo_notaries()
+
+namespace komodo {
+
+notary_table::notary_table(const char *elected[][2], int32_t num) : num(num)
+{
+    for (int32_t i = 0; i < num; i++)
+    {
+        decode_hex(pubkeys[i],33,(char *)elected[i][1]);
+        calc_rmd160_sha256(rmd160[i],pubkeys[i],33);
+        by_pubkey.emplace( std::string((const char *)pubkeys[i],33), i );
+        by_rmd160.emplace( std::string((const char *)rmd160[i],20), i );
+    }
+}
+
+int32_t notary_table::find(const uint8_t *pubkey33) const
+{
+    auto itr = by_pubkey.find( std::string((const char *)pubkey33,33) );
+    return itr == by_pubkey.end() ? -1 : itr->second;
+}
+
+int32_t notary_table::find_rmd160(const uint8_t *hash) const
+{
+    auto itr = by_rmd160.find( std::string((const char *)hash,20) );
+    return itr == by_rmd160.end() ? -1 : itr->second;
+}
+
+} // namespace komodo
+
+/****
+ * @returns the tables of all seasons, built on first use (thread safe)
+ */
+static const komodo::notary_table *notary_seasons()
+{
+    struct season_tables
+    {
+        season_tables()
+        {
+            for (int32_t i = 0; i < NUM_KMD_SEASONS; i++)
+                seasons[i] = komodo::notary_table(notaries_elected[i], NUM_KMD_NOTARIES);
+        }
+        komodo::notary_table seasons[NUM_KMD_SEASONS];
+    };
+    static const season_tables tables;
+    return tables.seasons;
+}
 
 
 /****
@@ -120,6 +164,35 @@ int32_t komodo_isnotaryvout(char *coinaddr,uint32_t tiptime) // from ac_private
     return(0);
 }
 
+/***
+ * @brief Given a height or timestamp, get the hardcoded notary season
+ * @param[in] height the height
+ * @param[in] timestamp the timestamp, 0 to derive it from the height
+ * @returns the season's notary table, or nullptr before the hardcoded seasons and on STAKED chains
+ */
+const komodo::notary_table *komodo_notarytable(int32_t height,uint32_t timestamp)
+{
+    if ( is_STAKED(chainName.symbol()) != 0 )
+        return nullptr;
+    int32_t kmd_season = 0;
+    if ( chainName.isKMD() )
+    {
+        // This is KMD, use block heights to determine the KMD notary season.. 
+        if ( height >= KOMODO_NOTARIES_HARDCODED )
+            kmd_season = getkmdseason(height);
+    }
+    else 
+    {
+        // This is a non LABS assetchain, use timestamp to detemine notary pubkeys. 
+        if ( timestamp == 0 )
+            timestamp = komodo_heightstamp(height); // derive the timestamp from the passed-in height
+        kmd_season = getacseason(timestamp);
+    }
+    if ( kmd_season == 0 )
+        return nullptr;
+    return &notary_seasons()[kmd_season-1];
+}
+
 /***
  * @brief Given a height or timestamp, get the appropriate notary keys
  * @param[out] pubkeys the results
@@ -140,33 +213,18 @@ int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestam
     // This allows KMD to still sync and use its proper pubkeys for dPoW.
     if ( is_STAKED(chainName.symbol()) == 0 )
     {
-        int32_t kmd_season = 0;
-        if ( chainName.isKMD() )
-        {
-            // This is KMD, use block heights to determine the KMD notary season.. 
-            if ( height >= KOMODO_NOTARIES_HARDCODED )
-                kmd_season = getkmdseason(height);
-        }
-        else 
+        const komodo::notary_table *table = komodo_notarytable(height,timestamp);
+        if ( table != nullptr )
         {
-            // This is a non LABS assetchain, use timestamp to detemine notary pubkeys. 
-            kmd_season = getacseason(timestamp);
-        }
-        if ( kmd_season != 0 )
-        {
-            if ( !didinit_NOTARIES[kmd_season-1] )
+            int32_t kmd_season = table - notary_seasons() + 1;
+            if ( ASSETCHAINS_PRIVATE != 0 && !didinit_NOTARIES[kmd_season-1] )
             {
-                for (int32_t i=0; i<NUM_KMD_NOTARIES; i++) 
-                    decode_hex(kmd_pubkeys[kmd_season-1][i],33,(char *)notaries_elected[kmd_season-1][i][1]);
-                if ( ASSETCHAINS_PRIVATE != 0 )
-                {
-                    // this is PIRATE, we need to populate the address array for the notary exemptions. 
-                    for (int32_t i = 0; i<NUM_KMD_NOTARIES; i++)
-                        pubkey2addr((char *)NOTARY_ADDRESSES[kmd_season-1][i],(uint8_t *)kmd_pubkeys[kmd_season-1][i]);
-                }
+                // this is PIRATE, we need to populate the address array for the notary exemptions. 
+                for (int32_t i = 0; i<NUM_KMD_NOTARIES; i++)
+                    pubkey2addr((char *)NOTARY_ADDRESSES[kmd_season-1][i],(uint8_t *)table->pubkeys[i]);
                 didinit_NOTARIES[kmd_season-1] = true;
             }
-            memcpy(pubkeys,kmd_pubkeys[kmd_season-1],NUM_KMD_NOTARIES * 33);
+            memcpy(pubkeys,table->pubkeys,NUM_KMD_NOTARIES * 33);
             return(NUM_KMD_NOTARIES);
         }
     }
@@ -210,6 +268,14 @@ int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestam
 int32_t komodo_electednotary(int32_t *numnotariesp,uint8_t *pubkey33,int32_t height,uint32_t timestamp)
 {
     int32_t i,n; uint8_t pubkeys[64][33];
+    if ( chainName.isKMD() )
+        timestamp = 0;
+    const komodo::notary_table *table = komodo_notarytable(height,timestamp);
+    if ( table != nullptr )
+    {
+        *numnotariesp = table->num;
+        return table->find(pubkey33);
+    }
     n = komodo_notaries(pubkeys,height,timestamp);
     *numnotariesp = n;
     for (i=0; i<n; i++)
@@ -493,6 +559,7 @@ void komodo_init(int32_t height)
     memset(&zero,0,sizeof(zero));
     if ( !didinit )
     {
+        notary_seasons(); // build the season tables before any validation thread needs them
         decode_hex(NOTARY_PUBKEY33,33,NOTARY_PUBKEY.c_str());
         if ( height >= 0 )
         {
@@ -521,7 +588,6 @@ void komodo_notaries_uninit()
     hwmheight = 0;
     hadnotarization = 0;
     memset(&didinit_NOTARIES[0], 0, sizeof(uint8_t) * NUM_KMD_SEASONS);
-    memset(&kmd_pubkeys[0], 0, sizeof(uint8_t) * NUM_KMD_SEASONS * 64 * 33);
     if (Pubkeys != nullptr)
     {
         // extern knotaries_entry *Pubkeys;
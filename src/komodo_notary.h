@@ -26,6 +26,45 @@
 
 #define CRYPTO777_PUBSECPSTR "020e46e79a2a8d12b9b5d12c7a91adb4e454edfae43c0a0cb805427d2ac7613fd9"
 
+#include <string>
+#include <unordered_map>
+
+namespace komodo {
+
+/***
+ * The elected notaries of one season. Built once and never modified,
+ * so it can be read from any thread without a lock.
+ */
+class notary_table
+{
+public:
+    notary_table() {}
+    /***
+     * @brief decode the season's pubkeys and derive the lookup structures
+     * @param elected the season's entries of notaries_elected
+     * @param num the number of notaries
+     */
+    notary_table(const char *elected[][2], int32_t num);
+    /***
+     * @param pubkey33 the public key to look for
+     * @returns the notaryid or -1 if not a notary of this season
+     */
+    int32_t find(const uint8_t *pubkey33) const;
+    /***
+     * @param rmd160 the hash of a public key
+     * @returns the notaryid or -1 if not a notary of this season
+     */
+    int32_t find_rmd160(const uint8_t *rmd160) const;
+    int32_t num = 0;
+    uint8_t pubkeys[64][33] = {};
+    uint8_t rmd160[64][20] = {};
+private:
+    std::unordered_map<std::string, int32_t> by_pubkey;
+    std::unordered_map<std::string, int32_t> by_rmd160;
+};
+
+} // namespace komodo
+
 /****
  * @brief get the kmd season based on height (used on the KMD chain)
  * @param height the chain height
@@ -56,6 +95,16 @@ int32_t ht_index_from_height(int32_t height);
  */
 int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestamp);
 
+/***
+ * @brief Given a height or timestamp, get the table of the season's notaries
+ * @note does not copy or lock. LABS chains and KMD heights below
+ *      KOMODO_NOTARIES_HARDCODED have no season table, use komodo_notaries()
+ * @param[in] height the height
+ * @param[in] timestamp the timestamp
+ * @returns the season's table or nullptr
+ */
+const komodo::notary_table *komodo_notarytable(int32_t height,uint32_t timestamp);
+
 int32_t komodo_electednotary(int32_t *numnotariesp,uint8_t *pubkey33,int32_t height,uint32_t timestamp);
 
 int32_t komodo_ratify_threshold(int32_t height,uint64_t signedmask);
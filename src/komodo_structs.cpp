@@ -17,6 +17,10 @@
 #include "komodo_bitcoind.h"
 #include "mem_read.h"
 
+#include <algorithm>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
 namespace komodo {
 
 /***
@@ -343,6 +347,133 @@ std::ostream& operator<<(std::ostream& os, const event_pricefeed& in)
     return os;
 }
 
+struct mapped_file::impl
+{
+    boost::interprocess::file_mapping mapping;
+    boost::interprocess::mapped_region region;
+};
+
+mapped_file::mapped_file(const std::string& fname)
+{
+    try
+    {
+        pimpl.reset(new impl);
+        pimpl->mapping = boost::interprocess::file_mapping(fname.c_str(), boost::interprocess::read_only);
+        pimpl->region = boost::interprocess::mapped_region(pimpl->mapping, boost::interprocess::read_only);
+    }
+    catch(const boost::interprocess::interprocess_exception& ex)
+    {
+        throw std::runtime_error("Unable to map " + fname + ": " + ex.what());
+    }
+    ptr = static_cast<uint8_t*>(pimpl->region.get_address());
+    len = pimpl->region.get_size();
+}
+
+mapped_file::~mapped_file() = default;
+
+void event_list::clear()
+{
+    entries.clear();
+    sorted = true;
+    source.reset();
+    source_dest.clear();
+    replay_func = 0;
+    replay_pos = 0;
+}
+
+void event_list::push_back(std::shared_ptr<event> ev)
+{
+    if (!entries.empty() && ev->height < entries.back().height)
+        sorted = false;
+    entries.push_back( {ev->height, 0, 0, ev} );
+}
+
+void event_list::push_back(int32_t height, uint8_t func, long pos)
+{
+    if (!entries.empty() && height < entries.back().height)
+        sorted = false;
+    entries.push_back( {height, func, pos, nullptr} );
+}
+
+void event_list::pop_back()
+{
+    entries.pop_back();
+    if (entries.empty())
+        sorted = true;
+}
+
+size_t event_list::rewind(int32_t height)
+{
+    std::vector<entry>::iterator first = entries.end();
+    if (sorted)
+    {
+        first = std::lower_bound(entries.begin(), entries.end(), height,
+                [](const entry& e, int32_t ht) { return e.height < ht; } );
+    }
+    else
+    {
+        while (first != entries.begin() && (first-1)->height >= height)
+            --first;
+    }
+    size_t removed = entries.end() - first;
+    entries.erase(first, entries.end());
+    if (entries.empty())
+        sorted = true;
+    return removed;
+}
+
+void event_list::set_source(std::shared_ptr<mapped_file> file, const char *dest)
+{
+    source = file;
+    source_dest = dest != nullptr ? dest : "";
+}
+
+bool event_list::replaying(komodo_event_type type) const
+{
+    switch(replay_func)
+    {
+        case 'P': return type == EVENT_PUBKEYS;
+        case 'N': case 'M': return type == EVENT_NOTARIZED;
+        case 'K': case 'T': return type == EVENT_KMDHEIGHT;
+        case 'R': return type == EVENT_OPRETURN;
+        case 'V': return type == EVENT_PRICEFEED;
+        default: return false;
+    }
+}
+
+const std::shared_ptr<event>& event_list::get(const entry& e) const
+{
+    if (e.ev == nullptr)
+    {
+        if (source == nullptr)
+            throw parse_error("No state file to read event from");
+        uint8_t *data = source->data();
+        long data_len = source->size();
+        long pos = e.pos + 1 + sizeof(int32_t); // skip the record identifier and height
+        switch(e.func)
+        {
+            case 'P':
+                e.ev = std::make_shared<event_pubkeys>(data, pos, data_len, e.height);
+                break;
+            case 'N': case 'M':
+                e.ev = std::make_shared<event_notarized>(data, pos, data_len, e.height, source_dest.c_str(), e.func == 'M');
+                break;
+            case 'K': case 'T':
+                e.ev = std::make_shared<event_kmdheight>(data, pos, data_len, e.height, e.func == 'T');
+                break;
+            case 'R':
+                e.ev = std::make_shared<event_opreturn>(data, pos, data_len, e.height);
+                break;
+            case 'V':
+                e.ev = std::make_shared<event_pricefeed>(data, pos, data_len, e.height);
+                break;
+            default:
+                throw parse_error("Unknown event record");
+        }
+    }
+    return e.ev;
+}
+
 } // namespace komodo
 
 /*****
@@ -351,12 +482,28 @@ std::ostream& operator<<(std::ostream& os, const event_pricefeed& in)
  */
 void komodo_state::AddCheckpoint(const notarized_checkpoint &in)
 {
-    NPOINTS.push_back(in);
+    static uint256 zero;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(NPOINTS_mutex);
+        const size_t idx = NPOINTS.size();
+        NPOINTS.push_back(in);
+        NPOINTS_maxheight.push_back( idx == 0 ? in.nHeight : std::max(NPOINTS_maxheight.back(), in.nHeight) );
+        if ( in.MoMdepth != 0 )
+        {
+            NPOINTS_notarized.insert( std::make_pair(in.notarized_height, idx) );
+            NPOINTS_maxdepth = std::max(NPOINTS_maxdepth, in.MoMdepth & 0xffff);
+        }
+        if ( in.MoM != zero )
+            NPOINTS_lastMoM = idx + 1;
+    }
     last = in;
 }
 
 /****
  * Get the notarization data below a particular height
+ * @note the result is the checkpoint just before the first one (in the order they were added)
+ *      at or beyond nHeight. That is the first index where the running maximum of nHeight
+ *      reaches nHeight, so a binary search over NPOINTS_maxheight finds it.
  * @param[in] nHeight the height desired
  * @param[out] notarized_hashp the hash of the notarized block
  * @param[out] notarized_desttxidp the desttxid
@@ -364,51 +511,14 @@ void komodo_state::AddCheckpoint(const notarized_checkpoint &in)
  */
 int32_t komodo_state::NotarizedData(int32_t nHeight,uint256 *notarized_hashp,uint256 *notarized_desttxidp) const
 {
-    bool found = false;
-
-    if ( NPOINTS.size() > 0 )
+    boost::shared_lock<boost::shared_mutex> lock(NPOINTS_mutex);
+    auto itr = std::lower_bound(NPOINTS_maxheight.begin(), NPOINTS_maxheight.end(), nHeight);
+    if ( itr != NPOINTS_maxheight.begin() )
     {
-        const notarized_checkpoint* np = nullptr;
-        if ( NPOINTS_last_index < NPOINTS.size() && NPOINTS_last_index > 0 ) // if we cached an NPOINT index
-        {
-            np = &NPOINTS[NPOINTS_last_index-1]; // grab the previous
-            if ( np->nHeight < nHeight ) // if that previous is below the height we are looking for
-            {
-                for (size_t i = NPOINTS_last_index; i < NPOINTS.size(); i++) // move forward
-                {
-                    if ( NPOINTS[i].nHeight >= nHeight ) // if we found the height we are looking for (or beyond)
-                    {
-                        found = true; // notify ourselves we were here
-                        break; // get out
-                    }
-                    np = &NPOINTS[i];
-                    NPOINTS_last_index = i;
-                }
-            }
-        }
-        if ( !found ) // we still haven't found what we were looking for
-        {
-            np = nullptr; // reset
-            for (size_t i = 0; i < NPOINTS.size(); i++) // linear search from the start
-            {
-                if ( NPOINTS[i].nHeight >= nHeight )
-                {
-                    found = true;
-                    break;
-                }
-                np = &NPOINTS[i];
-                NPOINTS_last_index = i;
-            }
-        }
-        if ( np != nullptr )
-        {
-            if ( np->nHeight >= nHeight || (found && np[1].nHeight < nHeight) )
-                LogPrintf("warning: flag.%d i.%ld np->ht %d [1].ht %d >= nHeight.%d\n",
-                        (int)found,NPOINTS_last_index,np->nHeight,np[1].nHeight,nHeight);
-            *notarized_hashp = np->notarized_hash;
-            *notarized_desttxidp = np->notarized_desttxid;
-            return(np->notarized_height);
-        }
+        const notarized_checkpoint &np = NPOINTS[ itr - NPOINTS_maxheight.begin() - 1 ];
+        *notarized_hashp = np.notarized_hash;
+        *notarized_desttxidp = np.notarized_desttxid;
+        return np.notarized_height;
     }
     memset(notarized_hashp,0,sizeof(*notarized_hashp));
     memset(notarized_desttxidp,0,sizeof(*notarized_desttxidp));
@@ -454,11 +564,9 @@ int32_t komodo_state::PrevMoMHeight() const
         return last.notarized_height;
     }
 
-    for(auto itr = NPOINTS.rbegin(); itr != NPOINTS.rend(); ++itr)
-    {
-        if( itr->MoM != zero)
-            return itr->notarized_height;
-    }
+    boost::shared_lock<boost::shared_mutex> lock(NPOINTS_mutex);
+    if ( NPOINTS_lastMoM != 0 )
+        return NPOINTS[NPOINTS_lastMoM-1].notarized_height;
     return 0;
 }
 
@@ -471,21 +579,36 @@ int32_t komodo_state::PrevMoMHeight() const
  */
 const notarized_checkpoint *komodo_state::CheckpointAtHeight(int32_t height) const
 {
-    // find the nearest notarization_height
-    // work backwards, get the first one that meets our criteria
-    for(auto itr = NPOINTS.rbegin(); itr != NPOINTS.rend(); ++itr)
+    // a match has height <= notarized_height < height + depth, so only the
+    // checkpoints notarized inside that window need to be looked at.
+    // Of those, the most recently added one wins.
+    boost::shared_lock<boost::shared_mutex> lock(NPOINTS_mutex);
+    const notarized_checkpoint *np = nullptr;
+    size_t best = 0;
+    const int64_t limit = (int64_t)height + NPOINTS_maxdepth;
+    for(auto itr = NPOINTS_notarized.lower_bound(height);
+            itr != NPOINTS_notarized.end() && itr->first < limit; ++itr)
     {
-        if ( itr->MoMdepth != 0 
-                && height > itr->notarized_height-(itr->MoMdepth&0xffff) // 2s compliment if negative
-                && height <= itr->notarized_height )
+        const notarized_checkpoint &cp = NPOINTS[itr->second];
+        if ( height > cp.notarized_height-(cp.MoMdepth&0xffff) // 2s compliment if negative
+                && (np == nullptr || itr->second > best) )
         {
-            return &(*itr);
+            np = &cp;
+            best = itr->second;
         }
     }
-    return nullptr;
+    return np; // NPOINTS is a deque, so the pointer survives later additions
 }
 
-void komodo_state::clear_checkpoints() { NPOINTS.clear(); }
+void komodo_state::clear_checkpoints()
+{
+    boost::unique_lock<boost::shared_mutex> lock(NPOINTS_mutex);
+    NPOINTS.clear();
+    NPOINTS_maxheight.clear();
+    NPOINTS_notarized.clear();
+    NPOINTS_maxdepth = 0;
+    NPOINTS_lastMoM = 0;
+}
 const uint256& komodo_state::LastNotarizedHash() const { return last.notarized_hash; }
 void komodo_state::SetLastNotarizedHash(const uint256 &in) { last.notarized_hash = in; }
 const uint256& komodo_state::LastNotarizedDestTxId() const { return last.notarized_desttxid; }
@@ -496,7 +619,11 @@ const int32_t& komodo_state::LastNotarizedHeight() const { return last.notarized
 void komodo_state::SetLastNotarizedHeight(const int32_t in) { last.notarized_height = in; }
 const int32_t& komodo_state::LastNotarizedMoMDepth() const { return last.MoMdepth; }
 void komodo_state::SetLastNotarizedMoMDepth(const int32_t in) { last.MoMdepth =in; }
-uint64_t komodo_state::NumCheckpoints() const { return NPOINTS.size(); }
+uint64_t komodo_state::NumCheckpoints() const
+{
+    boost::shared_lock<boost::shared_mutex> lock(NPOINTS_mutex);
+    return NPOINTS.size();
+}
 
 bool operator==(const notarized_checkpoint& lhs, const notarized_checkpoint& rhs)
 {
@@ -15,8 +15,12 @@
 #pragma once
 #include <memory>
 #include <list>
+#include <deque>
+#include <map>
 #include <vector>
 #include <cstdint>
+#include <iterator>
+#include <string>
 
 #include "komodo_defs.h"
 #include "komodo_extern_globals.h"
@@ -33,6 +37,7 @@
 
 #include "bits256.h"
 #include <mutex>
+#include <boost/thread/shared_mutex.hpp>
 
 //extern std::mutex komodo_mutex;  //todo remove
 
@@ -217,6 +222,126 @@ struct event_pricefeed : public event
 };
 std::ostream& operator<<(std::ostream& os, const event_pricefeed& in);
 
+/***
+ * A read-only view of a file, mapped into memory
+ */
+class mapped_file
+{
+public:
+    /***
+     * Map a file
+     * @param fname the file name
+     * @throws std::runtime_error if the file cannot be mapped
+     */
+    explicit mapped_file(const std::string& fname);
+    ~mapped_file();
+    uint8_t* data() const { return ptr; }
+    long size() const { return len; }
+private:
+    struct impl;
+    std::unique_ptr<impl> pimpl;
+    uint8_t* ptr = nullptr;
+    long len = 0;
+};
+
+/***
+ * The events of a komodo_state, ordered by height.
+ * Events read from the state file are kept as a (height, record position)
+ * pair and only decoded from the mapped file when they are accessed.
+ */
+class event_list
+{
+public:
+    struct entry
+    {
+        int32_t height;
+        uint8_t func; // record identifier in the state file ('P', 'N', etc.), 0 for events held in memory
+        long pos;     // position of the record in the mapped state file
+        mutable std::shared_ptr<event> ev;
+    };
+    /***
+     * Iterates the events, decoding them as they are dereferenced
+     */
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::shared_ptr<event> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::shared_ptr<event>* pointer;
+        typedef const std::shared_ptr<event>& reference;
+        const_iterator(const event_list* l, std::vector<entry>::const_iterator i) : list(l), it(i) {}
+        reference operator*() const { return list->get(*it); }
+        pointer operator->() const { return &list->get(*it); }
+        const_iterator& operator++() { ++it; return *this; }
+        const_iterator operator++(int) { const_iterator tmp(*this); ++it; return tmp; }
+        bool operator==(const const_iterator& rhs) const { return it == rhs.it; }
+        bool operator!=(const const_iterator& rhs) const { return it != rhs.it; }
+    private:
+        const event_list* list;
+        std::vector<entry>::const_iterator it;
+    };
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    const_iterator begin() const { return const_iterator(this, entries.begin()); }
+    const_iterator end() const { return const_iterator(this, entries.end()); }
+    void clear();
+    /***
+     * @brief add an event held in memory
+     * @param ev the event
+     */
+    void push_back(std::shared_ptr<event> ev);
+    /***
+     * @brief add an event that is in the mapped state file
+     * @param height the height of the event
+     * @param func the record identifier
+     * @param pos the position of the record
+     */
+    void push_back(int32_t height, uint8_t func, long pos);
+    void pop_back();
+    const std::shared_ptr<event>& front() const { return get(entries.front()); }
+    const std::shared_ptr<event>& back() const { return get(entries.back()); }
+    const std::shared_ptr<event>& at(size_t i) const { return get(entries.at(i)); }
+    /***
+     * @brief remove every event at or above a height
+     * @param height the height
+     * @returns the number of events removed
+     */
+    size_t rewind(int32_t height);
+    /***
+     * @brief set the mapped state file records are decoded from
+     * @param file the file
+     * @param dest the "parent" chain, needed to decode notarizations
+     */
+    void set_source(std::shared_ptr<mapped_file> file, const char *dest);
+    /***
+     * @brief mark the record being replayed from the source file, an event of the
+     * same type added while it is set is stored by position instead of being copied
+     * @param func the record identifier (0 to clear)
+     * @param pos the position of the record
+     */
+    void set_replay(uint8_t func, long pos) { replay_func = func; replay_pos = pos; }
+    /***
+     * @param type the event type being added
+     * @returns true if an event of this type is the record being replayed
+     */
+    bool replaying(komodo_event_type type) const;
+    /***
+     * @brief add the record being replayed
+     * @param height the height of the event
+     */
+    void push_replayed(int32_t height) { push_back(height, replay_func, replay_pos); }
+private:
+    const std::shared_ptr<event>& get(const entry& e) const;
+    std::vector<entry> entries;
+    bool sorted = true; // heights are non-decreasing, rewinds can binary search
+    std::shared_ptr<mapped_file> source;
+    std::string source_dest;
+    uint8_t replay_func = 0;
+    long replay_pos = 0;
+};
+
 } // namespace komodo
 
 struct knotary_entry { UT_hash_handle hh; uint8_t pubkey[33],notaryid; };
@@ -281,16 +406,18 @@ public:
     uint64_t approved;
     uint64_t redeemed;
     uint64_t shorted;
-    std::list<std::shared_ptr<komodo::event>> events;
+    komodo::event_list events;
     uint32_t RTbufs[64][3]; uint64_t RTmask;
     template<class T>
     bool add_event(const std::string& symbol, const uint32_t height, T& in)
     {
         if (!chainName.isKMD())
         {
-            std::shared_ptr<T> ptr = std::make_shared<T>( in );
             std::lock_guard<std::mutex> lock(komodo_mutex);
-            events.push_back( ptr );
+            if ( events.replaying(in.type) )
+                events.push_replayed(in.height); // already in the mapped state file, decoded on access
+            else
+                events.push_back( std::make_shared<T>( in ) );
             return true;
         }
         return false;
@@ -302,8 +429,12 @@ protected:
      * @note should only be used by tests
      */
     void clear_checkpoints();
-    std::vector<notarized_checkpoint> NPOINTS; // collection of notarizations
-    mutable size_t NPOINTS_last_index = 0; // caches checkpoint linear search position
+    std::deque<notarized_checkpoint> NPOINTS; // collection of notarizations, push_back keeps references valid
+    std::vector<int32_t> NPOINTS_maxheight; // running maximum of NPOINTS[i].nHeight, searched by KMD height
+    std::multimap<int32_t, size_t> NPOINTS_notarized; // notarized_height -> NPOINTS index, checkpoints with a MoMdepth
+    int32_t NPOINTS_maxdepth = 0; // widest (MoMdepth&0xffff) in NPOINTS_notarized
+    size_t NPOINTS_lastMoM = 0; // 1 + index of the last checkpoint with a MoM, 0 if none
+    mutable boost::shared_mutex NPOINTS_mutex; // readers share, AddCheckpoint is exclusive
     notarized_checkpoint last;
 
 public:
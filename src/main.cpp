@@ -27,6 +27,7 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
 #include "importcoin.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -41,6 +42,7 @@
 #include "net.h"
 #include "pow.h"
 #include "script/interpreter.h"
+#include "txcache.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -107,10 +109,12 @@ bool fTxIndex = false;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
+bool fCCIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+bool fBlockPrefetch = true;
 bool fCheckpointsEnabled = true;
 bool fCoinbaseEnforcedProtectionEnabled = true;
 size_t nCoinCacheUsage = 5000 * 300;
@@ -267,6 +271,7 @@ namespace {
         int64_t nTime;  //! Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //! Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //! The timeout for this block request (for disconnecting a slow peer)
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock;  //! Set while a compact block waits for "blocktxn".
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -330,6 +335,12 @@ namespace {
         int nBlocksInFlightValidHeaders;
         //! Whether we consider this a preferred download peer.
         bool fPreferredDownload;
+        //! Whether this peer understands "cmpctblock", we then fetch new blocks from it as compact blocks.
+        bool fProvidesCompactBlocks;
+        //! Whether this peer wants new blocks announced with "cmpctblock" instead of "inv".
+        bool fPreferHeaderAndIDs;
+        //! Compact blocks received, rebuilt without a round trip, rebuilt after "getblocktxn", and given up on.
+        int nCompactBlocks, nCompactReconstructed, nCompactRoundTrips, nCompactFailed;
 
         CNodeState() {
             fCurrentlyConnected = false;
@@ -343,6 +354,9 @@ namespace {
             nBlocksInFlight = 0;
             nBlocksInFlightValidHeaders = 0;
             fPreferredDownload = false;
+            fProvidesCompactBlocks = false;
+            fPreferHeaderAndIDs = false;
+            nCompactBlocks = nCompactReconstructed = nCompactRoundTrips = nCompactFailed = 0;
         }
     };
 
@@ -609,6 +623,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.fCompactBlocks = state->fProvidesCompactBlocks;
+    stats.nCompactBlocks = state->nCompactBlocks;
+    stats.nCompactReconstructed = state->nCompactReconstructed;
+    stats.nCompactRoundTrips = state->nCompactRoundTrips;
+    stats.nCompactFailed = state->nCompactFailed;
     return true;
 }
 
@@ -655,7 +674,7 @@ CBlockTreeDB *pblocktree = nullptr;
 
 #include "komodo.h"
 
-UniValue komodo_snapshot(int top)
+UniValue komodo_snapshot(int top, int workers)
 {
     LOCK(cs_main);
     int64_t total = -1;
@@ -663,7 +682,7 @@ UniValue komodo_snapshot(int top)
 
     if (fAddressIndex) {
 	    if ( pblocktree != nullptr ) {
-		result = pblocktree->Snapshot(top);
+		result = pblocktree->Snapshot(top, workers);
 	    } else {
 		LogPrintf("null pblocktree start with -addressindex=1\n");
 	    }
@@ -673,11 +692,11 @@ UniValue komodo_snapshot(int top)
     return(result);
 }
 
-bool komodo_snapshot2(std::map <std::string, CAmount> &addressAmounts)
+bool komodo_snapshot2(std::map <std::string, CAmount> &addressAmounts, const CAddressBalanceMap *undo)
 {
     if ( fAddressIndex && pblocktree != 0 ) 
     {
-		return pblocktree->Snapshot2(addressAmounts, 0);
+		return pblocktree->Snapshot2(addressAmounts, 0, undo);
     }
     else return false;
 }
@@ -685,6 +704,8 @@ bool komodo_snapshot2(std::map <std::string, CAmount> &addressAmounts)
 int32_t lastSnapShotHeight = 0;
 std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 
+static bool ReadBlockAddressBalanceDeltas(CBlockIndex *pindex, CAddressBalanceMap &deltas);
+
 bool komodo_dailysnapshot(int32_t height)
 {
     int reorglimit = 100; 
@@ -714,50 +735,26 @@ bool komodo_dailysnapshot(int32_t height)
     // if we already did this height dont bother doing it again, this is just a reorg. The actual snapshot height cannot be reorged.
     if ( undo_height == lastSnapShotHeight )
         return true;
-    std::map <std::string, int64_t> addressAmounts;
-    if ( !komodo_snapshot2(addressAmounts) )
-        return false;
 
-    // undo blocks in reverse order
+    // collect the balance changes of the blocks above undo_height, the address balance index
+    // keeps them per height so this only touches the addresses those blocks changed.
+    CAddressBalanceMap undo;
     for (int32_t n = height; n > undo_height; n--) 
     {
-        //LogPrintf( "undoing block.%i\n",n);
-        CBlockIndex *pindex; CBlock block;
-        if ( (pindex= komodo_chainactive(n)) == 0 || komodo_blockload(block, pindex) != 0 ) 
+        CBlockIndex *pindex; CAddressBalanceMap deltas;
+        if ( (pindex= komodo_chainactive(n)) == 0 || !ReadBlockAddressBalanceDeltas(pindex, deltas) ) 
             return false;
-        // undo transactions in reverse order
-        for (int32_t i = block.vtx.size() - 1; i >= 0; i--) 
+        for (CAddressBalanceMap::const_iterator it = deltas.begin(); it != deltas.end(); it++)
         {
-            const CTransaction &tx = block.vtx[i];
-            CTxDestination vDest; 
-            // loop vouts reverse order, remove value recieved.
-            for (unsigned int k = tx.vout.size(); k-- > 0;) 
-            {
-                const CTxOut &out = tx.vout[k];
-                if ( ExtractDestination(out.scriptPubKey, vDest) )
-                {
-                    addressAmounts[CBitcoinAddress(vDest).ToString()] -= out.nValue;
-                    if ( addressAmounts[CBitcoinAddress(vDest).ToString()] < 1 )
-                        addressAmounts.erase(CBitcoinAddress(vDest).ToString());
-                    //LogPrintf( "VOUT: address.%s remove_coins.%li\n",CBitcoinAddress(vDest).ToString().c_str(), out.nValue);
-                } 
-            }
-            // loop vins in reverse order, get prevout and return the sent balance.
-            for (unsigned int j = tx.vin.size(); j-- > 0;) 
-            {
-                uint256 blockhash; CTransaction txin;
-                if ( !tx.IsCoinImport() && !tx.IsCoinBase() && myGetTransaction(tx.vin[j].prevout.hash,txin,blockhash) ) 
-                {
-                    int vout = tx.vin[j].prevout.n;
-                    if ( ExtractDestination(txin.vout[vout].scriptPubKey, vDest) )
-                    {
-                        //LogPrintf( "VIN: address.%s add_coins.%li\n",CBitcoinAddress(vDest).ToString().c_str(), txin.vout[vout].nValue);
-                        addressAmounts[CBitcoinAddress(vDest).ToString()] += txin.vout[vout].nValue;
-                    }
-                }
-            }
+            CAddressBalanceValue &value = undo[it->first];
+            value.satoshis += it->second.satoshis;
+            value.utxos += it->second.utxos;
         }
     }
+    std::map <std::string, int64_t> addressAmounts;
+    if ( !komodo_snapshot2(addressAmounts, &undo) )
+        return false;
+
     vAddressSnapshot.clear(); // clear existing snapshot
     // convert address string to destination for easier conversion to what ever is required, eg, scriptPubKey. 
     for ( auto element : addressAmounts)
@@ -2188,6 +2185,42 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     return true;
 }
 
+bool ScanAddressIndex(uint160 addressHash, int type, int start, int end, const CAddressIndexKey *pafter,
+                      bool fReverse, const AddressIndexVisitor &visitor)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ScanAddressIndex(addressHash, type, start, end, pafter, fReverse, visitor))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool ScanAddressUnspent(uint160 addressHash, int type, const CAddressUnspentKey *pafter, bool fReverse,
+                        const AddressUnspentVisitor &visitor)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ScanAddressUnspentIndex(addressHash, type, pafter, fReverse, visitor))
+        return error("unable to get utxos for address");
+
+    return true;
+}
+
+bool GetCCIndex(uint160 addressHash, int type, uint8_t evalcode, uint8_t funcid, const uint256 &reftxid,
+                std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > &outputs)
+{
+    if (!fCCIndex)
+        return error("CC index not enabled");
+
+    if (!pblocktree->ReadCCIndex(CCIndexIteratorKey(type, addressHash, evalcode, funcid, reftxid), outputs))
+        return error("unable to get CC outputs for address");
+
+    return true;
+}
+
 /****
  * @brief add a transaction to the mempool
  * @param[in] tx the transaction
@@ -2216,6 +2249,34 @@ bool myAddtomempool(const CTransaction &tx, CValidationState *pstate, bool fSkip
     return true;
 }
 
+/*****
+ * @brief read a transaction from the block files and remember it in txCache
+ * @param[in] postx where the tx index says the transaction is
+ * @param[in] hash the expected transaction hash
+ * @param[out] txOut the transaction
+ * @param[out] hashBlock the hash of the block it is in
+ * @returns true on success
+ */
+static bool ReadTransactionFromDisk(const CDiskTxPos &postx, const uint256 &hash, CTransaction &txOut, uint256 &hashBlock)
+{
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
+    CBlockHeader header;
+    try {
+        file >> header;
+        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+        file >> txOut;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    hashBlock = header.GetHash();
+    if (txOut.GetHash() != hash)
+        return error("%s: txid mismatch", __func__);
+    txCache.Put(txOut, hashBlock);
+    return true;
+}
+
 /*****
  * @brief get a transaction by its hash (without locks)
  * @param[in] hash what to look for
@@ -2248,6 +2309,8 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
             return true;
         }
     }
+    if (txCache.Get(hash, txOut, hashBlock))
+        return true;
     //LogPrintf("check disk %s\n",hash.GetHex().c_str());
 
     if (fTxIndex) 
@@ -2255,31 +2318,75 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
         CDiskTxPos postx;
         //LogPrintf("ReadTxIndex\n");
         if (pblocktree->ReadTxIndex(hash, postx)) 
-        {
-            //LogPrintf("OpenBlockFile\n");
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            //LogPrintf("seek and read\n");
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
-            if (txOut.GetHash() != hash)
-                return error("%s: txid mismatch", __func__);
-            //LogPrintf("found on disk %s\n",hash.GetHex().c_str());
-            return true;
-        }
+            return ReadTransactionFromDisk(postx, hash, txOut, hashBlock);
     }
     //LogPrintf("not found on disk %s\n",hash.GetHex().c_str());
     return false;
 }
 
+/*****
+ * @brief get several transactions by their hashes (without locks)
+ * @note transactions that are not in the mempool or the cache are looked up in the
+ *      tx index in txid order, then read from the block files in file position order
+ * @param[in] hashes what to look for
+ * @param[out] txOut the found transactions, in the order of hashes
+ * @param[out] hashBlocks the hashes of the blocks (all zeros if still in mempool)
+ * @returns for each hash, true if found
+ */
+std::vector<bool> myGetTransactions(const std::vector<uint256> &hashes, std::vector<CTransaction> &txOut, std::vector<uint256> &hashBlocks)
+{
+    std::vector<bool> found(hashes.size(), false);
+    txOut.assign(hashes.size(), CTransaction());
+    hashBlocks.assign(hashes.size(), uint256());
+    if ( KOMODO_NSPV_SUPERLITE )
+    {
+        for (size_t i = 0; i < hashes.size(); i++)
+            found[i] = myGetTransaction(hashes[i], txOut[i], hashBlocks[i]);
+        return found;
+    }
+    std::map<uint256, std::vector<size_t> > missing; // ordered by txid, like the tx index keys
+    for (size_t i = 0; i < hashes.size(); i++)
+    {
+        if (mempool.lookup(hashes[i], txOut[i]) || txCache.Get(hashes[i], txOut[i], hashBlocks[i]))
+            found[i] = true;
+        else
+            missing[hashes[i]].push_back(i);
+    }
+    if (!fTxIndex || missing.empty())
+        return found;
+
+    typedef std::pair<CDiskTxPos, const std::pair<const uint256, std::vector<size_t> >*> TxPosition;
+    std::vector<TxPosition> positions;
+    for (const auto &entry : missing)
+    {
+        CDiskTxPos postx;
+        if (pblocktree->ReadTxIndex(entry.first, postx))
+            positions.push_back(std::make_pair(postx, &entry));
+    }
+    std::sort(positions.begin(), positions.end(),
+            [](const TxPosition &a, const TxPosition &b) {
+                if (a.first.nFile != b.first.nFile)
+                    return a.first.nFile < b.first.nFile;
+                if (a.first.nPos != b.first.nPos)
+                    return a.first.nPos < b.first.nPos;
+                return a.first.nTxOffset < b.first.nTxOffset;
+            });
+    for (const auto &pos : positions)
+    {
+        CTransaction tx;
+        uint256 hashBlock;
+        if (!ReadTransactionFromDisk(pos.first, pos.second->first, tx, hashBlock))
+            continue;
+        for (size_t i : pos.second->second)
+        {
+            txOut[i] = tx;
+            hashBlocks[i] = hashBlock;
+            found[i] = true;
+        }
+    }
+    return found;
+}
+
 bool NSPV_myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock, int32_t &txheight, int32_t &currentheight)
 {
     memset(&hashBlock,0,sizeof(hashBlock));
@@ -2317,25 +2424,13 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         return true;
     }
 
+    if (txCache.Get(hash, txOut, hashBlock))
+        return true;
+
     if (fTxIndex) {
         CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
-            if (txOut.GetHash() != hash)
-                return error("%s: txid mismatch", __func__);
-            return true;
-        }
+        if (pblocktree->ReadTxIndex(hash, postx))
+            return ReadTransactionFromDisk(postx, hash, txOut, hashBlock);
     }
 
     CBlockIndex *pindexSlow = nullptr;
@@ -2696,6 +2791,8 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
                 undo.nHeight = coins->nHeight;
                 undo.fCoinBase = coins->fCoinBase;
                 undo.nVersion = coins->nVersion;
+                undo.nLockTime = coins->nLockTime;
+                undo.fHaveLockTime = coins->fHaveLockTime;
             }
         }
     }
@@ -2791,8 +2888,8 @@ namespace Consensus {
             {
                 if ( coins->vout[prevout.n].nValue >= 10*COIN )
                 {
-                    int64_t interest; int32_t txheight; uint32_t locktime;
-                    if ( (interest= komodo_accrued_interest(&txheight,&locktime,prevout.hash,prevout.n,0,coins->vout[prevout.n].nValue,(int32_t)nSpendHeight-1)) != 0 )
+                    int64_t interest;
+                    if ( (interest= komodo_coins_interest(prevout.hash,*coins,prevout.n,(int32_t)nSpendHeight-1)) != 0 )
                     {
                         nValueIn += interest;
                     }
@@ -2981,6 +3078,8 @@ static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const CO
         coins->fCoinBase = undo.fCoinBase;
         coins->nHeight = undo.nHeight;
         coins->nVersion = undo.nVersion;
+        coins->nLockTime = undo.nLockTime;
+        coins->fHaveLockTime = undo.fHaveLockTime;
     } else {
         if (coins->IsPruned())
             fClean = fClean && error("%s: undo data adding output to missing transaction", __func__);
@@ -3003,6 +3102,7 @@ void ConnectNotarisations(const CBlock &block, int height)
         CDBBatch batch = CDBBatch(*pnotarisations);
         batch.Write(block.GetHash(), notarisations);
         WriteBackNotarisations(notarisations, batch);
+        WriteNotarisationIndexes(notarisations, height, block.GetHash(), batch);
         pnotarisations->WriteBatch(batch, true);
         LogPrintf("ConnectBlock: wrote %i block notarisations in block: %s\n",
                 notarisations.size(), block.GetHash().GetHex().data());
@@ -3010,7 +3110,7 @@ void ConnectNotarisations(const CBlock &block, int height)
 }
 
 
-void DisconnectNotarisations(const CBlock &block)
+void DisconnectNotarisations(const CBlock &block, int height)
 {
     // Delete from notarisations cache
     NotarisationsInBlock nibs;
@@ -3018,6 +3118,7 @@ void DisconnectNotarisations(const CBlock &block)
         CDBBatch batch = CDBBatch(*pnotarisations);
         batch.Erase(block.GetHash());
         EraseBackNotarisations(nibs, batch);
+        EraseNotarisationIndexes(nibs, height, batch);
         pnotarisations->WriteBatch(batch, true);
         LogPrintf("DisconnectTip: deleted %i block notarisations in block: %s\n",
             nibs.size(), block.GetHash().GetHex().data());
@@ -3052,34 +3153,167 @@ int8_t GetAddressType(const CScript &scriptPubKey, CTxDestination &vDest, txnout
     return keyType;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+/****
+ * Collect the CC index entries of a transaction: its CC outputs, keyed by the evalcode, funcid
+ * and reference txid of their opreturn. The opreturn of a CC vout is its vData when it carries
+ * one, the last vout's OP_RETURN otherwise
+ */
+static void GetCCIndexOutputs(const CTransaction &tx, int nHeight, std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > &outputs)
 {
-    assert(pindex->GetBlockHash() == view.GetBestBlock());
+    if (tx.vout.size() == 0)
+        return;
+    std::vector<unsigned char> txopret;
+    GetOpReturnData(tx.vout.back().scriptPubKey, txopret);
+
+    const uint256 hash = tx.GetHash();
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        const CTxOut &out = tx.vout[k];
+        CScript dummy;
+        std::vector<std::vector<unsigned char> > vParams;
+        std::vector<unsigned char> vopret;
+        if (!out.scriptPubKey.IsPayToCryptoCondition(&dummy, vParams))
+            continue;
+        if (vParams.size() > 0) {
+            COptCCParams p(vParams[0]);
+            if (p.vData.size() > 0)
+                vopret = p.vData[0];
+        }
+        if (vopret.size() == 0)
+            vopret = txopret;
+        if (vopret.size() < 2)
+            continue;
+        uint256 reftxid;
+        if (vopret.size() >= 2 + 32)
+            memcpy(reftxid.begin(), &vopret[2], 32);
+
+        vector<vector<unsigned char>> vSols;
+        CTxDestination vDest;
+        txnouttype txType = TX_PUBKEYHASH;
+        int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
+        if ( keyType == 0 )
+            continue;
+        for (auto addr : vSols)
+        {
+            uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+            outputs.push_back(make_pair(CCIndexKey(keyType, addrHash, vopret[0], vopret[1], reftxid, nHeight, hash, k),
+                                        CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+        }
+    }
+}
 
-    if (pfClean)
-        *pfClean = false;
+void AddressBalanceDeltas(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, CAddressBalanceMap &deltas)
+{
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+        // zero value outputs never show up in a snapshot, so they are not counted as utxos either
+        if (it->second == 0)
+            continue;
+        CAddressBalanceValue &value = deltas[CAddressIndexIteratorKey(it->first.type, it->first.hashBytes)];
+        value.satoshis += it->second;
+        value.utxos += it->first.spending ? -1 : 1;
+    }
+}
 
-    bool fClean = true;
-    //komodo_disconnect(pindex,block); does nothing?
+/**
+ * Get the address balance changes made by a connected block.
+ * Blocks connected before the address balance index existed have no stored record,
+ * for those the changes are rebuilt from the block and its undo data.
+ * @param pindex the block
+ * @param deltas the per address changes
+ * @returns true on success
+ */
+static bool ReadBlockAddressBalanceDeltas(CBlockIndex *pindex, CAddressBalanceMap &deltas)
+{
+    if (pblocktree->ReadAddressBalanceDeltas(pindex->nHeight, deltas))
+        return true;
+
+    CBlock block;
     CBlockUndo blockUndo;
     CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull())
-        return error("DisconnectBlock(): no undo data available");
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
-        return error("DisconnectBlock(): failure reading undo data");
-
+    if (!ReadBlockFromDisk(block, pindex, false))
+        return error("%s: failed to read block at height %d", __func__, pindex->nHeight);
+    if (pos.IsNull() || pindex->pprev == NULL || !UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
+        return error("%s: no undo data for block at height %d", __func__, pindex->nHeight);
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
-        return error("DisconnectBlock(): block and undo data inconsistent");
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+        return error("%s: block and undo data inconsistent", __func__);
 
-    // undo transactions in reverse order
-    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
         const CTransaction &tx = block.vtx[i];
         uint256 hash = tx.GetHash();
-        if (fAddressIndex) {
+        if (!tx.IsMint()) {
+            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s: transaction and undo data inconsistent", __func__);
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxOut &prevout = txundo.vprevout[j].txout;
+
+                vector<vector<unsigned char>> vSols;
+                CTxDestination vDest;
+                txnouttype txType = TX_PUBKEYHASH;
+                int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
+                if ( keyType != 0 )
+                {
+                    for (auto addr : vSols)
+                    {
+                        uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                        addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
+                    }
+                }
+            }
+        }
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+
+            vector<vector<unsigned char>> vSols;
+            CTxDestination vDest;
+            txnouttype txType = TX_PUBKEYHASH;
+            int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
+            if ( keyType != 0 )
+            {
+                for (auto addr : vSols)
+                {
+                    uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                    addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, hash, k, false), out.nValue));
+                }
+            }
+        }
+    }
+    AddressBalanceDeltas(addressIndex, deltas);
+    return true;
+}
+
+/**
+ * Collect the index changes of connecting or disconnecting a block.
+ * Everything comes from the block and its undo data, so the changes of a block can be
+ * collected again at startup when they did not reach the disk before a shutdown.
+ * @param block the block
+ * @param pindex its block index entry
+ * @param blockUndo the undo data of the block
+ * @param fUndo true if the block is disconnected
+ * @param update receives the changes
+ * @returns false if the block and undo data do not match
+ */
+static bool GetBlockIndexUpdate(const CBlock &block, const CBlockIndex *pindex, const CBlockUndo &blockUndo, bool fUndo, CBlockIndexUpdate &update)
+{
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: block and undo data inconsistent", __func__);
+
+    update.hashBlock = pindex->GetBlockHash();
+    update.hashPrevBlock = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+    update.nHeight = pindex->nHeight;
+    update.nTime = pindex->nTime;
+    update.fUndo = fUndo;
+    update.fAddressIndex = fAddressIndex;
+    update.fTimestampIndex = fTimestampIndex;
+    update.fCCIndex = fCCIndex;
+
+    for (unsigned int n = 0; n < block.vtx.size(); n++) {
+        // a disconnected block is undone in reverse order
+        const unsigned int i = fUndo ? block.vtx.size() - 1 - n : n;
+        const CTransaction &tx = block.vtx[i];
+        const uint256 hash = tx.GetHash();
 
+        if (fUndo && fAddressIndex) {
             for (unsigned int k = tx.vout.size(); k-- > 0;) {
                 const CTxOut &out = tx.vout[k];
 
@@ -3092,12 +3326,121 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                     for (auto addr : vSols)
                     {
                         uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                        addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, hash, k, false), out.nValue));
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, hash, k), CAddressUnspentValue()));
+                        update.addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, hash, k, false), out.nValue));
+                        update.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, hash, k), CAddressUnspentValue()));
+                    }
+                }
+            }
+        }
+        if (fUndo && fCCIndex)
+            GetCCIndexOutputs(tx, pindex->nHeight, update.ccIndex);
+
+        if (!tx.IsMint()) {
+            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s: transaction and undo data inconsistent", __func__);
+            for (unsigned int m = 0; m < tx.vin.size(); m++) {
+                const unsigned int j = fUndo ? tx.vin.size() - 1 - m : m;
+                const CTxIn &input = tx.vin[j];
+                const CTxInUndo &undo = txundo.vprevout[j];
+                const CTxOut &prevout = undo.txout;
+
+                // when undoing, the index restores the entries it kept for the spends of the block
+                if (fCCIndex && !fUndo && prevout.scriptPubKey.IsPayToCryptoCondition())
+                    update.ccSpends.push_back(input.prevout);
+
+                if (fUndo && fSpentIndex) {
+                    // undo and delete the spent index
+                    update.spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
+                }
+
+                if (!fAddressIndex && !fSpentIndex)
+                    continue;
+
+                vector<vector<unsigned char>> vSols;
+                CTxDestination vDest;
+                txnouttype txType = TX_PUBKEYHASH;
+                uint160 addrHash;
+                int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
+                if ( keyType != 0 )
+                {
+                    for (auto addr : vSols)
+                    {
+                        addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                        if (!fAddressIndex)
+                            continue;
+                        // record spending activity, or undo it
+                        update.addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
+
+                        // remove the output from the unspent index, or restore it
+                        if (fUndo)
+                            update.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
+                        else
+                            update.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                    }
+
+                    if (!fUndo && fSpentIndex) {
+                        // add the spent index to determine the txid and input that spent an output
+                        // and to find the amount and address from an input
+                        update.spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(hash, j, pindex->nHeight, prevout.nValue, keyType, addrHash)));
+                    }
+                }
+            }
+        }
+
+        if (!fUndo && fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut &out = tx.vout[k];
+
+                vector<vector<unsigned char>> vSols;
+                CTxDestination vDest;
+                txnouttype txType = TX_PUBKEYHASH;
+                int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
+                if ( keyType != 0 )
+                {
+                    for (auto addr : vSols)
+                    {
+                        uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                        // record receiving activity
+                        update.addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, hash, k, false), out.nValue));
+
+                        // record unspent output
+                        update.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, hash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
                     }
                 }
             }
         }
+        if (!fUndo && fCCIndex)
+            GetCCIndexOutputs(tx, pindex->nHeight, update.ccIndex);
+    }
+    if (fAddressIndex)
+        AddressBalanceDeltas(update.addressIndex, update.balanceDeltas);
+    return true;
+}
+
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+{
+    assert(pindex->GetBlockHash() == view.GetBestBlock());
+
+    if (pfClean)
+        *pfClean = false;
+
+    bool fClean = true;
+    //komodo_disconnect(pindex,block); does nothing?
+    CBlockUndo blockUndo;
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull())
+        return error("DisconnectBlock(): no undo data available");
+    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
+        return error("DisconnectBlock(): failure reading undo data");
+
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        return error("DisconnectBlock(): block and undo data inconsistent");
+
+    // undo transactions in reverse order
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction &tx = block.vtx[i];
+        uint256 hash = tx.GetHash();
 
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
@@ -3131,33 +3474,6 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 const CTxInUndo &undo = txundo.vprevout[j];
                 if (!ApplyTxInUndo(undo, view, out))
                     fClean = false;
-
-                const CTxIn input = tx.vin[j];
-
-                if (fSpentIndex) {
-                    // undo and delete the spent index
-                    spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
-                }
-
-                if (fAddressIndex) {
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-
-                    vector<vector<unsigned char>> vSols;
-                    CTxDestination vDest;
-                    txnouttype txType = TX_PUBKEYHASH;
-                    int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
-                    if ( keyType != 0 )
-                    {
-                        for (auto addr : vSols)
-                        {
-                            uint160 addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                            // undo spending activity
-                            addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-                            // restore unspent index
-                            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-                        }
-                    }
-                }
             }
         }
         else if (tx.IsCoinImport())
@@ -3188,13 +3504,12 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         return true;
     }
 
-    if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to delete address index");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
+    if (fAddressIndex || fSpentIndex || fCCIndex || fTimestampIndex) {
+        std::shared_ptr<CBlockIndexUpdate> update(new CBlockIndexUpdate());
+        if (!GetBlockIndexUpdate(block, pindex, blockUndo, true, *update))
+            return AbortNode(state, "Failed to collect index changes");
+        if (!pblocktree->QueueIndexUpdate(update))
+            return AbortNode(state, "Failed to queue the index updates of a disconnected block");
     }
 
     return fClean;
@@ -3303,6 +3618,7 @@ static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
+static int64_t nTimeKomodoHooks = 0;
 bool FindBlockPos(int32_t tmpflag,CValidationState &state, CDiskBlockPos &pos, unsigned int nAddSize, unsigned int nHeight, uint64_t nTime, bool fKnown = false);
 bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos);
 
@@ -3469,9 +3785,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     // Construct the incremental merkle tree at the current
     // block position,
     auto old_sprout_tree_root = view.GetBestAnchor(SPROUT);
@@ -3531,38 +3844,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             if (!view.HaveJoinSplitRequirements(tx))
                 return state.DoS(100, error("ConnectBlock(): JoinSplit requirements not met"),
                                  REJECT_INVALID, "bad-txns-joinsplit-requirements-not-met");
-            if (fAddressIndex || fSpentIndex)
-            {
-                for (size_t j = 0; j < tx.vin.size(); j++) 
-                {
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-
-                    vector<vector<unsigned char>> vSols;
-                    CTxDestination vDest;
-                    txnouttype txType = TX_PUBKEYHASH;
-                    uint160 addrHash;
-                    int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
-                    if ( keyType != 0 )
-                    {
-                        for (auto addr : vSols)
-                        {
-                            addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                            // record spending activity
-                            addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
-
-                            // remove address from unspent index
-                            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                        }
-
-                        if (fSpentIndex) {
-                            // add the spent index to determine the txid and input that spent an output
-                            // and to find the amount and address from an input
-                            spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, keyType, addrHash)));
-                        }
-                    }
-                }
-            }
             // Add in sigops done by pay-to-script-hash inputs;
             // this is to prevent a "rogue miner" from creating
             // an incredibly-expensive-to-validate block.
@@ -3603,31 +3884,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             control.Add(vChecks);
         }
 
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                uint160 addrHash;
-
-                vector<vector<unsigned char>> vSols;
-                CTxDestination vDest;
-                txnouttype txType = TX_PUBKEYHASH;
-                int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
-                if ( keyType != 0 )
-                {
-                    for (auto addr : vSols)
-                    {
-                        addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                        // record receiving activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                        // record unspent output
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                    }
-                }
-            }
-        }
-
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -3788,45 +4044,19 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
+    int64_t nTimeHooks = GetTimeMicros();
     ConnectNotarisations(block, pindex->nHeight); // MoMoM notarisation DB.
+    nTimeHooks = GetTimeMicros() - nTimeHooks;
 
     if (fTxIndex)
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
-    if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-
-    if (fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
-
-    if (fTimestampIndex)
-    {
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS) {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-        }
-
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
+    if (fAddressIndex || fSpentIndex || fCCIndex || fTimestampIndex) {
+        std::shared_ptr<CBlockIndexUpdate> update(new CBlockIndexUpdate());
+        if (!GetBlockIndexUpdate(block, pindex, blockundo, false, *update))
+            return AbortNode(state, "Failed to collect index changes");
+        if (!pblocktree->QueueIndexUpdate(update))
+            return AbortNode(state, "Failed to queue the index updates of a connected block");
     }
 
     // add this block to the view's block chain
@@ -3844,7 +4074,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeCallbacks * 0.000001);
 
     //FlushStateToDisk();
+    int64_t nTime5 = GetTimeMicros();
     komodo_connectblock(false,pindex,*(CBlock *)&block);  // dPoW state update.
+    nTimeHooks += GetTimeMicros() - nTime5;
+    nTimeKomodoHooks += nTimeHooks;
     if ( ASSETCHAINS_NOTARY_PAY[0] != 0 )
     {
       // Update the notary pay with the latest payment.
@@ -3970,8 +4203,11 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     return true;
 }
 
+static void CancelBlockPrefetch();
+
 void FlushStateToDisk() {
     CValidationState state;
+    CancelBlockPrefetch();
     if ( KOMODO_NSPV_FULLNODE )
         FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
@@ -4070,8 +4306,11 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
         if (!DisconnectBlock(block, state, pindexDelete, view))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
-        DisconnectNotarisations(block);
+        DisconnectNotarisations(block, pindexDelete->nHeight);
     }
+    txCache.EraseBlock(block);
+    komodo_segidring_disconnect(pindexDelete);
+    komodo_powwindow_disconnect(pindexDelete);
     pindexDelete->segid = -2;
     pindexDelete->nNotaryPay = 0; 
     pindexDelete->newcoins = 0;
@@ -4209,6 +4448,129 @@ static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
+static int64_t nTimePrefetch = 0;
+static int64_t nPrefetchedBlocks = 0;
+static int64_t nDiscardedPrefetches = 0;
+static int64_t nPrefetchedCoins = 0;
+static int64_t nBlocksConnected = 0;
+static int64_t nIBDStart = 0;
+static int64_t nIBDEnd = 0;
+
+//! the txids whose outputs a block spends, each once
+static std::vector<uint256> BlockPrevouts(const CBlock &block)
+{
+    std::vector<uint256> txids;
+    for (const CTransaction &tx : block.vtx)
+        if (!tx.IsCoinBase())
+            for (const CTxIn &txin : tx.vin)
+                txids.push_back(txin.prevout.hash);
+    std::sort(txids.begin(), txids.end());
+    txids.erase(std::unique(txids.begin(), txids.end()), txids.end());
+    return txids;
+}
+
+static int PrefetchThreads()
+{
+    return std::max(nScriptCheckThreads, 1);
+}
+
+/**
+ * Reads the next block to connect, and the coins it spends from the chainstate db, on a background
+ * thread while the current block is connected (scripts, indexes and komodo hooks).
+ * Only used with cs_main held
+ */
+class CBlockPrefetch
+{
+private:
+    boost::thread thread;
+    const CBlockIndex *pindex;
+    uint64_t nFlushCount;
+    bool fOk;
+    CBlock block;
+    std::vector<std::pair<uint256, CCoins> > coins;
+
+    void Run(const CCoinsViewCache *view, int nThreads)
+    {
+        RenameThread("komodo-prefetch");
+        fOk = ReadBlockFromDisk(block, pindex, false);
+        if (fOk)
+            view->ReadBaseCoins(BlockPrevouts(block), nThreads, coins);
+    }
+
+public:
+    CBlockPrefetch() : pindex(NULL), nFlushCount(0), fOk(false) {}
+    ~CBlockPrefetch() { Cancel(); }
+
+    void Start(const CBlockIndex *pindexIn, const CCoinsViewCache *view)
+    {
+        Cancel();
+        pindex = pindexIn;
+        nFlushCount = view->GetFlushCount();
+        thread = boost::thread(&CBlockPrefetch::Run, this, view, PrefetchThreads());
+    }
+
+    void Cancel()
+    {
+        if (thread.joinable())
+            thread.join();
+        pindex = NULL;
+        fOk = false;
+        block.SetNull();
+        coins.clear();
+    }
+
+    /**
+     * Take the prefetched block and cache its coins
+     * @param pindexIn the block about to be connected
+     * @param blockOut the block read from disk
+     * @param view the cache the coins go into, it must be the one passed to Start
+     * @returns false if nothing (usable) was prefetched for pindexIn
+     */
+    bool Take(const CBlockIndex *pindexIn, CBlock &blockOut, CCoinsViewCache *view)
+    {
+        if (pindex == NULL)
+            return false;
+        if (thread.joinable())
+            thread.join();
+        bool fMatch = fOk && pindex == pindexIn;
+        if (fMatch) {
+            blockOut = block;
+            // coins read before the chainstate was flushed may be outdated
+            if (view->GetFlushCount() == nFlushCount)
+                nPrefetchedCoins += view->AddPrefetched(coins);
+            else
+                fMatch = false;
+        }
+        if (fMatch)
+            nPrefetchedBlocks++;
+        else
+            nDiscardedPrefetches++;
+        Cancel();
+        return fMatch;
+    }
+};
+
+static CBlockPrefetch blockPrefetch;
+
+static void CancelBlockPrefetch()
+{
+    blockPrefetch.Cancel();
+}
+
+CConnectStats GetConnectStats()
+{
+    LOCK(cs_main);
+    CConnectStats stats;
+    stats.nBlocks = nBlocksConnected;
+    stats.nPrefetchedBlocks = nPrefetchedBlocks;
+    stats.nDiscardedPrefetches = nDiscardedPrefetches;
+    stats.nPrefetchedCoins = nPrefetchedCoins;
+    stats.nPrefetchTime = nTimePrefetch;
+    stats.nConnectTime = nTimeConnectTotal - nTimeKomodoHooks;
+    stats.nHooksTime = nTimeKomodoHooks;
+    stats.nIBDTime = nIBDStart == 0 ? 0 : (nIBDEnd != 0 ? nIBDEnd : GetTimeMicros()) - nIBDStart;
+    return stats;
+}
 
 /***
  * @brief Connect a new block to chainActive.
@@ -4216,19 +4578,32 @@ static int64_t nTimePostConnect = 0;
  * @param[out] state holds the state
  * @param pindexNew the new index
  * @param pblock a pointer to a CBlock (nullptr will load it from disk)
+ * @param pindexNext the block that will be connected after this one, if known, to prefetch it meanwhile
  * @returns true on success
  */
-bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *pblock) {
+bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *pblock, CBlockIndex *pindexNext = NULL) {
 
     assert(pindexNew->pprev == chainActive.Tip());
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
+    if (nIBDStart == 0)
+        nIBDStart = nTime1;
     CBlock block;
+    bool fPrefetched = false;
     if (!pblock) {
-        if (!ReadBlockFromDisk(block, pindexNew,1))
+        fPrefetched = blockPrefetch.Take(pindexNew, block, pcoinsTip);
+        if (!fPrefetched && !ReadBlockFromDisk(block, pindexNew,1))
             return AbortNode(state, "Failed to read block");
         pblock = &block;
-    }
+    } else {
+        blockPrefetch.Cancel();
+    }
+    // Cache the coins the block spends, and start reading the next block while this one connects
+    if (!fPrefetched && fBlockPrefetch)
+        nPrefetchedCoins += pcoinsTip->Prefetch(BlockPrevouts(*pblock), PrefetchThreads());
+    if (pindexNext != NULL && fBlockPrefetch && (pindexNext->nStatus & BLOCK_HAVE_DATA))
+        blockPrefetch.Start(pindexNext, pcoinsTip);
+    nTimePrefetch += GetTimeMicros() - nTime1;
     KOMODO_CONNECTING = (int32_t)pindexNew->nHeight;
     //LogPrintf("%s connecting ht.%d maxsize.%d vs %d\n",ASSETCHAINS_SYMBOL,(int32_t)pindexNew->nHeight,MAX_BLOCK_SIZE(pindexNew->nHeight),(int32_t)::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
     // Get the current commitment tree
@@ -4256,6 +4631,8 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
             return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
         }
         mapBlockSource.erase(pindexNew->GetBlockHash());
+        if ( komodo_segidring_connect(pindexNew, *pblock) )
+            setDirtyBlockIndex.insert(pindexNew);
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         if ( KOMODO_NSPV_FULLNODE )
@@ -4280,6 +4657,7 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
 
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    komodo_powwindow_connect(pindexNew);
     if ( KOMODO_NSPV_FULLNODE )
     {
         // Tell wallet about transactions that went from mempool
@@ -4300,6 +4678,9 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    nBlocksConnected++;
+    if (nIBDEnd == 0 && !IsInitialBlockDownload())
+        nIBDEnd = nTime6;
     if ( KOMODO_LONGESTCHAIN != 0 && (pindexNew->nHeight == KOMODO_LONGESTCHAIN || pindexNew->nHeight == KOMODO_LONGESTCHAIN+1) )
         KOMODO_INSYNC = (int32_t)pindexNew->nHeight;
     else KOMODO_INSYNC = 0;
@@ -4520,8 +4901,11 @@ static bool ActivateBestChainStep(bool fSkipdpow, CValidationState &state, CBloc
         nHeight = nTargetHeight;
 
         // Connect new blocks.
-        BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
-            if (!ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL)) {
+        for (std::vector<CBlockIndex*>::reverse_iterator it = vpindexToConnect.rbegin(); it != vpindexToConnect.rend(); it++) {
+            CBlockIndex *pindexConnect = *it;
+            // the next block to connect, to prefetch it unless it was passed in
+            CBlockIndex *pindexNext = it + 1 != vpindexToConnect.rend() && *(it + 1) != pindexMostWork ? *(it + 1) : NULL;
+            if (!ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL, pindexNext)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -4601,6 +4985,7 @@ bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock)
 
         bool fInitialDownload;
         int nNewHeight; // https://github.com/zcash/zcash/commit/c3646bdf886dcb65e75d9ed60d529c6e828161f3
+        std::set<NodeId> setCompactPeers;
         {
             LOCK(cs_main);
             CBlockIndex *pindexOldTip = chainActive.Tip();
@@ -4617,6 +5002,12 @@ bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock)
             pindexFork = chainActive.FindFork(pindexOldTip);
             fInitialDownload = IsInitialBlockDownload();
             nNewHeight = chainActive.Height();
+            // a single new block we already hold is announced as a compact block to the peers asking for it
+            if (pblock != NULL && pindexNewTip->pprev == pindexOldTip && pblock->GetHash() == pindexNewTip->GetBlockHash()) {
+                for (map<NodeId, CNodeState>::const_iterator it = mapNodeState.begin(); it != mapNodeState.end(); ++it)
+                    if (it->second.fPreferHeaderAndIDs)
+                        setCompactPeers.insert(it->first);
+            }
         }
         // When we reach this point, we switched to a new tip (stored in pindexNewTip).
 
@@ -4630,10 +5021,28 @@ bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock)
             // Don't relay blocks if pruning -- could cause a peer to try to download, resulting
             // in a stalled download if the block file is pruned before the request.
             if (nLocalServices & NODE_NETWORK) {
+                std::unique_ptr<CBlockHeaderAndShortTxIDs> cmpctblock;
+                if (!setCompactPeers.empty())
+                    cmpctblock.reset(new CBlockHeaderAndShortTxIDs(*pblock, ASSETCHAINS_STAKED != 0));
+                CInv inv(MSG_BLOCK, hashNewTip);
                 LOCK(cs_vNodes);
                 BOOST_FOREACH(CNode* pnode, vNodes)
-                if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                    pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                {
+                    if (nNewHeight <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
+                        continue;
+                    if (cmpctblock && setCompactPeers.count(pnode->GetId()) != 0) {
+                        bool fKnown;
+                        {
+                            LOCK(pnode->cs_inventory);
+                            fKnown = pnode->setInventoryKnown.count(inv) != 0;
+                        }
+                        if (!fKnown) {
+                            pnode->AddInventoryKnown(inv);
+                            pnode->PushMessage("cmpctblock", *cmpctblock);
+                        }
+                    } else
+                        pnode->PushInventory(inv);
+                }
             }
             // Notify external listeners about the new tip.
             GetMainSignals().UpdatedBlockTip(pindexNewTip);
@@ -6350,6 +6759,17 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
 
+    // Databases created before the address balance index existed build it once from the unspent index
+    if (fAddressIndex) {
+        bool fAddressBalanceIndex = false;
+        pblocktree->ReadFlag("addressbalanceindex", fAddressBalanceIndex);
+        if (!fAddressBalanceIndex) {
+            LogPrintf("%s: building address balance index\n", __func__);
+            if (!pblocktree->RebuildAddressBalanceIndex() || !pblocktree->WriteFlag("addressbalanceindex", true))
+                return error("%s: failed to build address balance index", __func__);
+        }
+    }
+
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
     LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
@@ -6358,6 +6778,10 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("spentindex", fSpentIndex);
     LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
+    // Check whether we have a CC index
+    pblocktree->ReadFlag("ccindex", fCCIndex);
+    LogPrintf("%s: CC index %s\n", __func__, fCCIndex ? "enabled" : "disabled");
+
     // Fill in-memory data
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
     {
@@ -6505,6 +6929,64 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
     return true;
 }
 
+static bool ReplayBlockIndexUpdate(CBlockIndex *pindex, bool fUndo)
+{
+    CBlock block;
+    CBlockUndo blockUndo;
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (!ReadBlockFromDisk(block, pindex, false))
+        return error("%s: failed to read block at height %d", __func__, pindex->nHeight);
+    if (pos.IsNull() || pindex->pprev == NULL || !UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
+        return error("%s: no undo data for block at height %d", __func__, pindex->nHeight);
+
+    std::shared_ptr<CBlockIndexUpdate> update(new CBlockIndexUpdate());
+    if (!GetBlockIndexUpdate(block, pindex, blockUndo, fUndo, *update))
+        return false;
+    return pblocktree->QueueIndexUpdate(update);
+}
+
+/**
+ * Bring the address, spent, CC and timestamp indexes in line with the active chain.
+ * Their writes trail validation, so after a crash they can be behind the chainstate
+ * or still hold blocks that were disconnected.
+ * @returns true on success
+ */
+bool ReplayBlockIndexes()
+{
+    LOCK(cs_main);
+    if (!fAddressIndex && !fSpentIndex && !fCCIndex && !fTimestampIndex)
+        return true;
+    CBlockIndex *pindexTip = chainActive.Tip();
+    if (pindexTip == NULL)
+        return true;
+
+    uint256 hashIndexed;
+    if (!pblocktree->ReadBestIndexedBlock(hashIndexed)) {
+        // indexes written by older versions are always in step with the chainstate
+        return pblocktree->WriteBestIndexedBlock(pindexTip->GetBlockHash());
+    }
+    if (hashIndexed == pindexTip->GetBlockHash())
+        return true;
+
+    BlockMap::iterator mi = mapBlockIndex.find(hashIndexed);
+    if (mi == mapBlockIndex.end() || mi->second == NULL)
+        return error("%s: indexed block %s is not in the block index", __func__, hashIndexed.ToString());
+    CBlockIndex *pindexIndexed = mi->second;
+    const CBlockIndex *pindexFork = chainActive.FindFork(pindexIndexed);
+    if (pindexFork == NULL)
+        return error("%s: indexed block %s is not connected to the active chain", __func__, hashIndexed.ToString());
+
+    LogPrintf("%s: indexes at height %d, rewinding to %d and replaying to %d\n", __func__,
+        pindexIndexed->nHeight, pindexFork->nHeight, pindexTip->nHeight);
+    for (CBlockIndex *pindex = pindexIndexed; pindex != pindexFork; pindex = pindex->pprev)
+        if (!ReplayBlockIndexUpdate(pindex, true))
+            return false;
+    for (CBlockIndex *pindex = chainActive.Next(pindexFork); pindex != NULL; pindex = chainActive.Next(pindex))
+        if (!ReplayBlockIndexUpdate(pindex, false))
+            return false;
+    return pblocktree->SyncIndexWrites();
+}
+
 /**
  * When there are blocks in the active chain with missing data (e.g. if the
  * activation height and branch ID of a particular upgrade have been altered),
@@ -6660,6 +7142,7 @@ bool RewindBlockIndex(const CChainParams& params)
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
+    CancelBlockPrefetch();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
@@ -6731,6 +7214,7 @@ bool InitBlockIndex() {
         // Use the provided setting for -addressindex in the new database
         fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
         pblocktree->WriteFlag("addressindex", fAddressIndex);
+        pblocktree->WriteFlag("addressbalanceindex", fAddressIndex);
         
         // Use the provided setting for -timestampindex in the new database
         fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
@@ -6738,7 +7222,9 @@ bool InitBlockIndex() {
         
         fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
         pblocktree->WriteFlag("spentindex", fSpentIndex);
-        LogPrintf("fAddressIndex.%d/%d fSpentIndex.%d/%d\n",fAddressIndex,DEFAULT_ADDRESSINDEX,fSpentIndex,DEFAULT_SPENTINDEX);
+        fCCIndex = GetBoolArg("-ccindex", DEFAULT_CCINDEX);
+        pblocktree->WriteFlag("ccindex", fCCIndex);
+        LogPrintf("fAddressIndex.%d/%d fSpentIndex.%d/%d fCCIndex.%d/%d\n",fAddressIndex,DEFAULT_ADDRESSINDEX,fSpentIndex,DEFAULT_SPENTINDEX,fCCIndex,DEFAULT_CCINDEX);
         LogPrintf("Initializing databases...\n");
     }
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -7202,7 +7688,7 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -7255,6 +7741,17 @@ void static ProcessGetData(CNode* pfrom)
                             //LogPrintf(" send block %d\n",komodo_block2height(&block));
                             pfrom->PushMessage("block", block);
                         }
+                        else if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            // the transactions of deeper blocks have left the peer's mempool, send those in full
+                            if (mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH)
+                            {
+                                CBlockHeaderAndShortTxIDs cmpctblock(block, ASSETCHAINS_STAKED != 0);
+                                pfrom->PushMessage("cmpctblock", cmpctblock);
+                            }
+                            else
+                                pfrom->PushMessage("block", block);
+                        }
                         else // MSG_FILTERED_BLOCK)
                         {
                             LOCK(pfrom->cs_filter);
@@ -7317,7 +7814,7 @@ void static ProcessGetData(CNode* pfrom)
                 }
             }
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -7336,6 +7833,24 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+/** Processes a block rebuilt from "cmpctblock" or "blocktxn" the way the "block" message does */
+void static ProcessReconstructedBlock(CNode* pfrom, const std::string& strCommand, CBlock& block)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    CValidationState state;
+    bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
+    ProcessNewBlock(0,0,state, pfrom, &block, forceProcessing, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+}
+
 #include "komodo_nSPV_defs.h"
 #include "komodo_nSPV.h"            // shared defines, structs, serdes, purge functions
 #include "komodo_nSPV_fullnode.h"   // nSPV fullnode handling of the getnSPV request messages
@@ -7538,6 +8053,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        // Offer compact blocks, and ask our outbound peers to announce new blocks with them.
+        // Peers without support ignore the unknown message.
+        if (!KOMODO_NSPV_SUPERLITE && GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS))
+            pfrom->PushMessage("sendcmpct", !pfrom->fInbound, CMPCTBLOCKS_VERSION);
     }
 
 
@@ -7823,7 +8343,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (chainActive.Tip()->GetBlockTime() > GetTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
                         nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        // a peer that supports it sends the block as a compact block
+                        vToFetch.push_back(nodestate->fProvidesCompactBlocks ? CInv(MSG_CMPCT_BLOCK, inv.hash) : inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -8216,6 +8737,184 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounce = false;
+        uint64_t nVersion = 0;
+        vRecv >> fAnnounce >> nVersion;
+        if (nVersion == CMPCTBLOCKS_VERSION && GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS)) {
+            LOCK(cs_main);
+            CNodeState *nodestate = State(pfrom->GetId());
+            nodestate->fProvidesCompactBlocks = true;
+            nodestate->fPreferHeaderAndIDs = fAnnounce;
+        }
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        uint256 hash = cmpctblock.header.GetHash();
+        CInv inv(MSG_BLOCK, hash);
+        LogPrint("net", "received cmpctblock %s peer=%d\n", hash.ToString(), pfrom->id);
+        pfrom->AddInventoryKnown(inv);
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            CNodeState *nodestate = State(pfrom->GetId());
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+            bool fInFlightFromPeer = itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+            vector<CInv> vFullBlock(1, inv);
+
+            CBlockIndex *pindex = NULL;
+            if (mapBlockIndex.count(cmpctblock.header.hashPrevBlock) == 0) {
+                // We are missing headers, ask for them and for the whole block if we requested it.
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hash);
+                if (fInFlightFromPeer)
+                    pfrom->PushMessage("getdata", vFullBlock);
+                return true;
+            }
+            CValidationState state;
+            int32_t futureblock = 0;
+            if (!AcceptBlockHeader(&futureblock, cmpctblock.header, state, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && futureblock == 0)
+                {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS/nDoS);
+                    return error("invalid header received in cmpctblock");
+                }
+                if (fInFlightFromPeer)
+                    pfrom->PushMessage("getdata", vFullBlock);
+                return true;
+            }
+            UpdateBlockAvailability(pfrom->GetId(), hash);
+
+            // Unrequested compact blocks are only used when they extend our tip, any other
+            // block goes through the usual headers-first download.
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                return true;
+            if (!fInFlightFromPeer && (itInFlight != mapBlocksInFlight.end() || pindex->pprev != chainActive.Tip() ||
+                                       nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER))
+                return true;
+            if (fInFlightFromPeer && itInFlight->second.second->partialBlock)
+                return true; // still waiting for the "blocktxn" of an earlier one
+
+            if (!fInFlightFromPeer)
+                MarkBlockAsInFlight(pfrom->GetId(), hash, chainparams.GetConsensus(), pindex);
+            nodestate->nCompactBlocks++;
+
+            std::shared_ptr<PartiallyDownloadedBlock> partialBlock(new PartiallyDownloadedBlock(&mempool));
+            ReadStatus status = partialBlock->InitData(cmpctblock);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(hash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("invalid cmpctblock %s from peer=%d", hash.ToString(), pfrom->id);
+            }
+            std::vector<uint16_t> vMissing;
+            if (status == READ_STATUS_OK) {
+                vMissing = partialBlock->GetMissing();
+                if (vMissing.empty()) {
+                    status = partialBlock->FillBlock(block, std::vector<CTransaction>());
+                    if (status == READ_STATUS_OK)
+                        nodestate->nCompactReconstructed++;
+                }
+            }
+            if (status != READ_STATUS_OK) {
+                // short id collisions, the full block stays in flight from this peer
+                nodestate->nCompactFailed++;
+                pfrom->PushMessage("getdata", vFullBlock);
+                return true;
+            }
+            if (!vMissing.empty()) {
+                mapBlocksInFlight[hash].second->partialBlock = partialBlock;
+                BlockTransactionsRequest req;
+                req.blockhash = hash;
+                req.indexes = vMissing;
+                LogPrint("net", "requesting %u of %u transactions of cmpctblock %s from peer=%d\n", vMissing.size(), cmpctblock.BlockTxCount(), hash.ToString(), pfrom->id);
+                pfrom->PushMessage("getblocktxn", req);
+                return true;
+            }
+        }
+        ProcessReconstructedBlock(pfrom, strCommand, block);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+            if (mi == mapBlockIndex.end() || mi->second == 0 || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint("net", "peer=%d asked for transactions of unknown block %s\n", pfrom->id, req.blockhash.ToString());
+                return true;
+            }
+            if (!chainActive.Contains(mi->second) || mi->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                // only recent blocks are served in parts, send this one the usual way
+                LogPrint("net", "peer=%d asked for transactions of old block %s, sending it in full\n", pfrom->id, req.blockhash.ToString());
+                pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+                ProcessGetData(pfrom);
+                return true;
+            }
+            if (!ReadBlockFromDisk(block, mi->second, 1))
+                assert(!"cannot load block from disk");
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("getblocktxn with out-of-bounds tx indexes from peer=%d", pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(resp.blockhash);
+            if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId() || !itInFlight->second.second->partialBlock) {
+                LogPrint("net", "peer=%d sent transactions of block %s we did not ask for\n", pfrom->id, resp.blockhash.ToString());
+                return true;
+            }
+            CNodeState *nodestate = State(pfrom->GetId());
+            std::shared_ptr<PartiallyDownloadedBlock> partialBlock = itInFlight->second.second->partialBlock;
+            itInFlight->second.second->partialBlock.reset();
+            ReadStatus status = partialBlock->FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("invalid blocktxn %s from peer=%d", resp.blockhash.ToString(), pfrom->id);
+            }
+            if (status == READ_STATUS_FAILED) {
+                // short id collisions, the full block stays in flight from this peer
+                nodestate->nCompactFailed++;
+                vector<CInv> vFullBlock(1, CInv(MSG_BLOCK, resp.blockhash));
+                pfrom->PushMessage("getdata", vFullBlock);
+                return true;
+            }
+            nodestate->nCompactRoundTrips++;
+        }
+        ProcessReconstructedBlock(pfrom, strCommand, block);
+    }
+
+
     else if (strCommand == "mempool")
     {
 
@@ -8722,8 +9421,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
             FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            bool fCompact = state.fProvidesCompactBlocks && !IsInitialBlockDownload();
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
-                vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                // the block on top of our tip can mostly be rebuilt from our mempool
+                vGetData.push_back(CInv(fCompact && pindex->pprev == chainActive.Tip() ? MSG_CMPCT_BLOCK : MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
                 LogPrint("net", "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                          pindex->nHeight, pto->id);
@@ -41,11 +41,13 @@
 #include "spentindex.h"
 #include "sync.h"
 #include "tinyformat.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "uint256.h"
 
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -103,6 +105,8 @@ static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
+/** Default for -compactblocks, negotiating "cmpctblock" relay with peers that support it. */
+static const bool DEFAULT_COMPACT_BLOCKS = true;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 160;
@@ -125,10 +129,13 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 #define DEFAULT_ADDRESSINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 #define DEFAULT_SPENTINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 static const bool DEFAULT_TIMESTAMPINDEX = false;
+static const bool DEFAULT_CCINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
 /** Default NSPV support enabled */
 static const bool DEFAULT_NSPV_PROCESSING = false;
+/** Default for -nspvthreads, the threads answering nSPV requests */
+static const int DEFAULT_NSPV_THREADS = 2;
 
 // Sanity check the magic numbers when we change them
 //BOOST_STATIC_ASSERT(DEFAULT_BLOCK_MAX_SIZE <= MAX_BLOCK_SIZE());
@@ -160,8 +167,10 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fCCIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
+extern bool fBlockPrefetch;
 extern bool fCheckpointsEnabled;
 // TODO: remove this flag by structuring our code such that
 // it is unneeded for testing
@@ -254,6 +263,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Answer the nSPV requests queued by the "getnSPV" message */
+void ThreadNSPVRequests();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -307,6 +318,21 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+
+/** Counters of the block connection pipeline, times in microseconds */
+struct CConnectStats
+{
+    int64_t nBlocks;               //!< blocks connected
+    int64_t nPrefetchedBlocks;     //!< blocks read with their coins while the previous block was connected
+    int64_t nDiscardedPrefetches;  //!< prefetches not used (another block was connected, or the chainstate was flushed)
+    int64_t nPrefetchedCoins;      //!< coins cached ahead of ConnectBlock
+    int64_t nPrefetchTime;         //!< reading blocks and caching their coins
+    int64_t nConnectTime;          //!< ConnectBlock without the komodo hooks
+    int64_t nHooksTime;            //!< komodo_connectblock and the notarisation db
+    int64_t nIBDTime;              //!< wall clock from the first block connected until initial download finished
+};
+/** Get the block connection pipeline counters */
+CConnectStats GetConnectStats();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 
@@ -330,6 +356,11 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    bool fCompactBlocks;
+    int nCompactBlocks;
+    int nCompactReconstructed;
+    int nCompactRoundTrips;
+    int nCompactFailed;
 };
 
 struct CTimestampIndexIteratorKey {
@@ -664,6 +695,199 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+struct CAddressIndexIteratorKeyCompare
+{
+    bool operator()(const CAddressIndexIteratorKey& a, const CAddressIndexIteratorKey& b) const {
+        if (a.type == b.type) {
+            return a.hashBytes < b.hashBytes;
+        } else {
+            return a.type < b.type;
+        }
+    }
+};
+
+/***
+ * Running balance of an address, kept in the block tree db next to the
+ * address unspent index so that snapshots do not need to walk every utxo
+ */
+struct CAddressBalanceValue {
+    CAmount satoshis;
+    int64_t utxos;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(satoshis);
+        READWRITE(utxos);
+    }
+
+    CAddressBalanceValue(CAmount sats, int64_t count) {
+        satoshis = sats;
+        utxos = count;
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        satoshis = 0;
+        utxos = 0;
+    }
+
+    bool IsNull() const {
+        return (satoshis == 0 && utxos == 0);
+    }
+};
+
+typedef std::map<CAddressIndexIteratorKey, CAddressBalanceValue, CAddressIndexIteratorKeyCompare> CAddressBalanceMap;
+
+/****
+ * Add the balance changes described by a set of address index records
+ * @param addressIndex the address index records of a block
+ * @param deltas where the per address changes are accumulated
+ */
+void AddressBalanceDeltas(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, CAddressBalanceMap &deltas);
+
+/***
+ * Key of the CC index: an unspent CC output on an address, found by the
+ * evalcode, funcid and reference txid of its opreturn.
+ * The reference txid is the 32 bytes after the funcid, as the module wrote them.
+ * Token-wrapped opreturns start with EVAL_TOKENS and are indexed under it
+ */
+struct CCIndexKey {
+    unsigned int type;
+    uint160 hashBytes;
+    uint8_t evalcode;
+    uint8_t funcid;
+    uint256 reftxid;
+    int blockHeight;
+    uint256 txhash;
+    size_t index;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 95;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s);
+        ser_writedata8(s, evalcode);
+        ser_writedata8(s, funcid);
+        reftxid.Serialize(s);
+        // Heights are stored big-endian for key sorting in LevelDB
+        ser_writedata32be(s, blockHeight);
+        txhash.Serialize(s);
+        ser_writedata32(s, index);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s);
+        evalcode = ser_readdata8(s);
+        funcid = ser_readdata8(s);
+        reftxid.Unserialize(s);
+        blockHeight = ser_readdata32be(s);
+        txhash.Unserialize(s);
+        index = ser_readdata32(s);
+    }
+
+    CCIndexKey(unsigned int addressType, uint160 addressHash, uint8_t eval, uint8_t func, uint256 ref,
+               int height, uint256 txid, size_t indexValue) {
+        type = addressType;
+        hashBytes = addressHash;
+        evalcode = eval;
+        funcid = func;
+        reftxid = ref;
+        blockHeight = height;
+        txhash = txid;
+        index = indexValue;
+    }
+
+    CCIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        type = 0;
+        hashBytes.SetNull();
+        evalcode = funcid = 0;
+        reftxid.SetNull();
+        blockHeight = 0;
+        txhash.SetNull();
+        index = 0;
+    }
+};
+
+/***
+ * Prefix of CCIndexKey used to seek. A funcid of 0 matches any funcid, a null
+ * reftxid any reference txid
+ */
+struct CCIndexIteratorKey {
+    unsigned int type;
+    uint160 hashBytes;
+    uint8_t evalcode;
+    uint8_t funcid;
+    uint256 reftxid;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 22 + (funcid != 0 ? 1 + (reftxid.IsNull() ? 0 : 32) : 0);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s);
+        ser_writedata8(s, evalcode);
+        if (funcid != 0) {
+            ser_writedata8(s, funcid);
+            if (!reftxid.IsNull())
+                reftxid.Serialize(s);
+        }
+    }
+
+    CCIndexIteratorKey(unsigned int addressType, uint160 addressHash, uint8_t eval, uint8_t func, uint256 ref) {
+        type = addressType;
+        hashBytes = addressHash;
+        evalcode = eval;
+        funcid = func;
+        reftxid = ref;
+    }
+
+    //! true while an iterator is within the serialized prefix
+    bool InRange(const CCIndexKey &key) const {
+        return key.type == type && key.hashBytes == hashBytes && key.evalcode == evalcode
+                && (funcid == 0 || (key.funcid == funcid && (reftxid.IsNull() || key.reftxid == reftxid)));
+    }
+    bool Matches(const CCIndexKey &key) const {
+        return InRange(key) && (reftxid.IsNull() || key.reftxid == reftxid);
+    }
+};
+
+/***
+ * The changes a connected or disconnected block makes to the address, spent, CC and
+ * timestamp indexes, written behind validation by CBlockTreeDB::QueueIndexUpdate
+ */
+struct CBlockIndexUpdate
+{
+    uint256 hashBlock;
+    uint256 hashPrevBlock;
+    int nHeight;
+    unsigned int nTime;
+    bool fUndo;             //!< the block is disconnected
+    bool fAddressIndex;
+    bool fTimestampIndex;
+    bool fCCIndex;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    CAddressBalanceMap balanceDeltas;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > ccIndex;       //!< the CC outputs of the block
+    std::vector<COutPoint> ccSpends;                                        //!< the CC outputs it spends, when connecting
+
+    CBlockIndexUpdate() : nHeight(0), nTime(0), fUndo(false), fAddressIndex(false), fTimestampIndex(false), fCCIndex(false) {}
+};
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -837,6 +1061,30 @@ bool GetAddressIndex(uint160 addressHash, int type,
                      int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+/****
+ * Walk the address index records of an address in height order, see CBlockTreeDB::ScanAddressIndex
+ * @returns false if the address index is not enabled or cannot be read
+ */
+bool ScanAddressIndex(uint160 addressHash, int type, int start, int end, const CAddressIndexKey *pafter,
+                      bool fReverse, const AddressIndexVisitor &visitor);
+/****
+ * Walk the unspent outputs of an address in key order, see CBlockTreeDB::ScanAddressUnspentIndex
+ * @returns false if the address index is not enabled or cannot be read
+ */
+bool ScanAddressUnspent(uint160 addressHash, int type, const CAddressUnspentKey *pafter, bool fReverse,
+                        const AddressUnspentVisitor &visitor);
+/****
+ * Get the unspent CC outputs on an address, by their opreturn
+ * @param addressHash the address
+ * @param type the address type
+ * @param evalcode the evalcode in the opreturn
+ * @param funcid the funcid in the opreturn, 0 for any
+ * @param reftxid the txid after the funcid in the opreturn, null for any
+ * @param outputs the results, ordered by height within a funcid and reftxid
+ * @returns false if the CC index is not enabled
+ */
+bool GetCCIndex(uint160 addressHash, int type, uint8_t evalcode, uint8_t funcid, const uint256 &reftxid,
+                std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > &outputs);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -896,6 +1144,14 @@ bool AcceptBlockHeader(int32_t *futureblockp,const CBlockHeader& block, CValidat
  */
 bool RewindBlockIndex(const CChainParams& params);
 
+/**
+ * Bring the address, spent, CC and timestamp indexes in line with the active chain.
+ * Their writes trail validation, so after a crash they can be behind the chainstate
+ * or still hold blocks that were disconnected.
+ * @returns true on success
+ */
+bool ReplayBlockIndexes();
+
 class CBlockFileInfo
 {
 public:
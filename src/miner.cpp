@@ -87,27 +87,53 @@ using namespace std;
 // transactions in the memory pool. When we select transactions from the
 // pool, we select by highest priority or fee rate, so we might consider
 // transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
+// CTemplateTx keeps track of these 'temporary orphans' while CreateNewBlock
+// is figuring out which transactions to include.
 //
-class COrphan
+// The first half of it only depends on the transaction and the chain tip, it
+// is kept in mapTemplateTxs from one template to the next and a new template
+// only looks up the inputs of the transactions that entered the mempool since.
+//
+class CTemplateTx
 {
 public:
+    unsigned int nTxSize;
+    double dPriority;                   // without prioritisetransaction deltas
+    CAmount nTotalIn;                   // likewise
+    set<uint256> setDependsOn;          // inputs still in the mempool
+    std::vector<int8_t> NotarisationNotaries;
+    bool fNotarisation;
+    bool fCacheInputsCheck;             // no import or CC inputs, whose checks may depend on more than the coins
+    bool fInputsChecked;                // ContextualCheckInputs() passed for an earlier template
+    uint64_t nLastSeen;
+
+    // the template being made
     const CTransaction* ptx;
-    set<uint256> setDependsOn;
+    double dTemplatePriority;
+    CAmount nFee;
     CFeeRate feeRate;
-    double dPriority;
+    CFeeRate packageFeeRate;            // highest feerate of a package it is the ancestor of
+    size_t nWaitingFor;
 
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
+    CTemplateTx() : nTxSize(0), dPriority(0), nTotalIn(0), fNotarisation(false), fCacheInputsCheck(false),
+        fInputsChecked(false), nLastSeen(0), ptx(NULL), dTemplatePriority(0), nFee(0), feeRate(0), packageFeeRate(0), nWaitingFor(0)
     {
     }
 };
 
+/** Packages with more unconfirmed ancestors than this do not lift their ancestors' feerate */
+static const size_t MAX_TEMPLATE_PACKAGE_ANCESTORS = 25;
+
+// guarded by mempool.cs, which CreateNewBlock holds while using them
+static std::map<uint256, CTemplateTx> mapTemplateTxs;
+static uint256 hashTemplateTip, hashTemplateNotaries;
+static uint64_t nTemplateGeneration = 0;
+
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
 // We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
+typedef boost::tuple<double, CFeeRate, CTemplateTx*> TxPriority;
 class TxPriorityCompare
 {
     bool byFee;
@@ -132,6 +158,128 @@ public:
     }
 };
 
+/**
+ * Works out the tip dependent part of ttx, returns false when an input is neither in the
+ * chain nor in the mempool.
+ */
+static bool GetTemplateTx(const CTransaction& tx, CTemplateTx& ttx, CCoinsViewCache& view, int nHeight, int8_t numSN, uint8_t notarypubkeys[64][33])
+{
+    double dPriority = 0;
+    CAmount nTotalIn = 0;
+    ttx.fCacheInputsCheck = !tx.IsCoinImport();
+    if (tx.IsCoinImport())
+    {
+        CAmount nValueIn = GetCoinImportValue(tx); // burn amount
+        nTotalIn += nValueIn;
+        dPriority += (double)nValueIn * 1000;  // flat multiplier... max = 1e16.
+    } else {
+        std::vector<int8_t> TMP_NotarisationNotaries;
+        bool fToCryptoAddress = false;
+        if ( numSN != 0 && notarypubkeys[0][0] != 0 && komodo_is_notarytx(tx) == 1 )
+            fToCryptoAddress = true;
+
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            // Read prev transaction
+            if (!view.HaveCoins(txin.prevout.hash))
+            {
+                // This should never happen; all transactions in the memory
+                // pool should connect to either transactions in the chain
+                // or other transactions in the memory pool.
+                CTxMemPool::indexed_transaction_set::const_iterator mi = mempool.mapTx.find(txin.prevout.hash);
+                if (mi == mempool.mapTx.end())
+                {
+                    LogPrintf("ERROR: mempool transaction missing input\n");
+                    // if (fDebug) assert("mempool transaction missing input" == 0);
+                    return false;
+                }
+
+                // Has to wait for dependencies
+                const CTxOut& prevout = mi->GetTx().vout[txin.prevout.n];
+                ttx.setDependsOn.insert(txin.prevout.hash);
+                if (prevout.scriptPubKey.IsPayToCryptoCondition())
+                    ttx.fCacheInputsCheck = false;
+                nTotalIn += prevout.nValue;
+                continue;
+            }
+            const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+            assert(coins);
+
+            CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
+            nTotalIn += nValueIn;
+            if (coins->vout[txin.prevout.n].scriptPubKey.IsPayToCryptoCondition())
+                ttx.fCacheInputsCheck = false;
+
+            int nConf = nHeight - coins->nHeight;
+
+            uint8_t *script; int32_t scriptlen; uint256 hash; CTransaction tx1;
+            // loop over notaries array and extract index of signers.
+            if ( fToCryptoAddress && myGetTransaction(txin.prevout.hash,tx1,hash) )
+            {
+                for (int8_t i = 0; i < numSN; i++)
+                {
+                    script = (uint8_t *)&tx1.vout[txin.prevout.n].scriptPubKey[0];
+                    scriptlen = (int32_t)tx1.vout[txin.prevout.n].scriptPubKey.size();
+                    if ( scriptlen == 35 && script[0] == 33 && script[34] == OP_CHECKSIG && memcmp(script+1,notarypubkeys[i],33) == 0 )
+                    {
+                        // We can add the index of each notary to vector, and clear it if this notarisation is not valid later on.
+                        TMP_NotarisationNotaries.push_back(i);
+                    }
+                }
+            }
+            dPriority += (double)nValueIn * nConf;
+        }
+        if ( numSN != 0 && notarypubkeys[0][0] != 0 && TMP_NotarisationNotaries.size() >= numSN / 5 )
+        {
+            // check a notary didnt sign twice (this would be an invalid notarisation later on and cause problems)
+            std::set<int> checkdupes( TMP_NotarisationNotaries.begin(), TMP_NotarisationNotaries.end() );
+            if ( checkdupes.size() != TMP_NotarisationNotaries.size() )
+            {
+                LogPrintf( "possible notarisation is signed multiple times by same notary, passed as normal transaction.\n");
+            }
+            else
+            {
+                ttx.fNotarisation = true;
+                ttx.NotarisationNotaries = TMP_NotarisationNotaries;
+            }
+        }
+        nTotalIn += tx.GetShieldedValueIn();
+    }
+
+    // Priority is sum(valuein * age) / modified_txsize
+    ttx.nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    ttx.dPriority = tx.ComputePriority(dPriority, ttx.nTxSize);
+    ttx.nTotalIn = nTotalIn;
+    return true;
+}
+
+/**
+ * Collects the unconfirmed ancestors of ptt, returns false when one of them is not going
+ * into this template or there are too many of them.
+ */
+static bool GetTemplateAncestors(const CTemplateTx* ptt, set<CTemplateTx*>& setAncestors)
+{
+    vector<const CTemplateTx*> vStack(1, ptt);
+    while (!vStack.empty())
+    {
+        const CTemplateTx* pcurrent = vStack.back();
+        vStack.pop_back();
+        BOOST_FOREACH(const uint256& hashParent, pcurrent->setDependsOn)
+        {
+            std::map<uint256, CTemplateTx>::iterator it = mapTemplateTxs.find(hashParent);
+            if (it == mapTemplateTxs.end() || it->second.ptx == NULL)
+                return false;
+            if (setAncestors.insert(&it->second).second)
+            {
+                if (setAncestors.size() > MAX_TEMPLATE_PACKAGE_ANCESTORS)
+                    return false;
+                vStack.push_back(&it->second);
+            }
+        }
+    }
+    return true;
+}
+
 void UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
     if ( ASSETCHAINS_ADAPTIVEPOW <= 0 )
@@ -291,9 +439,20 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
         SaplingMerkleTree sapling_tree;
         assert(view.GetSaplingAnchorAt(view.GetBestAnchor(SAPLING), sapling_tree));
 
+        // What was worked out about the transactions for the last template on this tip still holds
+        uint256 hashNotaries = Hash(BEGIN(numSN), END(numSN), BEGIN(notarypubkeys), END(notarypubkeys));
+        if ( hashTemplateTip != pindexPrev->GetBlockHash() || hashTemplateNotaries != hashNotaries )
+        {
+            mapTemplateTxs.clear();
+            hashTemplateTip = pindexPrev->GetBlockHash();
+            hashTemplateNotaries = hashNotaries;
+        }
+        nTemplateGeneration++;
+        size_t nReused = 0;
+
         // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
+        map<uint256, vector<CTemplateTx*> > mapDependers;
+        vector<CTemplateTx*> vCandidates;
         bool fPrintPriority = GetBoolArg("-printpriority", false);
 
         // This vector will be sorted into a priority queue:
@@ -339,102 +498,25 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
                 continue;
             }
 
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            bool fNotarisation = false;
-            std::vector<int8_t> TMP_NotarisationNotaries;
-            if (tx.IsCoinImport())
+            uint256 hash = tx.GetHash();
+            CTemplateTx* ptt = &mapTemplateTxs[hash];
+            if (ptt->nLastSeen != 0)
+                nReused++;
+            else if (!GetTemplateTx(tx, *ptt, view, nHeight, numSN, notarypubkeys))
             {
-                CAmount nValueIn = GetCoinImportValue(tx); // burn amount
-                nTotalIn += nValueIn;
-                dPriority += (double)nValueIn * 1000;  // flat multiplier... max = 1e16.
-            } else {
-                TMP_NotarisationNotaries.clear();
-                bool fToCryptoAddress = false;
-                if ( numSN != 0 && notarypubkeys[0][0] != 0 && komodo_is_notarytx(tx) == 1 )
-                    fToCryptoAddress = true;
-
-                BOOST_FOREACH(const CTxIn& txin, tx.vin)
-                {
-                    // Read prev transaction
-                    if (!view.HaveCoins(txin.prevout.hash))
-                    {
-                        // This should never happen; all transactions in the memory
-                        // pool should connect to either transactions in the chain
-                        // or other transactions in the memory pool.
-                        if (!mempool.mapTx.count(txin.prevout.hash))
-                        {
-                            LogPrintf("ERROR: mempool transaction missing input\n");
-                            // if (fDebug) assert("mempool transaction missing input" == 0);
-                            fMissingInputs = true;
-                            if (porphan)
-                                vOrphan.pop_back();
-                            break;
-                        }
-
-                        // Has to wait for dependencies
-                        if (!porphan)
-                        {
-                            // Use list for automatic deletion
-                            vOrphan.push_back(COrphan(&tx));
-                            porphan = &vOrphan.back();
-                        }
-                        mapDependers[txin.prevout.hash].push_back(porphan);
-                        porphan->setDependsOn.insert(txin.prevout.hash);
-                        nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
-                        continue;
-                    }
-                    const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                    assert(coins);
-
-                    CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                    nTotalIn += nValueIn;
-
-                    int nConf = nHeight - coins->nHeight;
-                    
-                    uint8_t *script; int32_t scriptlen; uint256 hash; CTransaction tx1;
-                    // loop over notaries array and extract index of signers.
-                    if ( fToCryptoAddress && myGetTransaction(txin.prevout.hash,tx1,hash) )
-                    {
-                        for (int8_t i = 0; i < numSN; i++) 
-                        {
-                            script = (uint8_t *)&tx1.vout[txin.prevout.n].scriptPubKey[0];
-                            scriptlen = (int32_t)tx1.vout[txin.prevout.n].scriptPubKey.size();
-                            if ( scriptlen == 35 && script[0] == 33 && script[34] == OP_CHECKSIG && memcmp(script+1,notarypubkeys[i],33) == 0 )
-                            {
-                                // We can add the index of each notary to vector, and clear it if this notarisation is not valid later on.
-                                TMP_NotarisationNotaries.push_back(i);                          
-                            }
-                        }
-                    }
-                    dPriority += (double)nValueIn * nConf;
-                }
-                if ( numSN != 0 && notarypubkeys[0][0] != 0 && TMP_NotarisationNotaries.size() >= numSN / 5 )
-                {
-                    // check a notary didnt sign twice (this would be an invalid notarisation later on and cause problems)
-                    std::set<int> checkdupes( TMP_NotarisationNotaries.begin(), TMP_NotarisationNotaries.end() );
-                    if ( checkdupes.size() != TMP_NotarisationNotaries.size() ) 
-                    {
-                        LogPrintf( "possible notarisation is signed multiple times by same notary, passed as normal transaction.\n");
-                    } else fNotarisation = true;
-                }
-                nTotalIn += tx.GetShieldedValueIn();
+                mapTemplateTxs.erase(hash);
+                continue;
             }
+            ptt->nLastSeen = nTemplateGeneration;
+            ptt->ptx = NULL;
 
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
+            double dPriority = ptt->dPriority;
+            CAmount nTotalIn = ptt->nTotalIn;
             mempool.ApplyDeltas(hash, dPriority, nTotalIn);
 
-            CFeeRate feeRate(nTotalIn-tx.GetValueOut(), nTxSize);
+            CFeeRate feeRate(nTotalIn-tx.GetValueOut(), ptt->nTxSize);
 
-            if ( fNotarisation ) 
+            if ( ptt->fNotarisation ) 
             {
                 // Special miner for notary pay chains. Can only enter this if numSN/notarypubkeys is set higher up.
                 if ( tx.vout.size() == 2 && tx.vout[1].nValue == 0 )
@@ -455,7 +537,7 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
                         if ( notarizedheight != 0 )
                         {
                             // this is the first one we see, add it to the block as TX1 
-                            NotarisationNotaries = TMP_NotarisationNotaries;
+                            NotarisationNotaries = ptt->NotarisationNotaries;
                             dPriority = 1e16;
                             fNotarisationBlock = true;
                             //LogPrintf( "Notarisation %s set to maximum priority\n",hash.ToString().c_str());
@@ -468,14 +550,55 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
                 dPriority -= 10;
                 // make sure notarisation is tx[1] in block. 
             }
-            if (porphan)
+            ptt->ptx = &tx;
+            ptt->dTemplatePriority = dPriority;
+            ptt->nFee = nTotalIn - tx.GetValueOut();
+            ptt->feeRate = ptt->packageFeeRate = feeRate;
+            ptt->nWaitingFor = ptt->setDependsOn.size();
+            vCandidates.push_back(ptt);
+        }
+
+        // forget the transactions that have left the mempool
+        for (std::map<uint256, CTemplateTx>::iterator it = mapTemplateTxs.begin(); it != mapTemplateTxs.end(); )
+        {
+            if (it->second.nLastSeen != nTemplateGeneration)
+                mapTemplateTxs.erase(it++);
+            else ++it;
+        }
+
+        BOOST_FOREACH(CTemplateTx* ptt, vCandidates)
+        {
+            if (ptt->nWaitingFor == 0)
             {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
+                vecPriority.push_back(TxPriority(ptt->dTemplatePriority, ptt->packageFeeRate, ptt));
+                continue;
+            }
+            BOOST_FOREACH(const uint256& hashParent, ptt->setDependsOn)
+                mapDependers[hashParent].push_back(ptt);
+
+            // A transaction paying for its parents lifts them to the feerate of the whole package
+            set<CTemplateTx*> setAncestors;
+            if (GetTemplateAncestors(ptt, setAncestors))
+            {
+                CAmount nPackageFee = ptt->nFee;
+                size_t nPackageSize = ptt->nTxSize;
+                BOOST_FOREACH(const CTemplateTx* pancestor, setAncestors)
+                {
+                    nPackageFee += pancestor->nFee;
+                    nPackageSize += pancestor->nTxSize;
+                }
+                CFeeRate packageFeeRate(nPackageFee, nPackageSize);
+                BOOST_FOREACH(CTemplateTx* pancestor, setAncestors)
+                {
+                    if (pancestor->packageFeeRate < packageFeeRate)
+                        pancestor->packageFeeRate = packageFeeRate;
+                }
             }
-            else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &(mi->GetTx())));
         }
+        // the lifted feerates of the transactions with no unconfirmed inputs
+        BOOST_FOREACH(TxPriority& item, vecPriority)
+            item.get<1>() = item.get<2>()->packageFeeRate;
+        LogPrint("bench", "CreateNewBlock(): %u candidates, %u mempool transactions known from the last template\n", vCandidates.size(), nReused);
 
         // Collect transactions into block
         uint64_t nBlockSize = 1000;
@@ -491,8 +614,10 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
         {
             // Take highest priority transaction off the priority queue:
             double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
+            CFeeRate packageFeeRate = vecPriority.front().get<1>();
+            CTemplateTx* ptt = vecPriority.front().get<2>();
+            const CTransaction& tx = *ptt->ptx;
+            CFeeRate feeRate = ptt->feeRate;
 
             std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
             vecPriority.pop_back();
@@ -551,7 +676,7 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
             double dPriorityDelta = 0;
             CAmount nFeeDelta = 0;
             mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
+            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (packageFeeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
             {
                 //LogPrintf("fee rate skip\n");
                 continue;
@@ -583,11 +708,16 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
             // policy here, but we still have to ensure that the block we
             // create only contains transactions that are valid in new blocks.
             CValidationState state;
-            PrecomputedTransactionData txdata(tx);
-            if (!ContextualCheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata, Params().GetConsensus(), consensusBranchId))
+            if (!ptt->fInputsChecked)
             {
-                //LogPrintf("context failure\n");
-                continue;
+                PrecomputedTransactionData txdata(tx);
+                if (!ContextualCheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata, Params().GetConsensus(), consensusBranchId))
+                {
+                    //LogPrintf("context failure\n");
+                    continue;
+                }
+                // the spent outputs are fixed by their txids, so this holds until the tip changes
+                ptt->fInputsChecked = ptt->fCacheInputsCheck;
             }
             UpdateCoins(tx, view, nHeight);
 
@@ -606,22 +736,18 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk,const CScript& _scriptPubKeyIn,
 
             if (fPrintPriority)
             {
-                LogPrintf("priority %.1f fee %s txid %s\n",dPriority, feeRate.ToString(), tx.GetHash().ToString());
+                LogPrintf("priority %.1f fee %s package fee %s txid %s\n",dPriority, feeRate.ToString(), packageFeeRate.ToString(), tx.GetHash().ToString());
             }
 
             // Add transactions that depend on this one to the priority queue
             if (mapDependers.count(hash))
             {
-                BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
+                BOOST_FOREACH(CTemplateTx* pdepender, mapDependers[hash])
                 {
-                    if (!porphan->setDependsOn.empty())
+                    if (pdepender->nWaitingFor != 0 && --pdepender->nWaitingFor == 0)
                     {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty())
-                        {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
+                        vecPriority.push_back(TxPriority(pdepender->dTemplatePriority, pdepender->packageFeeRate, pdepender));
+                        std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
                     }
                 }
             }
@@ -6,13 +6,66 @@
 #include "main.h"
 #include "notaries_staked.h"
 
+#include <algorithm>
+
 #include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
 
 
 NotarisationDB *pnotarisations;
 
+static const char DB_NOTARISATION_BYSYMBOL = 'y';
+static const char DB_NOTARISATION_BYCCID = 'i';
+static const char DB_NOTARISATION_INDEXED = 'x';
+
+/** Blocks whose notarisations BuildIndexes() writes in one batch */
+static const int NOTARISATION_INDEX_BATCH_BLOCKS = 10000;
+
+
+NotarisationDB::NotarisationDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "notarisations", nCacheSize, fMemory, fWipe, false, 64)
+{
+    // a new db is indexed as the blocks are connected
+    if (IsEmpty())
+        Write(DB_NOTARISATION_INDEXED, true);
+}
+
+bool NotarisationDB::BuildIndexes()
+{
+    if (Exists(DB_NOTARISATION_INDEXED))
+        return true;
 
-NotarisationDB::NotarisationDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "notarisations", nCacheSize, fMemory, fWipe, false, 64) { }
+    LogPrintf("Indexing notarisations by symbol and ccid...\n");
+    CDBBatch batch(*this);
+    int blocks = 0;
+    {
+        LOCK(cs_main);
+        boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next())
+        {
+            boost::this_thread::interruption_point();
+            // the notarisations of a block are keyed by its hash, back notarisations by a txid
+            uint256 blockHash;
+            NotarisationsInBlock nibs;
+            if (pcursor->GetKeySize() != blockHash.size() || !pcursor->GetKey(blockHash))
+                continue;
+            BlockMap::iterator mi = mapBlockIndex.find(blockHash);
+            if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second) || !pcursor->GetValue(nibs))
+                continue;
+            WriteNotarisationIndexes(nibs, mi->second->nHeight, blockHash, batch);
+            if (++blocks % NOTARISATION_INDEX_BATCH_BLOCKS == 0)
+            {
+                if (!WriteBatch(batch))
+                    return error("%s: failed to write notarisation indexes", __func__);
+                batch.Clear();
+            }
+        }
+    }
+    batch.Write(DB_NOTARISATION_INDEXED, true);
+    if (!WriteBatch(batch, true))
+        return error("%s: failed to write notarisation indexes", __func__);
+    LogPrintf("Indexed the notarisations of %d blocks\n", blocks);
+    return true;
+}
 
 /****
  * Get notarisations within a block
@@ -109,6 +162,163 @@ void EraseBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &
     }
 }
 
+/***
+ * Add the notarisations of the block at height to the symbol and ccid indexes
+ * @param notarisations the notarisations of the block
+ * @param height the height of the block
+ * @param blockHash the hash of the block, stored with each entry
+ * @param batch the collection of db transactions
+ */
+void WriteNotarisationIndexes(const NotarisationsInBlock &notarisations, int height, const uint256 &blockHash, CDBBatch &batch)
+{
+    for (uint32_t n = 0; n < notarisations.size(); n++)
+    {
+        const Notarisation &nota = notarisations[n];
+        batch.Write(std::make_pair(DB_NOTARISATION_BYSYMBOL, CNotarisationSymbolKey(nota.second.symbol, height, n)), std::make_pair(blockHash, nota));
+        batch.Write(std::make_pair(DB_NOTARISATION_BYCCID, CNotarisationCcidKey(nota.second.ccId, height, n)), std::make_pair(blockHash, nota));
+    }
+}
+
+/***
+ * Remove the notarisations of the block at height from the symbol and ccid indexes
+ * @param notarisations the notarisations of the block
+ * @param height the height of the block
+ * @param batch the collection of db transactions
+ */
+void EraseNotarisationIndexes(const NotarisationsInBlock &notarisations, int height, CDBBatch &batch)
+{
+    for (uint32_t n = 0; n < notarisations.size(); n++)
+    {
+        const Notarisation &nota = notarisations[n];
+        batch.Erase(std::make_pair(DB_NOTARISATION_BYSYMBOL, CNotarisationSymbolKey(nota.second.symbol, height, n)));
+        batch.Erase(std::make_pair(DB_NOTARISATION_BYCCID, CNotarisationCcidKey(nota.second.ccId, height, n)));
+    }
+}
+
+/****
+ * Read the index key under the cursor
+ * @returns 1 for an index key, 0 for a uint256 key that sorts among them, -1 past the index
+ */
+template <typename K>
+static int ReadIndexKey(CDBIterator *pcursor, char type, K &key)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    if (!pcursor->GetKeyDataStream(ssKey) || ssKey.empty() || ssKey[0] != type)
+        return -1;
+    std::pair<char, K> keyObj;
+    if (!pcursor->GetKey(keyObj) || 1 + keyObj.second.GetSerializeSize(SER_DISK, CLIENT_VERSION) != ssKey.size())
+        return 0;
+    key = keyObj.second;
+    return 1;
+}
+
+/****
+ * Read the index value under the cursor
+ * @returns true if it is of the block at height of the active chain, entries of a
+ * block that was disconnected without its index being erased (a crash in between)
+ * are left out as the scan of the blocks they replace would have
+ */
+static bool ReadActiveNotarisation(CDBIterator *pcursor, int height, Notarisation &nota)
+{
+    std::pair<uint256, Notarisation> value;
+    if (!pcursor->GetValue(value))
+        return false;
+    {
+        LOCK(cs_main);
+        CBlockIndex *pindex = chainActive[height];
+        if (pindex == NULL || pindex->GetBlockHash() != value.first)
+            return false;
+    }
+    nota = value.second;
+    return true;
+}
+
+/*****
+ * Get the notarisations for symbol between two heights of the active chain
+ * @param symbol the symbol to look for
+ * @param minHeight the lowest height
+ * @param maxHeight the highest height
+ * @param out the notarisations in chain order
+ */
+void GetNotarisationsBySymbol(const std::string &symbol, int minHeight, int maxHeight, std::vector<IndexedNotarisation> &out)
+{
+    out.clear();
+    boost::scoped_ptr<CDBIterator> pcursor(pnotarisations->NewIterator());
+    pcursor->Seek(std::make_pair(DB_NOTARISATION_BYSYMBOL, CNotarisationSymbolKey(symbol, std::max(minHeight, 0), 0)));
+    for (; pcursor->Valid(); pcursor->Next())
+    {
+        CNotarisationSymbolKey key;
+        Notarisation nota;
+        int ret = ReadIndexKey(pcursor.get(), DB_NOTARISATION_BYSYMBOL, key);
+        if (ret < 0 || (ret > 0 && (key.symbol != symbol || key.height > maxHeight)))
+            break;
+        if (ret > 0 && ReadActiveNotarisation(pcursor.get(), key.height, nota))
+            out.push_back(std::make_pair(key.height, nota));
+    }
+}
+
+/*****
+ * Get the latest notarisations for symbol, going down from maxHeight
+ * @param symbol the symbol to look for
+ * @param maxHeight where to start the search
+ * @param minHeight where to give up
+ * @param count stop after the block holding this many notarisations
+ * @param out the notarisations, highest block first and in block order within a block
+ */
+void GetLastNotarisationsBySymbol(const std::string &symbol, int maxHeight, int minHeight, size_t count, std::vector<IndexedNotarisation> &out)
+{
+    out.clear();
+    if (maxHeight < minHeight)
+        return;
+    boost::scoped_ptr<CDBIterator> pcursor(pnotarisations->NewIterator());
+    pcursor->Seek(std::make_pair(DB_NOTARISATION_BYSYMBOL, CNotarisationSymbolKey(symbol, maxHeight + 1, 0)));
+    if (pcursor->Valid())
+        pcursor->Prev();
+    else pcursor->SeekToLast();
+    for (; pcursor->Valid(); pcursor->Prev())
+    {
+        CNotarisationSymbolKey key;
+        Notarisation nota;
+        int ret = ReadIndexKey(pcursor.get(), DB_NOTARISATION_BYSYMBOL, key);
+        if (ret < 0 || (ret > 0 && (key.symbol != symbol || key.height < minHeight)))
+            break;
+        if (ret == 0 || !ReadActiveNotarisation(pcursor.get(), key.height, nota))
+            continue;
+        if (out.size() >= count && key.height != out.back().first)
+            break;
+        out.push_back(std::make_pair(key.height, nota));
+    }
+    // the cursor went through each block backwards
+    std::reverse(out.begin(), out.end());
+    std::stable_sort(out.begin(), out.end(), [](const IndexedNotarisation &a, const IndexedNotarisation &b) {
+        return a.first > b.first;
+    });
+}
+
+/*****
+ * Get the notarisations for ccId between two heights of the active chain
+ * @param ccId the ccid to look for
+ * @param minHeight the lowest height
+ * @param maxHeight the highest height
+ * @param out the notarisations in chain order
+ */
+void GetNotarisationsByCcid(uint32_t ccId, int minHeight, int maxHeight, std::vector<IndexedNotarisation> &out)
+{
+    out.clear();
+    boost::scoped_ptr<CDBIterator> pcursor(pnotarisations->NewIterator());
+    pcursor->Seek(std::make_pair(DB_NOTARISATION_BYCCID, CNotarisationCcidKey(ccId, std::max(minHeight, 0), 0)));
+    for (; pcursor->Valid(); pcursor->Next())
+    {
+        CNotarisationCcidKey key;
+        Notarisation nota;
+        int ret = ReadIndexKey(pcursor.get(), DB_NOTARISATION_BYCCID, key);
+        if (ret < 0 || (ret > 0 && (key.ccId != ccId || key.height > maxHeight)))
+            break;
+        if (ret > 0 && ReadActiveNotarisation(pcursor.get(), key.height, nota))
+            out.push_back(std::make_pair(key.height, nota));
+    }
+}
+
 /*****
  * Scan notarisationsdb backwards for blocks containing a notarisation
  * for given symbol. Return height of matched notarisation or 0.
@@ -123,22 +333,10 @@ int ScanNotarisationsDB(int height, std::string symbol, int scanLimitBlocks, Not
     if (height < 0 || height > chainActive.Height())
         return 0;
 
-    for (int i=0; i<scanLimitBlocks; i++) 
-    {
-        if (i > height) 
-            break;
-        NotarisationsInBlock notarisations;
-        uint256 blockHash = *chainActive[height-i]->phashBlock;
-        if (GetBlockNotarisations(blockHash, notarisations))
-        {
-            for(Notarisation& nota : notarisations) {
-                if (strcmp(nota.second.symbol, symbol.data()) == 0) 
-                {
-                    out = nota;
-                    return height-i;
-                }
-            }
-        }
-    }
-    return 0;
+    std::vector<IndexedNotarisation> notarisations;
+    GetLastNotarisationsBySymbol(symbol, height, std::max(height - scanLimitBlocks + 1, 0), 1, notarisations);
+    if (notarisations.empty())
+        return 0;
+    out = notarisations[0].second;
+    return notarisations[0].first;
 }
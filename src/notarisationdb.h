@@ -6,10 +6,21 @@
 #include "cc/eval.h"
 
 
+/****
+ * Besides the notarisations of each block and the back notarisations by KMD
+ * notarisation txid, the db indexes the notarisations of the active chain by
+ * symbol and by ccid, so crosschain lookups do not read block after block.
+ */
 class NotarisationDB : public CDBWrapper
 {
 public:
     NotarisationDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    /****
+     * Index the notarisations of the active chain if the db was written before
+     * the symbol and ccid indexes existed
+     * @returns true on success
+     */
+    bool BuildIndexes();
 };
 
 
@@ -17,6 +28,65 @@ extern NotarisationDB *pnotarisations;
 
 typedef std::pair<uint256,NotarisationData> Notarisation;
 typedef std::vector<Notarisation> NotarisationsInBlock;
+typedef std::pair<int,Notarisation> IndexedNotarisation; // height, notarisation
+
+/****
+ * Key of the by symbol index. Heights are stored big-endian for key sorting in
+ * LevelDB, n is the position among the notarisations of the block. The value is
+ * the block hash and the notarisation.
+ */
+struct CNotarisationSymbolKey {
+    std::string symbol;
+    int height;
+    uint32_t n;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return ::GetSerializeSize(symbol, nType, nVersion) + 8;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ::Serialize(s, symbol);
+        ser_writedata32be(s, height);
+        ser_writedata32be(s, n);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        ::Unserialize(s, symbol);
+        height = ser_readdata32be(s);
+        n = ser_readdata32be(s);
+    }
+
+    CNotarisationSymbolKey(const std::string& symbolIn, int heightIn, uint32_t nIn) : symbol(symbolIn), height(heightIn), n(nIn) {}
+    CNotarisationSymbolKey() : height(0), n(0) {}
+};
+
+/****
+ * Key of the by ccid index, sorted like CNotarisationSymbolKey
+ */
+struct CNotarisationCcidKey {
+    uint32_t ccId;
+    int height;
+    uint32_t n;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 12;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, ccId);
+        ser_writedata32be(s, height);
+        ser_writedata32be(s, n);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        ccId = ser_readdata32be(s);
+        height = ser_readdata32be(s);
+        n = ser_readdata32be(s);
+    }
+
+    CNotarisationCcidKey(uint32_t ccIdIn, int heightIn, uint32_t nIn) : ccId(ccIdIn), height(heightIn), n(nIn) {}
+    CNotarisationCcidKey() : ccId(0), height(0), n(0) {}
+};
 
 /****
  * Get notarisations within a block
@@ -51,6 +121,46 @@ void WriteBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &
  * @param batch the collection of db transactions
  */
 void EraseBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &batch);
+/***
+ * Add the notarisations of the block at height to the symbol and ccid indexes
+ * @param notarisations the notarisations of the block
+ * @param height the height of the block
+ * @param blockHash the hash of the block, stored with each entry
+ * @param batch the collection of db transactions
+ */
+void WriteNotarisationIndexes(const NotarisationsInBlock &notarisations, int height, const uint256 &blockHash, CDBBatch &batch);
+/***
+ * Remove the notarisations of the block at height from the symbol and ccid indexes
+ * @param notarisations the notarisations of the block
+ * @param height the height of the block
+ * @param batch the collection of db transactions
+ */
+void EraseNotarisationIndexes(const NotarisationsInBlock &notarisations, int height, CDBBatch &batch);
+/*****
+ * Get the notarisations for symbol between two heights of the active chain
+ * @param symbol the symbol to look for
+ * @param minHeight the lowest height
+ * @param maxHeight the highest height
+ * @param out the notarisations in chain order
+ */
+void GetNotarisationsBySymbol(const std::string &symbol, int minHeight, int maxHeight, std::vector<IndexedNotarisation> &out);
+/*****
+ * Get the latest notarisations for symbol, going down from maxHeight
+ * @param symbol the symbol to look for
+ * @param maxHeight where to start the search
+ * @param minHeight where to give up
+ * @param count stop after the block holding this many notarisations
+ * @param out the notarisations, highest block first and in block order within a block
+ */
+void GetLastNotarisationsBySymbol(const std::string &symbol, int maxHeight, int minHeight, size_t count, std::vector<IndexedNotarisation> &out);
+/*****
+ * Get the notarisations for ccId between two heights of the active chain
+ * @param ccId the ccid to look for
+ * @param minHeight the lowest height
+ * @param maxHeight the highest height
+ * @param out the notarisations in chain order
+ */
+void GetNotarisationsByCcid(uint32_t ccId, int minHeight, int maxHeight, std::vector<IndexedNotarisation> &out);
 /*****
  * Scan notarisationsdb backwards for blocks containing a notarisation
  * for given symbol. Return height of matched notarisation or 0.
@@ -173,6 +173,9 @@ enum {
     // Nodes may always request a MSG_FILTERED_BLOCK in a getdata, however,
     // MSG_FILTERED_BLOCK should not appear in any invs except as a part of getdata.
     MSG_FILTERED_BLOCK,
+    // A getdata for MSG_CMPCT_BLOCK is answered with a "cmpctblock" message, only sent
+    // to peers that announced support for compact blocks with "sendcmpct".
+    MSG_CMPCT_BLOCK,
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -31,6 +31,7 @@
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txcache.h"
 #include "util.h"
 #include "script/script.h"
 #include "script/script_error.h"
@@ -1401,6 +1402,16 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp, const CPubKey& my
             "  \"consensus\": {               (object) branch IDs of the current and upcoming consensus rules\n"
             "     \"chaintip\": \"xxxxxxxx\",   (string) branch ID used to validate the current chain tip\n"
             "     \"nextblock\": \"xxxxxxxx\"   (string) branch ID that the next block will be validated under\n"
+            "  },\n"
+            "  \"connectstats\": {            (object) timings of block connection since startup\n"
+            "     \"blocks\": xxxxxx,           (numeric) blocks connected\n"
+            "     \"prefetched_blocks\": xxxx,  (numeric) blocks read with their coins while the previous block was connected\n"
+            "     \"discarded_prefetches\": xx, (numeric) prefetches that could not be used\n"
+            "     \"prefetched_coins\": xxxxx,  (numeric) coins cached ahead of validation\n"
+            "     \"prefetch_seconds\": xx.x,   (numeric) time spent reading blocks and their coins (stage 1)\n"
+            "     \"connect_seconds\": xx.x,    (numeric) time spent checking inputs, scripts and CC evals, and writing indexes (stage 2)\n"
+            "     \"hooks_seconds\": xx.x,      (numeric) time spent in the komodo and notarisation hooks (stage 3)\n"
+            "     \"ibd_seconds\": xx.x         (numeric) wall clock time of the initial block download, so far while it runs\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -1459,6 +1470,18 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp, const CPubKey& my
     consensus.push_back(Pair("nextblock", HexInt(CurrentEpochBranchId(tip->nHeight + 1, consensusParams))));
     obj.push_back(Pair("consensus", consensus));
 
+    CConnectStats connectStats = GetConnectStats();
+    UniValue connect(UniValue::VOBJ);
+    connect.push_back(Pair("blocks", connectStats.nBlocks));
+    connect.push_back(Pair("prefetched_blocks", connectStats.nPrefetchedBlocks));
+    connect.push_back(Pair("discarded_prefetches", connectStats.nDiscardedPrefetches));
+    connect.push_back(Pair("prefetched_coins", connectStats.nPrefetchedCoins));
+    connect.push_back(Pair("prefetch_seconds", connectStats.nPrefetchTime * 0.000001));
+    connect.push_back(Pair("connect_seconds", connectStats.nConnectTime * 0.000001));
+    connect.push_back(Pair("hooks_seconds", connectStats.nHooksTime * 0.000001));
+    connect.push_back(Pair("ibd_seconds", connectStats.nIBDTime * 0.000001));
+    obj.push_back(Pair("connectstats", connect));
+
     if (fPruneMode)
     {
         CBlockIndex *block = chainActive.Tip();
@@ -1746,6 +1769,41 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return mempoolInfoToJSON();
 }
 
+UniValue gettxcacheinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "gettxcacheinfo\n"
+            "\nReturns details on the cache of transactions read from the block files.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"size\": xxxxx                (numeric) Current tx count\n"
+            "  \"usage\": xxxxx               (numeric) Estimated memory usage in bytes\n"
+            "  \"maxusage\": xxxxx            (numeric) Memory limit in bytes (-txcachesize)\n"
+            "  \"hits\": xxxxx                (numeric) Lookups answered from the cache\n"
+            "  \"misses\": xxxxx              (numeric) Lookups that went to disk\n"
+            "  \"hitrate\": x.xxx             (numeric) hits / (hits + misses)\n"
+            "  \"evictions\": xxxxx           (numeric) Transactions dropped to stay under the limit\n"
+            "  \"invalidations\": xxxxx       (numeric) Transactions dropped because their block was disconnected\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gettxcacheinfo", "")
+            + HelpExampleRpc("gettxcacheinfo", "")
+        );
+
+    CTxCacheStats stats = txCache.GetStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("size", (uint64_t)stats.nEntries));
+    ret.push_back(Pair("usage", (uint64_t)stats.nUsage));
+    ret.push_back(Pair("maxusage", (uint64_t)stats.nMaxUsage));
+    ret.push_back(Pair("hits", stats.nHits));
+    ret.push_back(Pair("misses", stats.nMisses));
+    ret.push_back(Pair("hitrate", stats.nHits + stats.nMisses == 0 ? 0.0 : (double)stats.nHits / (stats.nHits + stats.nMisses)));
+    ret.push_back(Pair("evictions", stats.nEvictions));
+    ret.push_back(Pair("invalidations", stats.nInvalidations));
+    return ret;
+}
+
 inline CBlockIndex* LookupBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);
@@ -1905,28 +1963,29 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp, const CPubKey& mypk
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
-    { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "z_gettreestate",         &z_gettreestate,         true  },
-    { "blockchain",         "getchaintxstats",        &getchaintxstats,        true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
-    { "blockchain",         "verifychain",            &verifychain,            true  },
+{ //  category              name                      actor (function)         okSafeMode concurrent
+  //  --------------------- ------------------------  -----------------------  ---------- ----------
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  true  },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  true  },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,  true  },
+    { "blockchain",         "getblock",               &getblock,               true,  true  },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,  true  },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,  false },
+    { "blockchain",         "z_gettreestate",         &z_gettreestate,         true,  true  },
+    { "blockchain",         "getchaintxstats",        &getchaintxstats,        true,  true  },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  true  },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,  true  },
+    { "blockchain",         "gettxcacheinfo",         &gettxcacheinfo,         true,  false },
+    { "blockchain",         "gettxout",               &gettxout,               true,  true  },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  false },
+    { "blockchain",         "verifychain",            &verifychain,            true,  false },
 
     /* Not shown in help */
-    { "hidden",             "invalidateblock",        &invalidateblock,        true  },
-    { "hidden",             "reconsiderblock",        &reconsiderblock,        true  },
-    { "hidden",             "letsdebug",              &letsdebug,              true  },
+    { "hidden",             "invalidateblock",        &invalidateblock,        true,  false },
+    { "hidden",             "reconsiderblock",        &reconsiderblock,        true,  false },
+    { "hidden",             "letsdebug",              &letsdebug,              true,  false },
 };
 
 void RegisterBlockchainRPCCommands(CRPCTable &tableRPC)
@@ -495,6 +495,8 @@ UniValue getmininginfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
             "  \"chain\": \"xxxx\",         (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"stakingcandidates\": n    (numeric) The utxos checked by the last staking round, PoS chains only\n"
+            "  \"stakingcandidatesps\": x  (numeric) The utxos checked per second by the last staking round, PoS chains only\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmininginfo", "")
@@ -531,6 +533,13 @@ UniValue getmininginfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     obj.push_back(Pair("staking",          staking));
     obj.push_back(Pair("generate",         GetBoolArg("-gen", false) && GetBoolArg("-genproclimit", -1) != 0 ));
     obj.push_back(Pair("numthreads",       (int64_t)KOMODO_MININGTHREADS));
+    if ( ASSETCHAINS_STAKED != 0 )
+    {
+        uint64_t nCandidates = 0;
+        double rate = komodo_stakingrate(&nCandidates);
+        obj.push_back(Pair("stakingcandidates",   nCandidates));
+        obj.push_back(Pair("stakingcandidatesps", rate));
+    }
 #endif
     return obj;
 }
@@ -1128,25 +1137,25 @@ UniValue getblocksubsidy(const UniValue& params, bool fHelp, const CPubKey& mypk
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "mining",             "getlocalsolps",          &getlocalsolps,          true  },
-    { "mining",             "getnetworksolps",        &getnetworksolps,        true  },
-    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true  },
-    { "mining",             "getmininginfo",          &getmininginfo,          true  },
-    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true  },
-    { "mining",             "getblocktemplate",       &getblocktemplate,       true  },
-    { "mining",             "submitblock",            &submitblock,            true  },
-    { "mining",             "getblocksubsidy",        &getblocksubsidy,        true  },
+{ //  category              name                      actor (function)         okSafeMode concurrent
+  //  --------------------- ------------------------  -----------------------  ---------- ----------
+    { "mining",             "getlocalsolps",          &getlocalsolps,          true,  false },
+    { "mining",             "getnetworksolps",        &getnetworksolps,        true,  false },
+    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,  false },
+    { "mining",             "getmininginfo",          &getmininginfo,          true,  false },
+    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,  false },
+    { "mining",             "getblocktemplate",       &getblocktemplate,       true,  false },
+    { "mining",             "submitblock",            &submitblock,            true,  false },
+    { "mining",             "getblocksubsidy",        &getblocksubsidy,        true,  false },
 
 #ifdef ENABLE_MINING
-    { "generating",         "getgenerate",            &getgenerate,            true  },
-    { "generating",         "setgenerate",            &setgenerate,            true  },
-    { "generating",         "generate",               &generate,               true  },
+    { "generating",         "getgenerate",            &getgenerate,            true,  false },
+    { "generating",         "setgenerate",            &setgenerate,            true,  false },
+    { "generating",         "generate",               &generate,               true,  false },
 #endif
 
-    { "util",               "estimatefee",            &estimatefee,            true  },
-    { "util",               "estimatepriority",       &estimatepriority,       true  },
+    { "util",               "estimatefee",            &estimatefee,            true,  false },
+    { "util",               "estimatepriority",       &estimatepriority,       true,  false },
 };
 
 void RegisterMiningRPCCommands(CRPCTable &tableRPC)
@@ -25,6 +25,7 @@
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "notaries_staked.h"
@@ -880,6 +881,99 @@ bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint16
     return true;
 }
 
+//! page size of getaddressutxos and getaddresstxids when only a cursor is given
+static const int DEFAULT_ADDRESS_PAGE_SIZE = 1000;
+static const int MAX_ADDRESS_PAGE_SIZE = 100000;
+
+/****
+ * Read the paging options of an address query
+ * @param param the query object
+ * @param nLimit receives the page size
+ * @param fReverse receives true if the entries are walked from the last to the first
+ * @param strCursor receives the cursor to continue after, empty for the first page
+ * @returns true if a page is requested, false for the whole unpaged result
+ */
+static bool GetAddressPageParams(const UniValue& param, int &nLimit, bool &fReverse, std::string &strCursor)
+{
+    if (!param.isObject())
+        return false;
+    UniValue limitValue = find_value(param.get_obj(), "limit");
+    UniValue cursorValue = find_value(param.get_obj(), "cursor");
+    UniValue reverseValue = find_value(param.get_obj(), "reverse");
+    if (limitValue.isNull() && cursorValue.isNull())
+        return false;
+
+    nLimit = DEFAULT_ADDRESS_PAGE_SIZE;
+    if (!limitValue.isNull()) {
+        nLimit = limitValue.get_int();
+        if (nLimit <= 0 || nLimit > MAX_ADDRESS_PAGE_SIZE)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid parameter, limit must be between 1 and %d", MAX_ADDRESS_PAGE_SIZE));
+    }
+    fReverse = reverseValue.isBool() && reverseValue.get_bool();
+    strCursor = cursorValue.isNull() ? "" : cursorValue.get_str();
+    return true;
+}
+
+/****
+ * The cursor of an address query is the position in the address list and the last index key returned
+ */
+template <typename K>
+static std::string EncodeAddressCursor(uint32_t nAddress, const K &key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << nAddress << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+template <typename K>
+static void DecodeAddressCursor(const std::string &strCursor, const std::vector<std::pair<uint160, int> > &addresses, uint32_t &nAddress, K &key)
+{
+    bool fValid = IsHex(strCursor);
+    if (fValid) {
+        try {
+            CDataStream ss(ParseHex(strCursor), SER_DISK, CLIENT_VERSION);
+            ss >> nAddress >> key;
+            // the key must be one of the address it points at, or the scan would start on another one
+            fValid = ss.empty() && nAddress < addresses.size() &&
+                     key.type == (unsigned int)addresses[nAddress].second && key.hashBytes == addresses[nAddress].first;
+        } catch (const std::exception&) {
+            fValid = false;
+        }
+    }
+    if (!fValid)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+}
+
+static void GetHeightRangeParams(const UniValue& param, int &start, int &end)
+{
+    start = end = 0;
+    if (param.isObject()) {
+        UniValue startValue = find_value(param.get_obj(), "start");
+        UniValue endValue = find_value(param.get_obj(), "end");
+        if (startValue.isNum())
+            start = startValue.get_int();
+        if (endValue.isNum())
+            end = endValue.get_int();
+    }
+}
+
+static UniValue AddressUnspentToJSON(const CAddressUnspentKey &key, const CAddressUnspentValue &value)
+{
+    UniValue output(UniValue::VOBJ);
+    std::string address;
+    if (!getAddressFromIndex(key.type, key.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
+
+    output.push_back(Pair("address", address));
+    output.push_back(Pair("txid", key.txhash.GetHex()));
+    output.push_back(Pair("outputIndex", (int)key.index));
+    output.push_back(Pair("script", HexStr(value.script.begin(), value.script.end())));
+    output.push_back(Pair("satoshis", value.satoshis));
+    output.push_back(Pair("height", value.blockHeight));
+    return output;
+}
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
                 std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
     return a.second.blockHeight < b.second.blockHeight;
@@ -976,6 +1070,11 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\"  (number, optional) Return a page of at most this many outputs, in txid order\n"
+            "  \"cursor\"  (string, optional) Continue after the page that returned this \"next\" cursor\n"
+            "  \"reverse\"  (boolean, optional, default=false) Page from the last output to the first\n"
+            "  \"start\"  (number, optional) Only outputs at or above this height, paged queries only\n"
+            "  \"end\"  (number, optional) Only outputs at or below this height, paged queries only\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
             "\nResult\n"
@@ -989,8 +1088,14 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
             "    \"satoshis\"  (number) The number of satoshis of the output\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit or cursor)\n"
+            "{\n"
+            "  \"utxos\"  (array) The outputs as above\n"
+            "  \"next\"  (string) Cursor of the next page, absent on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
             );
 
@@ -1008,35 +1113,68 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
-
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
-
     UniValue utxos(UniValue::VARR);
+    int nLimit = 0;
+    bool fReverse = false;
+    std::string strCursor, strNext;
+    bool fPaged = GetAddressPageParams(params[0], nLimit, fReverse, strCursor);
+
+    if (fPaged) {
+        // walk the index entry by entry, nothing beyond the page is read
+        int start, end;
+        GetHeightRangeParams(params[0], start, end);
+        uint32_t nAddress = 0;
+        CAddressUnspentKey resumeKey, lastKey;
+        if (!strCursor.empty())
+            DecodeAddressCursor(strCursor, addresses, nAddress, resumeKey);
+        const CAddressUnspentKey *pafter = strCursor.empty() ? NULL : &resumeKey;
+        int nCount = 0;
+        uint32_t nLastAddress = nAddress;
+        for (; nAddress < addresses.size() && strNext.empty(); nAddress++, pafter = NULL) {
+            AddressUnspentVisitor visitor = [&](const CAddressUnspentKey &key, const CAddressUnspentValue &value) {
+                if ((start > 0 && value.blockHeight < start) || (end > 0 && value.blockHeight > end))
+                    return true;
+                if (nCount == nLimit) {
+                    strNext = EncodeAddressCursor(nLastAddress, lastKey);
+                    return false;
+                }
+                utxos.push_back(AddressUnspentToJSON(key, value));
+                lastKey = key;
+                nLastAddress = nAddress;
+                nCount++;
+                return true;
+            };
+            if (!ScanAddressUnspent(addresses[nAddress].first, addresses[nAddress].second, pafter, fReverse, visitor)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
+    } else {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
-        UniValue output(UniValue::VOBJ);
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
         }
 
-        output.push_back(Pair("address", address));
-        output.push_back(Pair("txid", it->first.txhash.GetHex()));
-        output.push_back(Pair("outputIndex", (int)it->first.index));
-        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
-        output.push_back(Pair("satoshis", it->second.satoshis));
-        output.push_back(Pair("height", it->second.blockHeight));
-        utxos.push_back(output);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+            utxos.push_back(AddressUnspentToJSON(it->first, it->second));
     }
 
-    if (includeChainInfo) {
+    if (fPaged) {
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("utxos", utxos));
+        if (!strNext.empty())
+            result.push_back(Pair("next", strNext));
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
+            result.push_back(Pair("height", (int)chainActive.Height()));
+        }
+        return result;
+    } else if (includeChainInfo) {
         UniValue result(UniValue::VOBJ);
         result.push_back(Pair("utxos", utxos));
 
@@ -1332,11 +1470,11 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp, const CPubKey& my
 
 }
 
-UniValue komodo_snapshot(int top);
+UniValue komodo_snapshot(int top, int workers);
 
 UniValue getsnapshot(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
-    UniValue result(UniValue::VOBJ); int64_t total; int32_t top = 0;
+    UniValue result(UniValue::VOBJ); int64_t total; int32_t top = 0, workers = 0;
 
     if (params.size() > 0 && !params[0].isNull()) {
         top = atoi(params[0].get_str().c_str());
@@ -1349,13 +1487,20 @@ UniValue getsnapshot(const UniValue& params, bool fHelp, const CPubKey& mypk)
         }
     }
 
-    if ( fHelp || params.size() > 1)
+    if (params.size() > 1 && !params[1].isNull()) {
+        workers = params[1].isNum() ? params[1].get_int() : atoi(params[1].get_str().c_str());
+        if ( workers < 0 || workers > MAX_SNAPSHOT_WORKERS )
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid parameter, workers must be between 0 and %d", MAX_SNAPSHOT_WORKERS));
+    }
+
+    if ( fHelp || params.size() > 2)
     {
         throw runtime_error(
                             "getsnapshot\n"
 			    "\nReturns a snapshot of (address,amount) pairs at current height (requires addressindex to be enabled).\n"
 			    "\nArguments:\n"
 			    "  \"top\" (number, optional) Only return this many addresses, i.e. top N richlist\n"
+			    "  \"workers\" (number, optional, default=0) Threads used to scan the index, 0 uses one per core\n"
 			    "\nResult:\n"
 			    "{\n"
 			    "   \"addresses\": [\n"
@@ -1375,14 +1520,18 @@ UniValue getsnapshot(const UniValue& params, bool fHelp, const CPubKey& mypk)
 			    "  \"start_height\": 91,       (number) Block height snapshot began\n"
 			    "  \"ending_height\": 91,      (number) Block height snapshot finished\n"
 			    "  \"start_time\": 1531982752, (number) Unix epoch time snapshot started\n"
-			    "  \"end_time\": 1531982752    (number) Unix epoch time snapshot finished\n"
+			    "  \"end_time\": 1531982752,   (number) Unix epoch time snapshot finished\n"
+			    "  \"workers\": 4,             (number) Threads the index was scanned with\n"
+			    "  \"scanned_entries\": 2,     (number) Index entries read\n"
+			    "  \"scan_seconds\": 0.01,     (numeric) Time spent scanning the index\n"
+			    "  \"entries_per_second\": 200 (numeric) Scan throughput\n"
 			    "}\n"
 			    "\nExamples:\n"
 			    + HelpExampleCli("getsnapshot","")
 			    + HelpExampleRpc("getsnapshot", "1000")
                             );
     }
-    result = komodo_snapshot(top);
+    result = komodo_snapshot(top, workers);
     if ( result.size() > 0 ) {
         result.push_back(Pair("end_time", (int) time(NULL)));
     } else {
@@ -1406,6 +1555,9 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\"  (number, optional) Return a page of at most this many txids, in height order\n"
+            "  \"cursor\"  (string, optional) Continue after the page that returned this \"next\" cursor\n"
+            "  \"reverse\"  (boolean, optional, default=false) Page from the highest block to the lowest\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
             "\nResult:\n"
@@ -1413,8 +1565,14 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with limit or cursor, several addresses are paged one after another):\n"
+            "{\n"
+            "  \"txids\"  (array) The transaction ids\n"
+            "  \"next\"  (string) Cursor of the next page, absent on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"], \"limit\": 1000, \"reverse\": true}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
         );
 
@@ -1435,6 +1593,50 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
         }
     }
 
+    int nLimit = 0;
+    bool fReverse = false;
+    std::string strCursor;
+    if (GetAddressPageParams(params[0], nLimit, fReverse, strCursor)) {
+        GetHeightRangeParams(params[0], start, end);
+        uint32_t nAddress = 0;
+        CAddressIndexKey resumeKey, lastKey;
+        if (!strCursor.empty())
+            DecodeAddressCursor(strCursor, addresses, nAddress, resumeKey);
+        const CAddressIndexKey *pafter = strCursor.empty() ? NULL : &resumeKey;
+        // the records of one transaction are next to each other, the txid is returned once
+        uint256 lastTxid = strCursor.empty() ? uint256() : resumeKey.txhash;
+        UniValue txids(UniValue::VARR);
+        std::string strNext;
+        int nCount = 0;
+        uint32_t nLastAddress = nAddress;
+        for (; nAddress < addresses.size() && strNext.empty(); nAddress++, pafter = NULL) {
+            AddressIndexVisitor visitor = [&](const CAddressIndexKey &key, CAmount nValue) {
+                if (key.txhash == lastTxid && nLastAddress == nAddress) {
+                    lastKey = key;
+                    return true;
+                }
+                if (nCount == nLimit) {
+                    strNext = EncodeAddressCursor(nLastAddress, lastKey);
+                    return false;
+                }
+                txids.push_back(key.txhash.GetHex());
+                lastTxid = key.txhash;
+                lastKey = key;
+                nLastAddress = nAddress;
+                nCount++;
+                return true;
+            };
+            if (!ScanAddressIndex(addresses[nAddress].first, addresses[nAddress].second, start, end, pafter, fReverse, visitor)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("txids", txids));
+        if (!strNext.empty())
+            result.push_back(Pair("next", strNext));
+        return result;
+    }
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
@@ -1616,16 +1818,16 @@ UniValue decodeccopret(const UniValue& params, bool fHelp, const CPubKey& mypk)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "z_validateaddress",      &z_validateaddress,      true  }, /* uses wallet if enabled */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "verifymessage",          &verifymessage,          true  },
+{ //  category              name                      actor (function)         okSafeMode concurrent
+  //  --------------------- ------------------------  -----------------------  ---------- ----------
+    { "control",            "getinfo",                &getinfo,                true,  false }, /* uses wallet if enabled */
+    { "util",               "validateaddress",        &validateaddress,        true,  false }, /* uses wallet if enabled */
+    { "util",               "z_validateaddress",      &z_validateaddress,      true,  false }, /* uses wallet if enabled */
+    { "util",               "createmultisig",         &createmultisig,         true,  false },
+    { "util",               "verifymessage",          &verifymessage,          true,  false },
 
     /* Not shown in help */
-    { "hidden",             "setmocktime",            &setmocktime,            true  },
+    { "hidden",             "setmocktime",            &setmocktime,            true,  false },
 };
 
 void RegisterMiscRPCCommands(CRPCTable &tableRPC)
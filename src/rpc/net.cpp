@@ -109,7 +109,14 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"compactblocks\": {          (object) Compact blocks received from this peer\n"
+            "       \"enabled\": true|false,     (boolean) Whether new blocks are fetched from this peer as compact blocks\n"
+            "       \"received\": n,            (numeric) The compact blocks received\n"
+            "       \"reconstructed\": n,       (numeric) The ones rebuilt from our mempool alone\n"
+            "       \"roundtrips\": n,          (numeric) The ones rebuilt after asking for missing transactions\n"
+            "       \"failed\": n,              (numeric) The ones downloaded in full after all\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -165,6 +172,13 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            UniValue compact(UniValue::VOBJ);
+            compact.push_back(Pair("enabled", statestats.fCompactBlocks));
+            compact.push_back(Pair("received", statestats.nCompactBlocks));
+            compact.push_back(Pair("reconstructed", statestats.nCompactReconstructed));
+            compact.push_back(Pair("roundtrips", statestats.nCompactRoundTrips));
+            compact.push_back(Pair("failed", statestats.nCompactFailed));
+            obj.push_back(Pair("compactblocks", compact));
         }
         obj.push_back(Pair("addr_processed", stats.m_addr_processed));
         obj.push_back(Pair("addr_rate_limited", stats.m_addr_rate_limited));
@@ -681,20 +695,20 @@ UniValue clearbanned(const UniValue& params, bool fHelp, const CPubKey& mypk)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "network",            "getconnectioncount",     &getconnectioncount,     true  },
-    { "network",            "getdeprecationinfo",     &getdeprecationinfo,     true  },
-    { "network",            "ping",                   &ping,                   true  },
-    { "network",            "getpeerinfo",            &getpeerinfo,            true  },
-    { "network",            "addnode",                &addnode,                true  },
-    { "network",            "disconnectnode",         &disconnectnode,         true  },
-    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
-    { "network",            "getnettotals",           &getnettotals,           true  },
-    { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
-    { "network",            "setban",                 &setban,                 true  },
-    { "network",            "listbanned",             &listbanned,             true  },
-    { "network",            "clearbanned",            &clearbanned,            true  },
+{ //  category              name                      actor (function)         okSafeMode concurrent
+  //  --------------------- ------------------------  -----------------------  ---------- ----------
+    { "network",            "getconnectioncount",     &getconnectioncount,     true,  false },
+    { "network",            "getdeprecationinfo",     &getdeprecationinfo,     true,  false },
+    { "network",            "ping",                   &ping,                   true,  false },
+    { "network",            "getpeerinfo",            &getpeerinfo,            true,  false },
+    { "network",            "addnode",                &addnode,                true,  false },
+    { "network",            "disconnectnode",         &disconnectnode,         true,  false },
+    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  false },
+    { "network",            "getnettotals",           &getnettotals,           true,  false },
+    { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  false },
+    { "network",            "setban",                 &setban,                 true,  false },
+    { "network",            "listbanned",             &listbanned,             true,  false },
+    { "network",            "clearbanned",            &clearbanned,            true,  false },
 };
 
 void RegisterNetRPCCommands(CRPCTable &tableRPC)
@@ -30,6 +30,9 @@
 #include "asyncrpcqueue.h"
 #include "assetchain.h"
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <memory>
 
 #include <univalue.h>
@@ -287,355 +290,355 @@ UniValue stop(const UniValue& params, bool fHelp, const CPubKey& mypk)
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode concurrent
+  //  --------------------- ------------------------  -----------------------  ---------- ----------
     /* Overall control/query calls */
-    { "control",            "help",                   &help,                   true  },
-    { "control",            "getiguanajson",          &getiguanajson,          true  },
-    { "control",            "getnotarysendmany",      &getnotarysendmany,      true  },
-    { "control",            "geterablockheights",     &geterablockheights,     true  },
-    { "control",            "stop",                   &stop,                   true  },
+    { "control",            "help",                   &help,                   true,  false },
+    { "control",            "getiguanajson",          &getiguanajson,          true,  false },
+    { "control",            "getnotarysendmany",      &getnotarysendmany,      true,  false },
+    { "control",            "geterablockheights",     &geterablockheights,     true,  false },
+    { "control",            "stop",                   &stop,                   true,  false },
 
     /* P2P networking */
-    { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
-    { "network",            "getdeprecationinfo",     &getdeprecationinfo,     true  },
-    { "network",            "addnode",                &addnode,                true  },
-    { "network",            "disconnectnode",         &disconnectnode,         true  },
-    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
-    { "network",            "getconnectioncount",     &getconnectioncount,     true  },
-    { "network",            "getnettotals",           &getnettotals,           true  },
-    { "network",            "getpeerinfo",            &getpeerinfo,            true  },
-    { "network",            "ping",                   &ping,                   true  },
-    { "network",            "setban",                 &setban,                 true  },
-    { "network",            "listbanned",             &listbanned,             true  },
-    { "network",            "clearbanned",            &clearbanned,            true  },
+    { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  false },
+    { "network",            "getdeprecationinfo",     &getdeprecationinfo,     true,  false },
+    { "network",            "addnode",                &addnode,                true,  false },
+    { "network",            "disconnectnode",         &disconnectnode,         true,  false },
+    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  false },
+    { "network",            "getconnectioncount",     &getconnectioncount,     true,  false },
+    { "network",            "getnettotals",           &getnettotals,           true,  false },
+    { "network",            "getpeerinfo",            &getpeerinfo,            true,  false },
+    { "network",            "ping",                   &ping,                   true,  false },
+    { "network",            "setban",                 &setban,                 true,  false },
+    { "network",            "listbanned",             &listbanned,             true,  false },
+    { "network",            "clearbanned",            &clearbanned,            true,  false },
 
     /* Block chain and UTXO */
-    { "blockchain",         "coinsupply",             &coinsupply,             true  },
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false },
-    { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
-    { "blockchain",         "getlastsegidstakes",     &getlastsegidstakes,     true  },
-    { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
-    { "blockchain",         "verifychain",            &verifychain,            true  },
-    { "blockchain",         "getspentinfo",           &getspentinfo,           false },
-    { "blockchain",         "notaries",               &notaries,               true  },
-    //{ "blockchain",         "height_MoM",             &height_MoM,             true  },
-    //{ "blockchain",         "txMoMproof",             &txMoMproof,             true  },
-    { "blockchain",         "minerids",               &minerids,               true  },
-    { "blockchain",         "kvsearch",               &kvsearch,               true  },
-    { "blockchain",         "kvupdate",               &kvupdate,               true  },
-    { "blockchain",         "letsdebug",              &letsdebug,              true  },
+    { "blockchain",         "coinsupply",             &coinsupply,             true,  false },
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  true  },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  true  },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,  true  },
+    { "blockchain",         "getblock",               &getblock,               true,  true  },
+    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false, true  },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         true,  true  },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,  true  },
+    { "blockchain",         "getlastsegidstakes",     &getlastsegidstakes,     true,  false },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,  false },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  true  },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,  true  },
+    { "blockchain",         "gettxout",               &gettxout,               true,  true  },
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  true  },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,  true  },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  false },
+    { "blockchain",         "verifychain",            &verifychain,            true,  false },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           false, true  },
+    { "blockchain",         "notaries",               &notaries,               true,  false },
+    //{ "blockchain",         "height_MoM",             &height_MoM,             true,  false },
+    //{ "blockchain",         "txMoMproof",             &txMoMproof,             true,  false },
+    { "blockchain",         "minerids",               &minerids,               true,  false },
+    { "blockchain",         "kvsearch",               &kvsearch,               true,  false },
+    { "blockchain",         "kvupdate",               &kvupdate,               true,  false },
+    { "blockchain",         "letsdebug",              &letsdebug,              true,  false },
 
     /* Cross chain utilities */
-    { "crosschain",         "MoMoMdata",              &MoMoMdata,              true  },
-    { "crosschain",         "calc_MoM",               &calc_MoM,               true  },
-    { "crosschain",         "height_MoM",             &height_MoM,             true  },
-    { "crosschain",         "assetchainproof",        &assetchainproof,        true  },
-    { "crosschain",         "crosschainproof",        &crosschainproof,        true  },
-    { "crosschain",         "getNotarisationsForBlock", &getNotarisationsForBlock, true },
-    { "crosschain",         "scanNotarisationsDB",    &scanNotarisationsDB,    true },
-    { "crosschain",         "getimports",             &getimports,             true },
-    { "crosschain",         "getwalletburntransactions",  &getwalletburntransactions,             true },
-    { "crosschain",         "migrate_converttoexport", &migrate_converttoexport, true  },
-    { "crosschain",         "migrate_createburntransaction", &migrate_createburntransaction, true },
-    { "crosschain",         "migrate_createimporttransaction", &migrate_createimporttransaction, true  },
-    { "crosschain",         "migrate_completeimporttransaction", &migrate_completeimporttransaction, true  },
-    { "crosschain",         "migrate_checkburntransactionsource", &migrate_checkburntransactionsource, true },
-    { "crosschain",         "migrate_createnotaryapprovaltransaction", &migrate_createnotaryapprovaltransaction, true },
-    { "crosschain",         "selfimport", &selfimport, true  },
-    { "crosschain",         "importdual", &importdual, true  },
+    { "crosschain",         "MoMoMdata",              &MoMoMdata,              true,  false },
+    { "crosschain",         "calc_MoM",               &calc_MoM,               true,  false },
+    { "crosschain",         "height_MoM",             &height_MoM,             true,  false },
+    { "crosschain",         "assetchainproof",        &assetchainproof,        true,  false },
+    { "crosschain",         "crosschainproof",        &crosschainproof,        true,  false },
+    { "crosschain",         "getNotarisationsForBlock", &getNotarisationsForBlock, true,  false },
+    { "crosschain",         "scanNotarisationsDB",    &scanNotarisationsDB,    true,  false },
+    { "crosschain",         "getimports",             &getimports,             true,  false },
+    { "crosschain",         "getwalletburntransactions",  &getwalletburntransactions,             true,  false },
+    { "crosschain",         "migrate_converttoexport", &migrate_converttoexport, true,  false },
+    { "crosschain",         "migrate_createburntransaction", &migrate_createburntransaction, true,  false },
+    { "crosschain",         "migrate_createimporttransaction", &migrate_createimporttransaction, true,  false },
+    { "crosschain",         "migrate_completeimporttransaction", &migrate_completeimporttransaction, true,  false },
+    { "crosschain",         "migrate_checkburntransactionsource", &migrate_checkburntransactionsource, true,  false },
+    { "crosschain",         "migrate_createnotaryapprovaltransaction", &migrate_createnotaryapprovaltransaction, true,  false },
+    { "crosschain",         "selfimport", &selfimport, true,  false },
+    { "crosschain",         "importdual", &importdual, true,  false },
     //ImportGateway
-    { "crosschain",       "importgatewayddress",     &importgatewayaddress,      true },
-    { "crosschain",       "importgatewayinfo", &importgatewayinfo, true  },
-    { "crosschain",       "importgatewaybind", &importgatewaybind, true  },
-    { "crosschain",       "importgatewaydeposit", &importgatewaydeposit, true  },
-    { "crosschain",       "importgatewaywithdraw",  &importgatewaywithdraw,     true },
-    { "crosschain",       "importgatewaypartialsign",  &importgatewaypartialsign,     true },
-    { "crosschain",       "importgatewaycompletesigning",  &importgatewaycompletesigning,     true },
-    { "crosschain",       "importgatewaymarkdone",  &importgatewaymarkdone,     true },
-    { "crosschain",       "importgatewaypendingwithdraws",   &importgatewaypendingwithdraws,      true },
-    { "crosschain",       "importgatewayprocessed",   &importgatewayprocessed,  true },
+    { "crosschain",       "importgatewayddress",     &importgatewayaddress,      true,  false },
+    { "crosschain",       "importgatewayinfo", &importgatewayinfo, true,  false },
+    { "crosschain",       "importgatewaybind", &importgatewaybind, true,  false },
+    { "crosschain",       "importgatewaydeposit", &importgatewaydeposit, true,  false },
+    { "crosschain",       "importgatewaywithdraw",  &importgatewaywithdraw,     true,  false },
+    { "crosschain",       "importgatewaypartialsign",  &importgatewaypartialsign,     true,  false },
+    { "crosschain",       "importgatewaycompletesigning",  &importgatewaycompletesigning,     true,  false },
+    { "crosschain",       "importgatewaymarkdone",  &importgatewaymarkdone,     true,  false },
+    { "crosschain",       "importgatewaypendingwithdraws",   &importgatewaypendingwithdraws,      true,  false },
+    { "crosschain",       "importgatewayprocessed",   &importgatewayprocessed,  true,  false },
 
 
 
     /* Mining */
-    { "mining",             "getblocktemplate",       &getblocktemplate,       true  },
-    { "mining",             "getmininginfo",          &getmininginfo,          true  },
-    { "mining",             "getlocalsolps",          &getlocalsolps,          true  },
-    { "mining",             "getnetworksolps",        &getnetworksolps,        true  },
-    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true  },
-    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true  },
-    { "mining",             "submitblock",            &submitblock,            true  },
-    { "mining",             "getblocksubsidy",        &getblocksubsidy,        true  },
-    { "mining",             "genminingCSV",           &genminingCSV,           true  },
+    { "mining",             "getblocktemplate",       &getblocktemplate,       true,  false },
+    { "mining",             "getmininginfo",          &getmininginfo,          true,  false },
+    { "mining",             "getlocalsolps",          &getlocalsolps,          true,  false },
+    { "mining",             "getnetworksolps",        &getnetworksolps,        true,  false },
+    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,  false },
+    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,  false },
+    { "mining",             "submitblock",            &submitblock,            true,  false },
+    { "mining",             "getblocksubsidy",        &getblocksubsidy,        true,  false },
+    { "mining",             "genminingCSV",           &genminingCSV,           true,  false },
 
 #ifdef ENABLE_MINING
     /* Coin generation */
-    { "generating",         "getgenerate",            &getgenerate,            true  },
-    { "generating",         "setgenerate",            &setgenerate,            true  },
-    { "generating",         "generate",               &generate,               true  },
+    { "generating",         "getgenerate",            &getgenerate,            true,  false },
+    { "generating",         "setgenerate",            &setgenerate,            true,  false },
+    { "generating",         "generate",               &generate,               true,  false },
 #endif
 
     /* Raw transactions */
-    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
-    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
-    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
+    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,  false },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  true  },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,  true  },
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,  true  },
+    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false, false },
+    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false, false }, /* uses wallet if enabled */
 #ifdef ENABLE_WALLET
-    { "rawtransactions",    "fundrawtransaction",     &fundrawtransaction,     false },
+    { "rawtransactions",    "fundrawtransaction",     &fundrawtransaction,     false, false },
 #endif
 
     // auction
-    { "auction",       "auctionaddress",    &auctionaddress,  true },
+    { "auction",       "auctionaddress",    &auctionaddress,  true,  false },
 
     // lotto
-    { "lotto",       "lottoaddress",    &lottoaddress,  true },
+    { "lotto",       "lottoaddress",    &lottoaddress,  true,  false },
 
     // fsm
-    { "FSM",       "FSMaddress",   &FSMaddress, true },
-    { "FSM", "FSMcreate",    &FSMcreate,  true },
-    { "FSM",   "FSMlist",      &FSMlist,    true },
-    { "FSM",   "FSMinfo",      &FSMinfo,    true },
+    { "FSM",       "FSMaddress",   &FSMaddress, true,  false },
+    { "FSM", "FSMcreate",    &FSMcreate,  true,  false },
+    { "FSM",   "FSMlist",      &FSMlist,    true,  false },
+    { "FSM",   "FSMinfo",      &FSMinfo,    true,  false },
 
     // fsm
-    { "nSPV",   "nspv_getinfo",         &nspv_getinfo, true },
-    { "nSPV",   "nspv_login",           &nspv_login, true },
-    { "nSPV",   "nspv_listunspent",     &nspv_listunspent,  true },
-    { "nSPV",   "nspv_mempool",         &nspv_mempool,  true },
-    { "nSPV",   "nspv_listtransactions",&nspv_listtransactions,  true },
-    { "nSPV",   "nspv_spentinfo",       &nspv_spentinfo,    true },
-    { "nSPV",   "nspv_notarizations",   &nspv_notarizations,    true },
-    { "nSPV",   "nspv_hdrsproof",       &nspv_hdrsproof,    true },
-    { "nSPV",   "nspv_txproof",         &nspv_txproof,    true },
-    { "nSPV",   "nspv_spend",           &nspv_spend,    true },
-    { "nSPV",   "nspv_broadcast",       &nspv_broadcast,    true },
-    { "nSPV",   "nspv_logout",          &nspv_logout,    true },
-    { "nSPV",   "nspv_listccmoduleunspent",     &nspv_listccmoduleunspent,  true },
+    { "nSPV",   "nspv_getinfo",         &nspv_getinfo, true,  false },
+    { "nSPV",   "nspv_login",           &nspv_login, true,  false },
+    { "nSPV",   "nspv_listunspent",     &nspv_listunspent,  true,  false },
+    { "nSPV",   "nspv_mempool",         &nspv_mempool,  true,  false },
+    { "nSPV",   "nspv_listtransactions",&nspv_listtransactions,  true,  false },
+    { "nSPV",   "nspv_spentinfo",       &nspv_spentinfo,    true,  false },
+    { "nSPV",   "nspv_notarizations",   &nspv_notarizations,    true,  false },
+    { "nSPV",   "nspv_hdrsproof",       &nspv_hdrsproof,    true,  false },
+    { "nSPV",   "nspv_txproof",         &nspv_txproof,    true,  false },
+    { "nSPV",   "nspv_spend",           &nspv_spend,    true,  false },
+    { "nSPV",   "nspv_broadcast",       &nspv_broadcast,    true,  false },
+    { "nSPV",   "nspv_logout",          &nspv_logout,    true,  false },
+    { "nSPV",   "nspv_listccmoduleunspent",     &nspv_listccmoduleunspent,  true,  false },
 
     // rewards
-    { "rewards",       "rewardslist",       &rewardslist,     true },
-    { "rewards",       "rewardsinfo",       &rewardsinfo,     true },
-    { "rewards",       "rewardscreatefunding",       &rewardscreatefunding,     true },
-    { "rewards",       "rewardsaddfunding",       &rewardsaddfunding,     true },
-    { "rewards",       "rewardslock",       &rewardslock,     true },
-    { "rewards",       "rewardsunlock",     &rewardsunlock,   true },
-    { "rewards",       "rewardsaddress",    &rewardsaddress,  true },
+    { "rewards",       "rewardslist",       &rewardslist,     true,  false },
+    { "rewards",       "rewardsinfo",       &rewardsinfo,     true,  false },
+    { "rewards",       "rewardscreatefunding",       &rewardscreatefunding,     true,  false },
+    { "rewards",       "rewardsaddfunding",       &rewardsaddfunding,     true,  false },
+    { "rewards",       "rewardslock",       &rewardslock,     true,  false },
+    { "rewards",       "rewardsunlock",     &rewardsunlock,   true,  false },
+    { "rewards",       "rewardsaddress",    &rewardsaddress,  true,  false },
 
     // faucet
-    { "faucet",       "faucetinfo",      &faucetinfo,         true },
-    { "faucet",       "faucetfund",      &faucetfund,         true },
-    { "faucet",       "faucetget",       &faucetget,          true },
-    { "faucet",       "faucetaddress",   &faucetaddress,      true },
+    { "faucet",       "faucetinfo",      &faucetinfo,         true,  false },
+    { "faucet",       "faucetfund",      &faucetfund,         true,  false },
+    { "faucet",       "faucetget",       &faucetget,          true,  false },
+    { "faucet",       "faucetaddress",   &faucetaddress,      true,  false },
 
 		// Heir
-	{ "heir",       "heiraddress",   &heiraddress,      true },
-	{ "heir",       "heirfund",   &heirfund,      true },
-	{ "heir",       "heiradd",    &heiradd,        true },
-	{ "heir",       "heirclaim",  &heirclaim,     true },
-/*	{ "heir",       "heirfundtokens",   &heirfundtokens,      true },
-	{ "heir",       "heiraddtokens",    &heiraddtokens,        true },
-	{ "heir",       "heirclaimtokens",  &heirclaimtokens,     true },*/
-	{ "heir",       "heirinfo",   &heirinfo,      true },
-	{ "heir",       "heirlist",   &heirlist,      true },
+	{ "heir",       "heiraddress",   &heiraddress,      true,  false },
+	{ "heir",       "heirfund",   &heirfund,      true,  false },
+	{ "heir",       "heiradd",    &heiradd,        true,  false },
+	{ "heir",       "heirclaim",  &heirclaim,     true,  false },
+/*	{ "heir",       "heirfundtokens",   &heirfundtokens,      true,  false },
+	{ "heir",       "heiraddtokens",    &heiraddtokens,        true,  false },
+	{ "heir",       "heirclaimtokens",  &heirclaimtokens,     true,  false },*/
+	{ "heir",       "heirinfo",   &heirinfo,      true,  false },
+	{ "heir",       "heirlist",   &heirlist,      true,  false },
 
     // Channels
-    { "channels",       "channelsaddress",   &channelsaddress,   true },
-    { "channels",       "channelslist",      &channelslist,      true },
-    { "channels",       "channelsinfo",      &channelsinfo,      true },
-    { "channels",       "channelsopen",      &channelsopen,      true },
-    { "channels",       "channelspayment",   &channelspayment,   true },
-    { "channels",       "channelsclose",     &channelsclose,      true },
-    { "channels",       "channelsrefund",    &channelsrefund,    true },
+    { "channels",       "channelsaddress",   &channelsaddress,   true,  false },
+    { "channels",       "channelslist",      &channelslist,      true,  false },
+    { "channels",       "channelsinfo",      &channelsinfo,      true,  false },
+    { "channels",       "channelsopen",      &channelsopen,      true,  false },
+    { "channels",       "channelspayment",   &channelspayment,   true,  false },
+    { "channels",       "channelsclose",     &channelsclose,      true,  false },
+    { "channels",       "channelsrefund",    &channelsrefund,    true,  false },
 
     // Oracles
-    { "oracles",       "oraclesaddress",   &oraclesaddress,     true },
-    { "oracles",       "oracleslist",      &oracleslist,        true },
-    { "oracles",       "oraclesinfo",      &oraclesinfo,        true },
-    { "oracles",       "oraclescreate",    &oraclescreate,      true },
-    { "oracles",       "oraclesfund",  &oraclesfund,    true },
-    { "oracles",       "oraclesregister",  &oraclesregister,    true },
-    { "oracles",       "oraclessubscribe", &oraclessubscribe,   true },
-    { "oracles",       "oraclesdata",      &oraclesdata,        true },
-    { "oracles",       "oraclessample",   &oraclessample,     true },
-    { "oracles",       "oraclessamples",   &oraclessamples,     true },
+    { "oracles",       "oraclesaddress",   &oraclesaddress,     true,  false },
+    { "oracles",       "oracleslist",      &oracleslist,        true,  false },
+    { "oracles",       "oraclesinfo",      &oraclesinfo,        true,  false },
+    { "oracles",       "oraclescreate",    &oraclescreate,      true,  false },
+    { "oracles",       "oraclesfund",  &oraclesfund,    true,  false },
+    { "oracles",       "oraclesregister",  &oraclesregister,    true,  false },
+    { "oracles",       "oraclessubscribe", &oraclessubscribe,   true,  false },
+    { "oracles",       "oraclesdata",      &oraclesdata,        true,  false },
+    { "oracles",       "oraclessample",   &oraclessample,     true,  false },
+    { "oracles",       "oraclessamples",   &oraclessamples,     true,  false },
 
     // Payments
-    { "payments",       "paymentsaddress",   &paymentsaddress,       true },
-    { "payments",       "paymentstxidopret", &payments_txidopret,    true },
-    { "payments",       "paymentscreate",    &payments_create,       true },
-    { "payments",       "paymentsairdrop",   &payments_airdrop,      true },
-    { "payments",       "paymentsairdroptokens",   &payments_airdroptokens,      true },
-    { "payments",       "paymentslist",      &payments_list,         true },
-    { "payments",       "paymentsinfo",      &payments_info,         true },
-    { "payments",       "paymentsfund",      &payments_fund,         true },
-    { "payments",       "paymentsmerge",     &payments_merge,        true },
-    { "payments",       "paymentsrelease",   &payments_release,      true },
-
-    { "CClib",       "cclibaddress",   &cclibaddress,      true },
-    { "CClib",       "cclibinfo",   &cclibinfo,      true },
-    { "CClib",       "cclib",   &cclib,      true },
+    { "payments",       "paymentsaddress",   &paymentsaddress,       true,  false },
+    { "payments",       "paymentstxidopret", &payments_txidopret,    true,  false },
+    { "payments",       "paymentscreate",    &payments_create,       true,  false },
+    { "payments",       "paymentsairdrop",   &payments_airdrop,      true,  false },
+    { "payments",       "paymentsairdroptokens",   &payments_airdroptokens,      true,  false },
+    { "payments",       "paymentslist",      &payments_list,         true,  false },
+    { "payments",       "paymentsinfo",      &payments_info,         true,  false },
+    { "payments",       "paymentsfund",      &payments_fund,         true,  false },
+    { "payments",       "paymentsmerge",     &payments_merge,        true,  false },
+    { "payments",       "paymentsrelease",   &payments_release,      true,  false },
+
+    { "CClib",       "cclibaddress",   &cclibaddress,      true,  false },
+    { "CClib",       "cclibinfo",   &cclibinfo,      true,  false },
+    { "CClib",       "cclib",   &cclib,      true,  false },
 
     // Gateways
-    { "gateways",       "gatewaysaddress",   &gatewaysaddress,      true },
-    { "gateways",       "gatewayslist",      &gatewayslist,         true },
-    { "gateways",       "gatewaysexternaladdress",      &gatewaysexternaladdress,         true },
-    { "gateways",       "gatewaysdumpprivkey",      &gatewaysdumpprivkey,         true },
-    { "gateways",       "gatewaysinfo",      &gatewaysinfo,         true },
-    { "gateways",       "gatewaysbind",      &gatewaysbind,         true },
-    { "gateways",       "gatewaysdeposit",   &gatewaysdeposit,      true },
-    { "gateways",       "gatewaysclaim",     &gatewaysclaim,        true },
-    { "gateways",       "gatewayswithdraw",  &gatewayswithdraw,     true },
-    { "gateways",       "gatewayspartialsign",  &gatewayspartialsign,     true },
-    { "gateways",       "gatewayscompletesigning",  &gatewayscompletesigning,     true },
-    { "gateways",       "gatewaysmarkdone",  &gatewaysmarkdone,     true },
-    { "gateways",       "gatewayspendingdeposits",   &gatewayspendingdeposits,      true },
-    { "gateways",       "gatewayspendingwithdraws",   &gatewayspendingwithdraws,      true },
-    { "gateways",       "gatewaysprocessed",   &gatewaysprocessed,  true },
+    { "gateways",       "gatewaysaddress",   &gatewaysaddress,      true,  false },
+    { "gateways",       "gatewayslist",      &gatewayslist,         true,  false },
+    { "gateways",       "gatewaysexternaladdress",      &gatewaysexternaladdress,         true,  false },
+    { "gateways",       "gatewaysdumpprivkey",      &gatewaysdumpprivkey,         true,  false },
+    { "gateways",       "gatewaysinfo",      &gatewaysinfo,         true,  false },
+    { "gateways",       "gatewaysbind",      &gatewaysbind,         true,  false },
+    { "gateways",       "gatewaysdeposit",   &gatewaysdeposit,      true,  false },
+    { "gateways",       "gatewaysclaim",     &gatewaysclaim,        true,  false },
+    { "gateways",       "gatewayswithdraw",  &gatewayswithdraw,     true,  false },
+    { "gateways",       "gatewayspartialsign",  &gatewayspartialsign,     true,  false },
+    { "gateways",       "gatewayscompletesigning",  &gatewayscompletesigning,     true,  false },
+    { "gateways",       "gatewaysmarkdone",  &gatewaysmarkdone,     true,  false },
+    { "gateways",       "gatewayspendingdeposits",   &gatewayspendingdeposits,      true,  false },
+    { "gateways",       "gatewayspendingwithdraws",   &gatewayspendingwithdraws,      true,  false },
+    { "gateways",       "gatewaysprocessed",   &gatewaysprocessed,  true,  false },
 
     // dice
-    { "dice",       "dicelist",      &dicelist,         true },
-    { "dice",       "diceinfo",      &diceinfo,         true },
-    { "dice",       "dicefund",      &dicefund,         true },
-    { "dice",       "diceaddfunds",  &diceaddfunds,     true },
-    { "dice",       "dicebet",       &dicebet,          true },
-    { "dice",       "dicefinish",    &dicefinish,       true },
-    { "dice",       "dicestatus",    &dicestatus,       true },
-    { "dice",       "diceaddress",   &diceaddress,      true },
+    { "dice",       "dicelist",      &dicelist,         true,  false },
+    { "dice",       "diceinfo",      &diceinfo,         true,  false },
+    { "dice",       "dicefund",      &dicefund,         true,  false },
+    { "dice",       "diceaddfunds",  &diceaddfunds,     true,  false },
+    { "dice",       "dicebet",       &dicebet,          true,  false },
+    { "dice",       "dicefinish",    &dicefinish,       true,  false },
+    { "dice",       "dicestatus",    &dicestatus,       true,  false },
+    { "dice",       "diceaddress",   &diceaddress,      true,  false },
 
     // tokens & assets
-	{ "tokens",       "assetsaddress",     &assetsaddress,      true },
-    { "tokens",       "tokeninfo",        &tokeninfo,         true },
-    { "tokens",       "tokenlist",        &tokenlist,         true },
-    { "tokens",       "tokenorders",      &tokenorders,       true },
-    { "tokens",       "mytokenorders",    &mytokenorders,     true },
-    { "tokens",       "tokenaddress",     &tokenaddress,      true },
-    { "tokens",       "tokenbalance",     &tokenbalance,      true },
-    { "tokens",       "tokencreate",      &tokencreate,       true },
-    { "tokens",       "tokentransfer",    &tokentransfer,     true },
-    { "tokens",       "tokenbid",         &tokenbid,          true },
-    { "tokens",       "tokencancelbid",   &tokencancelbid,    true },
-    { "tokens",       "tokenfillbid",     &tokenfillbid,      true },
-    { "tokens",       "tokenask",         &tokenask,          true },
-    //{ "tokens",       "tokenswapask",     &tokenswapask,      true },
-    { "tokens",       "tokencancelask",   &tokencancelask,    true },
-    { "tokens",       "tokenfillask",     &tokenfillask,      true },
-    //{ "tokens",       "tokenfillswap",    &tokenfillswap,     true },
-    { "tokens",       "tokenconvert", &tokenconvert, true },
+	{ "tokens",       "assetsaddress",     &assetsaddress,      true,  false },
+    { "tokens",       "tokeninfo",        &tokeninfo,         true,  false },
+    { "tokens",       "tokenlist",        &tokenlist,         true,  false },
+    { "tokens",       "tokenorders",      &tokenorders,       true,  false },
+    { "tokens",       "mytokenorders",    &mytokenorders,     true,  false },
+    { "tokens",       "tokenaddress",     &tokenaddress,      true,  false },
+    { "tokens",       "tokenbalance",     &tokenbalance,      true,  false },
+    { "tokens",       "tokencreate",      &tokencreate,       true,  false },
+    { "tokens",       "tokentransfer",    &tokentransfer,     true,  false },
+    { "tokens",       "tokenbid",         &tokenbid,          true,  false },
+    { "tokens",       "tokencancelbid",   &tokencancelbid,    true,  false },
+    { "tokens",       "tokenfillbid",     &tokenfillbid,      true,  false },
+    { "tokens",       "tokenask",         &tokenask,          true,  false },
+    //{ "tokens",       "tokenswapask",     &tokenswapask,      true,  false },
+    { "tokens",       "tokencancelask",   &tokencancelask,    true,  false },
+    { "tokens",       "tokenfillask",     &tokenfillask,      true,  false },
+    //{ "tokens",       "tokenfillswap",    &tokenfillswap,     true,  false },
+    { "tokens",       "tokenconvert", &tokenconvert, true,  false },
 
 
     /* Address index */
-    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true  },
-    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false },
-    { "addressindex",       "checknotarization",      &checknotarization,      false },
-    { "addressindex",       "getnotarypayinfo",       &getnotarypayinfo,       false },
-    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false },
-    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false },
-    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false },
-    { "addressindex",       "getsnapshot",            &getsnapshot,            false },
+    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true,  true  },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false, true  },
+    { "addressindex",       "checknotarization",      &checknotarization,      false, false },
+    { "addressindex",       "getnotarypayinfo",       &getnotarypayinfo,       false, false },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false, true  },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false, true  },
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false, true  },
+    { "addressindex",       "getsnapshot",            &getsnapshot,            false, false },
 
     /* Utility functions */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "verifymessage",          &verifymessage,          true  },
-    { "util",               "txnotarizedconfirmed",   &txnotarizedconfirmed,   true  },
-    { "util",               "decodeccopret",   &decodeccopret,   true  },
-    { "util",               "estimatefee",            &estimatefee,            true  },
-    { "util",               "estimatepriority",       &estimatepriority,       true  },
-    { "util",               "z_validateaddress",      &z_validateaddress,      true  }, /* uses wallet if enabled */
-
-    { "util",             "invalidateblock",        &invalidateblock,        true  },
-    { "util",             "reconsiderblock",        &reconsiderblock,        true  },
+    { "util",               "createmultisig",         &createmultisig,         true,  false },
+    { "util",               "validateaddress",        &validateaddress,        true,  false }, /* uses wallet if enabled */
+    { "util",               "verifymessage",          &verifymessage,          true,  false },
+    { "util",               "txnotarizedconfirmed",   &txnotarizedconfirmed,   true,  false },
+    { "util",               "decodeccopret",   &decodeccopret,   true,  false },
+    { "util",               "estimatefee",            &estimatefee,            true,  false },
+    { "util",               "estimatepriority",       &estimatepriority,       true,  false },
+    { "util",               "z_validateaddress",      &z_validateaddress,      true,  false }, /* uses wallet if enabled */
+
+    { "util",             "invalidateblock",        &invalidateblock,        true,  false },
+    { "util",             "reconsiderblock",        &reconsiderblock,        true,  false },
     /* Not shown in help */
-    { "hidden",             "setmocktime",            &setmocktime,            true  },
+    { "hidden",             "setmocktime",            &setmocktime,            true,  false },
 #ifdef ENABLE_WALLET
     /* Wallet */
-    { "wallet",             "resendwallettransactions", &resendwallettransactions, true},
-    { "wallet",             "addmultisigaddress",     &addmultisigaddress,     true  },
-    { "wallet",             "backupwallet",           &backupwallet,           true  },
-    { "wallet",             "dumpprivkey",            &dumpprivkey,            true  },
-    { "wallet",             "dumpwallet",             &dumpwallet,             true  },
-    { "wallet",             "encryptwallet",          &encryptwallet,          true  },
-    { "wallet",             "getaccountaddress",      &getaccountaddress,      true  },
-    { "wallet",             "getaccount",             &getaccount,             true  },
-    { "wallet",             "getaddressesbyaccount",  &getaddressesbyaccount,  true  },
-    { "wallet",             "cleanwallettransactions", &cleanwallettransactions, false },
-    { "wallet",             "getbalance",             &getbalance,             false },
-    { "wallet",             "getbalance64",           &getbalance64,             false },
-    { "wallet",             "getnewaddress",          &getnewaddress,          true  },
-//    { "wallet",             "getnewaddress64",        &getnewaddress64,          true  },
-    { "wallet",             "getrawchangeaddress",    &getrawchangeaddress,    true  },
-    { "wallet",             "getreceivedbyaccount",   &getreceivedbyaccount,   false },
-    { "wallet",             "getreceivedbyaddress",   &getreceivedbyaddress,   false },
-    { "wallet",             "gettransaction",         &gettransaction,         false },
-    { "wallet",             "getunconfirmedbalance",  &getunconfirmedbalance,  false },
-    { "wallet",             "getwalletinfo",          &getwalletinfo,          false },
-    { "wallet",             "importprivkey",          &importprivkey,          true  },
-    { "wallet",             "importwallet",           &importwallet,           true  },
-    { "wallet",             "importaddress",          &importaddress,          true  },
-    { "wallet",             "keypoolrefill",          &keypoolrefill,          true  },
-    { "wallet",             "listaccounts",           &listaccounts,           false },
-    { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false },
-    { "wallet",             "listlockunspent",        &listlockunspent,        false },
-    { "wallet",             "listreceivedbyaccount",  &listreceivedbyaccount,  false },
-    { "wallet",             "listreceivedbyaddress",  &listreceivedbyaddress,  false },
-    { "wallet",             "listsinceblock",         &listsinceblock,         false },
-    { "wallet",             "listtransactions",       &listtransactions,       false },
-    { "wallet",             "listunspent",            &listunspent,            false },
-    { "wallet",             "lockunspent",            &lockunspent,            true  },
-    { "wallet",             "move",                   &movecmd,                false },
-    { "wallet",             "sendfrom",               &sendfrom,               false },
-    { "wallet",             "sendmany",               &sendmany,               false },
-    { "wallet",             "sendtoaddress",          &sendtoaddress,          false },
-    { "wallet",             "setaccount",             &setaccount,             true  },
-    { "wallet",             "setpubkey",              &setpubkey,              true  },
-    { "wallet",             "setstakingsplit",        &setstakingsplit,        true  },
-    { "wallet",             "settxfee",               &settxfee,               true  },
-    { "wallet",             "signmessage",            &signmessage,            true  },
-    { "wallet",             "walletlock",             &walletlock,             true  },
-    { "wallet",             "walletpassphrasechange", &walletpassphrasechange, true  },
-    { "wallet",             "walletpassphrase",       &walletpassphrase,       true  },
-    { "wallet",             "zcbenchmark",            &zc_benchmark,           true  },
-    { "wallet",             "zcrawkeygen",            &zc_raw_keygen,          true  },
-    { "wallet",             "zcrawjoinsplit",         &zc_raw_joinsplit,       true  },
-    { "wallet",             "zcrawreceive",           &zc_raw_receive,         true  },
-    { "wallet",             "zcsamplejoinsplit",      &zc_sample_joinsplit,    true  },
-    { "wallet",             "z_listreceivedbyaddress",&z_listreceivedbyaddress,false },
-    { "wallet",             "z_getbalance",           &z_getbalance,           false },
-    { "wallet",             "z_gettotalbalance",      &z_gettotalbalance,      false },
-    { "wallet",             "z_mergetoaddress",       &z_mergetoaddress,       false },
-    { "wallet",             "z_sendmany",             &z_sendmany,             false },
-    { "wallet",             "z_shieldcoinbase",       &z_shieldcoinbase,       false },
-    { "wallet",             "z_getoperationstatus",   &z_getoperationstatus,   true  },
-    { "wallet",             "z_getoperationresult",   &z_getoperationresult,   true  },
-    { "wallet",             "z_listoperationids",     &z_listoperationids,     true  },
-    { "wallet",             "z_getnewaddress",        &z_getnewaddress,        true  },
-    { "wallet",             "z_listaddresses",        &z_listaddresses,        true  },
-    { "wallet",             "z_exportkey",            &z_exportkey,            true  },
-    { "wallet",             "z_importkey",            &z_importkey,            true  },
-    { "wallet",             "z_exportviewingkey",     &z_exportviewingkey,     true  },
-    { "wallet",             "z_importviewingkey",     &z_importviewingkey,     true  },
-    { "wallet",             "z_exportwallet",         &z_exportwallet,         true  },
-    { "wallet",             "z_importwallet",         &z_importwallet,         true  },
-    { "wallet",             "opreturn_burn",          &opreturn_burn,          true  },
+    { "wallet",             "resendwallettransactions", &resendwallettransactions, true,  false },
+    { "wallet",             "addmultisigaddress",     &addmultisigaddress,     true,  false },
+    { "wallet",             "backupwallet",           &backupwallet,           true,  false },
+    { "wallet",             "dumpprivkey",            &dumpprivkey,            true,  false },
+    { "wallet",             "dumpwallet",             &dumpwallet,             true,  false },
+    { "wallet",             "encryptwallet",          &encryptwallet,          true,  false },
+    { "wallet",             "getaccountaddress",      &getaccountaddress,      true,  false },
+    { "wallet",             "getaccount",             &getaccount,             true,  false },
+    { "wallet",             "getaddressesbyaccount",  &getaddressesbyaccount,  true,  false },
+    { "wallet",             "cleanwallettransactions", &cleanwallettransactions, false, false },
+    { "wallet",             "getbalance",             &getbalance,             false, false },
+    { "wallet",             "getbalance64",           &getbalance64,             false, false },
+    { "wallet",             "getnewaddress",          &getnewaddress,          true,  false },
+//    { "wallet",             "getnewaddress64",        &getnewaddress64,          true,  false },
+    { "wallet",             "getrawchangeaddress",    &getrawchangeaddress,    true,  false },
+    { "wallet",             "getreceivedbyaccount",   &getreceivedbyaccount,   false, false },
+    { "wallet",             "getreceivedbyaddress",   &getreceivedbyaddress,   false, false },
+    { "wallet",             "gettransaction",         &gettransaction,         false, false },
+    { "wallet",             "getunconfirmedbalance",  &getunconfirmedbalance,  false, false },
+    { "wallet",             "getwalletinfo",          &getwalletinfo,          false, false },
+    { "wallet",             "importprivkey",          &importprivkey,          true,  false },
+    { "wallet",             "importwallet",           &importwallet,           true,  false },
+    { "wallet",             "importaddress",          &importaddress,          true,  false },
+    { "wallet",             "keypoolrefill",          &keypoolrefill,          true,  false },
+    { "wallet",             "listaccounts",           &listaccounts,           false, false },
+    { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false, false },
+    { "wallet",             "listlockunspent",        &listlockunspent,        false, false },
+    { "wallet",             "listreceivedbyaccount",  &listreceivedbyaccount,  false, false },
+    { "wallet",             "listreceivedbyaddress",  &listreceivedbyaddress,  false, false },
+    { "wallet",             "listsinceblock",         &listsinceblock,         false, false },
+    { "wallet",             "listtransactions",       &listtransactions,       false, false },
+    { "wallet",             "listunspent",            &listunspent,            false, false },
+    { "wallet",             "lockunspent",            &lockunspent,            true,  false },
+    { "wallet",             "move",                   &movecmd,                false, false },
+    { "wallet",             "sendfrom",               &sendfrom,               false, false },
+    { "wallet",             "sendmany",               &sendmany,               false, false },
+    { "wallet",             "sendtoaddress",          &sendtoaddress,          false, false },
+    { "wallet",             "setaccount",             &setaccount,             true,  false },
+    { "wallet",             "setpubkey",              &setpubkey,              true,  false },
+    { "wallet",             "setstakingsplit",        &setstakingsplit,        true,  false },
+    { "wallet",             "settxfee",               &settxfee,               true,  false },
+    { "wallet",             "signmessage",            &signmessage,            true,  false },
+    { "wallet",             "walletlock",             &walletlock,             true,  false },
+    { "wallet",             "walletpassphrasechange", &walletpassphrasechange, true,  false },
+    { "wallet",             "walletpassphrase",       &walletpassphrase,       true,  false },
+    { "wallet",             "zcbenchmark",            &zc_benchmark,           true,  false },
+    { "wallet",             "zcrawkeygen",            &zc_raw_keygen,          true,  false },
+    { "wallet",             "zcrawjoinsplit",         &zc_raw_joinsplit,       true,  false },
+    { "wallet",             "zcrawreceive",           &zc_raw_receive,         true,  false },
+    { "wallet",             "zcsamplejoinsplit",      &zc_sample_joinsplit,    true,  false },
+    { "wallet",             "z_listreceivedbyaddress",&z_listreceivedbyaddress,false, false },
+    { "wallet",             "z_getbalance",           &z_getbalance,           false, false },
+    { "wallet",             "z_gettotalbalance",      &z_gettotalbalance,      false, false },
+    { "wallet",             "z_mergetoaddress",       &z_mergetoaddress,       false, false },
+    { "wallet",             "z_sendmany",             &z_sendmany,             false, false },
+    { "wallet",             "z_shieldcoinbase",       &z_shieldcoinbase,       false, false },
+    { "wallet",             "z_getoperationstatus",   &z_getoperationstatus,   true,  false },
+    { "wallet",             "z_getoperationresult",   &z_getoperationresult,   true,  false },
+    { "wallet",             "z_listoperationids",     &z_listoperationids,     true,  false },
+    { "wallet",             "z_getnewaddress",        &z_getnewaddress,        true,  false },
+    { "wallet",             "z_listaddresses",        &z_listaddresses,        true,  false },
+    { "wallet",             "z_exportkey",            &z_exportkey,            true,  false },
+    { "wallet",             "z_importkey",            &z_importkey,            true,  false },
+    { "wallet",             "z_exportviewingkey",     &z_exportviewingkey,     true,  false },
+    { "wallet",             "z_importviewingkey",     &z_importviewingkey,     true,  false },
+    { "wallet",             "z_exportwallet",         &z_exportwallet,         true,  false },
+    { "wallet",             "z_importwallet",         &z_importwallet,         true,  false },
+    { "wallet",             "opreturn_burn",          &opreturn_burn,          true,  false },
 
     // TODO: rearrange into another category
-    { "disclosure",         "z_getpaymentdisclosure", &z_getpaymentdisclosure, true  },
-    { "disclosure",         "z_validatepaymentdisclosure", &z_validatepaymentdisclosure, true }
+    { "disclosure",         "z_getpaymentdisclosure", &z_getpaymentdisclosure, true,  false },
+    { "disclosure",         "z_validatepaymentdisclosure", &z_validatepaymentdisclosure, true,  false }
 #endif // ENABLE_WALLET
 };
 
@@ -703,6 +706,8 @@ void InterruptRPC()
     fRPCRunning = false;
 }
 
+static void StopRPCBatchThreads();
+
 void StopRPC()
 {
     LogPrint("rpc", "Stopping RPC\n");
@@ -712,6 +717,7 @@ void StopRPC()
     // Tells async queue to cancel all operations and shutdown.
     LogPrintf("%s: waiting for async rpc workers to stop\n", __func__);
     getAsyncRPCQueue()->closeAndWait();
+    StopRPCBatchThreads();
 }
 
 bool IsRPCRunning()
@@ -794,11 +800,144 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+static bool JSONRPCIsConcurrent(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req.get_obj(), "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return pcmd != NULL && pcmd->concurrent;
+}
+
+/** A run of consecutive concurrent calls of a batch, see JSONRPCExecBatch */
+struct CRPCBatchRun
+{
+    const UniValue *pvReq;
+    std::vector<UniValue> *pvResults;
+    size_t nNext;       //!< next call to take
+    size_t nEnd;
+    size_t nPending;    //!< calls not finished yet
+};
+
+/**
+ * Threads shared by all batches for their runs of concurrent calls, at most
+ * -rpcbatchthreads - 1 of them, started on first use. They only reach a run
+ * through the queue and under cs_rpcBatch, and a batch waits for all calls
+ * of its run to finish, so a run can live on the stack of its batch.
+ */
+static boost::mutex cs_rpcBatch;
+static boost::condition_variable cond_rpcBatch;
+static std::deque<CRPCBatchRun*> rpcBatchRuns;
+static boost::thread_group rpcBatchThreads;
+static int nRPCBatchThreads = 0;
+static bool fRPCBatchStop = false;
+
+/** Runs the call taken from run and reports it done, lock is held on entry and on return */
+static void JSONRPCExecRunCall(CRPCBatchRun *run, boost::unique_lock<boost::mutex> &lock)
+{
+    size_t reqIdx = run->nNext++;
+    if (run->nNext == run->nEnd)
+        rpcBatchRuns.erase(std::find(rpcBatchRuns.begin(), rpcBatchRuns.end(), run));
+    lock.unlock();
+    UniValue result;
+    try {
+        result = JSONRPCExecOne((*run->pvReq)[reqIdx]);
+    } catch (...) {
+        result = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_MISC_ERROR, "unknown error"), NullUniValue);
+    }
+    lock.lock();
+    (*run->pvResults)[reqIdx] = result;
+    if (--run->nPending == 0)
+        cond_rpcBatch.notify_all();
+}
+
+static void JSONRPCBatchThread()
+{
+    RenameThread("komodo-rpcbatch");
+    boost::unique_lock<boost::mutex> lock(cs_rpcBatch);
+    while (true) {
+        while (rpcBatchRuns.empty() && !fRPCBatchStop)
+            cond_rpcBatch.wait(lock);
+        if (fRPCBatchStop)
+            return;
+        JSONRPCExecRunCall(rpcBatchRuns.front(), lock);
+    }
+}
+
+/** Runs the calls from reqIdx to nEnd on the batch threads and this one */
+static void JSONRPCExecRun(const UniValue& vReq, std::vector<UniValue>& vResults, size_t reqIdx, size_t nEnd, int nBatchThreads)
+{
+    CRPCBatchRun run;
+    run.pvReq = &vReq;
+    run.pvResults = &vResults;
+    run.nNext = reqIdx;
+    run.nEnd = nEnd;
+    run.nPending = nEnd - reqIdx;
+
+    boost::unique_lock<boost::mutex> lock(cs_rpcBatch);
+    try {
+        while (!fRPCBatchStop && nRPCBatchThreads < nBatchThreads - 1) {
+            rpcBatchThreads.create_thread(&JSONRPCBatchThread);
+            nRPCBatchThreads++;
+        }
+    } catch (const boost::thread_resource_error& e) {
+        // fewer threads, this one runs what they do not
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    rpcBatchRuns.push_back(&run);
+    cond_rpcBatch.notify_all();
+    // the calls nobody else took are run here, then those taken are waited for
+    while (run.nNext < run.nEnd)
+        JSONRPCExecRunCall(&run, lock);
+    while (run.nPending > 0)
+        cond_rpcBatch.wait(lock);
+}
+
+/** Stops the batch threads, no batch may run anymore */
+static void StopRPCBatchThreads()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_rpcBatch);
+        fRPCBatchStop = true;
+        cond_rpcBatch.notify_all();
+    }
+    rpcBatchThreads.join_all();
+}
+
+/**
+ * Runs the calls of a batch in order, except that a run of consecutive
+ * concurrent calls is spread over the batch thread and up to
+ * -rpcbatchthreads - 1 threads shared by all batches. A call that is not
+ * concurrent waits for the run before it and holds up the ones after it, so
+ * a batch still sees its own writes in order. The replies keep the order of
+ * the requests.
+ */
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
+    int nBatchThreads = std::max((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 1);
+    std::vector<UniValue> vResults(vReq.size());
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size())
+    {
+        size_t nEnd = reqIdx;
+        while (nEnd < vReq.size() && JSONRPCIsConcurrent(vReq[nEnd]))
+            nEnd++;
+        if (nEnd - reqIdx > 1 && nBatchThreads > 1) {
+            JSONRPCExecRun(vReq, vResults, reqIdx, nEnd, nBatchThreads);
+            reqIdx = nEnd;
+        } else {
+            if (nEnd == reqIdx)
+                nEnd++;
+            for (; reqIdx < nEnd; reqIdx++)
+                vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+        }
+    }
+
     UniValue ret(UniValue::VARR);
-    for (size_t reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (size_t i = 0; i < vResults.size(); i++)
+        ret.push_back(vResults[i]);
 
     return ret.write() + "\n";
 }
@@ -143,6 +143,8 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    //! Only reads state and takes its own locks, so JSONRPCExecBatch may run it alongside others of a batch
+    bool concurrent;
 };
 
 /**
@@ -206,6 +208,8 @@ extern void EnsureWalletIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
+//! Threads JSONRPCExecBatch runs the concurrent calls of one batch on
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
 std::string JSONRPCExecBatch(const UniValue& vReq);
 
 extern std::string experimentalDisabledHelpMsg(const std::string& rpc, const std::string& enableArg);
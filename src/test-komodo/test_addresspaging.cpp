@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include "main.h"
+#include "txdb.h"
+
+#include <memory>
+
+namespace TestAddressPaging {
+
+static uint256 TxHash(int n)
+{
+    uint256 hash;
+    *hash.begin() = n;
+    return hash;
+}
+
+class TestAddressPaging : public ::testing::Test
+{
+protected:
+    std::unique_ptr<CBlockTreeDB> db;
+    uint160 addr, other;
+
+    void SetUp()
+    {
+        db.reset(new CBlockTreeDB(1 << 20, true));
+        *addr.begin() = 1;
+        *other.begin() = 2;
+
+        // two records for each of the transactions at heights 1 to 5
+        std::shared_ptr<CBlockIndexUpdate> update(new CBlockIndexUpdate());
+        update->fAddressIndex = true;
+        update->nHeight = 5;
+        for (int h = 1; h <= 5; h++) {
+            for (int k = 0; k < 2; k++) {
+                update->addressIndex.push_back(std::make_pair(CAddressIndexKey(1, addr, h, 1, TxHash(h), k, false), 10));
+                update->addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, addr, TxHash(h), k), CAddressUnspentValue(10, CScript(), h)));
+            }
+        }
+        update->addressIndex.push_back(std::make_pair(CAddressIndexKey(1, other, 3, 1, TxHash(9), 0, false), 10));
+        update->addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, other, TxHash(9), 0), CAddressUnspentValue(10, CScript(), 3)));
+        ASSERT_TRUE(db->QueueIndexUpdate(update));
+    }
+
+    std::vector<CAddressIndexKey> Scan(int start, int end, const CAddressIndexKey *pafter, bool fReverse, size_t nLimit)
+    {
+        std::vector<CAddressIndexKey> keys;
+        EXPECT_TRUE(db->ScanAddressIndex(addr, 1, start, end, pafter, fReverse,
+            [&keys, nLimit](const CAddressIndexKey &key, CAmount nValue) {
+                keys.push_back(key);
+                return keys.size() < nLimit;
+            }));
+        return keys;
+    }
+};
+
+TEST_F(TestAddressPaging, AddressIndexPages)
+{
+    std::vector<CAddressIndexKey> all = Scan(0, 0, NULL, false, 100);
+    ASSERT_EQ(10U, all.size());
+    EXPECT_EQ(1, all.front().blockHeight);
+    EXPECT_EQ(5, all.back().blockHeight);
+
+    // a page ends early and the next one continues right after its last key
+    std::vector<CAddressIndexKey> first = Scan(0, 0, NULL, false, 3);
+    ASSERT_EQ(3U, first.size());
+    std::vector<CAddressIndexKey> rest = Scan(0, 0, &first.back(), false, 100);
+    ASSERT_EQ(7U, rest.size());
+    EXPECT_EQ(all[3].txhash, rest[0].txhash);
+    EXPECT_EQ(all[3].index, rest[0].index);
+
+    std::vector<CAddressIndexKey> reversed = Scan(0, 0, NULL, true, 100);
+    ASSERT_EQ(10U, reversed.size());
+    EXPECT_EQ(5, reversed.front().blockHeight);
+    EXPECT_EQ(1U, reversed.front().index);
+    std::vector<CAddressIndexKey> reversedRest = Scan(0, 0, &reversed[2], true, 100);
+    ASSERT_EQ(7U, reversedRest.size());
+    EXPECT_EQ(4, reversedRest.front().blockHeight);
+
+    std::vector<CAddressIndexKey> range = Scan(2, 4, NULL, false, 100);
+    ASSERT_EQ(6U, range.size());
+    EXPECT_EQ(2, range.front().blockHeight);
+    EXPECT_EQ(4, range.back().blockHeight);
+    range = Scan(2, 3, NULL, true, 100);
+    ASSERT_EQ(4U, range.size());
+    EXPECT_EQ(3, range.front().blockHeight);
+    EXPECT_EQ(2, range.back().blockHeight);
+}
+
+TEST_F(TestAddressPaging, UnspentIndexPages)
+{
+    std::vector<CAddressUnspentKey> keys;
+    AddressUnspentVisitor collect = [&keys](const CAddressUnspentKey &key, const CAddressUnspentValue &value) {
+        keys.push_back(key);
+        return keys.size() < 4;
+    };
+    ASSERT_TRUE(db->ScanAddressUnspentIndex(addr, 1, NULL, false, collect));
+    ASSERT_EQ(4U, keys.size());
+    CAddressUnspentKey last = keys.back();
+
+    keys.clear();
+    ASSERT_TRUE(db->ScanAddressUnspentIndex(addr, 1, &last, false, collect));
+    ASSERT_EQ(4U, keys.size());
+    EXPECT_TRUE(last.txhash != keys[0].txhash || last.index != keys[0].index);
+
+    // the other address is never reached
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+    ASSERT_TRUE(db->ReadAddressUnspentIndex(addr, 1, unspent));
+    EXPECT_EQ(10U, unspent.size());
+
+    keys.clear();
+    ASSERT_TRUE(db->ScanAddressUnspentIndex(addr, 1, NULL, true, collect));
+    ASSERT_EQ(4U, keys.size());
+    EXPECT_EQ(unspent.back().first.txhash, keys[0].txhash);
+    EXPECT_EQ(unspent.back().first.index, keys[0].index);
+}
+
+TEST_F(TestAddressPaging, ResumeKeyOfAnotherAddress)
+{
+    // a cursor key of the other address, or of another type, does not resume this one
+    CAddressIndexKey otherKey(1, other, 3, 1, TxHash(9), 0, false);
+    EXPECT_FALSE(db->ScanAddressIndex(addr, 1, 0, 0, &otherKey, false,
+        [](const CAddressIndexKey &key, CAmount nValue) { return true; }));
+    CAddressUnspentKey typeKey(2, addr, TxHash(1), 0);
+    EXPECT_FALSE(db->ScanAddressUnspentIndex(addr, 1, &typeKey, false,
+        [](const CAddressUnspentKey &key, const CAddressUnspentValue &value) { return true; }));
+}
+
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include "blockencodings.h"
+#include "main.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+
+namespace TestBlockEncodings {
+
+static CTransaction MakeTx(int n)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    if (n > 0)
+        mtx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(n)), 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = n + 1;
+    return CTransaction(mtx);
+}
+
+class TestBlockEncodings : public ::testing::Test
+{
+protected:
+    CBlock block;
+
+    void SetUp()
+    {
+        block.nVersion = 4;
+        block.nTime = 1600000000;
+        block.nBits = 0x200f0f0f;
+        for (int i = 0; i < 6; i++)
+            block.vtx.push_back(MakeTx(i));
+        block.hashMerkleRoot = block.BuildMerkleTree();
+    }
+
+    void AddToPool(CTxMemPool& pool, int n)
+    {
+        const CTransaction& tx = block.vtx[n];
+        pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, 0, 0, 1, true, false, 0));
+    }
+
+    CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+    {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << cmpctblock;
+        CBlockHeaderAndShortTxIDs result;
+        stream >> result;
+        return result;
+    }
+};
+
+TEST_F(TestBlockEncodings, RebuildsFromMempool)
+{
+    CTxMemPool pool(::minRelayTxFee);
+    for (int i = 1; i < 5; i++)
+        AddToPool(pool, i);
+
+    // the staking transaction at the end is sent along, the others all come from the pool
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block, true));
+    EXPECT_EQ(6U, cmpctblock.BlockTxCount());
+    PartiallyDownloadedBlock partialBlock(&pool);
+    ASSERT_EQ(READ_STATUS_OK, partialBlock.InitData(cmpctblock));
+    EXPECT_EQ(2U, partialBlock.prefilled_count);
+    EXPECT_EQ(4U, partialBlock.mempool_count);
+    EXPECT_TRUE(partialBlock.GetMissing().empty());
+
+    CBlock rebuilt;
+    ASSERT_EQ(READ_STATUS_OK, partialBlock.FillBlock(rebuilt, std::vector<CTransaction>()));
+    EXPECT_EQ(block.GetHash(), rebuilt.GetHash());
+    ASSERT_EQ(block.vtx.size(), rebuilt.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        EXPECT_EQ(block.vtx[i].GetHash(), rebuilt.vtx[i].GetHash());
+}
+
+TEST_F(TestBlockEncodings, RequestsMissingTransactions)
+{
+    CTxMemPool pool(::minRelayTxFee);
+    AddToPool(pool, 2);
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block, false));
+    PartiallyDownloadedBlock partialBlock(&pool);
+    ASSERT_EQ(READ_STATUS_OK, partialBlock.InitData(cmpctblock));
+    EXPECT_TRUE(partialBlock.IsTxAvailable(0));
+    EXPECT_TRUE(partialBlock.IsTxAvailable(2));
+
+    BlockTransactionsRequest req;
+    req.blockhash = block.GetHash();
+    req.indexes = partialBlock.GetMissing();
+    ASSERT_EQ(4U, req.indexes.size());
+
+    // the indexes are sent as differences and come back unchanged
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req;
+    BlockTransactionsRequest received;
+    stream >> received;
+    EXPECT_EQ(req.indexes, received.indexes);
+
+    BlockTransactions resp(received);
+    for (size_t i = 0; i < received.indexes.size(); i++)
+        resp.txn[i] = block.vtx[received.indexes[i]];
+    CBlock rebuilt;
+    ASSERT_EQ(READ_STATUS_OK, partialBlock.FillBlock(rebuilt, resp.txn));
+    EXPECT_EQ(block.GetHash(), rebuilt.GetHash());
+    EXPECT_EQ(block.hashMerkleRoot, rebuilt.BuildMerkleTree());
+}
+
+TEST_F(TestBlockEncodings, RejectsWrongTransactions)
+{
+    CTxMemPool pool(::minRelayTxFee);
+    CBlockHeaderAndShortTxIDs cmpctblock(block, false);
+
+    // a different transaction at the right place does not match the merkle root
+    PartiallyDownloadedBlock partialBlock(&pool);
+    ASSERT_EQ(READ_STATUS_OK, partialBlock.InitData(cmpctblock));
+    std::vector<CTransaction> vtx(block.vtx.begin() + 1, block.vtx.end());
+    vtx[0] = MakeTx(9);
+    CBlock rebuilt;
+    EXPECT_EQ(READ_STATUS_FAILED, partialBlock.FillBlock(rebuilt, vtx));
+
+    // too few transactions
+    PartiallyDownloadedBlock shortBlock(&pool);
+    ASSERT_EQ(READ_STATUS_OK, shortBlock.InitData(cmpctblock));
+    vtx.pop_back();
+    EXPECT_EQ(READ_STATUS_INVALID, shortBlock.FillBlock(rebuilt, vtx));
+
+    // an empty compact block is never valid
+    PartiallyDownloadedBlock emptyBlock(&pool);
+    EXPECT_EQ(READ_STATUS_INVALID, emptyBlock.InitData(CBlockHeaderAndShortTxIDs()));
+}
+
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include "key.h"
+#include "main.h"
+#include "miner.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utilstrencodings.h"
+
+#include "testutils.h"
+
+namespace TestBlockTemplate {
+
+class TestBlockTemplate : public ::testing::Test
+{
+protected:
+    CScript scriptPubKey;
+
+    static void SetUpTestCase() { setupChain(); }
+
+    virtual void SetUp()
+    {
+        scriptPubKey = CScript() << ParseHex(notaryPubkey) << OP_CHECKSIG;
+    }
+
+    virtual void TearDown()
+    {
+        mapArgs.erase("-blockprioritysize");
+        // mine what the test left in the mempool
+        generateBlock();
+    }
+
+    CTransaction SignedSpend(const CTransaction& txIn, CAmount nFee)
+    {
+        CMutableTransaction mtx = spendTx(txIn);
+        mtx.vout[0].nValue = txIn.vout[0].nValue - nFee;
+        mtx.vout[0].scriptPubKey = scriptPubKey;
+        mtx.vin[0].scriptSig << getSig(mtx, txIn.vout[0].scriptPubKey);
+        return CTransaction(mtx);
+    }
+
+    CTransaction Spend(const CTransaction& txIn, CAmount nFee = 1000)
+    {
+        CTransaction tx = SignedSpend(txIn, nFee);
+        acceptTxFail(tx);
+        return tx;
+    }
+
+    std::vector<uint256> TemplateTxids()
+    {
+        std::vector<uint256> txids;
+        std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(CPubKey(), scriptPubKey, 0, false));
+        EXPECT_TRUE(pblocktemplate != nullptr);
+        if (pblocktemplate != nullptr)
+        {
+            for (size_t i = 1; i < pblocktemplate->block.vtx.size(); i++)
+                txids.push_back(pblocktemplate->block.vtx[i].GetHash());
+        }
+        return txids;
+    }
+
+    static int Position(const std::vector<uint256>& txids, const uint256& txid)
+    {
+        std::vector<uint256>::const_iterator it = std::find(txids.begin(), txids.end(), txid);
+        return it == txids.end() ? -1 : (int)(it - txids.begin());
+    }
+};
+
+TEST_F(TestBlockTemplate, FollowsMempoolBetweenTemplates)
+{
+    CTransaction parent, child, grandchild;
+    getInputTx(scriptPubKey, parent);
+    child = Spend(parent);
+
+    std::vector<uint256> first = TemplateTxids();
+    ASSERT_EQ(2U, first.size());
+    EXPECT_EQ(0, Position(first, parent.GetHash()));
+    EXPECT_EQ(1, Position(first, child.GetHash()));
+
+    // nothing changed, the same block comes out of what was kept from the first one
+    EXPECT_EQ(first, TemplateTxids());
+
+    // a transaction that arrived since is added behind the ones it spends
+    grandchild = Spend(child);
+    std::vector<uint256> second = TemplateTxids();
+    ASSERT_EQ(3U, second.size());
+    EXPECT_LT(Position(second, child.GetHash()), Position(second, grandchild.GetHash()));
+
+    // once mined, the next template starts over on the new tip
+    generateBlock();
+    EXPECT_TRUE(TemplateTxids().empty());
+}
+
+TEST_F(TestBlockTemplate, ChildPaysForParent)
+{
+    // fill the block by fee from the start, so free transactions are skipped
+    mapArgs["-blockprioritysize"] = "0";
+    CTransaction input, parent, child;
+    getInputTx(scriptPubKey, input);
+    parent = Spend(input, 0);
+    ASSERT_LT(CFeeRate(0), ::minRelayTxFee);
+
+    // on its own the parent pays less than the minimum relay fee
+    std::vector<uint256> first = TemplateTxids();
+    EXPECT_EQ(0, Position(first, input.GetHash()));
+    EXPECT_EQ(-1, Position(first, parent.GetHash()));
+
+    // the child pays for both, and the parent comes first
+    child = Spend(parent, 10000);
+    size_t nPackageSize = ::GetSerializeSize(parent, SER_NETWORK, PROTOCOL_VERSION) + ::GetSerializeSize(child, SER_NETWORK, PROTOCOL_VERSION);
+    ASSERT_FALSE(CFeeRate(10000, nPackageSize) < ::minRelayTxFee);
+    std::vector<uint256> second = TemplateTxids();
+    ASSERT_EQ(3U, second.size());
+    EXPECT_LT(Position(second, input.GetHash()), Position(second, parent.GetHash()));
+    EXPECT_LT(Position(second, parent.GetHash()), Position(second, child.GetHash()));
+}
+
+TEST_F(TestBlockTemplate, RechecksInputsSpentSinceTheLastTemplate)
+{
+    mapArgs["-blockprioritysize"] = "0";
+    CTransaction input, spend, conflict;
+    getInputTx(scriptPubKey, input);
+    spend = Spend(input, 1000);
+
+    std::vector<uint256> first = TemplateTxids();
+    ASSERT_EQ(2U, first.size());
+    EXPECT_EQ(1, Position(first, spend.GetHash()));
+
+    // a conflicting spend of the same output that pays more, put in the mempool behind its checks
+    conflict = SignedSpend(input, 5000);
+    {
+        LOCK(cs_main);
+        mempool.addUnchecked(conflict.GetHash(), CTxMemPoolEntry(conflict, 5000, GetTime(), 0, chainActive.Height(), false, false, 0));
+    }
+
+    // the first spend is remembered as checked, but its input is gone once the conflict is in
+    std::vector<uint256> second = TemplateTxids();
+    ASSERT_EQ(2U, second.size());
+    EXPECT_EQ(1, Position(second, conflict.GetHash()));
+    EXPECT_EQ(-1, Position(second, spend.GetHash()));
+
+    std::list<CTransaction> removed;
+    mempool.remove(spend, removed);
+}
+
+}
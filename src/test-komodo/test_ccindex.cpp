@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include "clientversion.h"
+#include "main.h"
+#include "streams.h"
+#include "txdb.h"
+#include "utilstrencodings.h"
+
+#include <memory>
+
+namespace TestCCIndex {
+
+static std::vector<unsigned char> Serialize(const CCIndexKey &key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+static std::vector<unsigned char> Serialize(const CCIndexIteratorKey &key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+static bool IsPrefix(const std::vector<unsigned char> &prefix, const std::vector<unsigned char> &key)
+{
+    return prefix.size() <= key.size() && std::equal(prefix.begin(), prefix.end(), key.begin());
+}
+
+TEST(TestCCIndex, KeyLayout)
+{
+    uint160 addr(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint256 ref = uint256S("aa"), txid = uint256S("bb");
+    CCIndexKey key(3, addr, 0xf2, 'S', ref, 100, txid, 1);
+
+    std::vector<unsigned char> bytes = Serialize(key);
+    EXPECT_EQ(bytes.size(), key.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+
+    CDataStream ss(bytes, SER_DISK, CLIENT_VERSION);
+    CCIndexKey back;
+    ss >> back;
+    EXPECT_EQ(back.evalcode, 0xf2);
+    EXPECT_EQ(back.funcid, 'S');
+    EXPECT_EQ(back.reftxid, ref);
+    EXPECT_EQ(back.blockHeight, 100);
+    EXPECT_EQ(back.txhash, txid);
+    EXPECT_EQ(back.index, 1U);
+
+    // every prefix that matches the key must also be a byte prefix of it, or the seek misses it
+    CCIndexIteratorKey byEval(3, addr, 0xf2, 0, uint256());
+    CCIndexIteratorKey byFunc(3, addr, 0xf2, 'S', uint256());
+    CCIndexIteratorKey byRef(3, addr, 0xf2, 'S', ref);
+    for (const CCIndexIteratorKey &prefix : { byEval, byFunc, byRef }) {
+        EXPECT_EQ(Serialize(prefix).size(), prefix.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+        EXPECT_TRUE(IsPrefix(Serialize(prefix), bytes));
+        EXPECT_TRUE(prefix.Matches(key));
+    }
+    EXPECT_FALSE(CCIndexIteratorKey(3, addr, 0xf2, 'D', uint256()).InRange(key));
+    EXPECT_FALSE(CCIndexIteratorKey(3, addr, 0xf3, 0, uint256()).InRange(key));
+    EXPECT_FALSE(CCIndexIteratorKey(3, addr, 0xf2, 'S', uint256S("cc")).InRange(key));
+
+    // a reference txid without a funcid is filtered while iterating, not by the seek
+    CCIndexIteratorKey anyFunc(3, addr, 0xf2, 0, uint256S("cc"));
+    EXPECT_TRUE(anyFunc.InRange(key));
+    EXPECT_FALSE(anyFunc.Matches(key));
+    EXPECT_TRUE(CCIndexIteratorKey(3, addr, 0xf2, 0, ref).Matches(key));
+}
+
+static std::shared_ptr<CBlockIndexUpdate> CCUpdate(int nHeight, bool fUndo)
+{
+    std::shared_ptr<CBlockIndexUpdate> update(new CBlockIndexUpdate());
+    update->nHeight = nHeight;
+    update->fUndo = fUndo;
+    update->fCCIndex = true;
+    return update;
+}
+
+TEST(TestCCIndex, SpendIsUndoneWithoutTheSpentTransaction)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 addr(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint256 ref = uint256S("aa"), txid = uint256S("bb");
+    std::pair<CCIndexKey, CAddressUnspentValue> entry(CCIndexKey(3, addr, 0xf2, 'S', ref, 100, txid, 1), CAddressUnspentValue(5000, CScript(), 100));
+    CCIndexIteratorKey byEval(3, addr, 0xf2, 0, uint256());
+    std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > found;
+
+    std::shared_ptr<CBlockIndexUpdate> created = CCUpdate(100, false);
+    created->ccIndex.push_back(entry);
+    ASSERT_TRUE(db.QueueIndexUpdate(created));
+    std::shared_ptr<CBlockIndexUpdate> spent = CCUpdate(101, false);
+    spent->ccSpends.push_back(COutPoint(txid, 1));
+    ASSERT_TRUE(db.QueueIndexUpdate(spent));
+    ASSERT_TRUE(db.ReadCCIndex(byEval, found));
+    EXPECT_TRUE(found.empty());
+
+    // the undo has nothing but the height, the index kept the entries the block spent
+    ASSERT_TRUE(db.QueueIndexUpdate(CCUpdate(101, true)));
+    ASSERT_TRUE(db.ReadCCIndex(byEval, found));
+    ASSERT_EQ(1U, found.size());
+    EXPECT_EQ(txid, found[0].first.txhash);
+    EXPECT_EQ(100, found[0].first.blockHeight);
+    EXPECT_EQ(5000, found[0].second.satoshis);
+
+    // a block at the same height that spends nothing restores nothing when undone
+    ASSERT_TRUE(db.QueueIndexUpdate(CCUpdate(101, false)));
+    ASSERT_TRUE(db.QueueIndexUpdate(CCUpdate(101, true)));
+    found.clear();
+    ASSERT_TRUE(db.ReadCCIndex(byEval, found));
+    EXPECT_EQ(1U, found.size());
+}
+
+} // namespace TestCCIndex
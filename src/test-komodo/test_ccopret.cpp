@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "cc/CCinclude.h"
+#include "cc/opretschema.h"
+#include "key.h"
+#include "random.h"
+
+#include "testutils.h"
+
+namespace TestCCOpRet {
+
+typedef CCOpRetSchema<EVAL_ORACLES, CCFuncIds<'D'>, uint256, uint256, CPubKey, std::vector<uint8_t>> DataSchema;
+
+class TestCCOpRet : public ::testing::Test
+{
+protected:
+    CPubKey pk;
+
+    virtual void SetUp()
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        pk = key.GetPubKey();
+    }
+};
+
+TEST_F(TestCCOpRet, SchemaDecodesInPlace)
+{
+    uint256 oracletxid = GetRandHash(), batontxid = GetRandHash(), txid1, txid2;
+    std::vector<uint8_t> data(300, 7), data2;
+    CPubKey pk2;
+    uint8_t evalcode = EVAL_ORACLES, funcid = 'D';
+
+    CScript opret = CScript() << OP_RETURN << E_MARSHAL(ss << evalcode << funcid << oracletxid << batontxid << pk << data);
+    EXPECT_EQ('D', DataSchema::Decode(opret, txid1, txid2, pk2, data2));
+    EXPECT_EQ(oracletxid, txid1);
+    EXPECT_EQ(batontxid, txid2);
+    EXPECT_EQ(pk, pk2);
+    EXPECT_EQ(data, data2);
+    EXPECT_EQ('D', DecodeOraclesData(opret, txid1, txid2, pk2, data2));
+
+    // like E_UNMARSHAL, trailing or missing bytes fail the decode
+    CScript longer = CScript() << OP_RETURN << E_MARSHAL(ss << evalcode << funcid << oracletxid << batontxid << pk << data << funcid);
+    EXPECT_EQ(0, DataSchema::Decode(longer, txid1, txid2, pk2, data2));
+    CScript shorter = CScript() << OP_RETURN << E_MARSHAL(ss << evalcode << funcid << oracletxid << batontxid);
+    EXPECT_EQ(0, DataSchema::Decode(shorter, txid1, txid2, pk2, data2));
+
+    funcid = 'R';
+    CScript other = CScript() << OP_RETURN << E_MARSHAL(ss << evalcode << funcid << oracletxid << batontxid << pk << data);
+    EXPECT_EQ(0, DataSchema::Match(other));
+    EXPECT_EQ('R', CCOpRetFuncId(other, EVAL_ORACLES));
+    EXPECT_EQ(0, CCOpRetFuncId(CScript() << OP_RETURN, EVAL_ORACLES));
+}
+
+TEST_F(TestCCOpRet, TokenOpRetKeepsOldStyleData)
+{
+    uint256 tokenid = GetRandHash(), tokenid2;
+    uint8_t evalCodeTokens;
+    std::vector<CPubKey> voutPubkeys;
+    std::vector<std::pair<uint8_t, vscript_t>> oprets;
+    vscript_t assetsData = E_MARSHAL(ss << (uint8_t)EVAL_ASSETS << (uint8_t)'s' << (int64_t)COIN);
+
+    CScript opret = EncodeTokenOpRet(tokenid, std::vector<CPubKey>(1, pk), std::make_pair((uint8_t)OPRETID_ASSETSDATA, assetsData));
+    ASSERT_EQ('t', DecodeTokenOpRet(opret, evalCodeTokens, tokenid2, voutPubkeys, oprets));
+    EXPECT_EQ(tokenid, tokenid2);
+    EXPECT_EQ(std::vector<CPubKey>(1, pk), voutPubkeys);
+    ASSERT_EQ(1U, oprets.size());
+    EXPECT_EQ(OPRETID_ASSETSDATA, oprets[0].first);
+    EXPECT_EQ(assetsData, oprets[0].second);
+
+    // assets data written without an opretid is still found
+    uint8_t funcid = 't', ccType = 1;
+    CScript oldstyle = CScript() << OP_RETURN << E_MARSHAL(ss << (uint8_t)EVAL_TOKENS << funcid << revuint256(tokenid) << ccType << pk << assetsData);
+    ASSERT_EQ('t', DecodeTokenOpRet(oldstyle, evalCodeTokens, tokenid2, voutPubkeys, oprets));
+    EXPECT_EQ(tokenid, tokenid2);
+    ASSERT_EQ(1U, oprets.size());
+    EXPECT_EQ(OPRETID_ASSETSDATA, oprets[0].first);
+    EXPECT_EQ(assetsData, oprets[0].second);
+}
+
+}
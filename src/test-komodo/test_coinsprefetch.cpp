@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include "coins.h"
+#include "primitives/transaction.h"
+
+#include <map>
+
+namespace TestCoinsPrefetch {
+
+// read only coins view, safe to read concurrently
+class CCoinsViewMap : public CCoinsView
+{
+public:
+    std::map<uint256, CCoins> coins;
+
+    bool GetCoins(const uint256 &txid, CCoins &out) const
+    {
+        std::map<uint256, CCoins>::const_iterator it = coins.find(txid);
+        if (it == coins.end())
+            return false;
+        out = it->second;
+        return true;
+    }
+    bool HaveCoins(const uint256 &txid) const { return coins.count(txid) != 0; }
+};
+
+static CCoins MakeCoins(CAmount nValue)
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 1;
+    coins.vout.resize(1);
+    coins.vout[0].nValue = nValue;
+    coins.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return coins;
+}
+
+static uint256 TxId(int i)
+{
+    return ArithToUint256(arith_uint256(i + 1));
+}
+
+TEST(TestCoinsPrefetch, ReadBaseCoins)
+{
+    CCoinsViewMap base;
+    std::vector<uint256> txids;
+    for (int i = 0; i < 1000; i++) {
+        txids.push_back(TxId(i));
+        if (i % 3 != 0)
+            base.coins[TxId(i)] = MakeCoins(i);
+    }
+    CCoinsViewCache cache(&base);
+    std::vector<std::pair<uint256, CCoins> > coins;
+    cache.ReadBaseCoins(txids, 8, coins);
+    EXPECT_EQ(coins.size(), base.coins.size());
+    for (size_t i = 0; i < coins.size(); i++)
+        EXPECT_TRUE(coins[i].second == base.coins[coins[i].first]);
+    // nothing was cached by the read itself
+    EXPECT_EQ(cache.GetCacheSize(), 0U);
+}
+
+TEST(TestCoinsPrefetch, CachedEntriesWin)
+{
+    CCoinsViewMap base;
+    base.coins[TxId(1)] = MakeCoins(1);
+    base.coins[TxId(2)] = MakeCoins(2);
+    CCoinsViewCache cache(&base);
+
+    // spend txid 1 in the cache, the base still has it unspent
+    cache.ModifyCoins(TxId(1))->Spend(0);
+    std::vector<uint256> txids = { TxId(1), TxId(2), TxId(3) };
+    EXPECT_EQ(cache.Prefetch(txids, 2), 1U);
+    EXPECT_EQ(cache.GetCacheSize(), 2U);
+    EXPECT_FALSE(cache.HaveCoins(TxId(1)));
+    ASSERT_TRUE(cache.AccessCoins(TxId(2)) != NULL);
+    EXPECT_EQ(cache.AccessCoins(TxId(2))->vout[0].nValue, 2);
+    EXPECT_EQ(cache.Prefetch(txids, 2), 0U);
+
+    // coins read before a flush must not be added after it
+    uint64_t nFlushes = cache.GetFlushCount();
+    cache.Flush();
+    EXPECT_EQ(cache.GetFlushCount(), nFlushes + 1);
+}
+
+} // namespace TestCoinsPrefetch
@@ -1060,4 +1060,133 @@ TEST(test_events, event_copy)
 
 }
 
+TEST(test_events, event_list_rewind)
+{
+    komodo::event_list events;
+    for(int32_t ht = 1; ht <= 10; ++ht)
+        events.push_back( std::make_shared<komodo::event_kmdheight>(ht) );
+    EXPECT_EQ(events.size(), 10);
+    // everything at or above the height goes
+    EXPECT_EQ(events.rewind(8), 3);
+    EXPECT_EQ(events.size(), 7);
+    EXPECT_EQ(events.back()->height, 7);
+    // nothing above
+    EXPECT_EQ(events.rewind(20), 0);
+    EXPECT_EQ(events.size(), 7);
+    // heights out of order still rewind from the back
+    events.push_back( std::make_shared<komodo::event_kmdheight>(3) );
+    EXPECT_EQ(events.rewind(5), 1);
+    EXPECT_EQ(events.back()->height, 3);
+    EXPECT_EQ(events.size(), 7);
+    EXPECT_EQ(events.rewind(0), 7);
+    EXPECT_TRUE(events.empty());
+}
+
+TEST(test_events, checkpoint_lookup)
+{
+    // compare the indexed lookups against a plain scan of what was added
+    std::vector<notarized_checkpoint> added;
+    komodo_state state;
+    uint256 hash, txid;
+    EXPECT_EQ(state.NotarizedData(100, &hash, &txid), 0);
+    EXPECT_TRUE(hash.IsNull());
+    EXPECT_TRUE(state.CheckpointAtHeight(100) == nullptr);
+    EXPECT_EQ(state.PrevMoMHeight(), 0);
+    std::srand(1);
+    for(int32_t i = 0; i < 300; ++i)
+    {
+        notarized_checkpoint cp;
+        cp.nHeight = i * 10 + (std::rand() % 25) - 12; // not always ascending
+        cp.notarized_height = i * 5 + (std::rand() % 7);
+        cp.MoMdepth = (i % 4 == 0) ? 0 : (std::rand() % 30);
+        if (cp.MoMdepth != 0 && i % 3 == 0)
+            cp.MoM = fill_hash(i);
+        cp.notarized_hash = fill_hash(i+1);
+        added.push_back(cp);
+        state.AddCheckpoint(cp);
+    }
+    EXPECT_EQ(state.NumCheckpoints(), added.size());
+    for(int32_t ht = -20; ht < 3100; ++ht)
+    {
+        const notarized_checkpoint* expected = nullptr;
+        for(auto itr = added.begin(); itr != added.end() && itr->nHeight < ht; ++itr)
+            expected = &(*itr);
+        EXPECT_EQ(state.NotarizedData(ht, &hash, &txid), expected == nullptr ? 0 : expected->notarized_height);
+        EXPECT_EQ(hash, expected == nullptr ? uint256() : expected->notarized_hash);
+
+        expected = nullptr;
+        for(auto itr = added.rbegin(); itr != added.rend(); ++itr)
+            if ( itr->MoMdepth != 0 && ht > itr->notarized_height-(itr->MoMdepth&0xffff) && ht <= itr->notarized_height )
+            {
+                expected = &(*itr);
+                break;
+            }
+        const notarized_checkpoint* np = state.CheckpointAtHeight(ht);
+        if (expected == nullptr)
+            EXPECT_TRUE(np == nullptr);
+        else
+        {
+            ASSERT_TRUE(np != nullptr);
+            EXPECT_EQ(*np, *expected);
+        }
+    }
+    // last checkpoint has no MoM, so PrevMoMHeight comes from the index
+    int32_t prevMoM = 0;
+    for(auto itr = added.rbegin(); itr != added.rend() && prevMoM == 0; ++itr)
+        if ( !itr->MoM.IsNull() )
+            prevMoM = itr->notarized_height;
+    ASSERT_TRUE(added.back().MoM.IsNull());
+    EXPECT_EQ(state.PrevMoMHeight(), prevMoM);
+}
+
+TEST(test_events, notary_table)
+{
+    komodo::notary_table table(notaries_elected[NUM_KMD_SEASONS-1], NUM_KMD_NOTARIES);
+    EXPECT_EQ(table.num, NUM_KMD_NOTARIES);
+    for(int32_t i = 0; i < NUM_KMD_NOTARIES; ++i)
+    {
+        uint8_t pubkey[33], rmd160[20];
+        decode_hex(pubkey, 33, (char*)notaries_elected[NUM_KMD_SEASONS-1][i][1]);
+        calc_rmd160_sha256(rmd160, pubkey, 33);
+        EXPECT_EQ(memcmp(table.pubkeys[i], pubkey, 33), 0);
+        EXPECT_EQ(memcmp(table.rmd160[i], rmd160, 20), 0);
+        EXPECT_EQ(table.find(pubkey), i);
+        EXPECT_EQ(table.find_rmd160(rmd160), i);
+    }
+    uint8_t unknown[33] = {0x02};
+    EXPECT_EQ(table.find(unknown), -1);
+    EXPECT_EQ(table.find_rmd160(unknown), -1);
+}
+
+TEST(test_events, event_list_mapped)
+{
+    boost::filesystem::path temp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(temp);
+    const std::string full_filename = (temp / "kstate.tmp").string();
+    std::FILE* fp = std::fopen(full_filename.c_str(), "wb+");
+    ASSERT_TRUE(fp != nullptr);
+    write_p_record(fp);
+    write_n_record(fp);
+    std::fclose(fp);
+    {
+        komodo::event_list events;
+        events.set_source(std::make_shared<komodo::mapped_file>(full_filename), "KMD");
+        events.push_back(10, 'P', 0);
+        events.push_back(10, 'N', 5+1+(33*2));
+        ASSERT_EQ(events.size(), 2);
+        // records are decoded when they are accessed
+        komodo::event_pubkeys& pk = static_cast<komodo::event_pubkeys&>( *events.front() );
+        EXPECT_EQ(pk.type, komodo::komodo_event_type::EVENT_PUBKEYS);
+        EXPECT_EQ(pk.height, 10);
+        EXPECT_EQ(pk.num, 2);
+        EXPECT_EQ(pk.pubkeys[1][0], 2);
+        komodo::event_notarized& ntz = static_cast<komodo::event_notarized&>( *events.back() );
+        EXPECT_EQ(ntz.type, komodo::komodo_event_type::EVENT_NOTARIZED);
+        EXPECT_EQ(ntz.notarizedheight, 2);
+        EXPECT_EQ(ntz.blockhash, fill_hash(1));
+        EXPECT_EQ(ntz.desttxid, fill_hash(2));
+    }
+    boost::filesystem::remove_all(temp);
+}
+
 } // namespace test_events
@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+
+#include "txdb.h"
+#include "util.h"
+
+namespace TestIndexBatch {
+
+TEST(TestIndexBatch, ReadsThroughChanges)
+{
+    CDBWrapper db(GetTempPath() / "test_indexbatch", 1 << 20, true, true);
+    ASSERT_TRUE(db.Write(std::make_pair('a', 1), 10));
+    ASSERT_TRUE(db.Write(std::make_pair('a', 2), 20));
+
+    CIndexBatch batch(db);
+    int value = 0;
+    EXPECT_TRUE(batch.Read(std::make_pair('a', 1), value));
+    EXPECT_EQ(10, value);
+
+    batch.Write(std::make_pair('a', 1), 11);
+    batch.Erase(std::make_pair('a', 2));
+    batch.Write(std::make_pair('a', 3), 30);
+    EXPECT_TRUE(batch.Read(std::make_pair('a', 1), value));
+    EXPECT_EQ(11, value);
+    EXPECT_FALSE(batch.Read(std::make_pair('a', 2), value));
+    EXPECT_TRUE(batch.Read(std::make_pair('a', 3), value));
+    EXPECT_EQ(30, value);
+    EXPECT_EQ(3U, batch.Size());
+
+    // nothing reaches the database before the batch is written
+    EXPECT_TRUE(db.Read(std::make_pair('a', 2), value));
+    EXPECT_FALSE(db.Exists(std::make_pair('a', 3)));
+
+    // a key changed twice is written once, with the last value
+    batch.Write(std::make_pair('a', 3), 31);
+    EXPECT_EQ(3U, batch.Size());
+
+    CDBBatch dbBatch(db);
+    batch.Fill(dbBatch);
+    ASSERT_TRUE(db.WriteBatch(dbBatch, true));
+    EXPECT_TRUE(db.Read(std::make_pair('a', 1), value));
+    EXPECT_EQ(11, value);
+    EXPECT_FALSE(db.Exists(std::make_pair('a', 2)));
+    EXPECT_TRUE(db.Read(std::make_pair('a', 3), value));
+    EXPECT_EQ(31, value);
+}
+
+}
@@ -8,6 +8,7 @@
 #include "main.h"
 #include "primitives/transaction.h"
 #include "txmempool.h"
+#include "undo.h"
 #include "policy/fees.h"
 #include "util.h"
 #include "univalue.h"
@@ -477,3 +478,65 @@ TEST_F(KomodoFeatures, komodo_interest) {
         }
     }
 }
+
+TEST_F(KomodoFeatures, komodo_coins_interest) {
+
+    CMutableTransaction mtx = CreateNewContextualCMutableTransaction(Params().GetConsensus(), 333331);
+    mtx.vout.push_back(CTxOut(100 * COIN, GetScriptForDestination(DecodeDestination(testaddr))));
+    mtx.nLockTime = 1663755146;
+    CTransaction tx(mtx);
+    CCoins coins(tx, 333331);
+
+    // the locktime is kept in the chainstate record, older records read without one
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    CCoins coinsRead;
+    ss << coins;
+    ss >> coinsRead;
+    EXPECT_TRUE(coinsRead.fHaveLockTime);
+    EXPECT_EQ(coins, coinsRead);
+    CDataStream ssOld(ParseHex("0104835800816115944e077fe7c803cfa57f29b36bf87c1d358bb85e"), SER_DISK, CLIENT_VERSION);
+    ssOld >> coinsRead;
+    EXPECT_FALSE(coinsRead.fHaveLockTime);
+    EXPECT_EQ(203998, coinsRead.nHeight);
+
+    // and in the undo data of its last output
+    CTxInUndo undo(coins.vout[0], false, coins.nHeight, coins.nVersion), undoRead;
+    undo.nLockTime = coins.nLockTime;
+    undo.fHaveLockTime = true;
+    ss << undo;
+    ss >> undoRead;
+    EXPECT_TRUE(undoRead.fHaveLockTime);
+    EXPECT_EQ(coins.nLockTime, undoRead.nLockTime);
+    EXPECT_EQ(333331U, undoRead.nHeight);
+    EXPECT_EQ(coins.nVersion, undoRead.nVersion);
+    undo.fHaveLockTime = false;
+    ss << undo;
+    ss >> undoRead;
+    EXPECT_FALSE(undoRead.fHaveLockTime);
+    EXPECT_EQ(333331U, undoRead.nHeight);
+
+    CBlock block;
+    CBlockIndex *pfakePrev = new CBlockIndex(block);
+    pfakePrev->nHeight = 333331;
+    pfakePrev->nTime = 1663762346 + 15 * 24 * 60 * 60;
+    CBlockIndex *pfakeIndex = new CBlockIndex(block);
+    pfakeIndex->nHeight = 333332;
+    pfakeIndex->nTime = 1663762346 + 31 * 24 * 60 * 60;
+    pfakeIndex->pprev = pfakePrev;
+    chainActive.SetTip(pfakeIndex);
+
+    uint64_t interest = komodo_interest(333331, 100 * COIN, 1663755146, pfakeIndex->nTime);
+    EXPECT_GT(interest, 0);
+    EXPECT_EQ(interest, komodo_coins_interest(tx.GetHash(), coins, 0, 333332));
+
+    // like komodo_accrued_interest it runs to the time of the tip, also below it
+    EXPECT_EQ(interest, komodo_coins_interest(tx.GetHash(), coins, 0, 333331));
+
+    // coins of the block being connected or of the mempool earn nothing yet
+    CCoins coinsNew(tx, 333333);
+    EXPECT_EQ(0, komodo_coins_interest(tx.GetHash(), coinsNew, 0, 333332));
+
+    chainActive.SetTip(nullptr);
+    delete pfakeIndex;
+    delete pfakePrev;
+}
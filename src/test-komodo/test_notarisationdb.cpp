@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include "cc/eval.h"
+#include "chain.h"
+#include "main.h"
+#include "notarisationdb.h"
+#include "uint256.h"
+
+#include "testutils.h"
+
+namespace TestNotarisationDB {
+
+class TestNotarisationDB : public ::testing::Test
+{
+protected:
+    static void SetUpTestCase() { setupChain(); }
+
+    // a private db, and an active chain of blocks 0-25 whose hashes are their heights
+    NotarisationDB *pnotarisationsShared;
+    CBlockIndex *pindexTipShared;
+    std::vector<uint256> hashes;
+    std::vector<CBlockIndex> blocks;
+
+    virtual void SetUp()
+    {
+        pnotarisationsShared = pnotarisations;
+        pnotarisations = new NotarisationDB(1 << 20, true);
+        pindexTipShared = chainActive.Tip();
+        hashes.resize(26);
+        blocks.resize(26);
+        for (int i = 0; i < 26; i++) {
+            hashes[i] = ArithToUint256(arith_uint256(100 + i));
+            blocks[i].phashBlock = &hashes[i];
+            blocks[i].nHeight = i;
+            blocks[i].pprev = i > 0 ? &blocks[i - 1] : NULL;
+        }
+        chainActive.SetTip(&blocks[25]);
+    }
+
+    virtual void TearDown()
+    {
+        chainActive.SetTip(pindexTipShared);
+        delete pnotarisations;
+        pnotarisations = pnotarisationsShared;
+    }
+
+    static Notarisation MakeNotarisation(const char *symbol, uint16_t ccId, int n)
+    {
+        NotarisationData data(0);
+        strcpy(data.symbol, symbol);
+        data.ccId = ccId;
+        data.MoM = ArithToUint256(arith_uint256(1000 + n));
+        return std::make_pair(ArithToUint256(arith_uint256(n)), data);
+    }
+
+    void Connect(const NotarisationsInBlock &nibs, int height)
+    {
+        CDBBatch batch(*pnotarisations);
+        WriteNotarisationIndexes(nibs, height, hashes[height], batch);
+        ASSERT_TRUE(pnotarisations->WriteBatch(batch, true));
+    }
+
+    static std::vector<uint256> Txids(const std::vector<IndexedNotarisation> &notarisations)
+    {
+        std::vector<uint256> txids;
+        for (const IndexedNotarisation &nota : notarisations)
+            txids.push_back(nota.second.first);
+        return txids;
+    }
+};
+
+TEST_F(TestNotarisationDB, IndexesBySymbolAndCcid)
+{
+    Notarisation a10 = MakeNotarisation("AAA", 2, 1), b10 = MakeNotarisation("BBB", 2, 2);
+    Notarisation a12 = MakeNotarisation("AAA", 2, 3), a15 = MakeNotarisation("AAA", 3, 4);
+    Notarisation a20 = MakeNotarisation("AAA", 2, 5), a20b = MakeNotarisation("AAA", 2, 6);
+    Connect({a10, b10}, 10);
+    Connect({a12}, 12);
+    Connect({a15}, 15);
+    Connect({a20, a20b}, 20);
+
+    // a block record whose hash starts like an index key sorts among them and is skipped
+    uint256 blockHash;
+    unsigned char *p = blockHash.begin();
+    p[0] = 'y'; p[1] = 3; memcpy(p + 2, "AAA", 3); p[8] = 11;
+    NotarisationsInBlock nibs = {b10};
+    ASSERT_TRUE(pnotarisations->Write(blockHash, nibs));
+
+    std::vector<IndexedNotarisation> notarisations;
+    GetNotarisationsBySymbol("AAA", 0, 19, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a10.first, a12.first, a15.first}), Txids(notarisations));
+    ASSERT_EQ(3U, notarisations.size());
+    EXPECT_EQ(12, notarisations[1].first);
+
+    GetNotarisationsBySymbol("AAA", 11, 14, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a12.first}), Txids(notarisations));
+
+    // newest block first, the block holding the last one asked for is read to its end
+    GetLastNotarisationsBySymbol("AAA", 19, 0, 2, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a15.first, a12.first}), Txids(notarisations));
+    GetLastNotarisationsBySymbol("AAA", 25, 0, 1, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a20.first, a20b.first}), Txids(notarisations));
+    GetLastNotarisationsBySymbol("AAA", 14, 11, 7, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a12.first}), Txids(notarisations));
+
+    GetNotarisationsByCcid(2, 0, 20, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a10.first, b10.first, a12.first, a20.first, a20b.first}), Txids(notarisations));
+
+    CDBBatch batch(*pnotarisations);
+    EraseNotarisationIndexes({a20, a20b}, 20, batch);
+    ASSERT_TRUE(pnotarisations->WriteBatch(batch, true));
+    GetLastNotarisationsBySymbol("AAA", 25, 0, 1, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a15.first}), Txids(notarisations));
+}
+
+TEST_F(TestNotarisationDB, SkipsBlocksOffTheActiveChain)
+{
+    Notarisation a10 = MakeNotarisation("AAA", 2, 1), a12 = MakeNotarisation("AAA", 2, 2);
+    Connect({a10}, 10);
+    Connect({a12}, 12);
+
+    // left behind by a block at height 14 that was disconnected without its index being erased
+    Notarisation stale = MakeNotarisation("AAA", 2, 3);
+    CDBBatch batch(*pnotarisations);
+    WriteNotarisationIndexes({stale}, 14, ArithToUint256(arith_uint256(999)), batch);
+    ASSERT_TRUE(pnotarisations->WriteBatch(batch, true));
+
+    std::vector<IndexedNotarisation> notarisations;
+    GetNotarisationsBySymbol("AAA", 0, 20, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a10.first, a12.first}), Txids(notarisations));
+    GetLastNotarisationsBySymbol("AAA", 20, 0, 1, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a12.first}), Txids(notarisations));
+    GetNotarisationsByCcid(2, 0, 20, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a10.first, a12.first}), Txids(notarisations));
+
+    // and the chain going back below 12
+    chainActive.SetTip(&blocks[11]);
+    GetLastNotarisationsBySymbol("AAA", 20, 0, 1, notarisations);
+    EXPECT_EQ(std::vector<uint256>({a10.first}), Txids(notarisations));
+}
+
+}
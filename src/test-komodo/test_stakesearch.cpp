@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+
+#include "komodo_bitcoind.h"
+#include "utiltime.h"
+
+#include <random>
+
+namespace TestStakeSearch {
+
+class TestStakeSearch : public ::testing::Test
+{
+protected:
+    std::mt19937_64 rng;
+    uint8_t segids[256];
+    const int64_t nNow = 1600000000;
+    uint32_t nSavedMinDiff;
+
+    void SetUp()
+    {
+        nSavedMinDiff = STAKING_MIN_DIFF;
+        STAKING_MIN_DIFF = ASSETCHAINS_MINDIFF[0];
+        rng.seed(12345);
+        for (int i = 0; i < 100; i++)
+            segids[i] = rng() & 0x3f;
+        SetMockTime(nNow);
+    }
+
+    void TearDown()
+    {
+        SetMockTime(0);
+        STAKING_MIN_DIFF = nSavedMinDiff;
+    }
+
+    uint256 RandHash()
+    {
+        uint256 hash;
+        for (uint8_t *p = hash.begin(); p != hash.end(); p++)
+            *p = rng();
+        return hash;
+    }
+
+    // compares the search with komodo_stake2() over random utxos, returns the number of winners
+    int Compare(const arith_uint256 &bnTarget, int n)
+    {
+        komodo_stakelimits limits;
+        komodo_stakelimits_init(&limits, bnTarget);
+        int winners = 0;
+        for (int i = 0; i < n; i++) {
+            uint256 txid = RandHash();
+            bits256 addrhash;
+            uint256 addr = RandHash();
+            memcpy(&addrhash, addr.begin(), sizeof(addrhash));
+            int32_t vout = rng() % 4;
+            int32_t nHeight = 1 + rng() % 20000;
+            uint64_t value = rng() % 4 == 0 ? rng() % (2 * COIN) : rng() % (10000000 * COIN);
+            uint32_t txtime = nNow - rng() % (3600 * 24 * 60);
+            uint32_t prevtime = nNow - rng() % 1000;
+            uint32_t blocktime = rng() % 2 == 0 ? 0 : prevtime + rng() % 600;
+
+            uint8_t hashbuf[256];
+            memcpy(hashbuf, segids, 100);
+            uint32_t expected = komodo_stake2(0, bnTarget, nHeight, txid, vout, blocktime, prevtime, value, txtime, addrhash, hashbuf);
+            uint32_t actual = komodo_stake_earliest(limits, nHeight, txid, vout, blocktime, prevtime, value, txtime, addrhash, segids);
+            EXPECT_EQ(expected, actual) << "utxo " << i;
+            if (expected != 0 && nHeight >= 10)
+                winners++;
+        }
+        return winners;
+    }
+};
+
+TEST_F(TestStakeSearch, MatchesLinearScan)
+{
+    bool fNegative, fOverflow;
+    arith_uint256 mindiff;
+    mindiff.SetCompact(STAKING_MIN_DIFF, &fNegative, &fOverflow);
+
+    int winners = 0;
+    for (int shift = 0; shift <= 40; shift += 8)
+        winners += Compare(mindiff >> shift, 300);
+    EXPECT_GT(winners, 0);
+
+    // targets above the minimum difficulty make the ratio 0, tiny ones make ratio * quotient overflow
+    Compare(mindiff << 1, 100);
+    Compare(~arith_uint256(0), 100);
+    Compare(arith_uint256(1), 100);
+    Compare(arith_uint256(12345), 100);
+}
+
+}
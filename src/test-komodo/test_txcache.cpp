@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "txcache.h"
+#include "primitives/block.h"
+
+namespace TestTxCache {
+
+static CTransaction MakeTx(uint32_t nLockTime, size_t scriptSize = 10)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.n = 0;
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 1;
+    mtx.vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(scriptSize, 1);
+    mtx.nLockTime = nLockTime;
+    return CTransaction(mtx);
+}
+
+TEST(TestTxCache, GetPutErase)
+{
+    CTxCache cache(1 << 20);
+    CTransaction tx1 = MakeTx(1), tx2 = MakeTx(2), out;
+    uint256 block1 = uint256S("01"), block2 = uint256S("02"), hashBlock;
+
+    EXPECT_FALSE(cache.Get(tx1.GetHash(), out, hashBlock));
+    cache.Put(tx1, block1);
+    cache.Put(tx2, block2);
+    cache.Put(MakeTx(3), uint256()); // not confirmed, not cached
+    EXPECT_TRUE(cache.Get(tx1.GetHash(), out, hashBlock));
+    EXPECT_EQ(out.GetHash(), tx1.GetHash());
+    EXPECT_EQ(hashBlock, block1);
+
+    CBlock block;
+    block.vtx.push_back(tx2);
+    cache.EraseBlock(block);
+    EXPECT_FALSE(cache.Get(tx2.GetHash(), out, hashBlock));
+
+    CTxCacheStats stats = cache.GetStats();
+    EXPECT_EQ(stats.nEntries, 1);
+    EXPECT_EQ(stats.nHits, 1);
+    EXPECT_EQ(stats.nMisses, 2);
+    EXPECT_EQ(stats.nInvalidations, 1);
+}
+
+TEST(TestTxCache, EvictsLeastRecentlyUsed)
+{
+    CTxCache cache(1 << 20);
+    std::vector<CTransaction> txs;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        txs.push_back(MakeTx(i, 1000));
+        cache.Put(txs.back(), uint256S("01"));
+    }
+    // room for two of them
+    cache.SetMaxUsage(cache.GetStats().nUsage * 2 / 3 + 1);
+    EXPECT_EQ(cache.GetStats().nEntries, 2);
+
+    CTransaction out;
+    uint256 hashBlock;
+    EXPECT_FALSE(cache.Get(txs[0].GetHash(), out, hashBlock));
+    EXPECT_TRUE(cache.Get(txs[1].GetHash(), out, hashBlock)); // now the most recent
+    cache.Put(MakeTx(3, 1000), uint256S("01"));
+    EXPECT_TRUE(cache.Get(txs[1].GetHash(), out, hashBlock));
+    EXPECT_FALSE(cache.Get(txs[2].GetHash(), out, hashBlock));
+    EXPECT_EQ(cache.GetStats().nEvictions, 2);
+
+    cache.SetMaxUsage(0);
+    EXPECT_EQ(cache.GetStats().nEntries, 0);
+    cache.Put(txs[0], uint256S("01"));
+    EXPECT_EQ(cache.GetStats().nEntries, 0);
+}
+
+} // namespace TestTxCache
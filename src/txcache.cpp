@@ -0,0 +1,122 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "txcache.h"
+
+#include "core_memusage.h"
+#include "memusage.h"
+#include "primitives/block.h"
+
+CTxCache txCache;
+
+static size_t TxUsage(const CTransaction &tx)
+{
+    return RecursiveDynamicUsage(tx) + memusage::DynamicUsage(tx.vjoinsplit)
+            + memusage::DynamicUsage(tx.vShieldedSpend) + memusage::DynamicUsage(tx.vShieldedOutput);
+}
+
+CTxCache::CTxCache(size_t nMaxUsageIn)
+{
+    stats.nMaxUsage = nMaxUsageIn;
+}
+
+bool CTxCache::Get(const uint256 &txid, CTransaction &tx, uint256 &hashBlock)
+{
+    LOCK(cs);
+    EntryMap::iterator it = entries.find(txid);
+    if (it == entries.end())
+    {
+        stats.nMisses++;
+        return false;
+    }
+    stats.nHits++;
+    lru.splice(lru.begin(), lru, it->second.lru);
+    tx = it->second.tx;
+    hashBlock = it->second.hashBlock;
+    return true;
+}
+
+void CTxCache::Put(const CTransaction &tx, const uint256 &hashBlock)
+{
+    if (hashBlock.IsNull())
+        return;
+    LOCK(cs);
+    if (stats.nMaxUsage == 0)
+        return;
+    const uint256 &txid = tx.GetHash();
+    EntryMap::iterator it = entries.find(txid);
+    if (it != entries.end())
+        EraseEntry(it);
+    Entry &entry = entries[txid];
+    entry.tx = tx;
+    entry.hashBlock = hashBlock;
+    entry.nUsage = TxUsage(tx) + sizeof(Entry) + sizeof(uint256) + 4 * sizeof(void*);
+    entry.lru = lru.insert(lru.begin(), txid);
+    stats.nUsage += entry.nUsage;
+    Trim();
+}
+
+void CTxCache::EraseBlock(const CBlock &block)
+{
+    LOCK(cs);
+    for (const CTransaction &tx : block.vtx)
+    {
+        EntryMap::iterator it = entries.find(tx.GetHash());
+        if (it != entries.end())
+        {
+            EraseEntry(it);
+            stats.nInvalidations++;
+        }
+    }
+}
+
+void CTxCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    stats.nMaxUsage = nMaxUsageIn;
+    Trim();
+}
+
+void CTxCache::Clear()
+{
+    LOCK(cs);
+    entries.clear();
+    lru.clear();
+    stats.nUsage = 0;
+}
+
+CTxCacheStats CTxCache::GetStats() const
+{
+    LOCK(cs);
+    CTxCacheStats ret = stats;
+    ret.nEntries = entries.size();
+    return ret;
+}
+
+void CTxCache::EraseEntry(EntryMap::iterator it)
+{
+    stats.nUsage -= it->second.nUsage;
+    lru.erase(it->second.lru);
+    entries.erase(it);
+}
+
+void CTxCache::Trim()
+{
+    while (stats.nUsage > stats.nMaxUsage && !lru.empty())
+    {
+        EraseEntry(entries.find(lru.back()));
+        stats.nEvictions++;
+    }
+}
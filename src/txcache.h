@@ -0,0 +1,103 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef KOMODO_TXCACHE_H
+#define KOMODO_TXCACHE_H
+
+#include "coins.h" // CCoinsKeyHasher
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <unordered_map>
+
+class CBlock;
+
+//! -txcachesize default (MiB)
+static const int64_t DEFAULT_TX_CACHE_SIZE = 32;
+
+struct CTxCacheStats
+{
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+    uint64_t nEvictions = 0;
+    uint64_t nInvalidations = 0;
+    size_t nEntries = 0;
+    size_t nUsage = 0;
+    size_t nMaxUsage = 0;
+};
+
+/**
+ * Size bounded, least recently used cache of confirmed transactions that were
+ * read from the block files, with the hash of the block they were read from.
+ * Shared by myGetTransaction() and GetTransaction(), so it has its own lock.
+ * Mempool transactions are never cached, and the transactions of a
+ * disconnected block are dropped.
+ */
+class CTxCache
+{
+public:
+    explicit CTxCache(size_t nMaxUsageIn = DEFAULT_TX_CACHE_SIZE << 20);
+
+    /****
+     * @brief look up a transaction
+     * @param[in] txid the transaction hash
+     * @param[out] tx the transaction
+     * @param[out] hashBlock the block the transaction was read from
+     * @returns true on a hit
+     */
+    bool Get(const uint256 &txid, CTransaction &tx, uint256 &hashBlock);
+
+    /****
+     * @brief add a confirmed transaction, evicting the least recently used ones if full
+     * @param tx the transaction
+     * @param hashBlock the block the transaction was read from
+     */
+    void Put(const CTransaction &tx, const uint256 &hashBlock);
+
+    /****
+     * @brief drop the transactions of a block, called when it is disconnected
+     * @param block the block
+     */
+    void EraseBlock(const CBlock &block);
+
+    /** Set the memory limit in bytes, 0 disables the cache */
+    void SetMaxUsage(size_t nMaxUsageIn);
+    void Clear();
+    CTxCacheStats GetStats() const;
+
+private:
+    struct Entry
+    {
+        CTransaction tx;
+        uint256 hashBlock;
+        size_t nUsage;
+        std::list<uint256>::iterator lru;
+    };
+    typedef std::unordered_map<uint256, Entry, CCoinsKeyHasher> EntryMap;
+
+    void EraseEntry(EntryMap::iterator it);
+    void Trim();
+
+    mutable CCriticalSection cs;
+    EntryMap entries;
+    std::list<uint256> lru; //! most recently used first
+    CTxCacheStats stats;
+};
+
+extern CTxCache txCache;
+
+#endif // KOMODO_TXCACHE_H
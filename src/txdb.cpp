@@ -33,7 +33,10 @@
 #include "init.h"
 
 #include <stdint.h>
+#include <algorithm>
+#include <limits>
 
+#include <boost/scoped_array.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -49,6 +52,11 @@ static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'd';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCEINDEX = 'e';
+static const char DB_ADDRESSBALANCEDELTA = 'E';
+static const char DB_CCUNSPENTINDEX = 'C';
+static const char DB_CCOUTPOINT = 'O';
+static const char DB_CCSPENT = 'Q';
 static const char DB_TIMESTAMPINDEX = 'S';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
@@ -60,13 +68,23 @@ static const char DB_BEST_SAPLING_ANCHOR = 'z';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BEST_INDEXED_BLOCK = 'I';
+static const char DB_COINS_LOCKTIME = 'L';
+
+/** Coins records UpgradeLockTimes() rewrites in one batch */
+static const int COINS_LOCKTIME_BATCH_SIZE = 10000;
 
 
 CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
+    // every record of a new chainstate is written with its nLockTime
+    if (db.IsEmpty())
+        db.Write(DB_COINS_LOCKTIME, true);
 }
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
 {
+    if (db.IsEmpty())
+        db.Write(DB_COINS_LOCKTIME, true);
 }
 
 
@@ -118,6 +136,48 @@ bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
     return db.Exists(make_pair(DB_COINS, txid));
 }
 
+bool CCoinsViewDB::UpgradeLockTimes() {
+    if (db.Exists(DB_COINS_LOCKTIME))
+        return true;
+
+    LogPrintf("%s: storing nLockTime in the coins records\n", __func__);
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_COINS);
+    CDBBatch batch(db);
+    int nBatch = 0, nUpgraded = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, uint256> key;
+        CCoins coins;
+        if (!pcursor->GetKey(key) || key.first != DB_COINS)
+            break;
+        if (!pcursor->GetValue(coins))
+            return error("%s: unable to read coins %s", __func__, key.second.GetHex());
+        if (!coins.fHaveLockTime) {
+            CTransaction tx;
+            uint256 hashBlock;
+            if (!GetTransaction(key.second, tx, hashBlock, true))
+                return error("%s: transaction %s not found", __func__, key.second.GetHex());
+            coins.nLockTime = tx.nLockTime;
+            coins.fHaveLockTime = true;
+            batch.Write(key, coins);
+            nUpgraded++;
+            if (++nBatch == COINS_LOCKTIME_BATCH_SIZE) {
+                if (!db.WriteBatch(batch))
+                    return false;
+                batch.Clear();
+                nBatch = 0;
+            }
+        }
+        pcursor->Next();
+    }
+    batch.Write(DB_COINS_LOCKTIME, true);
+    if (!db.WriteBatch(batch, true))
+        return false;
+    LogPrintf("%s: %d coins records upgraded\n", __func__, nUpgraded);
+    return true;
+}
+
 uint256 CCoinsViewDB::GetBestBlock() const {
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
@@ -219,7 +279,103 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles),
+        fIndexWriteFailed(false), fStopIndexWriter(false) {
+}
+
+CBlockTreeDB::~CBlockTreeDB() {
+    {
+        boost::unique_lock<boost::mutex> lock(csIndexWriter);
+        fStopIndexWriter = true;
+        condIndexWriter.notify_all();
+    }
+    if (indexWriter.joinable())
+        indexWriter.join();
+}
+
+void CBlockTreeDB::IndexWriterThread() {
+    RenameThread("komodo-indexwrite");
+    while (true) {
+        std::vector<std::shared_ptr<const CBlockIndexUpdate> > updates;
+        {
+            boost::unique_lock<boost::mutex> lock(csIndexWriter);
+            while (indexQueue.empty() && !fStopIndexWriter)
+                condIndexWriter.wait(lock);
+            if (indexQueue.empty())
+                return;
+            // the updates stay queued until written, so readers wait for them
+            updates.assign(indexQueue.begin(), indexQueue.end());
+        }
+        bool fOk = true;
+        try {
+            CIndexBatch changes(*this);
+            for (size_t i = 0; i < updates.size(); i++)
+                ApplyIndexUpdate(changes, *updates[i]);
+            const CBlockIndexUpdate &last = *updates.back();
+            changes.Write(DB_BEST_INDEXED_BLOCK, last.fUndo ? last.hashPrevBlock : last.hashBlock);
+            CDBBatch batch(*this);
+            changes.Fill(batch);
+            LogPrint("bench", "%s: %u blocks, %u index keys\n", __func__, updates.size(), changes.Size());
+            fOk = WriteBatch(batch);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+            fOk = false;
+        }
+        boost::unique_lock<boost::mutex> lock(csIndexWriter);
+        indexQueue.erase(indexQueue.begin(), indexQueue.begin() + updates.size());
+        if (!fOk) {
+            // nothing after a failed write can be applied, validation stops at the next block
+            fIndexWriteFailed = true;
+            indexQueue.clear();
+        }
+        condIndexWriter.notify_all();
+    }
+}
+
+bool CBlockTreeDB::QueueIndexUpdate(const std::shared_ptr<const CBlockIndexUpdate> &update) {
+    boost::unique_lock<boost::mutex> lock(csIndexWriter);
+    while (indexQueue.size() >= MAX_INDEX_WRITE_LAG && !fIndexWriteFailed)
+        condIndexWriter.wait(lock);
+    if (fIndexWriteFailed)
+        return error("%s: an earlier index write failed", __func__);
+    indexQueue.push_back(update);
+    if (!indexWriter.joinable())
+        indexWriter = boost::thread(&CBlockTreeDB::IndexWriterThread, this);
+    condIndexWriter.notify_all();
+    return true;
+}
+
+bool CBlockTreeDB::SyncIndexWrites() const {
+    boost::unique_lock<boost::mutex> lock(csIndexWriter);
+    while (!indexQueue.empty() && !fIndexWriteFailed)
+        condIndexWriter.wait(lock);
+    return !fIndexWriteFailed;
+}
+
+bool CBlockTreeDB::ReadBestIndexedBlock(uint256 &hash) const {
+    return Read(DB_BEST_INDEXED_BLOCK, hash);
+}
+
+bool CBlockTreeDB::WriteBestIndexedBlock(const uint256 &hash) {
+    if (!SyncIndexWrites())
+        return false;
+    return Write(DB_BEST_INDEXED_BLOCK, hash);
+}
+
+void CBlockTreeDB::ApplyIndexUpdate(CIndexBatch &batch, const CBlockIndexUpdate &update) const {
+    if (update.fAddressIndex) {
+        if (update.fUndo)
+            EraseAddressIndex(batch, update.addressIndex);
+        else
+            WriteAddressIndex(batch, update.addressIndex);
+        UpdateAddressUnspentIndex(batch, update.addressUnspentIndex);
+        UpdateAddressBalanceIndex(batch, update.nHeight, update.balanceDeltas, update.fUndo);
+    }
+    UpdateSpentIndex(batch, update.spentIndex);
+    if (update.fCCIndex)
+        UpdateCCIndex(batch, update.nHeight, update.ccIndex, update.ccSpends, update.fUndo);
+    if (update.fTimestampIndex && !update.fUndo)
+        WriteTimestampIndex(batch, update.hashBlock, update.hashPrevBlock, update.nTime);
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) const {
@@ -339,11 +495,11 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
 }
 
 bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) const {
+    SyncIndexWrites();
     return Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
-    CDBBatch batch(*this);
+void CBlockTreeDB::UpdateSpentIndex(CIndexBatch &batch, const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) const {
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(make_pair(DB_SPENTINDEX, it->first));
@@ -351,11 +507,9 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
             batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(*this);
+void CBlockTreeDB::UpdateAddressUnspentIndex(CIndexBatch &batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) const {
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
@@ -363,102 +517,379 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
             batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
+}
+
+//! true if both keys serialize to the same bytes
+template <typename K>
+static bool SameIndexKey(const K &a, const K &b) {
+    CDataStream ssA(SER_DISK, CLIENT_VERSION), ssB(SER_DISK, CLIENT_VERSION);
+    ssA << a;
+    ssB << b;
+    return ssA.size() == ssB.size() && std::equal(ssA.begin(), ssA.end(), ssB.begin());
+}
+
+/****
+ * Position a cursor on the first entry of a scan
+ * @param pcursor the cursor, already positioned by a seek
+ * @param fReverse true if the scan goes backwards, the cursor is moved to the entry before the seek position
+ * @param fSkip true if the cursor is on the resume key, it is moved past it
+ */
+static void StartIndexScan(CDBIterator *pcursor, bool fReverse, bool fSkip) {
+    if (fReverse) {
+        if (pcursor->Valid())
+            pcursor->Prev();
+        else
+            pcursor->SeekToLast();
+    } else if (fSkip) {
+        pcursor->Next();
+    }
+}
+
+bool CBlockTreeDB::ScanAddressUnspentIndex(uint160 addressHash, int type, const CAddressUnspentKey *pafter, bool fReverse,
+                                           const AddressUnspentVisitor &visitor) {
+
+    if (pafter && (pafter->hashBytes != addressHash || pafter->type != (unsigned int)type))
+        return error("%s: resume key of another address", __func__);
+    SyncIndexWrites();
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    bool fSkip = false;
+    if (pafter) {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, *pafter));
+        pair<char, CAddressUnspentKey> keyObj;
+        fSkip = pcursor->Valid() && pcursor->GetKey(keyObj) && keyObj.first == DB_ADDRESSUNSPENTINDEX && SameIndexKey(keyObj.second, *pafter);
+    } else if (fReverse) {
+        uint256 hashLast;
+        memset(hashLast.begin(), 0xff, hashLast.size());
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentKey(type, addressHash, hashLast, 0xffffffff)));
+    } else {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
+    StartIndexScan(pcursor.get(), fReverse, fSkip);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        pair<char, CAddressUnspentKey> keyObj;
+        if (!pcursor->GetKey(keyObj) || keyObj.first != DB_ADDRESSUNSPENTINDEX ||
+            keyObj.second.hashBytes != addressHash || keyObj.second.type != (unsigned int)type)
+            break;
+        CAddressUnspentValue nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address unspent value");
+        if (!visitor(keyObj.second, nValue))
+            break;
+        if (fReverse)
+            pcursor->Prev();
+        else
+            pcursor->Next();
+    }
+    return true;
 }
 
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    return ScanAddressUnspentIndex(addressHash, type, NULL, false,
+        [&unspentOutputs](const CAddressUnspentKey &key, const CAddressUnspentValue &value) {
+            unspentOutputs.push_back(make_pair(key, value));
+            return true;
+        });
+}
 
+void CBlockTreeDB::UpdateCCIndex(CIndexBatch &batch, int nHeight, const std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > &outputs,
+                                 const std::vector<COutPoint> &spends, bool fUndo) const {
+    typedef std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > CCIndexEntries;
+    // a CC output can be indexed under several addresses, all of them are kept under its outpoint
+    // while it is unspent so that spending it removes every entry
+    std::map<COutPoint, CCIndexEntries> added, removed;
+    for (CCIndexEntries::const_iterator it = outputs.begin(); it != outputs.end(); it++)
+        (fUndo ? removed : added)[COutPoint(it->first.txhash, it->first.index)].push_back(*it);
+    if (fUndo) {
+        // the entries the block spent were kept under its height, outputs it spent itself were never written
+        CCIndexEntries spent;
+        batch.Read(make_pair(DB_CCSPENT, nHeight), spent);
+        for (CCIndexEntries::const_iterator it = spent.begin(); it != spent.end(); it++)
+            added[COutPoint(it->first.txhash, it->first.index)].push_back(*it);
+        batch.Erase(make_pair(DB_CCSPENT, nHeight));
+    } else {
+        CCIndexEntries spent;
+        for (std::vector<COutPoint>::const_iterator it = spends.begin(); it != spends.end(); it++) {
+            CCIndexEntries entries;
+            std::map<COutPoint, CCIndexEntries>::iterator found = added.find(*it);
+            if (found != added.end()) {
+                added.erase(found);
+            } else if (batch.Read(make_pair(DB_CCOUTPOINT, *it), entries)) {
+                spent.insert(spent.end(), entries.begin(), entries.end());
+                removed[*it] = entries;
+            }
+        }
+        if (!spent.empty())
+            batch.Write(make_pair(DB_CCSPENT, nHeight), spent);
+        else
+            batch.Erase(make_pair(DB_CCSPENT, nHeight));
+    }
+
+    for (std::map<COutPoint, CCIndexEntries>::const_iterator it = removed.begin(); it != removed.end(); it++) {
+        for (CCIndexEntries::const_iterator entry = it->second.begin(); entry != it->second.end(); entry++)
+            batch.Erase(make_pair(DB_CCUNSPENTINDEX, entry->first));
+        batch.Erase(make_pair(DB_CCOUTPOINT, it->first));
+    }
+    for (std::map<COutPoint, CCIndexEntries>::const_iterator it = added.begin(); it != added.end(); it++) {
+        for (CCIndexEntries::const_iterator entry = it->second.begin(); entry != it->second.end(); entry++)
+            batch.Write(make_pair(DB_CCUNSPENTINDEX, entry->first), entry->second);
+        batch.Write(make_pair(DB_CCOUTPOINT, it->first), it->second);
+    }
+}
+
+bool CBlockTreeDB::ReadCCIndex(const CCIndexIteratorKey &prefix,
+                               std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > &vect) {
+    SyncIndexWrites();
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    pcursor->Seek(make_pair(DB_CCUNSPENTINDEX, prefix));
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        try {
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            pair<char, CAddressUnspentKey> keyObj;
-            pcursor->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressUnspentKey indexKey = keyObj.second;
-
-            if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.hashBytes == addressHash) {
-                try {
-                    CAddressUnspentValue nValue;
-                    pcursor->GetValue(nValue);
-                    unspentOutputs.push_back(make_pair(indexKey, nValue));
-                    pcursor->Next();
-                } catch (const std::exception& e) {
-                    return error("failed to get address unspent value");
-                }
-            } else {
-                break;
-            }
-        } catch (const std::exception& e) {
+        pair<char, CCIndexKey> keyObj;
+        if (!pcursor->GetKey(keyObj) || keyObj.first != DB_CCUNSPENTINDEX || !prefix.InRange(keyObj.second))
             break;
+        if (!prefix.Matches(keyObj.second)) {
+            pcursor->Next();
+            continue;
         }
+        CAddressUnspentValue nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get CC index value");
+        vect.push_back(make_pair(keyObj.second, nValue));
+        pcursor->Next();
     }
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
+void CBlockTreeDB::WriteAddressIndex(CIndexBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) const {
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
+void CBlockTreeDB::EraseAddressIndex(CIndexBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) const {
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
-                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+bool CBlockTreeDB::ScanAddressIndex(uint160 addressHash, int type, int start, int end, const CAddressIndexKey *pafter,
+                                    bool fReverse, const AddressIndexVisitor &visitor) {
 
+    if (pafter && (pafter->hashBytes != addressHash || pafter->type != (unsigned int)type))
+        return error("%s: resume key of another address", __func__);
+    SyncIndexWrites();
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
+    bool fSkip = false;
+    if (pafter) {
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, *pafter));
+        pair<char, CAddressIndexKey> keyObj;
+        fSkip = pcursor->Valid() && pcursor->GetKey(keyObj) && keyObj.first == DB_ADDRESSINDEX && SameIndexKey(keyObj.second, *pafter);
+    } else if (fReverse) {
+        // the first entry above the range, the scan starts right before it
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, end > 0 ? end + 1 : std::numeric_limits<int>::max())));
+    } else if (start > 0) {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
     } else {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
+    StartIndexScan(pcursor.get(), fReverse, fSkip);
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        try {
-            pair<char, CAddressIndexKey> keyObj;
-            pcursor->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressIndexKey indexKey = keyObj.second;
+        pair<char, CAddressIndexKey> keyObj;
+        if (!pcursor->GetKey(keyObj) || keyObj.first != DB_ADDRESSINDEX ||
+            keyObj.second.hashBytes != addressHash || keyObj.second.type != (unsigned int)type)
+            break;
+        const CAddressIndexKey &indexKey = keyObj.second;
+        if (fReverse ? (start > 0 && indexKey.blockHeight < start) : (end > 0 && indexKey.blockHeight > end))
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        if (!visitor(indexKey, nValue))
+            break;
+        if (fReverse)
+            pcursor->Prev();
+        else
+            pcursor->Next();
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                    int start, int end) {
+    return ScanAddressIndex(addressHash, type, (start > 0 && end > 0) ? start : 0, end, NULL, false,
+        [&addressIndex](const CAddressIndexKey &key, CAmount nValue) {
+            addressIndex.push_back(make_pair(key, nValue));
+            return true;
+        });
+}
 
-            if (chType == DB_ADDRESSINDEX && indexKey.hashBytes == addressHash) {
-                if (end > 0 && indexKey.blockHeight > end) {
-                    break;
+void CBlockTreeDB::UpdateAddressBalanceIndex(CIndexBatch &batch, int nHeight, const CAddressBalanceMap &deltas, bool fUndo) const {
+    for (CAddressBalanceMap::const_iterator it=deltas.begin(); it!=deltas.end(); it++) {
+        CAddressBalanceValue value;
+        batch.Read(make_pair(DB_ADDRESSBALANCEINDEX, it->first), value);
+        if (fUndo) {
+            value.satoshis -= it->second.satoshis;
+            value.utxos -= it->second.utxos;
+        } else {
+            value.satoshis += it->second.satoshis;
+            value.utxos += it->second.utxos;
+        }
+        if (value.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, it->first), value);
+        }
+    }
+    if (fUndo) {
+        batch.Erase(make_pair(DB_ADDRESSBALANCEDELTA, nHeight));
+    } else {
+        batch.Write(make_pair(DB_ADDRESSBALANCEDELTA, nHeight), deltas);
+    }
+}
+
+bool CBlockTreeDB::ReadAddressBalanceDeltas(int nHeight, CAddressBalanceMap &deltas) const {
+    SyncIndexWrites();
+    return Read(make_pair(DB_ADDRESSBALANCEDELTA, nHeight), deltas);
+}
+
+bool CBlockTreeDB::ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) const {
+    SyncIndexWrites();
+    return Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), value);
+}
+
+/****
+ * Sum the entries of one shard of the address keyspace, the addresses whose
+ * hash starts with a byte in [nFirst, nLast], for every address type.
+ * Keys come out of leveldb sorted by (type, hash) so each address is complete
+ * as soon as the key changes and no map is needed to aggregate them.
+ */
+static void ScanAddressBalanceShard(CBlockTreeDB *db, char chIndex, unsigned int nFirst, unsigned int nLast,
+        std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > *pbalances, int64_t *pnEntries, bool *pfSuccess)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(db->NewIterator());
+    for (unsigned int type = 1; type <= 3; type++)
+    {
+        uint160 start;
+        *start.begin() = nFirst;
+        CAddressIndexIteratorKey current;
+        CAddressBalanceValue balance;
+        for (pcursor->Seek(make_pair(chIndex, CAddressIndexIteratorKey(type, start))); pcursor->Valid(); pcursor->Next())
+        {
+            boost::this_thread::interruption_point();
+            pair<char, CAddressIndexIteratorKey> keyObj;
+            if (!pcursor->GetKey(keyObj) || keyObj.first != chIndex || keyObj.second.type != type || *keyObj.second.hashBytes.begin() > nLast)
+                break;
+            if (keyObj.second.type != current.type || keyObj.second.hashBytes != current.hashBytes)
+            {
+                if (!balance.IsNull())
+                    pbalances->push_back(make_pair(current, balance));
+                current = keyObj.second;
+                balance.SetNull();
+            }
+            if (chIndex == DB_ADDRESSUNSPENTINDEX)
+            {
+                CAddressUnspentValue value;
+                if (!pcursor->GetValue(value))
+                {
+                    *pfSuccess = false;
+                    return;
                 }
-                try {
-                    CAmount nValue;
-                    pcursor->GetValue(nValue);
-
-                    addressIndex.push_back(make_pair(indexKey, nValue));
-                    pcursor->Next();
-                } catch (const std::exception& e) {
-                    return error("failed to get address index value");
+                if (value.satoshis != 0)
+                {
+                    balance.satoshis += value.satoshis;
+                    balance.utxos++;
                 }
-            } else {
-                break;
             }
-        } catch (const std::exception& e) {
-            break;
+            else
+            {
+                CAddressBalanceValue value;
+                if (!pcursor->GetValue(value))
+                {
+                    *pfSuccess = false;
+                    return;
+                }
+                balance.satoshis += value.satoshis;
+                balance.utxos += value.utxos;
+            }
+            (*pnEntries)++;
         }
+        if (!balance.IsNull())
+            pbalances->push_back(make_pair(current, balance));
+    }
+    *pfSuccess = true;
+}
+
+bool CBlockTreeDB::ScanAddressBalances(bool fUnspentIndex, int nWorkers,
+        std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > &balances, int64_t &nEntries)
+{
+    if (nWorkers <= 0)
+        nWorkers = GetNumCores();
+    nWorkers = std::max(1, std::min(nWorkers, MAX_SNAPSHOT_WORKERS));
+
+    char chIndex = fUnspentIndex ? DB_ADDRESSUNSPENTINDEX : DB_ADDRESSBALANCEINDEX;
+    SyncIndexWrites();
+    std::vector<std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > > vShards(nWorkers);
+    std::vector<int64_t> vEntries(nWorkers, 0);
+    // std::vector<bool> is packed, so keep the per worker results apart
+    boost::scoped_array<bool> fSuccess(new bool[nWorkers]);
+    boost::thread_group workers;
+    for (int i = 0; i < nWorkers; i++)
+    {
+        fSuccess[i] = false;
+        unsigned int nFirst = (256 * i) / nWorkers;
+        unsigned int nLast = (256 * (i + 1)) / nWorkers - 1;
+        workers.create_thread(boost::bind(&ScanAddressBalanceShard, this, chIndex, nFirst, nLast, &vShards[i], &vEntries[i], &fSuccess[i]));
+    }
+    try {
+        workers.join_all();
+    } catch (const boost::thread_interrupted&) {
+        workers.interrupt_all();
+        workers.join_all();
+        throw;
     }
 
+    nEntries = 0;
+    size_t nTotal = 0;
+    for (int i = 0; i < nWorkers; i++)
+    {
+        if (!fSuccess[i])
+            return error("%s: failed to read address balance values", __func__);
+        nEntries += vEntries[i];
+        nTotal += vShards[i].size();
+    }
+    balances.clear();
+    balances.reserve(nTotal);
+    for (int i = 0; i < nWorkers; i++)
+        balances.insert(balances.end(), vShards[i].begin(), vShards[i].end());
     return true;
 }
 
+bool CBlockTreeDB::RebuildAddressBalanceIndex() {
+    std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > balances;
+    int64_t nEntries = 0;
+    if (!ScanAddressBalances(true, 0, balances, nEntries))
+        return false;
+
+    CDBBatch batch(*this);
+    for (size_t i = 0; i < balances.size(); i++) {
+        batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, balances[i].first), balances[i].second);
+        if ((i + 1) % 100000 == 0) {
+            if (!WriteBatch(batch))
+                return error("%s: failed to write address balances", __func__);
+            batch.Clear();
+        }
+    }
+    LogPrintf("%s: %li address balances written from %li unspent outputs\n", __func__, balances.size(), nEntries);
+    return WriteBatch(batch, true);
+}
+
 bool getAddressFromIndex(const int &type, const uint160 &hash, std::string &address);
 
 #define DECLARE_IGNORELIST std::map <std::string,int> ignoredMap = { \
@@ -481,79 +912,78 @@ bool getAddressFromIndex(const int &type, const uint160 &hash, std::string &addr
     {"RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY", 1} \
 };
 
-bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret)
+static bool AddressBalanceGreater(const std::pair<CAmount, CAddressIndexIteratorKey> &a, const std::pair<CAmount, CAddressIndexIteratorKey> &b)
 {
-    int64_t total = 0; int64_t totalAddresses = 0; std::string address;
+    if (a.first != b.first)
+        return a.first > b.first;
+    return CAddressIndexIteratorKeyCompare()(b.second, a.second);
+}
+
+bool CBlockTreeDB::SnapshotBalances(std::vector<std::pair<CAmount, CAddressIndexIteratorKey> > &vbalances, UniValue *ret, const CAddressBalanceMap *undo, int nWorkers)
+{
+    int64_t total = 0; int64_t totalAddresses = 0;
     int64_t utxos = 0; int64_t ignoredAddresses = 0, cryptoConditionsUTXOs = 0, cryptoConditionsTotals = 0;
     DECLARE_IGNORELIST
-    boost::scoped_ptr<CDBIterator> iter(NewIterator());
-    //std::map <std::string, CAmount> addressAmounts;
-    for (iter->SeekToLast(); iter->Valid(); iter->Prev())
+    // decode the ignore list once and match on the binary keys
+    std::set<CAddressIndexIteratorKey, CAddressIndexIteratorKeyCompare> ignoredKeys;
+    for (std::map <std::string, int>::iterator it = ignoredMap.begin(); it != ignoredMap.end(); it++)
     {
-        boost::this_thread::interruption_point();
-        try
-        {
-            std::vector<unsigned char> slKey = std::vector<unsigned char>();
-            pair<char, CAddressIndexIteratorKey> keyObj;
-            iter->GetKey(keyObj);
+        uint160 hashBytes; int type = 0;
+        if ( CBitcoinAddress(it->first).GetIndexKey(hashBytes, type, false) )
+            ignoredKeys.insert(CAddressIndexIteratorKey(type, hashBytes));
+    }
 
-            char chType = keyObj.first;
-            CAddressIndexIteratorKey indexKey = keyObj.second;
-            //LogPrintf( "chType=%d\n", chType);
-            if (chType == DB_ADDRESSUNSPENTINDEX)
-            {
-                try {
-                    CAmount nValue;
-                    iter->GetValue(nValue);
-                    if ( nValue == 0 )
-                        continue;
-                    getAddressFromIndex(indexKey.type, indexKey.hashBytes, address);
-                    if ( indexKey.type == 3 )
-                    {
-                        cryptoConditionsUTXOs++;
-                        cryptoConditionsTotals += nValue;
-                        total += nValue;
-                        continue;
-                    }
-                    std::map <std::string, int>::iterator ignored = ignoredMap.find(address);
-                    if (ignored != ignoredMap.end())
-                    {
-                        LogPrintf("ignoring %s\n", address.c_str());
-                        ignoredAddresses++;
-                        continue;
-                    }
+    std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > balances;
+    int64_t nEntries = 0;
+    int64_t nStart = GetTimeMicros();
+    if (nWorkers <= 0)
+        nWorkers = GetNumCores();
+    nWorkers = std::max(1, std::min(nWorkers, MAX_SNAPSHOT_WORKERS));
+    if (!ScanAddressBalances(false, nWorkers, balances, nEntries))
+        return false;
+    int64_t nScanTime = GetTimeMicros() - nStart;
 
-                    std::map <std::string, CAmount>::iterator pos = addressAmounts.find(address);
-                    if ( pos == addressAmounts.end() )
-                    {
-                        // insert new address + utxo amount
-                        //LogPrintf( "inserting new address %s with amount %li\n", address.c_str(), nValue);
-                        addressAmounts[address] = nValue;
-                        totalAddresses++;
-                    }
-                    else
-                    {
-                        // update unspent tally for this address
-                        //LogPrintf( "updating address %s with new utxo amount %li\n", address.c_str(), nValue);
-                        addressAmounts[address] += nValue;
-                    }
-                    //LogPrintf("{\"%s\", %.8f},\n",address.c_str(),(double)nValue/COIN);
-                    // total += nValue;
-                    utxos++;
-                    total += nValue;
-                }
-                catch (const std::exception& e)
-                {
-                    LogPrintf( "DONE %s: LevelDB addressindex exception! - %s\n", __func__, e.what());
-                    return false; //break; this means failiure of DB? we need to exit here if so for consensus code!
-                }
-            }
+    // take the changes of the blocks above the snapshot height back out
+    CAddressBalanceMap pending;
+    if (undo)
+        pending = *undo;
+    for (size_t i = 0; i < balances.size(); i++)
+    {
+        CAddressBalanceMap::iterator it = pending.find(balances[i].first);
+        if (it != pending.end())
+        {
+            balances[i].second.satoshis -= it->second.satoshis;
+            balances[i].second.utxos -= it->second.utxos;
+            pending.erase(it);
         }
-        catch (const std::exception& e)
+    }
+    // what is left are addresses that were emptied since the snapshot height
+    for (CAddressBalanceMap::const_iterator it = pending.begin(); it != pending.end(); it++)
+        balances.push_back(make_pair(it->first, CAddressBalanceValue(-it->second.satoshis, -it->second.utxos)));
+
+    vbalances.clear();
+    vbalances.reserve(balances.size());
+    for (size_t i = 0; i < balances.size(); i++)
+    {
+        CAmount nValue = balances[i].second.satoshis;
+        if ( nValue <= 0 )
+            continue;
+        if ( balances[i].first.type == 3 )
         {
-            LogPrintf( "DONE reading index entries\n");
-            break;
+            cryptoConditionsUTXOs += balances[i].second.utxos;
+            cryptoConditionsTotals += nValue;
+            total += nValue;
+            continue;
+        }
+        if ( ignoredKeys.count(balances[i].first) != 0 )
+        {
+            ignoredAddresses++;
+            continue;
         }
+        vbalances.push_back(make_pair(nValue, balances[i].first));
+        totalAddresses++;
+        utxos += balances[i].second.utxos;
+        total += nValue;
     }
     //LogPrintf( "total=%f, totalAddresses=%li, utxos=%li, ignored=%li\n", (double) total / COIN, totalAddresses, utxos, ignoredAddresses);
     
@@ -578,27 +1008,70 @@ bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, Un
         ret->push_back(make_pair("total_includeCCvouts", (double) (total+cryptoConditionsTotals)/ COIN ));
         // The snapshot finished at this block height
         ret->push_back(make_pair("ending_height", chainActive.Height()));
+        // Number of threads the index was scanned with
+        ret->push_back(make_pair("workers", nWorkers));
+        // Number of index entries read and how fast
+        ret->push_back(make_pair("scanned_entries", nEntries));
+        ret->push_back(make_pair("scan_seconds", (double) nScanTime / 1000000));
+        ret->push_back(make_pair("entries_per_second", nScanTime > 0 ? (double) nEntries * 1000000 / nScanTime : 0.));
+    }
+    return true;
+}
+
+bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret, const CAddressBalanceMap *undo, int nWorkers)
+{
+    std::vector<std::pair<CAmount, CAddressIndexIteratorKey> > vbalances;
+    std::string address;
+    if (!SnapshotBalances(vbalances, ret, undo, nWorkers))
+        return false;
+    for (size_t i = 0; i < vbalances.size(); i++)
+    {
+        getAddressFromIndex(vbalances[i].second.type, vbalances[i].second.hashBytes, address);
+        addressAmounts[address] += vbalances[i].first;
     }
     return true;
 }
 
 extern std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 
-UniValue CBlockTreeDB::Snapshot(int top)
+UniValue CBlockTreeDB::Snapshot(int top, int nWorkers)
 {
     std::vector <std::pair<CAmount, std::string>> vaddr;
-    //std::vector <std::vector <std::pair<CAmount, CScript>>> tokenids;
-    std::map <std::string, CAmount> addressAmounts;
+    std::vector <std::pair<CAmount, CAddressIndexIteratorKey>> vbalances;
     UniValue result(UniValue::VOBJ);
     UniValue addressesSorted(UniValue::VARR);
     result.push_back(Pair("start_time", (int) time(NULL)));
-    if ( (vAddressSnapshot.size() > 0 && top < 0) || (Snapshot2(addressAmounts,&result) && top >= 0) )
+    if ( (vAddressSnapshot.size() > 0 && top < 0) || (SnapshotBalances(vbalances,&result,0,nWorkers) && top >= 0) )
     {
         if ( top > -1 )
         {
-            for (std::pair<std::string, CAmount> element : addressAmounts)
-                vaddr.push_back( make_pair(element.second, element.first) );
-            std::sort(vaddr.rbegin(), vaddr.rend());
+            if ( top > 0 && top < vbalances.size() )
+            {
+                // keep the top N in a bounded min-heap instead of sorting every address
+                std::vector <std::pair<CAmount, CAddressIndexIteratorKey>> heap;
+                heap.reserve(top + 1);
+                for (size_t i = 0; i < vbalances.size(); i++)
+                {
+                    if ( heap.size() == top && !AddressBalanceGreater(vbalances[i], heap.front()) )
+                        continue;
+                    heap.push_back(vbalances[i]);
+                    std::push_heap(heap.begin(), heap.end(), AddressBalanceGreater);
+                    if ( heap.size() > top )
+                    {
+                        std::pop_heap(heap.begin(), heap.end(), AddressBalanceGreater);
+                        heap.pop_back();
+                    }
+                }
+                vbalances.swap(heap);
+            }
+            std::sort(vbalances.begin(), vbalances.end(), AddressBalanceGreater);
+            // only the addresses that are returned get encoded
+            std::string address;
+            for (size_t i = 0; i < vbalances.size(); i++)
+            {
+                getAddressFromIndex(vbalances[i].second.type, vbalances[i].second.hashBytes, address);
+                vaddr.push_back( make_pair(vbalances[i].first, address) );
+            }
         }
         else 
         {
@@ -627,14 +1100,27 @@ UniValue CBlockTreeDB::Snapshot(int top)
     return(result);
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
+void CBlockTreeDB::WriteTimestampIndex(CIndexBatch &batch, const uint256 &hashBlock, const uint256 &hashPrevBlock, unsigned int nTime) const {
+    unsigned int logicalTS = nTime;
+    CTimestampBlockIndexValue prevLogicalTS;
+
+    // retrieve logical timestamp of the previous block
+    if (!hashPrevBlock.IsNull())
+        if (!batch.Read(std::make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(hashPrevBlock)), prevLogicalTS))
+            LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+
+    if (logicalTS <= prevLogicalTS.ltimestamp) {
+        logicalTS = prevLogicalTS.ltimestamp + 1;
+        LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, nTime, prevLogicalTS.ltimestamp, logicalTS);
+    }
+
+    batch.Write(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexKey(logicalTS, hashBlock)), 0);
+    batch.Write(make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(hashBlock)), CTimestampBlockIndexValue(logicalTS));
 }
 
 bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
 
+    SyncIndexWrites();
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
@@ -668,14 +1154,9 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
-}
-
 bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) const {
 
+    SyncIndexWrites();
     CTimestampBlockIndexValue(lts);
     if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
 	return false;
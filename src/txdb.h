@@ -24,12 +24,19 @@
 #include "coins.h"
 #include "dbwrapper.h"
 
+#include <deque>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 #include <univalue.h>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 class CBlockFileInfo;
 class CBlockIndex;
 class CDiskBlockIndex;
@@ -39,20 +46,116 @@ struct CAddressUnspentValue;
 struct CAddressIndexKey;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
+struct CAddressIndexIteratorKeyCompare;
+struct CAddressBalanceValue;
+struct CCIndexKey;
+struct CCIndexIteratorKey;
+class COutPoint;
 struct CTimestampIndexKey;
 struct CTimestampIndexIteratorKey;
 struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct CBlockIndexUpdate;
 class uint256;
 
+typedef std::map<CAddressIndexIteratorKey, CAddressBalanceValue, CAddressIndexIteratorKeyCompare> CAddressBalanceMap;
+
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! max. threads used to scan the address indexes for a snapshot
+static const int MAX_SNAPSHOT_WORKERS = 16;
+//! called for each entry an address index scan finds, returning false ends the scan
+typedef std::function<bool(const CAddressIndexKey&, CAmount)> AddressIndexVisitor;
+//! called for each entry an address unspent index scan finds, returning false ends the scan
+typedef std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> AddressUnspentVisitor;
+
+//! max. number of blocks whose index changes wait for the background writer
+static const unsigned int MAX_INDEX_WRITE_LAG = 64;
+
+/**
+ * Index changes of one or more blocks, kept sorted by serialized key so that a later
+ * block's change of a key replaces an earlier one before anything reaches leveldb.
+ * Reads through the batch see its changes
+ */
+class CIndexBatch
+{
+private:
+    const CDBWrapper &db;
+    //! serialized key -> (true, serialized value) or (false, "") when erased
+    std::map<std::string, std::pair<bool, std::string> > changes;
+    size_t nBytes;
+
+    template <typename T>
+    static std::string Serialized(const T& obj)
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << obj;
+        return std::string(ss.begin(), ss.end());
+    }
+
+    void Set(const std::string &key, bool fWrite, const std::string &value)
+    {
+        std::pair<bool, std::string> &entry = changes[key];
+        nBytes += key.size() + value.size();
+        entry.first = fWrite;
+        entry.second = value;
+    }
+
+public:
+    CIndexBatch(const CDBWrapper &dbIn) : db(dbIn), nBytes(0) {}
+
+    template <typename K, typename V>
+    void Write(const K& key, const V& value)
+    {
+        Set(Serialized(key), true, Serialized(value));
+    }
+
+    template <typename K>
+    void Erase(const K& key)
+    {
+        Set(Serialized(key), false, std::string());
+    }
+
+    template <typename K, typename V>
+    bool Read(const K& key, V& value) const
+    {
+        std::map<std::string, std::pair<bool, std::string> >::const_iterator it = changes.find(Serialized(key));
+        if (it == changes.end())
+            return db.Read(key, value);
+        if (!it->second.first)
+            return false;
+        try {
+            CDataStream ssValue(it->second.second.data(), it->second.second.data() + it->second.second.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> value;
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
+    bool Empty() const { return changes.empty(); }
+    //! number of distinct keys changed
+    size_t Size() const { return changes.size(); }
+    //! bytes of all changes made, replaced ones included
+    size_t Bytes() const { return nBytes; }
+
+    //! Add the changes to a leveldb batch, in key order
+    void Fill(CDBBatch &batch) const
+    {
+        for (std::map<std::string, std::pair<bool, std::string> >::const_iterator it = changes.begin(); it != changes.end(); it++) {
+            if (it->second.first)
+                batch.WriteRaw(it->first, it->second.second);
+            else
+                batch.EraseRaw(it->first);
+        }
+    }
+};
 
 /** 
  * CCoinsView backed by the coin database (chainstate/) 
@@ -80,6 +183,12 @@ public:
      * @returns true if the txid exists in the database
      */
     bool HaveCoins(const uint256 &txid) const;
+    /****
+     * Add nLockTime to the coins records written before it was stored, looking each
+     * transaction up once. A no-op once done, and for chainstates created since.
+     * @returns true on success
+     */
+    bool UpgradeLockTimes();
     uint256 GetBestBlock() const;
     uint256 GetBestAnchor(ShieldedType type) const;
     bool BatchWrite(CCoinsMap &mapCoins,
@@ -102,6 +211,7 @@ public:
  * - spent index
  * - unspent index
  * - address / amount
+ * - address / balance, with the balance changes of each block
  * - timestamp index
  * - block hash / timestamp index
  */
@@ -118,10 +228,105 @@ public:
      * @param maxOpenFiles leveldb max open files
      */
     CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = true, int maxOpenFiles = 1000);
+    /****
+     * dtor, waits for the queued index changes to be written
+     */
+    ~CBlockTreeDB();
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    // index changes waiting for (or being written by) the background writer, oldest first
+    mutable boost::mutex csIndexWriter;
+    mutable boost::condition_variable condIndexWriter;
+    std::deque<std::shared_ptr<const CBlockIndexUpdate> > indexQueue;
+    bool fIndexWriteFailed;
+    bool fStopIndexWriter;
+    boost::thread indexWriter;
+
+    void IndexWriterThread();
+    /****
+     * Add the index changes of a block to a batch
+     * @param batch where the changes go
+     * @param update the changes
+     */
+    void ApplyIndexUpdate(CIndexBatch &batch, const CBlockIndexUpdate &update) const;
+    /****
+     * Update a batch of spent index entries
+     * @param batch where the changes go
+     * @param vect the entries to add/update
+     */
+    void UpdateSpentIndex(CIndexBatch &batch, const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) const;
+    /****
+     * Update the unspent indexes for an address
+     * @param batch where the changes go
+     * @param vect the name/value pairs
+     */
+    void UpdateAddressUnspentIndex(CIndexBatch &batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) const;
+    /****
+     * Add (or remove when disconnecting) the CC index entries of a block
+     * @param batch where the changes go
+     * @param nHeight the height of the block, the entries it spends are kept under it for the undo
+     * @param outputs the CC outputs of the block
+     * @param spends the CC outputs spent by the block, when connecting
+     * @param fUndo true when the block is disconnected
+     */
+    void UpdateCCIndex(CIndexBatch &batch, int nHeight, const std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > &outputs,
+                       const std::vector<COutPoint> &spends, bool fUndo) const;
+    /*****
+     * Write a batch of address index / amount records
+     * @param batch where the changes go
+     * @param vect a collection of address index/amount records
+     */
+    void WriteAddressIndex(CIndexBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect) const;
+    /****
+     * Remove a batch of address index / amount records
+     * @param batch where the changes go
+     * @param vect the records to erase
+     */
+    void EraseAddressIndex(CIndexBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect) const;
+    /****
+     * Apply the address balance changes of a block
+     * @param batch where the changes go
+     * @param nHeight the height of the block
+     * @param deltas the per address changes made by the block
+     * @param fUndo true to reverse the changes (block disconnected)
+     */
+    void UpdateAddressBalanceIndex(CIndexBatch &batch, int nHeight, const CAddressBalanceMap &deltas, bool fUndo) const;
+    /****
+     * Write the timestamp entries of a block, its logical timestamp follows the previous block's
+     * @param batch where the changes go
+     * @param hashBlock the block
+     * @param hashPrevBlock the previous block
+     * @param nTime the block time
+     */
+    void WriteTimestampIndex(CIndexBatch &batch, const uint256 &hashBlock, const uint256 &hashPrevBlock, unsigned int nTime) const;
 public:
+    /****
+     * Queue the index changes of a connected or disconnected block for the background writer.
+     * Changes are written in queue order, several blocks per leveldb batch, and the index
+     * readers below wait for them. Waits while MAX_INDEX_WRITE_LAG blocks are queued
+     * @param update the changes
+     * @returns false if an earlier write failed
+     */
+    bool QueueIndexUpdate(const std::shared_ptr<const CBlockIndexUpdate> &update);
+    /****
+     * Wait for the queued index changes to be written
+     * @returns false if a write failed
+     */
+    bool SyncIndexWrites() const;
+    /****
+     * Read the last block whose index changes were written
+     * @param hash the block hash
+     * @returns false if it was never recorded
+     */
+    bool ReadBestIndexedBlock(uint256 &hash) const;
+    /****
+     * Record the last block whose index changes were written
+     * @param hash the block hash
+     * @returns true on success
+     */
+    bool WriteBestIndexedBlock(const uint256 &hash);
     /***
      * Write a batch of records and sync
      * @param fileInfo the block file info records to write
@@ -183,18 +388,6 @@ public:
      * @returns true on success
      */
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) const;
-    /****
-     * Update a batch of spent index entries
-     * @param vect the entries to add/update
-     * @returns true on success
-     */
-    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
-    /****
-     * Update the unspent indexes for an address
-     * @param vect the name/value pairs
-     * @returns true on success
-     */
-    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     /****
      * Read the unspent key/value pairs for a particular address
      * @param addressHash the address
@@ -204,18 +397,25 @@ public:
      */
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
-    /*****
-     * Write a batch of address index / amount records
-     * @param vect a collection of address index/amount records
+    /****
+     * Walk the unspent outputs of an address in key (txid, output index) order, without collecting them
+     * @param addressHash the address
+     * @param type the address type
+     * @param pafter if not NULL, start after this key (resume a previous scan), which must be of the address
+     * @param fReverse true to walk from the last entry to the first
+     * @param visitor called for each entry, the scan ends when it returns false
      * @returns true on success
      */
-    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    bool ScanAddressUnspentIndex(uint160 addressHash, int type, const CAddressUnspentKey *pafter, bool fReverse,
+                                 const AddressUnspentVisitor &visitor);
     /****
-     * Remove a batch of address index / amount records
-     * @param vect the records to erase
+     * Read the unspent CC outputs matching a prefix
+     * @param prefix the address, evalcode and optionally funcid and reftxid
+     * @param vect the results
      * @returns true on success
      */
-    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    bool ReadCCIndex(const CCIndexIteratorKey &prefix,
+                     std::vector<std::pair<CCIndexKey, CAddressUnspentValue> > &vect);
     /****
      * Read a range of address index / amount records for a particular address
      * @param addressHash the address to look for
@@ -229,11 +429,49 @@ public:
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
     /****
-     * Write a timestamp entry to the db
-     * @param timestampIndex the record to write
+     * Walk the address index records of an address in height order, without collecting them
+     * @param addressHash the address
+     * @param type the address type
+     * @param start the first height, 0 for no limit
+     * @param end the last height, 0 for no limit
+     * @param pafter if not NULL, start after this key (resume a previous scan), which must be of the address
+     * @param fReverse true to walk from the highest record to the lowest
+     * @param visitor called for each record, the scan ends when it returns false
+     * @returns true on success
+     */
+    bool ScanAddressIndex(uint160 addressHash, int type, int start, int end, const CAddressIndexKey *pafter,
+                          bool fReverse, const AddressIndexVisitor &visitor);
+    /****
+     * Read the address balance changes recorded for a block
+     * @param nHeight the height of the block
+     * @param deltas the results
+     * @returns true if a record exists for this height
+     */
+    bool ReadAddressBalanceDeltas(int nHeight, CAddressBalanceMap &deltas) const;
+    /****
+     * Read the balance of a particular address
+     * @param addressHash the address
+     * @param type the address type
+     * @param value the result
+     * @returns true if the address has a balance
+     */
+    bool ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) const;
+    /****
+     * Sum the address unspent index or read the address balance index, split
+     * over several threads that each handle a range of the address keyspace
+     * @param fUnspentIndex true to sum the unspent index, false to read the balance index
+     * @param nWorkers number of threads (0 for one per core)
+     * @param balances the per address results, in no particular order
+     * @param nEntries the number of index entries read
+     * @returns true on success
+     */
+    bool ScanAddressBalances(bool fUnspentIndex, int nWorkers,
+            std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > &balances, int64_t &nEntries);
+    /****
+     * (Re)build the address balance index from the address unspent index
      * @returns true on success
      */
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
+    bool RebuildAddressBalanceIndex();
     /****
      * Read the timestamp entry from the db
      * @param high ending timestamp (most recent)
@@ -244,13 +482,6 @@ public:
      */
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, 
             std::vector<std::pair<uint256, unsigned int> > &vect);
-    /****
-     * Write a block hash / timestamp record
-     * @param blockhashIndex the key (the hash)
-     * @param logicalts the value (the timestamp)
-     * @returns true on success
-     */
-    bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     /*****
      * Given a hash, find its timestamp
      * @param hash the hash (the key)
@@ -287,16 +518,29 @@ public:
     /****
      * Get a snapshot
      * @param top max number of results, sorted by amount descending (aka richlist)
+     * @param nWorkers number of threads used to scan the index (0 for one per core)
      * @returns the data ( a collection of (addr, amount, segid) )
      */
-    UniValue Snapshot(int top);
+    UniValue Snapshot(int top, int nWorkers = 0);
     /****
      * Get a snapshot
      * @param addressAmounts the results
      * @param ret results summary (passing nullptr skips compiling this summary)
+     * @param undo balance changes to take back out of the current balances (nullptr for the tip)
+     * @param nWorkers number of threads used to scan the index (0 for one per core)
+     * @returns true on success
+     */
+    bool Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret, const CAddressBalanceMap *undo = nullptr, int nWorkers = 0);
+    /****
+     * Get a snapshot keyed by the binary address, the addresses are not encoded
+     * @param vbalances the (amount, address) results, unsorted
+     * @param ret results summary (passing nullptr skips compiling this summary)
+     * @param undo balance changes to take back out of the current balances (nullptr for the tip)
+     * @param nWorkers number of threads used to scan the index (0 for one per core)
      * @returns true on success
      */
-    bool Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret);
+    bool SnapshotBalances(std::vector<std::pair<CAmount, CAddressIndexIteratorKey> > &vbalances, UniValue *ret,
+            const CAddressBalanceMap *undo = nullptr, int nWorkers = 0);
 };
 
 #endif // BITCOIN_TXDB_H
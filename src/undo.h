@@ -14,8 +14,13 @@
  *
  *  Contains the prevout's CTxOut being spent, and if this was the
  *  last output of the affected transaction, its metadata as well
- *  (coinbase or not, height, transaction version)
+ *  (coinbase or not, height, transaction version, locktime)
+ *
+ *  The locktime is only written when the coins had it, flagged by the top bit of
+ *  the header code so that undo data written before it existed still reads.
  */
+static const unsigned int TXINUNDO_LOCKTIME_FLAG = 0x80000000;
+
 class CTxInUndo
 {
 public:
@@ -23,15 +28,20 @@ public:
     bool fCoinBase;       // if the outpoint was the last unspent: whether it belonged to a coinbase
     unsigned int nHeight; // if the outpoint was the last unspent: its height
     int nVersion;         // if the outpoint was the last unspent: its version
+    uint32_t nLockTime;   // if the outpoint was the last unspent and fHaveLockTime: its locktime
+    bool fHaveLockTime;
 
-    CTxInUndo() : txout(), fCoinBase(false), nHeight(0), nVersion(0) {}
-    CTxInUndo(const CTxOut &txoutIn, bool fCoinBaseIn = false, unsigned int nHeightIn = 0, int nVersionIn = 0) : txout(txoutIn), fCoinBase(fCoinBaseIn), nHeight(nHeightIn), nVersion(nVersionIn) { }
+    CTxInUndo() : txout(), fCoinBase(false), nHeight(0), nVersion(0), nLockTime(0), fHaveLockTime(false) {}
+    CTxInUndo(const CTxOut &txoutIn, bool fCoinBaseIn = false, unsigned int nHeightIn = 0, int nVersionIn = 0) : txout(txoutIn), fCoinBase(fCoinBaseIn), nHeight(nHeightIn), nVersion(nVersionIn), nLockTime(0), fHaveLockTime(false) { }
 
     template<typename Stream>
     void Serialize(Stream &s) const {
-        ::Serialize(s, VARINT(nHeight*2+(fCoinBase ? 1 : 0)));
+        bool fLockTime = nHeight > 0 && fHaveLockTime;
+        ::Serialize(s, VARINT(nHeight*2+(fCoinBase ? 1 : 0)+(fLockTime ? TXINUNDO_LOCKTIME_FLAG : 0)));
         if (nHeight > 0)
             ::Serialize(s, VARINT(this->nVersion));
+        if (fLockTime)
+            ::Serialize(s, VARINT(this->nLockTime));
         ::Serialize(s, CTxOutCompressor(REF(txout)));
     }
 
@@ -39,10 +49,15 @@ public:
     void Unserialize(Stream &s) {
         unsigned int nCode = 0;
         ::Unserialize(s, VARINT(nCode));
+        fHaveLockTime = (nCode & TXINUNDO_LOCKTIME_FLAG) != 0;
+        nCode &= ~TXINUNDO_LOCKTIME_FLAG;
         nHeight = nCode / 2;
         fCoinBase = nCode & 1;
         if (nHeight > 0)
             ::Unserialize(s, VARINT(this->nVersion));
+        nLockTime = 0;
+        if (fHaveLockTime)
+            ::Unserialize(s, VARINT(this->nLockTime));
         ::Unserialize(s, REF(CTxOutCompressor(REF(txout))));
     }
 };
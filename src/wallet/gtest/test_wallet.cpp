@@ -8,6 +8,7 @@
 #include "main.h"
 #include "primitives/block.h"
 #include "random.h"
+#include "script/script_ext.h"
 #include "transaction_builder.h"
 #include "utiltest.h"
 #include "wallet/wallet.h"
@@ -45,6 +46,8 @@ class TestWallet : public CWallet {
 public:
     TestWallet() : CWallet() { }
 
+    using CWallet::FindMySaplingNotes;
+
     bool EncryptKeys(CKeyingMaterial& vMasterKeyIn) {
         return CCryptoKeyStore::EncryptKeys(vMasterKeyIn);
     }
@@ -71,6 +74,10 @@ public:
     void MarkAffectedTransactionsDirty(const CTransaction& tx) {
         CWallet::MarkAffectedTransactionsDirty(tx);
     }
+    void SetScanning(bool fScanning, int nHeight) {
+        fScanningWallet = fScanning;
+        nScanHeight = nHeight;
+    }
 };
 
 CWalletTx GetValidReceive(const libzcash::SproutSpendingKey& sk, CAmount value, bool randomInputs, int32_t version = 2) {
@@ -579,6 +586,107 @@ TEST(WalletTests, FindMySaplingNotesWithIvkOnly) {
     UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
 }
 
+// An address of ivk other than defaultAddr
+static libzcash::SaplingPaymentAddress DiversifiedAddress(const libzcash::SaplingIncomingViewingKey& ivk,
+                                                          const libzcash::SaplingPaymentAddress& defaultAddr) {
+    libzcash::diversifier_t d = {0};
+    for (int i = 1; i < 256; i++) {
+        d[0] = i;
+        auto addr = ivk.address(d);
+        if (addr && !(addr.get() == defaultAddr))
+            return addr.get();
+    }
+    ADD_FAILURE() << "no valid diversifier";
+    return defaultAddr;
+}
+
+// A transaction spending a note of sk to addr, with the change back to sk's default address
+static CTransaction GetSaplingPayment(const Consensus::Params& consensusParams,
+                                      const libzcash::SaplingExtendedSpendingKey& sk,
+                                      const libzcash::SaplingPaymentAddress& addr) {
+    libzcash::SaplingNote note(sk.DefaultAddress(), 50000);
+    SaplingMerkleTree tree;
+    tree.append(note.cm().get());
+    auto builder = TransactionBuilder(consensusParams, 1);
+    EXPECT_TRUE(builder.AddSaplingSpend(sk.expsk, note, tree.root(), tree.witness()));
+    builder.AddSaplingOutput(sk.expsk.full_viewing_key().ovk, addr, 25000, {});
+    auto maybe_tx = builder.Build();
+    EXPECT_TRUE(static_cast<bool>(maybe_tx));
+    return maybe_tx.get();
+}
+
+TEST(WalletTests, FindMySaplingNotesInBatches) {
+    SelectParams(CBaseChainParams::REGTEST);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_SAPLING, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    auto consensusParams = Params().GetConsensus();
+
+    // a spending key, and a key the wallet only has the incoming viewing key of
+    std::vector<unsigned char, secure_allocator<unsigned char>> rawSeed(32);
+    HDSeed seed(rawSeed);
+    auto sk = libzcash::SaplingExtendedSpendingKey::Master(seed);
+    rawSeed[0] = 1;
+    HDSeed seed2(rawSeed);
+    auto sk2 = libzcash::SaplingExtendedSpendingKey::Master(seed2);
+    auto ivk = sk.expsk.full_viewing_key().in_viewing_key();
+    auto ivk2 = sk2.expsk.full_viewing_key().in_viewing_key();
+
+    // payments to addresses of the keys the wallet has not seen yet
+    auto addr = DiversifiedAddress(ivk, sk.DefaultAddress());
+    auto addr2 = DiversifiedAddress(ivk2, sk2.DefaultAddress());
+    CTransaction tx = GetSaplingPayment(consensusParams, sk, addr);
+    CTransaction tx2 = GetSaplingPayment(consensusParams, sk2, addr2);
+    CTransaction transparent;
+
+    {
+        TestWallet wallet;
+        ASSERT_TRUE(wallet.AddSaplingZKey(sk, sk.DefaultAddress()));
+        ASSERT_TRUE(wallet.AddSaplingIncomingViewingKey(ivk2, sk2.DefaultAddress()));
+
+        std::vector<const CTransaction*> vtx {&tx, &transparent, &tx2};
+        auto vNotes = wallet.FindMySaplingNotes(vtx, 4);
+        ASSERT_EQ(vtx.size(), vNotes.size());
+        for (size_t n = 0; n < vtx.size(); n++) {
+            auto single = wallet.FindMySaplingNotes(*vtx[n]);
+            EXPECT_TRUE(single.first == vNotes[n].first) << "transaction " << n;
+            EXPECT_TRUE(single.second == vNotes[n].second) << "transaction " << n;
+        }
+        EXPECT_EQ(2, vNotes[0].first.size());
+        EXPECT_EQ(0, vNotes[1].first.size());
+        EXPECT_EQ(2, vNotes[2].first.size());
+
+        // ivk is also an incoming viewing key of the wallet, through the default address of sk,
+        // it is still tried as the full viewing key's so the new address is added
+        ASSERT_EQ(1, vNotes[0].second.size());
+        EXPECT_EQ(ivk, vNotes[0].second[addr]);
+        for (auto& item : vNotes[0].first)
+            EXPECT_EQ(ivk, item.second.ivk);
+        // an incoming viewing key alone adds no addresses
+        EXPECT_EQ(0, vNotes[2].second.size());
+    }
+
+    {
+        TestWallet wallet;
+        LOCK(wallet.cs_wallet);
+        ASSERT_TRUE(wallet.AddSaplingZKey(sk, sk.DefaultAddress()));
+
+        CBlock block;
+        block.vtx.push_back(tx);
+        block.vtx.push_back(tx2);
+        EXPECT_EQ(2, wallet.FindMySaplingNotes(tx, &block).first.size());
+        EXPECT_EQ(0, wallet.FindMySaplingNotes(tx2, &block).first.size());
+
+        // a key added while the block is applied starts the block trial over
+        ASSERT_TRUE(wallet.AddSaplingIncomingViewingKey(ivk2, sk2.DefaultAddress()));
+        EXPECT_EQ(2, wallet.FindMySaplingNotes(tx2, &block).first.size());
+        EXPECT_EQ(2, wallet.FindMySaplingNotes(tx, &block).first.size());
+    }
+
+    // Revert to default
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_SAPLING, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+}
+
 TEST(WalletTests, FindMySproutNotes) {
     CWallet wallet;
 
@@ -2160,3 +2268,184 @@ TEST(WalletTests, SaplingNoteLocking) {
     EXPECT_FALSE(wallet.IsLockedNote(sop1));
     EXPECT_FALSE(wallet.IsLockedNote(sop2));
 }
+
+TEST(WalletTests, AvailableCoinsFollowsSpends) {
+    CWallet wallet;
+    LOCK2(cs_main, wallet.cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    wallet.AddKeyPubKey(key, key.GetPubKey());
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptWatched = CScript() << OP_TRUE;
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vout.push_back(CTxOut(5 * COIN, scriptMine));
+    mtx.vout.push_back(CTxOut(5 * COIN, scriptWatched));
+    CWalletTx wtx(&wallet, mtx);
+
+    CMutableTransaction mspend;
+    mspend.vin.resize(1);
+    mspend.vin[0].prevout = COutPoint(wtx.GetHash(), 0);
+    mspend.vout.push_back(CTxOut(4 * COIN, CScript() << OP_FALSE));
+    CWalletTx wtx2(&wallet, mspend);
+
+    // Fake-mine the receive, then the spend on top of it
+    EXPECT_EQ(-1, chainActive.Height());
+    CBlock block;
+    block.vtx.push_back(wtx);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    auto blockHash = block.GetHash();
+    CBlockIndex fakeIndex {block};
+    mapBlockIndex.insert(std::make_pair(blockHash, &fakeIndex));
+    chainActive.SetTip(&fakeIndex);
+
+    CBlock block2;
+    block2.hashPrevBlock = blockHash;
+    block2.vtx.push_back(wtx2);
+    block2.hashMerkleRoot = block2.BuildMerkleTree();
+    auto blockHash2 = block2.GetHash();
+    CBlockIndex fakeIndex2 {block2};
+    fakeIndex2.pprev = &fakeIndex;
+    fakeIndex2.nHeight = 1;
+    mapBlockIndex.insert(std::make_pair(blockHash2, &fakeIndex2));
+
+    std::vector<COutput> vCoins;
+    wtx.SetMerkleBranch(block);
+    wallet.AddToWallet(wtx, true, NULL);
+    wallet.AvailableCoins(vCoins, false);
+    ASSERT_EQ(1, vCoins.size());
+    EXPECT_EQ(0, vCoins[0].i);
+
+    chainActive.SetTip(&fakeIndex2);
+    wtx2.SetMerkleBranch(block2);
+    wallet.AddToWallet(wtx2, true, NULL);
+    wallet.AvailableCoins(vCoins, false);
+    EXPECT_EQ(0, vCoins.size());
+
+    // Watching the other output brings the spent transaction back
+    wallet.AddWatchOnly(scriptWatched);
+    wallet.AvailableCoins(vCoins, false);
+    ASSERT_EQ(1, vCoins.size());
+    EXPECT_EQ(1, vCoins[0].i);
+
+    // The spend leaves the chain and gives its output back
+    chainActive.SetTip(&fakeIndex);
+    wallet.AddToWallet(wtx2, true, NULL);
+    wallet.AvailableCoins(vCoins, false);
+    EXPECT_EQ(2, vCoins.size());
+
+    // Tear down
+    chainActive.SetTip(NULL);
+    mapBlockIndex.erase(blockHash);
+    mapBlockIndex.erase(blockHash2);
+}
+
+TEST(WalletTests, ScanKeysMatchIsMine) {
+    TestWallet wallet;
+    LOCK(wallet.cs_wallet);
+
+    CKey key, watched, other;
+    key.MakeNewKey(true);
+    watched.MakeNewKey(true);
+    other.MakeNewKey(true);
+    wallet.AddKeyPubKey(key, key.GetPubKey());
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptWatched = GetScriptForDestination(watched.GetPubKey().GetID());
+    wallet.AddWatchOnly(scriptWatched);
+    wallet.AddCScript(scriptMine);
+
+    // a timelocked coinbase output, its script only in the opret that follows it
+    CScriptExt timelock;
+    timelock.AddCheckLockTimeVerify(1000);
+    timelock += scriptMine;
+
+    CMutableTransaction mtx;
+    mtx.vout.push_back(CTxOut(1, scriptMine));
+    mtx.vout.push_back(CTxOut(1, GetScriptForDestination(CScriptID(scriptMine))));
+    mtx.vout.push_back(CTxOut(1, CScriptExt().PayToScriptHash(CScriptID(timelock))));
+    mtx.vout.push_back(CTxOut(0, CScriptExt().OpReturnScript(timelock, OPRETTYPE_TIMELOCK)));
+    mtx.vout.push_back(CTxOut(1, scriptWatched));
+    mtx.vout.push_back(CTxOut(1, GetScriptForDestination(other.GetPubKey().GetID())));
+    mtx.vout.push_back(CTxOut(1, GetScriptForDestination(CScriptID(GetScriptForDestination(other.GetPubKey().GetID())))));
+    CTransaction tx(mtx);
+
+    CWalletScanKeys keys(wallet);
+    std::vector<isminetype> expected = { ISMINE_SPENDABLE, ISMINE_SPENDABLE, ISMINE_SPENDABLE, ISMINE_NO,
+                                         ISMINE_WATCH_ONLY, ISMINE_NO, ISMINE_NO };
+    ASSERT_EQ(expected.size(), tx.vout.size());
+    for (uint32_t i = 0; i < tx.vout.size(); i++) {
+        EXPECT_EQ(expected[i], ::IsMine(keys, tx, i, NULL)) << "output " << i;
+        EXPECT_EQ(expected[i], wallet.IsMine(tx, i)) << "output " << i;
+    }
+
+    // the wallet learnt the timelock script, the copy is left as it was
+    EXPECT_TRUE(wallet.HaveCScript(CScriptID(timelock)));
+    EXPECT_FALSE(keys.HaveCScript(CScriptID(timelock)));
+    EXPECT_EQ(1U, keys.ScriptCount());
+
+    // so a later payment to it without the opret is only seen by the wallet, which the rescan checks for
+    CMutableTransaction mpay;
+    mpay.vout.push_back(CTxOut(1, CScriptExt().PayToScriptHash(CScriptID(timelock))));
+    CTransaction pay(mpay);
+    EXPECT_EQ(ISMINE_NO, ::IsMine(keys, pay, 0, NULL));
+    EXPECT_EQ(ISMINE_SPENDABLE, wallet.IsMine(pay, 0));
+    EXPECT_EQ(ISMINE_SPENDABLE, ::IsMine(CWalletScanKeys(wallet), pay, 0, NULL));
+}
+
+TEST(WalletTests, ChainTipLeavesBlocksAboveARescan) {
+    TestWallet wallet;
+    SproutMerkleTree sproutTree0, sproutTree;
+    SaplingMerkleTree saplingTree0, saplingTree;
+
+    auto sk = libzcash::SproutSpendingKey::random();
+    wallet.AddSproutSpendingKey(sk);
+
+    CBlock block1;
+    CBlockIndex index1(block1);
+    index1.nHeight = 1;
+    auto outpts = CreateValidBlock(wallet, sk, index1, block1, sproutTree, saplingTree);
+
+    std::vector<JSOutPoint> sproutNotes {outpts.first};
+    std::vector<SaplingOutPoint> saplingNotes {outpts.second};
+    std::vector<boost::optional<SproutWitness>> sproutWitnesses;
+    std::vector<boost::optional<SaplingWitness>> saplingWitnesses;
+    auto anchors1 = GetWitnessesAndAnchors(wallet, sproutNotes, saplingNotes, sproutWitnesses, saplingWitnesses);
+
+    CBlock block2;
+    block2.hashPrevBlock = block1.GetHash();
+    block2.vtx.push_back(GetValidReceive(sk, 50, true, 4));
+    CBlockIndex index2(block2);
+    index2.nHeight = 2;
+
+    // a rescan that has applied block 1 increments block 2 itself when it gets there
+    wallet.SetScanning(true, 1);
+    wallet.ChainTip(&index2, &block2, sproutTree, saplingTree, true);
+    auto anchors2 = GetWitnessesAndAnchors(wallet, sproutNotes, saplingNotes, sproutWitnesses, saplingWitnesses);
+    EXPECT_EQ(anchors1.first, anchors2.first);
+    EXPECT_EQ(1, wallet.ScanningHeight());
+
+    // nor is the best chain written while the witnesses are behind it
+    MockWalletDB walletdb;
+    CBlockLocator loc;
+    EXPECT_CALL(walletdb, TxnBegin()).Times(0);
+    wallet.SetBestChain(walletdb, loc);
+
+    // disconnecting block 1 sends the rescan back below it
+    wallet.ChainTip(&index1, &block1, sproutTree0, saplingTree0, false);
+    EXPECT_EQ(0, wallet.ScanningHeight());
+    GetWitnessesAndAnchors(wallet, sproutNotes, saplingNotes, sproutWitnesses, saplingWitnesses);
+    EXPECT_FALSE((bool) sproutWitnesses[0]);
+
+    // without a rescan the tip goes straight to the witnesses
+    wallet.SetScanning(false, -1);
+    wallet.ChainTip(&index1, &block1, sproutTree0, saplingTree0, true);
+    auto anchors3 = GetWitnessesAndAnchors(wallet, sproutNotes, saplingNotes, sproutWitnesses, saplingWitnesses);
+    EXPECT_EQ(anchors1.first, anchors3.first);
+    wallet.ChainTip(&index2, &block2, sproutTree, saplingTree, true);
+    auto anchors4 = GetWitnessesAndAnchors(wallet, sproutNotes, saplingNotes, sproutWitnesses, saplingWitnesses);
+    EXPECT_NE(anchors1.first, anchors4.first);
+    EXPECT_TRUE((bool) sproutWitnesses[0]);
+}
@@ -2720,6 +2720,13 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"unlocked_until\": ttt,      (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
             "  \"paytxfee\": x.xxxx,         (numeric) the transaction fee configuration, set in " + CURRENCY_UNIT + "/kB\n"
             "  \"seedfp\": \"uint256\",        (string) the BLAKE2b-256 hash of the HD seed\n"
+            "  \"scanning\":                 (json object) current rescan details, or false if no rescan is in progress\n"
+            "    {\n"
+            "      \"duration\": xxxx,          (numeric) elapsed seconds since the rescan started\n"
+            "      \"progress\": x.xxxx,        (numeric) rescan progress [0.0, 1.0]\n"
+            "      \"height\": xxxx,            (numeric) height of the last block rescanned\n"
+            "      \"blocks_per_second\": x.x,  (numeric) blocks rescanned per second since the rescan started\n"
+            "    }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
@@ -2742,6 +2749,16 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     uint256 seedFp = pwalletMain->GetHDChain().seedFp;
     if (!seedFp.IsNull())
          obj.push_back(Pair("seedfp", seedFp.GetHex()));
+    if (pwalletMain->IsScanning()) {
+        UniValue scanning(UniValue::VOBJ);
+        scanning.push_back(Pair("duration", pwalletMain->ScanningDuration() / 1000));
+        scanning.push_back(Pair("progress", pwalletMain->ScanningProgress()));
+        scanning.push_back(Pair("height", pwalletMain->ScanningHeight()));
+        scanning.push_back(Pair("blocks_per_second", pwalletMain->ScanningBlocksPerSecond()));
+        obj.push_back(Pair("scanning", scanning));
+    } else {
+        obj.push_back(Pair("scanning", false));
+    }
     return obj;
 }
 
@@ -2892,7 +2909,7 @@ UniValue listunspent(const UniValue& params, bool fHelp, const CPubKey& mypk)
             uint64_t interest; uint32_t locktime;
             if ( pindex != 0 && (tipindex= chainActive.Tip()) != 0 )
             {
-                interest = komodo_accrued_interest(&txheight,&locktime,out.tx->GetHash(),out.i,0,nValue,(int32_t)tipindex->nHeight);
+                interest = pwalletMain->GetAccruedInterest(COutPoint(out.tx->GetHash(),out.i),nValue,txheight,locktime);
                 //interest = komodo_interest(txheight,nValue,out.tx->nLockTime,tipindex->nTime);
                 entry.push_back(Pair("interest",ValueFromAmount(interest)));
             }
@@ -2933,7 +2950,7 @@ uint64_t komodo_interestsum()
                 CBlockIndex *tipindex,*pindex = it->second;
                 if ( pindex != 0 && (tipindex= chainActive.Tip()) != 0 )
                 {
-                    interest = komodo_accrued_interest(&txheight,&locktime,out.tx->GetHash(),out.i,0,nValue,(int32_t)tipindex->nHeight);
+                    interest = pwalletMain->GetAccruedInterest(COutPoint(out.tx->GetHash(),out.i),nValue,txheight,locktime);
                     sum += interest;
                 }
             }
@@ -3295,6 +3312,17 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
         } else if (benchmarktype == "trydecryptnotes") {
             int nAddrs = params[2].get_int();
             sample_times.push_back(benchmark_try_decrypt_notes(nAddrs));
+        } else if (benchmarktype == "trydecryptsaplingnotes") {
+            int nAddrs = params[2].get_int();
+            int nOutputs = 100;
+            int nThreads = std::max(1, nScriptCheckThreads);
+            if (params.size() >= 4) {
+                nOutputs = params[3].get_int();
+            }
+            if (params.size() >= 5) {
+                nThreads = params[4].get_int();
+            }
+            sample_times.push_back(benchmark_try_decrypt_sapling_notes(nAddrs, nOutputs, nThreads));
         } else if (benchmarktype == "incnotewitnesses") {
             int nTxs = params[2].get_int();
             sample_times.push_back(benchmark_increment_note_witnesses(nTxs));
@@ -3324,6 +3352,12 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
             sample_times.push_back(benchmark_verify_sapling_spend());
         } else if (benchmarktype == "verifysaplingoutput") {
             sample_times.push_back(benchmark_verify_sapling_output());
+        } else if (benchmarktype == "decodeccoprets" || benchmarktype == "unmarshalccoprets") {
+            int nOprets = 10000;
+            if (params.size() >= 3) {
+                nOprets = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_decode_cc_oprets(nOprets, benchmarktype == "unmarshalccoprets"));
         } else {
             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid benchmarktype");
         }
@@ -7876,77 +7910,77 @@ extern UniValue z_getpaymentdisclosure(const UniValue& params, bool fHelp, const
 extern UniValue z_validatepaymentdisclosure(const UniValue& params, bool fHelp, const CPubKey& mypk);
 
 static const CRPCCommand commands[] =
-{ //  category              name                        actor (function)           okSafeMode
-    //  --------------------- ------------------------    -----------------------    ----------
-    { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false },
-    { "hidden",             "resendwallettransactions", &resendwallettransactions, true  },
-    { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true  },
-    { "wallet",             "backupwallet",             &backupwallet,             true  },
-    { "wallet",             "dumpprivkey",              &dumpprivkey,              true  },
-    { "wallet",             "dumpwallet",               &dumpwallet,               true  },
-    { "wallet",             "encryptwallet",            &encryptwallet,            true  },
-    { "wallet",             "getaccountaddress",        &getaccountaddress,        true  },
-    { "wallet",             "getaccount",               &getaccount,               true  },
-    { "wallet",             "getaddressesbyaccount",    &getaddressesbyaccount,    true  },
-    { "wallet",             "getbalance",               &getbalance,               false },
-    { "wallet",             "getnewaddress",            &getnewaddress,            true  },
-    { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true  },
-    { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false },
-    { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false },
-    { "wallet",             "gettransaction",           &gettransaction,           false },
-    { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false },
-    { "wallet",             "getwalletinfo",            &getwalletinfo,            false },
-    { "wallet",             "convertpassphrase",        &convertpassphrase,        true  },
-    { "wallet",             "importprivkey",            &importprivkey,            true  },
-    { "wallet",             "importwallet",             &importwallet,             true  },
-    { "wallet",             "importaddress",            &importaddress,            true  },
-    { "wallet",             "keypoolrefill",            &keypoolrefill,            true  },
-    { "wallet",             "listaccounts",             &listaccounts,             false },
-    { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false },
-    { "wallet",             "listlockunspent",          &listlockunspent,          false },
-    { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false },
-    { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false },
-    { "wallet",             "listsinceblock",           &listsinceblock,           false },
-    { "wallet",             "listtransactions",         &listtransactions,         false },
-    { "wallet",             "listunspent",              &listunspent,              false },
-    { "wallet",             "lockunspent",              &lockunspent,              true  },
-    { "wallet",             "move",                     &movecmd,                  false },
-    { "wallet",             "sendfrom",                 &sendfrom,                 false },
-    { "wallet",             "sendmany",                 &sendmany,                 false },
-    { "wallet",             "sendtoaddress",            &sendtoaddress,            false },
-    { "wallet",             "setaccount",               &setaccount,               true  },
-    { "wallet",             "settxfee",                 &settxfee,                 true  },
-    { "wallet",             "signmessage",              &signmessage,              true  },
-    { "wallet",             "walletlock",               &walletlock,               true  },
-    { "wallet",             "walletpassphrasechange",   &walletpassphrasechange,   true  },
-    { "wallet",             "walletpassphrase",         &walletpassphrase,         true  },
-    { "wallet",             "zcbenchmark",              &zc_benchmark,             true  },
-    { "wallet",             "zcrawkeygen",              &zc_raw_keygen,            true  },
-    { "wallet",             "zcrawjoinsplit",           &zc_raw_joinsplit,         true  },
-    { "wallet",             "zcrawreceive",             &zc_raw_receive,           true  },
-    { "wallet",             "zcsamplejoinsplit",        &zc_sample_joinsplit,      true  },
-    { "wallet",             "z_listreceivedbyaddress",  &z_listreceivedbyaddress,  false },
-    { "wallet",             "z_listunspent",            &z_listunspent,            false },
-    { "wallet",             "z_getbalance",             &z_getbalance,             false },
-    { "wallet",             "z_gettotalbalance",        &z_gettotalbalance,        false },
-    { "wallet",             "z_mergetoaddress",         &z_mergetoaddress,         false },
-    { "wallet",             "z_sendmany",               &z_sendmany,               false },
-    { "wallet",             "z_shieldcoinbase",         &z_shieldcoinbase,         false },
-    { "wallet",             "z_getoperationstatus",     &z_getoperationstatus,     true  },
-    { "wallet",             "z_getoperationresult",     &z_getoperationresult,     true  },
-    { "wallet",             "z_listoperationids",       &z_listoperationids,       true  },
-    { "wallet",             "z_getnewaddress",          &z_getnewaddress,          true  },
-    { "wallet",             "z_listaddresses",          &z_listaddresses,          true  },
-    { "wallet",             "z_exportkey",              &z_exportkey,              true  },
-    { "wallet",             "z_importkey",              &z_importkey,              true  },
-    { "wallet",             "z_exportviewingkey",       &z_exportviewingkey,       true  },
-    { "wallet",             "z_importviewingkey",       &z_importviewingkey,       true  },
-    { "wallet",             "z_exportwallet",           &z_exportwallet,           true  },
-    { "wallet",             "z_importwallet",           &z_importwallet,           true  },
-    { "wallet",             "z_viewtransaction",        &z_viewtransaction,        true  },
+{ //  category              name                        actor (function)           okSafeMode concurrent
+    //  --------------------- ------------------------    -----------------------    ---------- ----------
+    { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false, false },
+    { "hidden",             "resendwallettransactions", &resendwallettransactions, true,  false },
+    { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true,  false },
+    { "wallet",             "backupwallet",             &backupwallet,             true,  false },
+    { "wallet",             "dumpprivkey",              &dumpprivkey,              true,  false },
+    { "wallet",             "dumpwallet",               &dumpwallet,               true,  false },
+    { "wallet",             "encryptwallet",            &encryptwallet,            true,  false },
+    { "wallet",             "getaccountaddress",        &getaccountaddress,        true,  false },
+    { "wallet",             "getaccount",               &getaccount,               true,  false },
+    { "wallet",             "getaddressesbyaccount",    &getaddressesbyaccount,    true,  false },
+    { "wallet",             "getbalance",               &getbalance,               false, false },
+    { "wallet",             "getnewaddress",            &getnewaddress,            true,  false },
+    { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true,  false },
+    { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false, false },
+    { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false, false },
+    { "wallet",             "gettransaction",           &gettransaction,           false, false },
+    { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false, false },
+    { "wallet",             "getwalletinfo",            &getwalletinfo,            false, false },
+    { "wallet",             "convertpassphrase",        &convertpassphrase,        true,  false },
+    { "wallet",             "importprivkey",            &importprivkey,            true,  false },
+    { "wallet",             "importwallet",             &importwallet,             true,  false },
+    { "wallet",             "importaddress",            &importaddress,            true,  false },
+    { "wallet",             "keypoolrefill",            &keypoolrefill,            true,  false },
+    { "wallet",             "listaccounts",             &listaccounts,             false, false },
+    { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false, false },
+    { "wallet",             "listlockunspent",          &listlockunspent,          false, false },
+    { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false, false },
+    { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false, false },
+    { "wallet",             "listsinceblock",           &listsinceblock,           false, false },
+    { "wallet",             "listtransactions",         &listtransactions,         false, false },
+    { "wallet",             "listunspent",              &listunspent,              false, false },
+    { "wallet",             "lockunspent",              &lockunspent,              true,  false },
+    { "wallet",             "move",                     &movecmd,                  false, false },
+    { "wallet",             "sendfrom",                 &sendfrom,                 false, false },
+    { "wallet",             "sendmany",                 &sendmany,                 false, false },
+    { "wallet",             "sendtoaddress",            &sendtoaddress,            false, false },
+    { "wallet",             "setaccount",               &setaccount,               true,  false },
+    { "wallet",             "settxfee",                 &settxfee,                 true,  false },
+    { "wallet",             "signmessage",              &signmessage,              true,  false },
+    { "wallet",             "walletlock",               &walletlock,               true,  false },
+    { "wallet",             "walletpassphrasechange",   &walletpassphrasechange,   true,  false },
+    { "wallet",             "walletpassphrase",         &walletpassphrase,         true,  false },
+    { "wallet",             "zcbenchmark",              &zc_benchmark,             true,  false },
+    { "wallet",             "zcrawkeygen",              &zc_raw_keygen,            true,  false },
+    { "wallet",             "zcrawjoinsplit",           &zc_raw_joinsplit,         true,  false },
+    { "wallet",             "zcrawreceive",             &zc_raw_receive,           true,  false },
+    { "wallet",             "zcsamplejoinsplit",        &zc_sample_joinsplit,      true,  false },
+    { "wallet",             "z_listreceivedbyaddress",  &z_listreceivedbyaddress,  false, false },
+    { "wallet",             "z_listunspent",            &z_listunspent,            false, false },
+    { "wallet",             "z_getbalance",             &z_getbalance,             false, false },
+    { "wallet",             "z_gettotalbalance",        &z_gettotalbalance,        false, false },
+    { "wallet",             "z_mergetoaddress",         &z_mergetoaddress,         false, false },
+    { "wallet",             "z_sendmany",               &z_sendmany,               false, false },
+    { "wallet",             "z_shieldcoinbase",         &z_shieldcoinbase,         false, false },
+    { "wallet",             "z_getoperationstatus",     &z_getoperationstatus,     true,  false },
+    { "wallet",             "z_getoperationresult",     &z_getoperationresult,     true,  false },
+    { "wallet",             "z_listoperationids",       &z_listoperationids,       true,  false },
+    { "wallet",             "z_getnewaddress",          &z_getnewaddress,          true,  false },
+    { "wallet",             "z_listaddresses",          &z_listaddresses,          true,  false },
+    { "wallet",             "z_exportkey",              &z_exportkey,              true,  false },
+    { "wallet",             "z_importkey",              &z_importkey,              true,  false },
+    { "wallet",             "z_exportviewingkey",       &z_exportviewingkey,       true,  false },
+    { "wallet",             "z_importviewingkey",       &z_importviewingkey,       true,  false },
+    { "wallet",             "z_exportwallet",           &z_exportwallet,           true,  false },
+    { "wallet",             "z_importwallet",           &z_importwallet,           true,  false },
+    { "wallet",             "z_viewtransaction",        &z_viewtransaction,        true,  false },
     // TODO: rearrange into another category
-    { "disclosure",         "z_getpaymentdisclosure",   &z_getpaymentdisclosure,   true  },
-    { "disclosure",         "z_validatepaymentdisclosure", &z_validatepaymentdisclosure, true }
+    { "disclosure",         "z_getpaymentdisclosure",   &z_getpaymentdisclosure,   true,  false },
+    { "disclosure",         "z_validatepaymentdisclosure", &z_validatepaymentdisclosure, true,  false }
 };
 
 void RegisterWalletRPCCommands(CRPCTable &tableRPC)
@@ -296,6 +296,7 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
+    fUnspentTxidsValid = false;
 
     // check if we need to remove from watch-only
     CScript script;
@@ -319,6 +320,7 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
 
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
         return false;
+    fUnspentTxidsValid = false;
     if (!fFileBacked)
         return true;
     {
@@ -479,6 +481,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    fUnspentTxidsValid = false;
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -504,6 +507,7 @@ bool CWallet::AddWatchOnly(const CScript &dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    fUnspentTxidsValid = false;
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
@@ -516,6 +520,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
+    fUnspentTxidsValid = false;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (fFileBacked)
@@ -602,6 +607,15 @@ void CWallet::ChainTip(const CBlockIndex *pindex,
                        SaplingMerkleTree saplingTree,
                        bool added)
 {
+    LOCK(cs_wallet);
+    if (fScanningWallet) {
+        // blocks above a running rescan are incremented by the rescan when it gets there,
+        // a disconnect below it sends the rescan back
+        if (pindex->nHeight > nScanHeight)
+            return;
+        if (!added)
+            nScanHeight = pindex->nHeight - 1;
+    }
     if (added) {
         IncrementNoteWitnesses(pindex, pblock, sproutTree, saplingTree);
     } else {
@@ -880,6 +894,42 @@ void CWallet::SyncMetaData(pair<typename TxSpendMap<T>::iterator, typename TxSpe
     }
 }
 
+/**
+ * Keep tx and the wallet transactions it spends in setUnspentTxids: a spend that
+ * left the chain hands the outputs it spent back.
+ */
+void CWallet::AddToUnspentTxids(const CTransaction& tx)
+{
+    if (!fUnspentTxidsValid)
+        return;
+    setUnspentTxids.insert(tx.GetHash());
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        if (mapWallet.count(txin.prevout.hash))
+            setUnspentTxids.insert(txin.prevout.hash);
+    }
+}
+
+/**
+ * Depth of the deepest wallet transaction spending the outpoint, -1 if none
+ * is in the chain or the mempool.
+ */
+int CWallet::GetSpendDepth(const uint256& hash, unsigned int n) const
+{
+    const COutPoint outpoint(hash, n);
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
+    range = mapTxSpends.equal_range(outpoint);
+
+    int nSpendDepth = -1;
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it)
+    {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end())
+            nSpendDepth = std::max(nSpendDepth, mit->second.GetDepthInMainChain());
+    }
+    return nSpendDepth;
+}
+
 /**
  * Outpoint is spent if any non-conflicted transaction
  * spends it:
@@ -1499,6 +1549,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         mapWallet[hash].BindWallet(this);
         UpdateNullifierNoteMapWithTx(mapWallet[hash]);
         AddToSpends(hash);
+        AddToUnspentTxids(wtxIn);
     }
     else
     {
@@ -1508,6 +1559,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
         UpdateNullifierNoteMapWithTx(wtx);
+        AddToUnspentTxids(wtx);
         bool fInsertedNew = ret.second;
         if (fInsertedNew)
         {
@@ -1665,7 +1717,7 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
         auto sproutNoteData = FindMySproutNotes(tx);
-        auto saplingNoteDataAndAddressesToAdd = FindMySaplingNotes(tx);
+        auto saplingNoteDataAndAddressesToAdd = FindMySaplingNotes(tx, pblock);
         auto saplingNoteData = saplingNoteDataAndAddressesToAdd.first;
         auto addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
         for (const auto &addressToAdd : addressesToAdd) {
@@ -1787,6 +1839,10 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
+        std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+        if (it != mapWallet.end())
+            AddToUnspentTxids(it->second);
+        setUnspentTxids.erase(hash);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
     }
@@ -1881,6 +1937,141 @@ mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx) const
 }
 
 
+/**
+ * Work of a batched Sapling trial decryption: one output against a run of
+ * ivks, see TrialDecryptSaplingOutputs.
+ */
+struct CSaplingTrialTask
+{
+    const OutputDescription *poutput;
+    size_t nIvkBegin, nIvkEnd;
+    int nIvk;
+    diversifier_t d;
+};
+
+static void RunSaplingTrialTasks(std::vector<CSaplingTrialTask> *pvTasks, const std::vector<SaplingIncomingViewingKey> *pvIvks, std::atomic<size_t> *pnNext)
+{
+    size_t i;
+    while ((i = (*pnNext)++) < pvTasks->size())
+    {
+        CSaplingTrialTask& task = (*pvTasks)[i];
+        for (size_t k = task.nIvkBegin; k < task.nIvkEnd; k++)
+        {
+            const OutputDescription& output = *task.poutput;
+            auto result = SaplingNotePlaintext::decrypt(output.encCiphertext, (*pvIvks)[k], output.ephemeralKey, output.cm);
+            if (result) {
+                task.nIvk = k;
+                task.d = result.get().d;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Trial decrypts every output against vIvks in order, with the trials split in
+ * tasks of SAPLING_TRIAL_IVKS_PER_TASK ivks spread over nThreads threads.
+ * Returns per output the index of the first ivk that decrypts it, or -1, and
+ * the diversifier of the note in vDiversifiers.
+ */
+static std::vector<int> TrialDecryptSaplingOutputs(const std::vector<const OutputDescription*>& vOutputs,
+                                                   const std::vector<SaplingIncomingViewingKey>& vIvks,
+                                                   int nThreads,
+                                                   std::vector<diversifier_t>& vDiversifiers)
+{
+    std::vector<CSaplingTrialTask> vTasks;
+    for (const OutputDescription *poutput : vOutputs) {
+        for (size_t k = 0; k < vIvks.size(); k += SAPLING_TRIAL_IVKS_PER_TASK) {
+            CSaplingTrialTask task;
+            task.poutput = poutput;
+            task.nIvkBegin = k;
+            task.nIvkEnd = std::min(vIvks.size(), k + SAPLING_TRIAL_IVKS_PER_TASK);
+            task.nIvk = -1;
+            vTasks.push_back(task);
+        }
+    }
+
+    std::atomic<size_t> nNext(0);
+    if (nThreads > 1 && vTasks.size() > 1) {
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nThreads && (size_t)i < vTasks.size(); i++)
+            threadGroup.create_thread(boost::bind(&RunSaplingTrialTasks, &vTasks, &vIvks, &nNext));
+        threadGroup.join_all();
+    } else {
+        RunSaplingTrialTasks(&vTasks, &vIvks, &nNext);
+    }
+
+    // tasks of an output are in ivk order, the first one that decrypted wins
+    std::vector<int> vIvkIndexes(vOutputs.size(), -1);
+    vDiversifiers.resize(vOutputs.size());
+    size_t nTasksPerOutput = (vIvks.size() + SAPLING_TRIAL_IVKS_PER_TASK - 1) / SAPLING_TRIAL_IVKS_PER_TASK;
+    for (size_t i = 0; i < vOutputs.size(); i++) {
+        for (size_t t = i * nTasksPerOutput; t < (i + 1) * nTasksPerOutput; t++) {
+            if (vTasks[t].nIvk >= 0) {
+                vIvkIndexes[i] = vTasks[t].nIvk;
+                vDiversifiers[i] = vTasks[t].d;
+                break;
+            }
+        }
+    }
+    return vIvkIndexes;
+}
+
+/** TrialDecryptSaplingOutputs of all shielded outputs of block into trial */
+static void TrialDecryptSaplingBlock(const CBlock& block,
+                                     const std::vector<SaplingIncomingViewingKey>& vIvks,
+                                     int nThreads,
+                                     CSaplingBlockTrial& trial)
+{
+    std::vector<const OutputDescription*> vOutputs;
+    trial.hashBlock = block.GetHash();
+    trial.mapFirstOutput.clear();
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.vShieldedOutput.empty())
+            continue;
+        trial.mapFirstOutput[tx.GetHash()] = vOutputs.size();
+        for (const OutputDescription& output : tx.vShieldedOutput)
+            vOutputs.push_back(&output);
+    }
+    trial.vIvkIndexes = TrialDecryptSaplingOutputs(vOutputs, vIvks, nThreads, trial.vDiversifiers);
+}
+
+/**
+ * Sapling ivks of the wallet in the order FindMySaplingNotes tries them: those
+ * of full viewing keys first, their count in nFullViewing, then the other
+ * incoming viewing keys.
+ */
+void CWallet::GetSaplingTrialIvks(std::vector<SaplingIncomingViewingKey>& vIvks, size_t& nFullViewing) const
+{
+    AssertLockHeld(cs_SpendingKeyStore);
+    vIvks.clear();
+    for (auto it = mapSaplingFullViewingKeys.begin(); it != mapSaplingFullViewingKeys.end(); ++it)
+        vIvks.push_back(it->first);
+    nFullViewing = vIvks.size();
+    std::set<SaplingIncomingViewingKey> setIvks(vIvks.begin(), vIvks.end());
+    for (auto it = mapSaplingIncomingViewingKeys.begin(); it != mapSaplingIncomingViewingKeys.end(); ++it) {
+        if (setIvks.insert(it->second).second)
+            vIvks.push_back(it->second);
+    }
+}
+
+/**
+ * Copy of the keys, redeem scripts and watch-only scripts IsMine(tx) looks
+ * at, for the rescan threads to check outputs without cs_KeyStore.
+ */
+void CWallet::GetTransparentScanKeys(std::set<CKeyID>& setKeys, ScriptMap& scripts, WatchOnlySet& watchOnly) const
+{
+    LOCK(cs_KeyStore);
+    GetKeys(setKeys);
+    scripts = mapScripts;
+    watchOnly = setWatchOnly;
+}
+
+CWalletScanKeys::CWalletScanKeys(const CWallet& wallet)
+{
+    wallet.GetTransparentScanKeys(setKeyIds, mapScripts, setWatchOnly);
+}
+
 /**
  * Finds all output notes in the given transaction that have been sent to
  * SaplingPaymentAddresses in this wallet.
@@ -1891,55 +2082,117 @@ mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx) const
  */
 std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> CWallet::FindMySaplingNotes(const CTransaction &tx) const
 {
+    if (tx.vShieldedOutput.empty())
+        return std::make_pair(mapSaplingNoteData_t(), SaplingIncomingViewingKeyMap());
+    // called for each mempool transaction, a few outputs are not worth starting threads for
+    return FindMySaplingNotes(std::vector<const CTransaction*>(1, &tx), 1)[0];
+}
+
+/**
+ * FindMySaplingNotes for many transactions at once, eg those of a block. All
+ * their outputs are tried against all ivks of the wallet in one batch spread
+ * over nThreads threads, see TrialDecryptSaplingOutputs.
+ */
+std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> CWallet::FindMySaplingNotes(const std::vector<const CTransaction*>& vtx, int nThreads) const
+{
+    std::vector<SaplingIncomingViewingKey> vIvks;
+    size_t nFullViewing;
+    {
+        LOCK(cs_SpendingKeyStore);
+        GetSaplingTrialIvks(vIvks, nFullViewing);
+    }
+
+    std::vector<const OutputDescription*> vOutputs;
+    for (const CTransaction *ptx : vtx) {
+        for (const OutputDescription& output : ptx->vShieldedOutput)
+            vOutputs.push_back(&output);
+    }
+    std::vector<diversifier_t> vDiversifiers;
+    std::vector<int> vIvkIndexes = TrialDecryptSaplingOutputs(vOutputs, vIvks, nThreads, vDiversifiers);
+
     LOCK(cs_SpendingKeyStore);
-    uint256 hash = tx.GetHash();
+    std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> vNotes(vtx.size());
+    size_t nOutput = 0;
+    for (size_t n = 0; n < vtx.size(); n++) {
+        if (vtx[n]->vShieldedOutput.empty())
+            continue;
+        vNotes[n] = SaplingNotesFromTrial(*vtx[n], vIvks, nFullViewing, &vIvkIndexes[nOutput], &vDiversifiers[nOutput]);
+        nOutput += vtx[n]->vShieldedOutput.size();
+    }
+    return vNotes;
+}
 
+/**
+ * The notes of tx from the trial decryption of its outputs with vIvks, the
+ * first nFullViewing of which are of full viewing keys: per output the index
+ * of the ivk that decrypted it or -1, and the note diversifier.
+ */
+std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> CWallet::SaplingNotesFromTrial(
+    const CTransaction& tx,
+    const std::vector<SaplingIncomingViewingKey>& vIvks,
+    size_t nFullViewing,
+    const int *pIvkIndexes,
+    const diversifier_t *pDiversifiers) const
+{
+    AssertLockHeld(cs_SpendingKeyStore);
+    // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
+    uint256 hash = tx.GetHash();
     mapSaplingNoteData_t noteData;
     SaplingIncomingViewingKeyMap viewingKeysToAdd;
-
-    // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
     for (uint32_t i = 0; i < tx.vShieldedOutput.size(); ++i) {
-        const OutputDescription output = tx.vShieldedOutput[i];
-        bool found = false;
-        for (auto it = mapSaplingFullViewingKeys.begin(); it != mapSaplingFullViewingKeys.end(); ++it) {
-            SaplingIncomingViewingKey ivk = it->first;
-            auto result = SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cm);
-            if (result) {
-                auto address = ivk.address(result.get().d);
-                if (address && mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
-                    viewingKeysToAdd[address.get()] = ivk;
-                }
-                // We don't cache the nullifier here as computing it requires knowledge of the note position
-                // in the commitment tree, which can only be determined when the transaction has been mined.
-                SaplingOutPoint op {hash, i};
-                SaplingNoteData nd;
-                nd.ivk = ivk;
-                noteData.insert(std::make_pair(op, nd));
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            for (auto it = mapSaplingIncomingViewingKeys.begin(); it != mapSaplingIncomingViewingKeys.end(); ++it) {
-                SaplingIncomingViewingKey ivk = it-> second;
-                auto result = SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cm);
-                if (!result) {
-                    continue;
-                }
-                // We don't cache the nullifier here as computing it requires knowledge of the note position
-                // in the commitment tree, which can only be determined when the transaction has been mined.
-                SaplingOutPoint op {hash, i};
-                SaplingNoteData nd;
-                nd.ivk = ivk;
-                noteData.insert(std::make_pair(op, nd));
-                break;
+        if (pIvkIndexes[i] < 0)
+            continue;
+        const SaplingIncomingViewingKey& ivk = vIvks[pIvkIndexes[i]];
+        if ((size_t)pIvkIndexes[i] < nFullViewing) {
+            auto address = ivk.address(pDiversifiers[i]);
+            if (address && mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
+                viewingKeysToAdd[address.get()] = ivk;
             }
         }
+        // We don't cache the nullifier here as computing it requires knowledge of the note position
+        // in the commitment tree, which can only be determined when the transaction has been mined.
+        SaplingOutPoint op {hash, i};
+        SaplingNoteData nd;
+        nd.ivk = ivk;
+        noteData.insert(std::make_pair(op, nd));
     }
-
     return std::make_pair(noteData, viewingKeysToAdd);
 }
 
+/**
+ * FindMySaplingNotes of tx in pblock. The first transaction of a block asked
+ * for has the whole block batch decrypted, unless a rescan thread already did,
+ * and the others are then looked up. A change of the trial ivks, which adding
+ * Sapling keys while transactions of the block are added can make, starts
+ * the block over.
+ */
+std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> CWallet::FindMySaplingNotes(const CTransaction &tx, const CBlock *pblock)
+{
+    AssertLockHeld(cs_wallet);
+    if (pblock == NULL || tx.vShieldedOutput.empty())
+        return FindMySaplingNotes(tx);
+
+    std::vector<SaplingIncomingViewingKey> vIvks;
+    size_t nFullViewing;
+    {
+        LOCK(cs_SpendingKeyStore);
+        GetSaplingTrialIvks(vIvks, nFullViewing);
+    }
+    if (vIvks != vSaplingTrialIvks || nFullViewing != nSaplingTrialFullViewing) {
+        vSaplingTrialIvks.swap(vIvks);
+        nSaplingTrialFullViewing = nFullViewing;
+        saplingBlockTrial.hashBlock.SetNull();
+    }
+    if (saplingBlockTrial.hashBlock != pblock->GetHash())
+        TrialDecryptSaplingBlock(*pblock, vSaplingTrialIvks, std::max(1, nScriptCheckThreads), saplingBlockTrial);
+    std::map<uint256, size_t>::const_iterator it = saplingBlockTrial.mapFirstOutput.find(tx.GetHash());
+    if (it == saplingBlockTrial.mapFirstOutput.end())
+        return FindMySaplingNotes(tx);
+    LOCK(cs_SpendingKeyStore);
+    return SaplingNotesFromTrial(tx, vSaplingTrialIvks, nSaplingTrialFullViewing,
+                                 &saplingBlockTrial.vIvkIndexes[it->second], &saplingBlockTrial.vDiversifiers[it->second]);
+}
+
 bool CWallet::IsSproutNullifierFromMe(const uint256& nullifier) const
 {
     {
@@ -2090,9 +2343,6 @@ CAmount CWallet::GetChange(const CTxOut& txout) const
     return (IsChange(txout) ? txout.nValue : 0);
 }
 
-typedef vector<unsigned char> valtype;
-unsigned int HaveKeys(const vector<valtype>& pubkeys, const CKeyStore& keystore);
-
 bool CWallet::IsMine(const CTransaction& tx)
 {
     for (int i = 0; i < tx.vout.size(); i++)
@@ -2103,128 +2353,18 @@ bool CWallet::IsMine(const CTransaction& tx)
     return false;
 }
 
-/*
-    Before Verus changes CWallet::IsMine(const CTransaction& tx) called other version
-    of IsMine for each vout: CWallet::IsMine(const CTxOut& txout), so now we have two
-    similar functions:
-        - isminetype CWallet::IsMine(const CTransaction& tx, uint32_t voutNum) (wallet.cpp)
-        - isminetype IsMineInner(const CKeyStore& keystore, const CScript& _scriptPubKey, IsMineSigVersion sigversion) (wallet_ismine.cpp)
-    TODO: sort this out (!)
-*/
-
 // special case handling for non-standard/Verus OP_RETURN script outputs, which need the transaction
-// to determine ownership
+// to determine ownership, see ::IsMine(keystore, tx, voutNum)
 
 isminetype CWallet::IsMine(const CTransaction& tx, uint32_t voutNum)
 {
-    vector<valtype> vSolutions;
-    txnouttype whichType;
-    const CScriptExt scriptPubKey = CScriptExt(tx.vout[voutNum].scriptPubKey);
-
-    if (!Solver(scriptPubKey, whichType, vSolutions)) {
-        if (this->HaveWatchOnly(scriptPubKey))
-            return ISMINE_WATCH_ONLY;
-        return ISMINE_NO;
-    }
-
-    CKeyID keyID;
-    CScriptID scriptID;
-    CScriptExt subscript;
-    int voutNext = voutNum + 1;
-
-    switch (whichType)
-    {
-        case TX_NONSTANDARD:
-        case TX_NULL_DATA:
-            break;
-
-        case TX_CRYPTOCONDITION:
-            // for now, default is that the first value returned will be the script, subsequent values will be
-            // pubkeys. if we have the first pub key in our wallet, we consider this spendable
-            if (vSolutions.size() > 1)
-            {
-                keyID = CPubKey(vSolutions[1]).GetID();
-                if (this->HaveKey(keyID))
-                    return ISMINE_SPENDABLE;
-            }
-            break;
-
-        case TX_PUBKEY:
-            keyID = CPubKey(vSolutions[0]).GetID();
-            if (this->HaveKey(keyID))
-                return ISMINE_SPENDABLE;
-            break;
-
-        case TX_PUBKEYHASH:
-            keyID = CKeyID(uint160(vSolutions[0]));
-            if (this->HaveKey(keyID))
-                return ISMINE_SPENDABLE;
-            break;
-
-        case TX_SCRIPTHASH:
-            scriptID = CScriptID(uint160(vSolutions[0]));
-            if (this->GetCScript(scriptID, subscript))
-            {
-                // if this is a CLTV, handle it differently
-                if (subscript.IsCheckLockTimeVerify())
-                {
-                    return (::IsMine(*this, subscript));
-                }
-                else
-                {
-                    isminetype ret = ::IsMine(*this, subscript);
-                    if (ret == ISMINE_SPENDABLE)
-                        return ret;
-                }
-            }
-            else if (tx.vout.size() > (voutNext = voutNum + 1) &&
-                tx.vout[voutNext].scriptPubKey.size() > 7 &&
-                tx.vout[voutNext].scriptPubKey[0] == OP_RETURN)
-            {
-                // get the opret script from next vout, verify that the front is CLTV and hash matches
-                // if so, remove it and use the solver
-                opcodetype op;
-                std::vector<uint8_t> opretData;
-                CScript::const_iterator it = tx.vout[voutNext].scriptPubKey.begin() + 1;
-                if (tx.vout[voutNext].scriptPubKey.GetOp2(it, op, &opretData))
-                {
-                    if (opretData.size() > 0 && opretData[0] == OPRETTYPE_TIMELOCK)
-                    {
-                        CScript opretScript = CScript(opretData.begin() + 1, opretData.end());
-
-                        if (CScriptID(opretScript) == scriptID &&
-                            opretScript.IsCheckLockTimeVerify())
-                        {
-                            // if we find that this is ours, we need to add this script to the wallet,
-                            // and we can then recognize this transaction
-                            isminetype t = ::IsMine(*this, opretScript);
-                            if (t != ISMINE_NO)
-                            {
-                                this->AddCScript(opretScript);
-                            }
-                            return t;
-                        }
-                    }
-                }
-            }
-            break;
-
-        case TX_MULTISIG:
-            // Only consider transactions "mine" if we own ALL the
-            // keys involved. Multi-signature transactions that are
-            // partially owned (somebody else has a key that can spend
-            // them) enable spend-out-from-under-you attacks, especially
-            // in shared-wallet situations.
-            vector<valtype> keys(vSolutions.begin()+1, vSolutions.begin()+vSolutions.size()-1);
-            if (HaveKeys(keys, *this) == keys.size())
-                return ISMINE_SPENDABLE;
-            break;
-    }
-
-    if (this->HaveWatchOnly(scriptPubKey))
-        return ISMINE_WATCH_ONLY;
-
-    return ISMINE_NO;
+    CScript timelockScript;
+    isminetype ret = ::IsMine(*this, tx, voutNum, &timelockScript);
+    // if we find that this is ours, we need to add this script to the wallet,
+    // and we can then recognize this transaction
+    if (ret != ISMINE_NO && !timelockScript.empty())
+        AddCScript(timelockScript);
+    return ret;
 }
 
 
@@ -2735,10 +2875,107 @@ void CWallet::WitnessNoteCommitment(std::vector<uint256> commitments,
     }
 }
 
+/**
+ * A block of a rescan, read from disk and checked on a rescan thread for
+ * transactions that may involve the wallet.
+ */
+struct CWalletScanBlock
+{
+    CBlockIndex *pindex;
+    CBlock block;
+    std::vector<bool> vMaybeMine;
+    CSaplingBlockTrial saplingTrial;
+
+    CWalletScanBlock(CBlockIndex *pindexIn) : pindex(pindexIn) {}
+};
+
+/**
+ * Keys the rescan threads check transactions with, copied once per rescan so
+ * the threads do not serialize on cs_KeyStore and cs_SpendingKeyStore and
+ * leave the wallet alone.
+ */
+struct CWalletScanFilter
+{
+    CWalletScanKeys keys;
+    NoteDecryptorMap sproutDecryptors;
+    std::vector<SaplingIncomingViewingKey> saplingIvks;
+    size_t nSaplingFullViewing;
+
+    CWalletScanFilter(const CWallet& wallet) : keys(wallet), nSaplingFullViewing(0) {}
+
+    /**
+     * Whether AddToWalletIfInvolvingMe could take tx on account of its
+     * transparent outputs and Sprout notes. Sapling outputs are batch
+     * decrypted per block in FilterBlocks, and what depends on earlier
+     * transactions (IsFromMe and transactions already in the wallet) is left
+     * to the ordered pass.
+     */
+    bool MaybeMine(const CTransaction& tx) const
+    {
+        // later payments to the timelock scripts the ordered pass adds to the wallet are
+        // not seen on the copy, the ordered pass checks for them itself
+        for (uint32_t i = 0; i < tx.vout.size(); i++) {
+            if (::IsMine(keys, tx, i, NULL) != ISMINE_NO)
+                return true;
+        }
+        for (size_t i = 0; i < tx.vjoinsplit.size(); i++) {
+            if (sproutDecryptors.empty())
+                break;
+            auto hSig = tx.vjoinsplit[i].h_sig(*pzcashParams, tx.joinSplitPubKey);
+            for (uint8_t j = 0; j < tx.vjoinsplit[i].ciphertexts.size(); j++) {
+                for (const NoteDecryptorMap::value_type& item : sproutDecryptors) {
+                    try {
+                        SproutNotePlaintext::decrypt(item.second, tx.vjoinsplit[i].ciphertexts[j],
+                                                     tx.vjoinsplit[i].ephemeralKey, hSig, j);
+                        return true;
+                    } catch (const note_decryption_failed &err) {
+                        // Couldn't decrypt with this decryptor
+                    } catch (const std::exception &exc) {
+                        // Let FindMySproutNotes report it
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    void FilterBlocks(std::vector<CWalletScanBlock> *pvBlocks, std::atomic<size_t> *pnNext) const
+    {
+        RenameThread("komodo-rescan");
+        size_t i;
+        while ((i = (*pnNext)++) < pvBlocks->size())
+        {
+            CWalletScanBlock& scan = (*pvBlocks)[i];
+            ReadBlockFromDisk(scan.block, scan.pindex, 1);
+            scan.vMaybeMine.resize(scan.block.vtx.size());
+            for (size_t j = 0; j < scan.block.vtx.size(); j++)
+                scan.vMaybeMine[j] = MaybeMine(scan.block.vtx[j]);
+            // the rescan threads each take a block, so the block's batch runs on this one,
+            // the ordered pass hands the result to FindMySaplingNotes
+            TrialDecryptSaplingBlock(scan.block, saplingIvks, 1, scan.saplingTrial);
+            for (size_t j = 0; j < scan.block.vtx.size(); j++) {
+                std::map<uint256, size_t>::const_iterator it = scan.saplingTrial.mapFirstOutput.find(scan.block.vtx[j].GetHash());
+                if (it == scan.saplingTrial.mapFirstOutput.end())
+                    continue;
+                for (size_t k = 0; k < scan.block.vtx[j].vShieldedOutput.size(); k++) {
+                    if (scan.saplingTrial.vIvkIndexes[it->second + k] >= 0)
+                        scan.vMaybeMine[j] = true;
+                }
+            }
+        }
+    }
+};
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and checked for our outputs and notes in batches on
+ * -par threads, off cs_main, while the previous batch is applied in chain
+ * order under cs_main and cs_wallet. The locks are left between batches so
+ * the node keeps working during a long rescan.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
@@ -2750,6 +2987,16 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 
     std::vector<uint256> myTxHashes;
 
+    LOCK(cs_scan);
+
+    CWalletScanFilter filter(*this);
+    {
+        LOCK(cs_SpendingKeyStore);
+        filter.sproutDecryptors = mapNoteDecryptors;
+        GetSaplingTrialIvks(filter.saplingIvks, filter.nSaplingFullViewing);
+    }
+
+    double dProgressStart, dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -2759,42 +3006,115 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             pindex = chainActive.Next(pindex);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
-        while (pindex)
+        dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
+
+        nScanHeight = pindex ? pindex->nHeight - 1 : chainActive.Height();
+        nScanBlocks = 0;
+        nScanStartTime = GetTimeMillis();
+        dScanProgress = 0;
+        fScanningWallet = true;
+    }
+
+    int nThreads = std::max(1, nScriptCheckThreads);
+    std::vector<CWalletScanBlock> vBlocks, vNextBlocks;
+    bool fDone = false;
+    while (!fDone)
+    {
+        // read and filter the next batch while this one is applied
+        vNextBlocks.clear();
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            LOCK(cs_main);
+            for (int nHeight = nScanHeight + 1 + vBlocks.size(); nHeight <= chainActive.Height() && vNextBlocks.size() < WALLET_RESCAN_BATCH_SIZE; nHeight++)
+                vNextBlocks.push_back(CWalletScanBlock(chainActive[nHeight]));
+        }
+        std::atomic<size_t> nNext(0);
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nThreads && i < vNextBlocks.size(); i++)
+            threadGroup.create_thread(boost::bind(&CWalletScanFilter::FilterBlocks, &filter, &vNextBlocks, &nNext));
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex,1);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+        bool fReorg = false;
+        try {
+            LOCK2(cs_main, cs_wallet);
+            for (CWalletScanBlock& scan : vBlocks)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate)) {
-                    myTxHashes.push_back(tx.GetHash());
-                    ret++;
+                // a reorg while the locks were left, go on from where ChainTip left the witnesses
+                if (scan.pindex->nHeight != nScanHeight + 1 || chainActive[scan.pindex->nHeight] != scan.pindex)
+                {
+                    fReorg = true;
+                    break;
                 }
-            }
+                pindex = scan.pindex;
+                nScanHeight = pindex->nHeight;
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                // the trial ivks are compared with the wallet's again before the result is used
+                if (vSaplingTrialIvks != filter.saplingIvks || nSaplingTrialFullViewing != filter.nSaplingFullViewing) {
+                    vSaplingTrialIvks = filter.saplingIvks;
+                    nSaplingTrialFullViewing = filter.nSaplingFullViewing;
+                }
+                std::swap(saplingBlockTrial, scan.saplingTrial);
 
-            SproutMerkleTree sproutTree;
-            SaplingMerkleTree saplingTree;
-            // This should never fail: we should always be able to get the tree
-            // state on the path to the tip of our chain
-            assert(pcoinsTip->GetSproutAnchorAt(pindex->hashSproutAnchor, sproutTree));
-            if (pindex->pprev) {
-                if (NetworkUpgradeActive(pindex->pprev->nHeight, Params().GetConsensus(), Consensus::UPGRADE_SAPLING)) {
-                    assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
+                // IsMine(tx) adds the scripts of timelocked outputs, later payments to them are not in the copy
+                bool fNewScripts;
+                {
+                    LOCK(cs_KeyStore);
+                    fNewScripts = mapScripts.size() != filter.keys.ScriptCount();
+                }
+                for (size_t i = 0; i < scan.block.vtx.size(); i++)
+                {
+                    const CTransaction& tx = scan.block.vtx[i];
+                    if (!scan.vMaybeMine[i] && !(fNewScripts && IsMine(tx)) && !mapWallet.count(tx.GetHash()) && !IsFromMe(tx))
+                        continue;
+                    if (AddToWalletIfInvolvingMe(tx, &scan.block, fUpdate)) {
+                        myTxHashes.push_back(tx.GetHash());
+                        ret++;
+                    }
                 }
-            }
-            // Increment note witness caches
-            ChainTip(pindex, &block, sproutTree, saplingTree, true);
 
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+                SproutMerkleTree sproutTree;
+                SaplingMerkleTree saplingTree;
+                // This should never fail: we should always be able to get the tree
+                // state on the path to the tip of our chain
+                assert(pcoinsTip->GetSproutAnchorAt(pindex->hashSproutAnchor, sproutTree));
+                if (pindex->pprev) {
+                    if (NetworkUpgradeActive(pindex->pprev->nHeight, Params().GetConsensus(), Consensus::UPGRADE_SAPLING)) {
+                        assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
+                    }
+                }
+                // Increment note witness caches
+                ChainTip(pindex, &scan.block, sproutTree, saplingTree, true);
+
+                nScanBlocks++;
+                if (dProgressTip - dProgressStart > 0.0)
+                    dScanProgress = std::min(1.0, (Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart));
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f, %.1f blocks/s\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex), ScanningBlocksPerSecond());
+                }
             }
+            // done once caught up with the tip while still holding cs_main
+            if (!fReorg && nScanHeight == chainActive.Height())
+            {
+                fScanningWallet = false;
+                fDone = true;
+            }
+        } catch (...) {
+            threadGroup.join_all();
+            fScanningWallet = false;
+            throw;
         }
+        threadGroup.join_all();
+
+        if (fReorg)
+            vBlocks.clear();
+        else
+            vBlocks.swap(vNextBlocks);
+    }
+
+    {
+        LOCK2(cs_main, cs_wallet);
 
         // After rescanning, persist Sapling note data that might have changed, e.g. nullifiers.
         // Do not flush the wallet here for performance reasons.
@@ -3282,8 +3602,23 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (!fUnspentTxidsValid)
+        {
+            setUnspentTxids.clear();
+            for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+                setUnspentTxids.insert(it->first);
+            fUnspentTxidsValid = true;
+        }
+        std::set<uint256>::iterator txit = setUnspentTxids.begin();
+        while (txit != setUnspentTxids.end())
         {
+            std::set<uint256>::iterator cur = txit++;
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(*cur);
+            if (it == mapWallet.end())
+            {
+                setUnspentTxids.erase(cur);
+                continue;
+            }
             const uint256& wtxid = it->first;
             const CWalletTx* pcoin = &(*it).second;
 
@@ -3303,10 +3638,16 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             if (nDepth < 0)
                 continue;
 
+            bool fHoldsUnspent = false;
             for (int i = 0; i < pcoin->vout.size(); i++)
             {
                 isminetype mine = IsMine(pcoin->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
+                if (mine == ISMINE_NO)
+                    continue;
+                int nSpendDepth = GetSpendDepth(wtxid, i);
+                if (nSpendDepth < 1)
+                    fHoldsUnspent = true;
+                if (nSpendDepth < 0 &&
                     !IsLockedCoin((*it).first, i) && (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
                     (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected((*it).first, i)))
                 {
@@ -3319,7 +3660,7 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                             {
                                 if ( (tipindex= chainActive.Tip()) != 0 )
                                 {
-                                    komodo_accrued_interest(&txheight,&locktime,wtxid,i,0,pcoin->vout[i].nValue,(int32_t)tipindex->nHeight);
+                                    GetAccruedInterest(COutPoint(wtxid,i),pcoin->vout[i].nValue,txheight,locktime);
                                     interest = komodo_interestnew(txheight,pcoin->vout[i].nValue,locktime,tipindex->nTime);
                                 } 
                                 else 
@@ -3350,10 +3691,40 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                     vCoins.push_back(COutput(pcoin, i, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO));
                 }
             }
+            // every output of ours is spent by a confirmed transaction, only a reorg
+            // gives one back and that runs the spend through AddToWallet again
+            if (!fHoldsUnspent)
+                setUnspentTxids.erase(cur);
         }
     }
 }
 
+uint64_t CWallet::GetAccruedInterest(const COutPoint& outpoint, CAmount nValue, int32_t& txheight, uint32_t& locktime) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    CBlockIndex *tipindex = chainActive.Tip();
+    txheight = 0;
+    locktime = 0;
+    if ( tipindex == 0 )
+        return 0;
+    if ( hashAccruedInterestTip != tipindex->GetBlockHash() )
+    {
+        mapAccruedInterest.clear();
+        hashAccruedInterestTip = tipindex->GetBlockHash();
+    }
+    std::map<COutPoint, CAccruedInterest>::const_iterator it = mapAccruedInterest.find(outpoint);
+    if ( it == mapAccruedInterest.end() )
+    {
+        CAccruedInterest accrued;
+        accrued.interest = komodo_accrued_interest(&accrued.txheight,&accrued.locktime,outpoint.hash,outpoint.n,0,nValue,(int32_t)tipindex->nHeight);
+        it = mapAccruedInterest.insert(std::make_pair(outpoint, accrued)).first;
+    }
+    txheight = it->second.txheight;
+    locktime = it->second.locktime;
+    return it->second.interest;
+}
+
 std::map<CTxDestination, std::vector<COutput>> CWallet::ListCoins() const
 {
     // TODO: Add AssertLockHeld(cs_wallet) here.
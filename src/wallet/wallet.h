@@ -42,6 +42,7 @@
 #include "base58.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -92,6 +93,12 @@ extern unsigned int WITNESS_CACHE_SIZE;
 //! Size of HD seed in bytes
 static const size_t HD_WALLET_SEED_LENGTH = 32;
 
+//! Blocks a rescan reads ahead and then applies per hold of cs_main
+static const size_t WALLET_RESCAN_BATCH_SIZE = 100;
+
+//! Incoming viewing keys an output is trial decrypted with per task of a batched Sapling trial decryption
+static const size_t SAPLING_TRIAL_IVKS_PER_TASK = 32;
+
 extern const char * DEFAULT_WALLET_DAT;
 
 class CBlockIndex;
@@ -759,6 +766,19 @@ private:
 };
 
 
+/**
+ * Sapling trial decryption of the shielded outputs of a block: per output, in
+ * block order, the index of the ivk that decrypted it or -1, and the note
+ * diversifier.
+ */
+struct CSaplingBlockTrial
+{
+    uint256 hashBlock;
+    std::map<uint256, size_t> mapFirstOutput; // per transaction with shielded outputs
+    std::vector<int> vIvkIndexes;
+    std::vector<libzcash::diversifier_t> vDiversifiers;
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -797,6 +817,56 @@ private:
     TxNullifiers mapTxSproutNullifiers;
     TxNullifiers mapTxSaplingNullifiers;
 
+    /**
+     * Wallet transactions that may still hold an unspent output of ours, so AvailableCoins
+     * only visits those instead of all of mapWallet. Built on first use, transactions are
+     * added when they enter or change in the wallet along with the ones they spend, and
+     * AvailableCoins drops a transaction once none of its outputs is both ours and unspent
+     * by a confirmed wallet transaction. Adding keys or scripts rebuilds it.
+     */
+    mutable std::set<uint256> setUnspentTxids;
+    mutable bool fUnspentTxidsValid;
+    void AddToUnspentTxids(const CTransaction& tx);
+
+    struct CAccruedInterest
+    {
+        int32_t txheight;
+        uint32_t locktime;
+        uint64_t interest;
+    };
+    /** komodo_accrued_interest of wallet outputs, for the tip in hashAccruedInterestTip */
+    mutable std::map<COutPoint, CAccruedInterest> mapAccruedInterest;
+    mutable uint256 hashAccruedInterestTip;
+
+protected:
+    /**
+     * Sapling trial decryption of the last block a transaction was added
+     * from, and the ivks of GetSaplingTrialIvks it was done with.
+     */
+    CSaplingBlockTrial saplingBlockTrial;
+    std::vector<libzcash::SaplingIncomingViewingKey> vSaplingTrialIvks;
+    size_t nSaplingTrialFullViewing;
+    std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> FindMySaplingNotes(const CTransaction& tx, const CBlock *pblock);
+    std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingNotesFromTrial(
+        const CTransaction& tx,
+        const std::vector<libzcash::SaplingIncomingViewingKey>& vIvks,
+        size_t nFullViewing,
+        const int *pIvkIndexes,
+        const libzcash::diversifier_t *pDiversifiers) const;
+
+    /**
+     * A running ScanForWalletTransactions leaves cs_main between batches of blocks.
+     * nScanHeight is the last block it applied, ChainTip leaves the blocks above it
+     * to the rescan so note witnesses are still incremented in chain order.
+     */
+    CCriticalSection cs_scan;
+    std::atomic<bool> fScanningWallet;
+    std::atomic<int> nScanHeight;
+    std::atomic<int> nScanBlocks;
+    std::atomic<int64_t> nScanStartTime;
+    std::atomic<double> dScanProgress;
+
+private:
     void AddToTransparentSpends(const COutPoint& outpoint, const uint256& wtxid);
     void AddToSproutSpends(const uint256& nullifier, const uint256& wtxid);
     void AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid);
@@ -828,6 +898,9 @@ protected:
 
     template <typename WalletDB>
     void SetBestChainINTERNAL(WalletDB& walletdb, const CBlockLocator& loc) {
+        // the witnesses are behind the tip until a running rescan catches up
+        if (fScanningWallet)
+            return;
         if (!walletdb.TxnBegin()) {
             // This needs to be done atomically, so don't do it at all
             LogPrintf("SetBestChain(): Couldn't start atomic write\n");
@@ -948,6 +1021,13 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         nWitnessCacheSize = 0;
+        nSaplingTrialFullViewing = 0;
+        fUnspentTxidsValid = false;
+        fScanningWallet = false;
+        nScanHeight = -1;
+        nScanBlocks = 0;
+        nScanStartTime = 0;
+        dScanProgress = 0;
     }
 
     /**
@@ -1023,6 +1103,11 @@ public:
     bool CanSupportFeature(enum WalletFeature wf) { AssertLockHeld(cs_wallet); return nWalletMaxVersion >= wf; }
 
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed=true, const CCoinControl *coinControl = NULL, bool fIncludeZeroValue=false, bool fIncludeCoinBase=true) const;
+    /**
+     * Return komodo_accrued_interest of a wallet output at the current tip, with the height
+     * and locktime of its transaction. Only the first call per output and tip reads the disk.
+     */
+    uint64_t GetAccruedInterest(const COutPoint& outpoint, CAmount nValue, int32_t& txheight, uint32_t& locktime) const;
     /**
      * Return list of available coins and locked coins grouped by non-change output address.
      */
@@ -1036,6 +1121,7 @@ public:
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
+    int GetSpendDepth(const uint256& hash, unsigned int n) const;
     bool IsSproutSpent(const uint256& nullifier) const;
     bool IsSaplingSpent(const uint256& nullifier) const;
 
@@ -1186,6 +1272,11 @@ public:
          std::vector<boost::optional<SproutWitness>>& witnesses,
          uint256 &final_anchor);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    bool IsScanning() const { return fScanningWallet; }
+    int ScanningHeight() const { return nScanHeight; }
+    int64_t ScanningDuration() const { return fScanningWallet ? GetTimeMillis() - nScanStartTime : 0; }
+    double ScanningProgress() const { return fScanningWallet ? (double)dScanProgress : 0; }
+    double ScanningBlocksPerSecond() const { return fScanningWallet ? nScanBlocks * 1000.0 / std::max((int64_t)1, ScanningDuration()) : 0; }
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime);
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime);
@@ -1229,6 +1320,9 @@ public:
         uint8_t n) const;
     mapSproutNoteData_t FindMySproutNotes(const CTransaction& tx) const;
     std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> FindMySaplingNotes(const CTransaction& tx) const;
+    std::vector<std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap>> FindMySaplingNotes(const std::vector<const CTransaction*>& vtx, int nThreads) const;
+    void GetSaplingTrialIvks(std::vector<libzcash::SaplingIncomingViewingKey>& vIvks, size_t& nFullViewing) const;
+    void GetTransparentScanKeys(std::set<CKeyID>& setKeys, ScriptMap& scripts, WatchOnlySet& watchOnly) const;
     bool IsSproutNullifierFromMe(const uint256& nullifier) const;
     bool IsSaplingNullifierFromMe(const uint256& nullifier) const;
 
@@ -1373,6 +1467,27 @@ public:
                           bool ignoreLocked=true);
 };
 
+/**
+ * A copy of the wallet's transparent keys to check outputs with ::IsMine(keystore, tx, n)
+ * off cs_wallet: the ids of its keys, not the keys themselves, its scripts and its
+ * watch-only scripts.
+ */
+class CWalletScanKeys : public CBasicKeyStore
+{
+private:
+    std::set<CKeyID> setKeyIds;
+public:
+    CWalletScanKeys(const CWallet& wallet);
+
+    bool HaveKey(const CKeyID &address) const { return setKeyIds.count(address) > 0; }
+    void GetKeys(std::set<CKeyID> &setAddress) const { setAddress = setKeyIds; }
+    size_t ScriptCount() const
+    {
+        LOCK(cs_KeyStore);
+        return mapScripts.size();
+    }
+};
+
 /** A key allocated from the key pool. */
 class CReserveKey
 {
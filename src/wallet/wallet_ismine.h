@@ -26,6 +26,7 @@
 
 class CKeyStore;
 class CScript;
+class CTransaction;
 
 /** IsMine() return codes */
 enum isminetype
@@ -42,5 +43,11 @@ typedef uint8_t isminefilter;
 
 isminetype IsMine(const CKeyStore& keystore, const CScript& scriptPubKey);
 isminetype IsMine(const CKeyStore& keystore, const CTxDestination& dest);
+/**
+ * IsMine for output voutNum of tx. A P2SH output followed by a timelock opret whose script hashes
+ * to it is checked with that script, which is returned in pTimelockScript (when not NULL) so the
+ * caller can add it to the keystore. The keystore itself is left unchanged.
+ */
+isminetype IsMine(const CKeyStore& keystore, const CTransaction& tx, uint32_t voutNum, CScript* pTimelockScript);
 
 #endif // BITCOIN_WALLET_WALLET_ISMINE_H
@@ -10,6 +10,7 @@
 #include "init.h"
 #include "primitives/transaction.h"
 #include "base58.h"
+#include "cc/CCinclude.h"
 #include "crypto/equihash.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -31,6 +32,7 @@
 #include "zcash/Zcash.h"
 #include "zcash/IncrementalMerkleTree.hpp"
 #include "zcash/Note.hpp"
+#include "zcash/zip32.h"
 #include "librustzcash.h"
 
 using namespace libzcash;
@@ -282,6 +284,45 @@ double benchmark_try_decrypt_notes(size_t nAddrs)
     return timer_stop(tv_start);
 }
 
+// Trial decrypts nOutputs Sapling outputs, the last one ours, against the ivks
+// of nAddrs wallet keys in one FindMySaplingNotes batch on nThreads threads
+double benchmark_try_decrypt_sapling_notes(size_t nAddrs, size_t nOutputs, int nThreads)
+{
+    CWallet wallet;
+    libzcash::SaplingPaymentAddress mine;
+    for (int i = 0; i < nAddrs; i++) {
+        auto sk = libzcash::SaplingExtendedSpendingKey::Master(HDSeed::Random());
+        mine = sk.DefaultAddress();
+        wallet.AddSaplingZKey(sk, mine);
+    }
+
+    CMutableTransaction mtx;
+    std::array<unsigned char, ZC_MEMO_SIZE> memo = {{0xF6}};
+    for (size_t i = 0; i < nOutputs; i++) {
+        auto address = (i + 1 == nOutputs && nAddrs > 0) ? mine : libzcash::SaplingSpendingKey::random().default_address();
+        SaplingNote note(address, GetRand(MAX_MONEY));
+        auto res = libzcash::SaplingNotePlaintext(note, memo).encrypt(note.pk_d);
+        if (!res) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "SaplingNotePlaintext::encrypt() failed");
+        }
+        OutputDescription odesc;
+        odesc.cm = *note.cm();
+        odesc.ephemeralKey = res.get().second.get_epk();
+        odesc.encCiphertext = res.get().first;
+        mtx.vShieldedOutput.push_back(odesc);
+    }
+    CTransaction tx(mtx);
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    auto vNotes = wallet.FindMySaplingNotes(std::vector<const CTransaction*>(1, &tx), nThreads);
+    double t = timer_stop(tv_start);
+    if (vNotes[0].first.size() != (nAddrs > 0 && nOutputs > 0 ? 1 : 0)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "only the last output should decrypt");
+    }
+    return t;
+}
+
 double benchmark_increment_note_witnesses(size_t nTxs)
 {
     CWallet wallet;
@@ -615,3 +656,91 @@ double benchmark_verify_sapling_output()
     }
     return timer_stop(tv_start);
 }
+
+// The opreturn decoders as they were before cc/opretschema.h, for comparison
+static uint8_t unmarshal_oracles_data(const CScript &scriptPubKey, uint256 &oracletxid, uint256 &batontxid, CPubKey &pk, std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> vopret; uint8_t e, f;
+    GetOpReturnData(scriptPubKey, vopret);
+    if (vopret.size() > 2 && E_UNMARSHAL(vopret, ss >> e; ss >> f; ss >> oracletxid; ss >> batontxid; ss >> pk; ss >> data) && e == EVAL_ORACLES && f == 'D')
+        return f;
+    return 0;
+}
+
+static uint8_t unmarshal_token_opret(const CScript &scriptPubKey, uint256 &tokenid, std::vector<CPubKey> &voutPubkeys, std::vector<std::pair<uint8_t, vscript_t>> &oprets)
+{
+    vscript_t vopret, vblob, voldstyledata;
+    uint8_t dummyEvalCode, dummyFuncId, ccType, opretId = 0;
+    CPubKey voutPubkey1, voutPubkey2;
+
+    GetOpReturnData(scriptPubKey, vopret);
+    oprets.clear();
+    if (vopret.size() <= 2 || vopret[0] != EVAL_TOKENS || vopret[1] != 't')
+        return 0;
+    bool foundOldstyle = E_UNMARSHAL(vopret, ss >> dummyEvalCode; ss >> dummyFuncId; ss >> tokenid; ss >> ccType;
+                                     if (ccType >= 1) ss >> voutPubkey1;
+                                     if (ccType == 2) ss >> voutPubkey2;
+                                     if (!ss.eof()) ss >> voldstyledata;) &&
+                         voldstyledata.size() >= 2 && voldstyledata[0] == EVAL_ASSETS;
+    if (!foundOldstyle && !E_UNMARSHAL(vopret, ss >> dummyEvalCode; ss >> dummyFuncId; ss >> tokenid; ss >> ccType;
+                                       if (ccType >= 1) ss >> voutPubkey1;
+                                       if (ccType == 2) ss >> voutPubkey2;
+                                       while (!ss.eof()) {
+                                           ss >> opretId;
+                                           if (!ss.eof()) {
+                                               ss >> vblob;
+                                               oprets.push_back(std::make_pair(opretId, vblob));
+                                           }
+                                       }))
+        return 0;
+    voutPubkeys.clear();
+    if (voutPubkey1.IsValid())
+        voutPubkeys.push_back(voutPubkey1);
+    if (voutPubkey2.IsValid())
+        voutPubkeys.push_back(voutPubkey2);
+    return 't';
+}
+
+// Decodes nOprets oracles data and token transfer opreturns, either in place
+// through DecodeOraclesData/DecodeTokenOpRet or with the E_UNMARSHAL copies
+double benchmark_decode_cc_oprets(size_t nOprets, bool fUnmarshal)
+{
+    uint256 oracletxid = GetRandHash(), batontxid = GetRandHash(), tokenid = GetRandHash();
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pk = key.GetPubKey();
+    std::vector<uint8_t> data(256, 0x5a);
+    uint8_t evalcode = EVAL_ORACLES, funcid = 'D';
+
+    CScript dataOpret, tokenOpret;
+    dataOpret << OP_RETURN << E_MARSHAL(ss << evalcode << funcid << oracletxid << batontxid << pk << data);
+    vscript_t assetsData = E_MARSHAL(ss << (uint8_t)EVAL_ASSETS << (uint8_t)'s' << (int64_t)COIN << std::vector<uint8_t>(pk.begin(), pk.end()));
+    tokenOpret = EncodeTokenOpRet(tokenid, std::vector<CPubKey>(1, pk), std::make_pair((uint8_t)OPRETID_ASSETSDATA, assetsData));
+
+    uint256 txid1, txid2;
+    CPubKey pk2;
+    std::vector<uint8_t> data2;
+    std::vector<CPubKey> voutPubkeys;
+    std::vector<std::pair<uint8_t, vscript_t>> oprets;
+    uint8_t evalCodeTokens;
+    size_t nDecoded = 0;
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (size_t i = 0; i < nOprets; i++) {
+        if (i & 1) {
+            if ((fUnmarshal ? unmarshal_token_opret(tokenOpret, txid1, voutPubkeys, oprets)
+                            : DecodeTokenOpRet(tokenOpret, evalCodeTokens, txid1, voutPubkeys, oprets)) == 't')
+                nDecoded++;
+        } else {
+            if ((fUnmarshal ? unmarshal_oracles_data(dataOpret, txid1, txid2, pk2, data2)
+                            : DecodeOraclesData(dataOpret, txid1, txid2, pk2, data2)) == 'D')
+                nDecoded++;
+        }
+    }
+    double t = timer_stop(tv_start);
+    if (nDecoded != nOprets) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "opreturns should all decode");
+    }
+    return t;
+}